@@ -0,0 +1,168 @@
+// GAUCHO RACING VDM NATIVE ARDUINO CORE
+// The part of the Teensy core the firmware uses, on Linux (see Hal.h). Memory placement attributes
+// compile away, the rest calls into the simulated hardware.
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <cmath>
+#include <cstdlib>
+#include <type_traits>
+#include "imxrt.h"
+
+// one address space on the host
+#define FASTRUN
+#define FLASHMEM
+#define PROGMEM
+#define DMAMEM
+#define EXTMEM
+#define F(s) (s)
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define INPUT_PULLDOWN 3
+#define DEC 10
+#define HEX 16
+#define BIN 2
+#define LED_BUILTIN 13
+
+#define PI 3.1415926535897932384626433832795
+#define HALF_PI 1.5707963267948966192313216916398
+#define TWO_PI 6.283185307179586476925286766559
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+
+// Teensy 4.1 analog pins
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define A6 20
+#define A7 21
+#define A8 22
+#define A9 23
+#define A10 24
+#define A11 25
+#define A12 26
+#define A13 27
+#define A14 38
+#define A15 39
+#define A16 40
+#define A17 41
+
+using std::abs;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// the Teensy core's map: rounded for integers, plain linear for floating point
+template <class T, class A, class B, class C, class D>
+long map(T _x, A _in_min, B _in_max, C _out_min, D _out_max, typename std::enable_if<std::is_integral<T>::value>::type* = 0){
+    long x = _x, in_min = _in_min, in_max = _in_max, out_min = _out_min, out_max = _out_max;
+    if((in_max - in_min) > (out_max - out_min)) return (x - in_min) * (out_max - out_min + 1) / (in_max - in_min + 1) + out_min;
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+template <class T, class A, class B, class C, class D>
+T map(T x, A in_min, B in_max, C out_min, D out_max, typename std::enable_if<std::is_floating_point<T>::value>::type* = 0){
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+uint8_t digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+void analogReadResolution(unsigned int bits);
+
+class Print {
+    public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t b) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size){
+        size_t n = 0;
+        while(size--) n += write(*buffer++);
+        return n;
+    }
+    virtual int availableForWrite(){return 0;}
+    virtual void flush(){}
+    size_t write(const char* s){return write((const uint8_t*)s, strlen(s));}
+
+    size_t print(const char* s){return write(s);}
+    size_t print(char c){return write((uint8_t)c);}
+    size_t print(int n, int base = DEC){return print((long)n, base);}
+    size_t print(unsigned int n, int base = DEC){return print((unsigned long)n, base);}
+    size_t print(long n, int base = DEC){
+        if(base == DEC) return printf("%ld", n);
+        return print((unsigned long)n, base);
+    }
+    size_t print(unsigned long n, int base = DEC){
+        if(base == HEX) return printf("%lX", n);
+        if(base == BIN){
+            char buf[8 * sizeof(n) + 1];
+            char* p = buf + sizeof(buf) - 1;
+            *p = 0;
+            do { *--p = '0' + (n & 1); n >>= 1; } while(n);
+            return write(p);
+        }
+        return printf("%lu", n);
+    }
+    size_t print(double n, int digits = 2){return printf("%.*f", digits, n);}
+    template <class T> size_t println(T v){return print(v) + println();}
+    template <class T> size_t println(T v, int f){return print(v, f) + println();}
+    size_t println(){return write((const uint8_t*)"\r\n", 2);}
+
+    int printf(const char* format, ...) __attribute__((format(printf, 2, 3))){
+        char buf[512];
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(buf, sizeof(buf), format, args);
+        va_end(args);
+        if(n < 0) return n;
+        return write((const uint8_t*)buf, (size_t)n < sizeof(buf) ? n : sizeof(buf) - 1);
+    }
+};
+
+class Stream : public Print {
+    public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    long parseInt();
+};
+
+// USB serial: input from hal::serialInput(), output to hal::serialOutput()
+class usb_serial_class : public Stream {
+    public:
+    void begin(long){}
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t b) override {return write(&b, 1);}
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    int availableForWrite() override;
+    explicit operator bool(){return true;}
+};
+
+extern usb_serial_class Serial;
+
+#endif
@@ -0,0 +1,32 @@
+// GAUCHO RACING VDM NATIVE EEPROM
+// The Teensy EEPROM class over hal::eeprom() (see Hal.h).
+#ifndef NATIVE_EEPROM_H
+#define NATIVE_EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+#include "Hal.h"
+
+#define E2END (hal::EEPROM_SIZE - 1)
+
+struct EEPROMClass {
+    uint8_t read(int address){return address >= 0 && address < hal::EEPROM_SIZE ? hal::eeprom()[address] : 0;}
+    void write(int address, uint8_t value){if(address >= 0 && address < hal::EEPROM_SIZE) hal::eeprom()[address] = value;}
+    void update(int address, uint8_t value){write(address, value);}
+    uint16_t length(){return hal::EEPROM_SIZE;}
+
+    template <class T> T& get(int address, T& t){
+        uint8_t* p = (uint8_t*)&t;
+        for(size_t i = 0; i < sizeof(T); i++) p[i] = read(address + i);
+        return t;
+    }
+    template <class T> const T& put(int address, const T& t){
+        const uint8_t* p = (const uint8_t*)&t;
+        for(size_t i = 0; i < sizeof(T); i++) update(address + i, p[i]);
+        return t;
+    }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,67 @@
+// GAUCHO RACING VDM NATIVE FLEXCAN
+// FlexCAN_T4 over the virtual buses in Hal.cpp. Every instance of a bus shares that bus's queues, as
+// they share the controller on the Teensy. Bus numbers stand in for the controller addresses.
+#ifndef NATIVE_FLEXCAN_T4_H
+#define NATIVE_FLEXCAN_T4_H
+
+#include <stdint.h>
+#include "Hal.h"
+
+typedef enum CAN_DEV_TABLE {CAN0 = 0, CAN1 = 1, CAN2 = 2, CAN3 = 3} CAN_DEV_TABLE;
+typedef enum FLEXCAN_RXQUEUE_TABLE {RX_SIZE_2 = 2, RX_SIZE_4 = 4, RX_SIZE_8 = 8, RX_SIZE_16 = 16, RX_SIZE_32 = 32,
+                                    RX_SIZE_64 = 64, RX_SIZE_128 = 128, RX_SIZE_256 = 256, RX_SIZE_512 = 512, RX_SIZE_1024 = 1024} FLEXCAN_RXQUEUE_TABLE;
+typedef enum FLEXCAN_TXQUEUE_TABLE {TX_SIZE_2 = 2, TX_SIZE_4 = 4, TX_SIZE_8 = 8, TX_SIZE_16 = 16, TX_SIZE_32 = 32,
+                                    TX_SIZE_64 = 64, TX_SIZE_128 = 128, TX_SIZE_256 = 256, TX_SIZE_512 = 512, TX_SIZE_1024 = 1024} FLEXCAN_TXQUEUE_TABLE;
+
+typedef struct CAN_message_t {
+    uint32_t id = 0;
+    uint16_t timestamp = 0;
+    uint8_t idhit = 0;
+    struct {
+        bool extended = 0;
+        bool remote = 0;
+        bool overrun = 0;
+        bool reserved = 0;
+    } flags;
+    uint8_t len = 8;
+    uint8_t buf[8] = {0};
+    int8_t mb = 0;
+    uint8_t bus = 0;
+    bool seq = 0;
+} CAN_message_t;
+
+typedef struct CANFD_message_t {
+    uint32_t id = 0;
+    uint16_t timestamp = 0;
+    uint8_t idhit = 0;
+    bool brs = 1;
+    bool esi = 0;
+    bool edl = 1;
+    struct {
+        bool extended = 0;
+        bool overrun = 0;
+        bool reserved = 0;
+    } flags;
+    uint8_t len = 8;
+    uint8_t buf[64] = {0};
+    int8_t mb = 0;
+    uint8_t bus = 0;
+    bool seq = 0;
+} CANFD_message_t;
+
+namespace hal {
+void canBegin(uint8_t bus, uint16_t rxSize);
+int canWrite(uint8_t bus, const CAN_message_t& m);
+int canRead(uint8_t bus, CAN_message_t& m);
+}
+
+template <CAN_DEV_TABLE _bus, FLEXCAN_RXQUEUE_TABLE _rxSize = RX_SIZE_16, FLEXCAN_TXQUEUE_TABLE _txSize = TX_SIZE_16>
+class FlexCAN_T4 {
+    public:
+    void begin(){hal::canBegin(_bus, _rxSize);}
+    void setBaudRate(uint32_t /*baud*/){}
+    int write(const CAN_message_t& m){return hal::canWrite(_bus, m);}
+    int read(CAN_message_t& m){return hal::canRead(_bus, m);}
+};
+
+#endif
@@ -0,0 +1,318 @@
+// GAUCHO RACING VDM NATIVE HAL
+// Linux side of the native headers, see Hal.h.
+#include "Hal.h"
+#include "Arduino.h"
+#include "FlexCAN_T4.h"
+#include "SD.h"
+#include "EEPROM.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <deque>
+#include <thread>
+
+usb_serial_class Serial;
+SDClass SD;
+EEPROMClass EEPROM;
+
+namespace {
+
+struct Bus {
+    std::deque<CAN_message_t> rx;
+    uint16_t rxSize = 0;                            // 0 until begin()
+    hal::CanStats stats;
+};
+
+uint64_t simTime = 0;
+bool followHost = false;
+std::chrono::steady_clock::time_point hostStart;
+uint64_t hostOffset = 0;
+
+Bus buses[hal::CAN_BUSES + 1];
+uint16_t analogIn[hal::PINS];
+uint8_t digitalIn[hal::PINS];
+int digitalOut[hal::PINS];
+int modes[hal::PINS];
+
+std::string sdDir;
+bool sdSet = false;
+uint8_t eepromData[hal::EEPROM_SIZE];
+
+std::deque<char> serialIn;
+int serialFd = 1;
+bool capture = false;
+std::string captured;
+
+Bus* bus(uint8_t b){return b >= 1 && b <= hal::CAN_BUSES ? &buses[b] : nullptr;}
+
+}
+
+namespace hal {
+
+std::function<void(uint8_t, const CAN_message_t&)> onCanWrite;
+
+void reset(){
+    simTime = 0;
+    followHost = false;
+    for(Bus& b : buses) b = Bus();
+    for(uint16_t i = 0; i < PINS; i++){
+        analogIn[i] = 0;
+        digitalIn[i] = 0;
+        digitalOut[i] = -1;
+        modes[i] = -1;
+    }
+    memset(eepromData, 0xFF, sizeof(eepromData));
+    serialIn.clear();
+    captured.clear();
+}
+
+uint64_t now(){
+    if(!followHost) return simTime;
+    return hostOffset + std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - hostStart).count();
+}
+
+void advance(uint64_t us){
+    if(followHost) std::this_thread::sleep_for(std::chrono::microseconds(us));
+    else simTime += us;
+}
+
+void realTime(bool on){
+    if(on == followHost) return;
+    if(on){
+        hostOffset = simTime;
+        hostStart = std::chrono::steady_clock::now();
+    }
+    else simTime = now();
+    followHost = on;
+}
+
+bool canInject(uint8_t b, const CAN_message_t& m){
+    Bus* p = bus(b);
+    if(!p) return false;
+    p->stats.injected++;
+    // the controller drops frames while the firmware has not started the bus or is behind
+    if(p->rx.size() >= p->rxSize){
+        p->stats.overruns++;
+        return false;
+    }
+    CAN_message_t f = m;
+    f.bus = b;
+    f.timestamp = (uint16_t)now();
+    p->rx.push_back(f);
+    return true;
+}
+
+size_t canPending(uint8_t b){
+    Bus* p = bus(b);
+    return p ? p->rx.size() : 0;
+}
+
+const CanStats& canStats(uint8_t b){
+    static CanStats none;
+    Bus* p = bus(b);
+    return p ? p->stats : none;
+}
+
+void canBegin(uint8_t b, uint16_t rxSize){
+    if(Bus* p = bus(b)) p->rxSize = rxSize;
+}
+
+int canWrite(uint8_t b, const CAN_message_t& m){
+    Bus* p = bus(b);
+    if(!p) return 0;
+    p->stats.written++;
+    if(onCanWrite) onCanWrite(b, m);
+    return 1;
+}
+
+int canRead(uint8_t b, CAN_message_t& m){
+    Bus* p = bus(b);
+    if(!p || p->rx.empty()) return 0;
+    m = p->rx.front();
+    p->rx.pop_front();
+    p->stats.read++;
+    return 1;
+}
+
+void setAnalog(uint8_t pin, uint16_t value){if(pin < PINS) analogIn[pin] = value;}
+void setDigital(uint8_t pin, bool high){if(pin < PINS) digitalIn[pin] = high;}
+int digitalOutput(uint8_t pin){return pin < PINS ? digitalOut[pin] : -1;}
+int pinModeOf(uint8_t pin){return pin < PINS ? modes[pin] : -1;}
+
+void sdRoot(const char* dir){
+    sdSet = dir != nullptr;
+    sdDir = dir ? dir : "";
+    if(sdSet) mkdir(dir, 0755);
+}
+
+std::string sdPath(const char* name){
+    while(*name == '/') name++;
+    return sdDir + "/" + name;
+}
+
+uint8_t* eeprom(){return eepromData;}
+
+bool eepromLoad(const char* path){
+    FILE* f = fopen(path, "rb");
+    if(!f) return false;
+    bool ok = fread(eepromData, 1, sizeof(eepromData), f) == sizeof(eepromData);
+    fclose(f);
+    return ok;
+}
+
+bool eepromSave(const char* path){
+    FILE* f = fopen(path, "wb");
+    if(!f) return false;
+    bool ok = fwrite(eepromData, 1, sizeof(eepromData), f) == sizeof(eepromData);
+    return fclose(f) == 0 && ok;
+}
+
+void serialInput(const char* text, size_t length){serialIn.insert(serialIn.end(), text, text + length);}
+void serialOutput(int fd){serialFd = fd;}
+void serialCapture(bool on){capture = on;}
+std::string& serialCaptured(){return captured;}
+
+// power on state for programs that never call reset()
+struct PowerOn {
+    PowerOn(){reset();}
+} powerOn;
+
+}
+
+// clock
+uint32_t micros(){return (uint32_t)hal::now();}
+uint32_t millis(){return (uint32_t)(hal::now() / 1000);}
+void delay(uint32_t ms){hal::advance((uint64_t)ms * 1000);}
+void delayMicroseconds(uint32_t us){hal::advance(us);}
+void yield(){}
+
+uint32_t native_cycle_count(){
+    static const auto start = std::chrono::steady_clock::now();
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    return (uint32_t)(ns * 3 / 5);
+}
+
+// pins
+void pinMode(uint8_t pin, uint8_t mode){if(pin < hal::PINS) modes[pin] = mode;}
+void digitalWrite(uint8_t pin, uint8_t value){if(pin < hal::PINS) digitalOut[pin] = value ? HIGH : LOW;}
+uint8_t digitalRead(uint8_t pin){
+    if(pin >= hal::PINS) return LOW;
+    if(modes[pin] == OUTPUT) return digitalOut[pin] == HIGH;
+    return digitalIn[pin];
+}
+int analogRead(uint8_t pin){return pin < hal::PINS ? analogIn[pin] : 0;}
+void analogWrite(uint8_t pin, int value){if(pin < hal::PINS) digitalOut[pin] = value;}
+void analogReadResolution(unsigned int /*bits*/){}
+
+// serial
+long Stream::parseInt(){
+    long v = 0;
+    bool negative = false, digits = false;
+    while(available()){
+        int c = peek();
+        if(c == '-' && !digits) negative = true;
+        else if(c >= '0' && c <= '9'){
+            v = v * 10 + (c - '0');
+            digits = true;
+        }
+        else if(digits) break;
+        read();
+    }
+    return negative ? -v : v;
+}
+
+int usb_serial_class::available(){return (int)serialIn.size();}
+
+int usb_serial_class::read(){
+    if(serialIn.empty()) return -1;
+    int c = (uint8_t)serialIn.front();
+    serialIn.pop_front();
+    return c;
+}
+
+int usb_serial_class::peek(){return serialIn.empty() ? -1 : (uint8_t)serialIn.front();}
+
+size_t usb_serial_class::write(const uint8_t* buffer, size_t size){
+    if(capture) captured.append((const char*)buffer, size);
+    for(size_t done = 0; serialFd >= 0 && done < size;){
+        ssize_t n = ::write(serialFd, buffer + done, size - done);
+        if(n <= 0) break;
+        done += n;
+    }
+    return size;
+}
+
+// the USB packet buffers of the Teensy, a little over 6 KB
+int usb_serial_class::availableForWrite(){return 6144;}
+
+// SD
+bool FsFile::open(const char* path, int oflag){
+    close();
+    if(!sdSet) return false;
+    fd = ::open(hal::sdPath(path).c_str(), oflag, 0644);
+    return fd >= 0;
+}
+
+bool FsFile::close(){
+    if(fd < 0) return false;
+    ::close(fd);
+    fd = -1;
+    return true;
+}
+
+bool FsFile::preAllocate(uint64_t length){return fd >= 0 && fileSize() == 0 && ftruncate(fd, length) == 0;}
+
+size_t FsFile::write(const void* buf, size_t count){
+    if(fd < 0) return 0;
+    ssize_t n = ::write(fd, buf, count);
+    return n < 0 ? 0 : n;
+}
+
+int FsFile::read(void* buf, size_t count){return fd < 0 ? -1 : (int)::read(fd, buf, count);}
+
+int FsFile::read(){
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+int FsFile::available(){
+    uint64_t left = fileSize() - curPosition();
+    return left > 0x7FFFFFFF ? 0x7FFFFFFF : (int)left;
+}
+
+bool FsFile::seekSet(uint64_t position){return fd >= 0 && lseek(fd, position, SEEK_SET) == (off_t)position;}
+uint64_t FsFile::curPosition() const {return fd < 0 ? 0 : lseek(fd, 0, SEEK_CUR);}
+
+uint64_t FsFile::fileSize() const {
+    struct stat st;
+    return fd >= 0 && fstat(fd, &st) == 0 ? st.st_size : 0;
+}
+
+bool FsFile::truncate(){return truncate(curPosition());}
+bool FsFile::truncate(uint64_t length){return fd >= 0 && ftruncate(fd, length) == 0;}
+bool FsFile::sync(){return fd >= 0 && fsync(fd) == 0;}
+
+FsFile SdFs::open(const char* path, int oflag){
+    FsFile f;
+    f.open(path, oflag);
+    return f;
+}
+
+bool SdFs::exists(const char* path){
+    struct stat st;
+    return sdSet && stat(hal::sdPath(path).c_str(), &st) == 0;
+}
+
+bool SdFs::remove(const char* path){return sdSet && unlink(hal::sdPath(path).c_str()) == 0;}
+
+bool SDClass::begin(uint8_t /*csPin*/){return sdSet;}
+bool SDClass::mediaPresent(){return sdSet;}
+
+File SDClass::open(const char* path, uint8_t mode){
+    int flags = O_RDONLY;
+    if(mode == FILE_WRITE) flags = O_RDWR | O_CREAT | O_APPEND;
+    else if(mode == FILE_WRITE_BEGIN) flags = O_RDWR | O_CREAT;
+    return sdfs.open(path, flags);
+}
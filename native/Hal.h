@@ -0,0 +1,74 @@
+// GAUCHO RACING VDM NATIVE HAL
+// The firmware talks to the hardware through the Arduino / Teensy API (Arduino.h, FlexCAN_T4.h, SD.h,
+// EEPROM.h), so that API is the hardware abstraction: the headers in native/ stand in for the Teensy
+// core and libraries on Linux, and this is the other side of them, where a test or benchmark drives
+// the simulated hardware.
+//     clock   simulated by default, moved only by advance() (and delay()); realTime() follows the host
+//     CAN     one virtual bus per FlexCAN instance, frames injected toward the firmware queue up to
+//             the instance's RX size, frames the firmware writes go to onCanWrite and are counted
+//     ADC/IO  analog and digital inputs are set per pin, outputs and pin modes read back
+//     SD      a host directory, absent until sdRoot() names one
+//     EEPROM  4284 bytes in RAM, loaded and saved to a file on request
+//     Serial  input queued by serialInput(), output to a host file descriptor and/or a capture buffer
+// setup() and loop() in src/main.cpp run unmodified against this; native/NativeMain.cpp is the
+// pio run -e native entry point and the tools link the same files with their own main().
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <string>
+
+struct CAN_message_t;
+
+namespace hal {
+
+const uint8_t CAN_BUSES = 3;                        // CAN1, CAN2, CAN3
+const uint16_t PINS = 64;
+const uint16_t EEPROM_SIZE = 4284;                  // Teensy 4.1 emulated EEPROM
+
+// put everything back to power on: time 0, no frames, inputs low, EEPROM erased (0xFF)
+void reset();
+
+// clock
+uint64_t now();                                     // us since power on
+void advance(uint64_t us);
+void realTime(bool on);                             // follow the host clock from now on
+
+// CAN, bus is the FlexCAN_T4 CAN_DEV_TABLE value
+bool canInject(uint8_t bus, const CAN_message_t& m);  // false when the firmware's RX queue is full
+size_t canPending(uint8_t bus);
+extern std::function<void(uint8_t bus, const CAN_message_t& m)> onCanWrite;
+struct CanStats {
+    uint32_t injected = 0;
+    uint32_t read = 0;
+    uint32_t written = 0;
+    uint32_t overruns = 0;                          // injections dropped on a full RX queue
+};
+const CanStats& canStats(uint8_t bus);
+
+// pins
+void setAnalog(uint8_t pin, uint16_t value);
+void setDigital(uint8_t pin, bool high);
+int digitalOutput(uint8_t pin);                     // last digitalWrite, -1 for never written
+int pinModeOf(uint8_t pin);                         // -1 before pinMode
+
+// SD card
+void sdRoot(const char* dir);                       // nullptr: no card
+std::string sdPath(const char* name);
+
+// EEPROM
+uint8_t* eeprom();
+bool eepromLoad(const char* path);
+bool eepromSave(const char* path);
+
+// USB serial
+void serialInput(const char* text, size_t length);
+void serialOutput(int fd);                          // -1 to drop
+void serialCapture(bool on);
+std::string& serialCaptured();
+
+}
+
+#endif
@@ -0,0 +1,125 @@
+// GAUCHO RACING VDM NATIVE MAIN
+// Runs the firmware's setup() and loop() on Linux against the simulated hardware (see Hal.h) and
+// reports what the loop costs on the host.
+//
+// Build:
+//     pio run -e native                       or
+//     g++ -O2 -std=gnu++17 -I native -I src src/main.cpp native/Hal.cpp native/NativeMain.cpp -o vdm_native
+//
+// Usage:
+//     vdm_native [--seconds S] [--step US] [--realtime] [--sd DIR] [--eeprom FILE] [--serial FILE|-|none] [--pin PIN=VALUE]...
+//         --seconds   simulated run time (10 s default), with --realtime host time, 0 runs until killed
+//         --step      simulated us per loop pass (100 default)
+//         --realtime  follow the host clock, the loop spins as it would on the car
+//         --sd        directory standing in for the SD card (no card by default)
+//         --eeprom    EEPROM image, loaded at start and saved at exit
+//         --serial    where the USB serial output goes (stdout default); stdin is the console input
+//         --pin       hold an input: analogRead() gives VALUE, digitalRead() HIGH for any VALUE but 0
+#include "Hal.h"
+#include "Arduino.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+void setup();
+void loop();
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int){stopRequested = 1;}
+
+// console input without ever blocking the loop
+static void pollStdin(bool& open){
+    if(!open) return;
+    struct pollfd p = {0, POLLIN, 0};
+    if(poll(&p, 1, 0) <= 0) return;
+    char buf[256];
+    ssize_t n = read(0, buf, sizeof(buf));
+    if(n <= 0) open = false;
+    else hal::serialInput(buf, n);
+}
+
+static void usage(){
+    fprintf(stderr, "usage: vdm_native [--seconds S] [--step US] [--realtime] [--sd DIR] [--eeprom FILE] [--serial FILE|-|none] [--pin PIN=VALUE]...\n");
+}
+
+int main(int argc, char** argv){
+    double seconds = 10;
+    uint32_t step = 100;
+    bool realtime = false;
+    const char* sd = nullptr;
+    const char* eepromFile = nullptr;
+    const char* serial = "-";
+    for(int i = 1; i < argc; i++){
+        const char* a = argv[i];
+        bool more = i + 1 < argc;
+        if(!strcmp(a, "--seconds") && more) seconds = atof(argv[++i]);
+        else if(!strcmp(a, "--step") && more) step = std::max(1, atoi(argv[++i]));
+        else if(!strcmp(a, "--realtime")) realtime = true;
+        else if(!strcmp(a, "--sd") && more) sd = argv[++i];
+        else if(!strcmp(a, "--eeprom") && more) eepromFile = argv[++i];
+        else if(!strcmp(a, "--serial") && more) serial = argv[++i];
+        else if(!strcmp(a, "--pin") && more && strchr(argv[i + 1], '=')){
+            const char* p = argv[++i];
+            int pin = atoi(p), value = atoi(strchr(p, '=') + 1);
+            hal::setAnalog(pin, value);
+            hal::setDigital(pin, value != 0);
+        }
+        else {
+            usage();
+            return 2;
+        }
+    }
+
+    if(!strcmp(serial, "none")) hal::serialOutput(-1);
+    else if(strcmp(serial, "-")){
+        int fd = open(serial, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0){
+            perror(serial);
+            return 1;
+        }
+        hal::serialOutput(fd);
+    }
+    hal::sdRoot(sd);
+    if(eepromFile && !hal::eepromLoad(eepromFile)) fprintf(stderr, "%s: starting with an erased EEPROM\n", eepromFile);
+    hal::realTime(realtime);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    bool stdinOpen = true;
+    uint64_t end = seconds > 0 ? (uint64_t)(seconds * 1e6) : UINT64_MAX;
+    auto t0 = std::chrono::steady_clock::now();
+    setup();
+    double setupNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+
+    uint64_t loops = 0;
+    double worstNs = 0, totalNs = 0;
+    while(!stopRequested && hal::now() < end){
+        if((loops & 63) == 0) pollStdin(stdinOpen);
+        auto a = std::chrono::steady_clock::now();
+        loop();
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - a).count();
+        totalNs += ns;
+        worstNs = std::max(worstNs, ns);
+        loops++;
+        if(!realtime) hal::advance(step);
+    }
+
+    if(eepromFile && !hal::eepromSave(eepromFile)) perror(eepromFile);
+    fprintf(stderr, "\n%.3f s %s, setup %.1f us, %llu loop passes: mean %.2f us, worst %.2f us on the host\n",
+        hal::now() * 1e-6, realtime ? "real time" : "simulated", setupNs / 1e3, (unsigned long long)loops,
+        loops ? totalNs / loops / 1e3 : 0, worstNs / 1e3);
+    for(uint8_t b = 1; b <= hal::CAN_BUSES; b++){
+        const hal::CanStats& s = hal::canStats(b);
+        if(s.injected || s.written) fprintf(stderr, "CAN%u: %u written, %u injected, %u read, %u overruns\n", b, s.written, s.injected, s.read, s.overruns);
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+// GAUCHO RACING VDM NATIVE SD
+// The Teensy SD library (SD.sdfs is SdFat's SdFs) over a host directory, hal::sdRoot(). preAllocate()
+// sizes the file sparsely so the logger's 512 MB reservation costs nothing on disk.
+#ifndef NATIVE_SD_H
+#define NATIVE_SD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <fcntl.h>
+
+#define BUILTIN_SDCARD 254
+#define FILE_READ 0
+#define FILE_WRITE 1
+#define FILE_WRITE_BEGIN 2
+
+class FsFile {
+    public:
+    bool open(const char* path, int oflag = O_RDONLY);
+    bool isOpen() const {return fd >= 0;}
+    explicit operator bool() const {return isOpen();}
+    bool close();
+    bool preAllocate(uint64_t length);
+    size_t write(const void* buf, size_t count);
+    size_t write(uint8_t b){return write(&b, 1);}
+    int read(void* buf, size_t count);
+    int read();
+    int available();
+    bool seekSet(uint64_t position);
+    uint64_t curPosition() const;
+    uint64_t fileSize() const;
+    bool truncate();
+    bool truncate(uint64_t length);
+    bool sync();
+
+    private:
+    int fd = -1;
+};
+
+// SD.open's File, the same file without the heap wrapper
+typedef FsFile File;
+
+class SdFs {
+    public:
+    FsFile open(const char* path, int oflag = O_RDONLY);
+    bool exists(const char* path);
+    bool remove(const char* path);
+};
+
+class SDClass {
+    public:
+    SdFs sdfs;
+    bool begin(uint8_t csPin = BUILTIN_SDCARD);
+    bool mediaPresent();
+    File open(const char* path, uint8_t mode = FILE_READ);
+    bool exists(const char* path){return sdfs.exists(path);}
+    bool remove(const char* path){return sdfs.remove(path);}
+};
+
+extern SDClass SD;
+
+#endif
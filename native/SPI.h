@@ -0,0 +1,6 @@
+// GAUCHO RACING VDM NATIVE SPI
+// Included by Nodes.h, nothing on the VDM uses SPI directly.
+#ifndef NATIVE_SPI_H
+#define NATIVE_SPI_H
+
+#endif
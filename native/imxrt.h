@@ -0,0 +1,13 @@
+// GAUCHO RACING VDM NATIVE IMXRT
+// Registers the firmware reads directly. The cycle counter counts host time in 600 MHz cycles so
+// cycle budgets read the same as on the Teensy (the host is faster, see tools/vdm_attitude.cpp).
+#ifndef NATIVE_IMXRT_H
+#define NATIVE_IMXRT_H
+
+#include <stdint.h>
+
+uint32_t native_cycle_count();
+#define ARM_DWT_CYCCNT (native_cycle_count())
+#define F_CPU_ACTUAL 600000000
+
+#endif
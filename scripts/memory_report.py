@@ -0,0 +1,140 @@
+"""
+GAUCHO RACING VDM MEMORY REPORT
+Static RAM budget of the firmware, per subsystem and per Teensy 4.1 memory region, read from the
+symbol table of the linked ELF. There is no heap at run time (see src/HeapGuard.h), so this is the
+whole memory budget apart from the stack. It also checks the FASTRUN / FLASHMEM / DMAMEM placement
+described at the top of src/main.cpp and fails the build when a symbol landed in the wrong region.
+
+Run by PlatformIO after every link (extra_scripts in platformio.ini), or by hand:
+    python3 scripts/memory_report.py .pio/build/teensy41/firmware.elf [arm-none-eabi-nm]
+"""
+import re
+import subprocess
+import sys
+
+# Teensy 4.1 memory map: (area, RAM column, start, end)
+AREAS = [
+    ("ITCM", "RAM1", 0x00000000, 0x00080000),      # FASTRUN code, the default for code
+    ("DTCM", "RAM1", 0x20000000, 0x20080000),      # globals and the stack
+    ("OCRAM", "RAM2", 0x20200000, 0x20280000),     # DMAMEM
+    ("FLASH", None, 0x60000000, 0x70000000),       # FLASHMEM code, PROGMEM data
+    ("EXTMEM", "EXTMEM", 0x70000000, 0x71000000),  # PSRAM
+]
+RAM1_SIZE = 512 * 1024                              # FlexRAM, shared by ITCM and DTCM in 32 KB banks
+RAM2_SIZE = 512 * 1024
+TCM_BANK = 32 * 1024
+
+# where the hot and cold symbols must end up, matched against the demangled name
+PLACEMENT = [
+    (r"^(drive_active|drive_standby|drive_regen|computeTractionControl|sampleDriverInputs|serviceDerating|serviceThermal|serviceAttitude|getThrottle[12]|writeMessage|loop)\(", ("ITCM",)),
+    (r"^SystemsCheck::|^\w+::receive\(", ("ITCM",)),
+    (r"^(DTI|ECU|WFL|WFR|WRL|WRR|GPS1|PEDALS|ACU1|TCM1|DASHBOARD|ENERGY_METER|STEERING_WHEEL|msg|msg2|TUNE|FAULTS|CLOCK_SYNC)$", ("DTCM",)),
+    (r"^(log_raw|log_out|log_index|debug_page_text|console_text|tlm_packet_buf|tlm_frame_buf)$", ("OCRAM", "EXTMEM")),
+    (r"^(setup|serviceBoot|printDebug|consoleCommand|consoleList|readSDCard|ecu_flash|vehicle(Status|Health|Network|Settings|PowerData))\(", ("FLASH",)),
+]
+
+# first match wins, matched against the demangled symbol name
+SUBSYSTEMS = [
+    ("logger", r"LOGGER|DataLogger|log_"),
+    ("telemetry", r"TELEMETRY|Telemetry|tlm_"),
+    ("console / debug page", r"CONSOLE|Console|console_|DEBUG_PAGE|DebugPage|debug_page|^vehicle[A-Z]|printDebug"),
+    ("tune", r"TUNE|Tune|tune_|TC_GAINS"),
+    ("faults / pings", r"SYSTEMS_CHECK|SystemsCheck|FAULTS|WARNINGS|LIMITS|PING_NODES|SYS_CHECK"),
+    ("clock sync", r"CLOCK_SYNC|ClockSync"),
+    ("nodes", r"\b(DTI|ECU|WFL|WFR|WRL|WRR|GPS1|PEDALS|ACU1|TCM1|DASHBOARD|ENERGY_METER|STEERING_WHEEL)\b|::receive\("),
+    ("CAN", r"can_primary|can_data|FlexCAN|^msg2?$"),
+    ("SD card", r"\bSD\b|SdFs|SdFat|Sdio|SdCard|FsVolume|FsFile|ExFat|FatVolume|FatFile"),
+    ("USB serial", r"usb_|Serial|rx_buffer|tx_buffer"),
+    ("EEPROM", r"eeprom|EEPROM"),
+]
+
+
+def area_of(addr):
+    for area, column, lo, hi in AREAS:
+        if lo <= addr < hi:
+            return area, column
+    return None, None
+
+
+def subsystem_of(name):
+    for sub, pattern in SUBSYSTEMS:
+        if re.search(pattern, name):
+            return sub
+    return "core / other"
+
+
+def symbols(elf, nm):
+    out = subprocess.run([nm, "-S", "-C", "--size-sort", elf], check=True, capture_output=True, text=True).stdout
+    for line in out.splitlines():
+        parts = line.split(None, 3)
+        if len(parts) < 4:
+            continue
+        addr, size, kind, name = parts
+        yield int(addr, 16), int(size, 16), kind, name
+
+
+# @return number of placement violations
+def report(elf, nm, out=sys.stdout):
+    table = {}
+    totals = {"RAM1": 0, "RAM2": 0, "EXTMEM": 0}
+    areas = {}
+    checked = {}
+    violations = []
+    for addr, size, kind, name in symbols(elf, nm):
+        area, column = area_of(addr)
+        for pattern, allowed in PLACEMENT:
+            if re.search(pattern, name):
+                checked[pattern] = checked.get(pattern, 0) + 1
+                if area not in allowed:
+                    violations.append("%s in %s, expected %s" % (name, area, " or ".join(allowed)))
+                break
+        if column is None:
+            continue   # flash
+        areas[area] = areas.get(area, 0) + size
+        sub = subsystem_of(name)
+        row = table.setdefault(sub, {"RAM1": 0, "RAM2": 0, "EXTMEM": 0})
+        row[column] += size
+        totals[column] += size
+
+    out.write("\nVDM static memory by subsystem (bytes)\n")
+    out.write("%-24s %10s %10s %10s\n" % ("subsystem", "RAM1", "RAM2", "EXTMEM"))
+    for sub, row in sorted(table.items(), key=lambda e: -(e[1]["RAM1"] + e[1]["RAM2"] + e[1]["EXTMEM"])):
+        out.write("%-24s %10d %10d %10d\n" % (sub, row["RAM1"], row["RAM2"], row["EXTMEM"]))
+    out.write("%-24s %10d %10d %10d\n" % ("total", totals["RAM1"], totals["RAM2"], totals["EXTMEM"]))
+    out.write("RAM1 %.1f%% of %d KB (DTCM left over is the stack), RAM2 %.1f%% of %d KB\n\n" % (
+        100.0 * totals["RAM1"] / RAM1_SIZE, RAM1_SIZE // 1024, 100.0 * totals["RAM2"] / RAM2_SIZE, RAM2_SIZE // 1024))
+
+    itcm = areas.get("ITCM", 0)
+    banks = (itcm + TCM_BANK - 1) // TCM_BANK
+    dtcm_size = RAM1_SIZE - banks * TCM_BANK
+    dtcm = areas.get("DTCM", 0)
+    out.write("tightly coupled: ITCM %d bytes in %d x 32 KB banks, DTCM %d of %d bytes, %d left for the stack\n" % (
+        itcm, banks, dtcm, dtcm_size, dtcm_size - dtcm))
+    for pattern, allowed in PLACEMENT:
+        if pattern not in checked:
+            out.write("placement: nothing matches %s (inlined?)\n" % pattern)
+    for v in violations:
+        out.write("PLACEMENT ERROR: %s\n" % v)
+    out.write("placement %s\n\n" % ("FAILED" if violations else "ok"))
+    return len(violations)
+
+
+def post_action(source, target, env):
+    nm = env.subst("$CC").replace("gcc", "nm")
+    elf = str(source[0])
+    try:
+        return 1 if report(elf, nm) else 0
+    except (OSError, subprocess.CalledProcessError) as e:
+        sys.stderr.write("memory report skipped: %s\n" % e)
+        return 0
+
+
+try:
+    Import("env")   # noqa: F821, run as a PlatformIO extra script
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", post_action)   # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        if len(sys.argv) not in (2, 3):
+            sys.stderr.write("usage: memory_report.py FIRMWARE.elf [NM]\n")
+            sys.exit(1)
+        sys.exit(1 if report(sys.argv[1], sys.argv[2] if len(sys.argv) == 3 else "arm-none-eabi-nm") else 0)
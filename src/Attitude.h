@@ -0,0 +1,157 @@
+
+// GAUCHO RACING VDM ATTITUDE
+// Mahony complementary filter on the central IMU at a fixed ATTITUDE_PERIOD. The gyro is integrated into a
+// quaternion, and the error between the measured and the estimated gravity (and magnetic field, when there
+// is one) is fed back through a PI term, the I part tracking gyro bias. The accelerometer also sees the
+// car's own acceleration, so the filtered rate of change of speed is taken off the longitudinal axis and
+// speed * yaw rate off the lateral axis first, and any sample still further than ATTITUDE_ACCEL_GATE
+// from 1 g (kerbs, wheelspin) is left to the gyro alone.
+// The estimated gravity taken off the measurement leaves the body frame longitudinal and lateral
+// acceleration. Axes: x forward, y left, z up. tools/vdm_attitude.cpp checks accuracy and cost on host.
+// Shared with the host tools, so no Arduino dependencies here.
+#ifndef ATTITUDE_H
+#define ATTITUDE_H
+
+#include <stdint.h>
+#include <math.h>
+
+const uint32_t ATTITUDE_PERIOD = 5000;              // us between steps, 200 Hz
+const float ATTITUDE_KP = 1.0;                      // 1/s, gravity and heading correction
+const float ATTITUDE_KI = 0.02;                     // 1/s^2, gyro bias
+const float ATTITUDE_ACCEL_GATE = 0.15;             // g, no accelerometer correction beyond 1 g +- this
+const float ATTITUDE_MAX_STEP = 0.05;               // s, longer gaps are integrated as this
+const float ATTITUDE_SPEED_FILTER = 0.05;           // s, time constant on the rate of change of speed
+const uint32_t ATTITUDE_CYCLE_BUDGET = 3000;        // CPU cycles a step may take on the Teensy
+const float STANDARD_GRAVITY = 9.80665;             // m/s^2
+
+// one IMU reading in body axes
+struct ImuSample {
+    float gx, gy, gz;                               // rad/s
+    float ax, ay, az;                               // g
+    float mx, my, mz;                               // any unit, all 0 for no magnetometer
+};
+
+struct Attitude {
+    float q0 = 1, q1 = 0, q2 = 0, q3 = 0;           // body to earth quaternion
+    float roll = 0, pitch = 0, yaw = 0;             // rad, yaw relative to magnetic north (or the start without a magnetometer)
+    float longAccel = 0, latAccel = 0;              // m/s^2, body frame, gravity removed
+    float biasX = 0, biasY = 0, biasZ = 0;          // rad/s, gyro bias estimate
+    float speedRate = 0;                            // m/s^2, filtered rate of change of speed
+    bool seeded = false;
+
+    // statistics
+    uint32_t steps = 0;
+    uint32_t rejected = 0;                          // steps left to the gyro by the acceleration gate
+
+    bool due(uint32_t now) const {return !seeded || now - last >= ATTITUDE_PERIOD;}
+
+    // step if ATTITUDE_PERIOD has elapsed
+    // @param now micros()
+    // @param speed m/s forward, for the centripetal correction
+    // @return true when a step was taken
+    bool update(uint32_t now, const ImuSample& s, float speed){
+        if(!due(now)) return false;
+        float dt = (now - last) * 1e-6f;
+        last = now;
+        if(!seeded){
+            seed(s);
+            lastSpeed = speed;
+        }
+        else step(dt > ATTITUDE_MAX_STEP ? ATTITUDE_MAX_STEP : dt, s, speed);
+        return true;
+    }
+
+    // level the quaternion on the accelerometer, yaw 0
+    void seed(const ImuSample& s){
+        float r = atan2f(s.ay, s.az) * 0.5f;
+        float p = atan2f(-s.ax, sqrtf(s.ay * s.ay + s.az * s.az)) * 0.5f;
+        float cr = cosf(r), sr = sinf(r), cp = cosf(p), sp = sinf(p);
+        q0 = cr * cp;
+        q1 = sr * cp;
+        q2 = cr * sp;
+        q3 = -sr * sp;
+        biasX = biasY = biasZ = 0;
+        speedRate = 0;
+        seeded = true;
+        angles(s);
+    }
+
+    // one filter step of dt seconds
+    void step(float dt, const ImuSample& s, float speed){
+        steps++;
+        float gx = s.gx, gy = s.gy, gz = s.gz;
+        speedRate += ((speed - lastSpeed) / dt - speedRate) * dt / (ATTITUDE_SPEED_FILTER + dt);
+        lastSpeed = speed;
+        float ax = s.ax - speedRate / STANDARD_GRAVITY, ay = s.ay - speed * (gz - biasZ) / STANDARD_GRAVITY, az = s.az;
+        float ex = 0, ey = 0, ez = 0;
+
+        // gravity in body axes, halved
+        float vx = q1 * q3 - q0 * q2, vy = q0 * q1 + q2 * q3, vz = q0 * q0 - 0.5f + q3 * q3;
+        float an = ax * ax + ay * ay + az * az;
+        if(an > (1 - ATTITUDE_ACCEL_GATE) * (1 - ATTITUDE_ACCEL_GATE) && an < (1 + ATTITUDE_ACCEL_GATE) * (1 + ATTITUDE_ACCEL_GATE)){
+            float n = 1 / sqrtf(an);
+            ax *= n;
+            ay *= n;
+            az *= n;
+            ex = ay * vz - az * vy;
+            ey = az * vx - ax * vz;
+            ez = ax * vy - ay * vx;
+        }
+        else rejected++;
+
+        float mn = s.mx * s.mx + s.my * s.my + s.mz * s.mz;
+        if(mn > 0){
+            float n = 1 / sqrtf(mn);
+            float mx = s.mx * n, my = s.my * n, mz = s.mz * n;
+            // field in earth axes, then its reference direction in body axes
+            float hx = 2 * (mx * (0.5f - q2 * q2 - q3 * q3) + my * (q1 * q2 - q0 * q3) + mz * (q1 * q3 + q0 * q2));
+            float hy = 2 * (mx * (q1 * q2 + q0 * q3) + my * (0.5f - q1 * q1 - q3 * q3) + mz * (q2 * q3 - q0 * q1));
+            float bx = sqrtf(hx * hx + hy * hy);
+            float bz = 2 * (mx * (q1 * q3 - q0 * q2) + my * (q2 * q3 + q0 * q1) + mz * (0.5f - q1 * q1 - q2 * q2));
+            float wx = bx * (0.5f - q2 * q2 - q3 * q3) + bz * (q1 * q3 - q0 * q2);
+            float wy = bx * (q1 * q2 - q0 * q3) + bz * (q0 * q1 + q2 * q3);
+            float wz = bx * (q0 * q2 + q1 * q3) + bz * (0.5f - q1 * q1 - q2 * q2);
+            ex += my * wz - mz * wy;
+            ey += mz * wx - mx * wz;
+            ez += mx * wy - my * wx;
+        }
+
+        // bias is the negative of the integral term
+        biasX -= 2 * ATTITUDE_KI * ex * dt;
+        biasY -= 2 * ATTITUDE_KI * ey * dt;
+        biasZ -= 2 * ATTITUDE_KI * ez * dt;
+        gx += 2 * ATTITUDE_KP * ex - biasX;
+        gy += 2 * ATTITUDE_KP * ey - biasY;
+        gz += 2 * ATTITUDE_KP * ez - biasZ;
+
+        gx *= 0.5f * dt;
+        gy *= 0.5f * dt;
+        gz *= 0.5f * dt;
+        float a = q0, b = q1, c = q2;
+        q0 += -b * gx - c * gy - q3 * gz;
+        q1 += a * gx + c * gz - q3 * gy;
+        q2 += a * gy - b * gz + q3 * gx;
+        q3 += a * gz + b * gy - c * gx;
+        float n = 1 / sqrtf(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+        q0 *= n;
+        q1 *= n;
+        q2 *= n;
+        q3 *= n;
+        angles(s);
+    }
+
+    private:
+    uint32_t last = 0;
+    float lastSpeed = 0;
+
+    void angles(const ImuSample& s){
+        roll = atan2f(q0 * q1 + q2 * q3, 0.5f - q1 * q1 - q2 * q2);
+        float sp = 2 * (q0 * q2 - q1 * q3);
+        pitch = asinf(sp > 1 ? 1 : sp < -1 ? -1 : sp);
+        yaw = atan2f(q1 * q2 + q0 * q3, 0.5f - q2 * q2 - q3 * q3);
+        longAccel = (s.ax - 2 * (q1 * q3 - q0 * q2)) * STANDARD_GRAVITY;
+        latAccel = (s.ay - 2 * (q0 * q1 + q2 * q3)) * STANDARD_GRAVITY;
+    }
+};
+
+#endif
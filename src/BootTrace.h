@@ -0,0 +1,40 @@
+
+// GAUCHO RACING VDM BOOT TRACE
+// Time spent in each boot stage. setup() only brings up what the safety logic needs (CAN, pins,
+// inverter disable, the EEPROM tune) and hands the slow work (SD card, logger, tune import) to
+// background steps run from loop(); every stage calls mark() when it finishes, so the trace shows
+// both how long until GLV_ON and how long until the car is fully up.
+#ifndef BOOT_TRACE_H
+#define BOOT_TRACE_H
+
+#include <Arduino.h>
+
+const uint8_t BOOT_MAX_STAGES = 12;
+const uint32_t BOOT_READY_BUDGET = 50000;           // us from reset to GLV_ON with CAN and faults live
+
+struct BootStage {
+    const char* name;
+    uint32_t end;                                   // micros() when the stage finished
+    uint32_t time;                                  // us the stage took
+};
+
+struct BootTrace {
+    BootStage stages[BOOT_MAX_STAGES];
+    uint8_t count = 0;
+    uint32_t ready = 0;                             // micros() at the end of setup()
+    uint32_t done = 0;                              // micros() when the background steps finished, 0 until then
+
+    // close the current stage, the first one runs from reset
+    void mark(const char* name){
+        if(count == BOOT_MAX_STAGES) return;
+        uint32_t now = micros();
+        uint32_t start = count ? stages[count - 1].end : 0;
+        stages[count++] = {name, now, now - start};
+    }
+
+    bool overBudget() const {return ready > BOOT_READY_BUDGET;}
+};
+
+BootTrace BOOT;
+
+#endif
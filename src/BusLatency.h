@@ -0,0 +1,65 @@
+// GAUCHO RACING VDM BUS LATENCY
+// Stamps frames from the ACU, Pedals, Steering Wheel and Dash in the VDM's micros() time base:
+// arrival time minus the one way bus latency, taken as half the best recent ping round trip.
+//
+// The ping request sent by tryPingRequests() carries the VDM millis() in bytes 0..3 and the
+// VDM micros() in bytes 4..7 (big endian); the response echoes the VDM micros() in bytes 4..7.
+// The node data frames carry no node timestamp, so node clock offset and drift cannot be estimated;
+// only the latency is tracked, and frames are stamped from their receive time.
+#ifndef BUS_LATENCY_H
+#define BUS_LATENCY_H
+
+#include <stdint.h>
+
+// nodes that answer ping requests, in the same order as the ping node numbers (1 - 4)
+enum LatencyNode {LATENCY_ACU, LATENCY_PEDALS, LATENCY_STEERING, LATENCY_DASH, LATENCY_NODE_COUNT};
+
+const uint32_t LATENCY_RTT_SLACK = 200;     // microseconds above the best round trip still accepted
+const uint32_t LATENCY_RTT_DECAY = 50;      // microseconds the best round trip relaxes per sample
+
+// bus latency of one node
+struct NodeLatency {
+    uint32_t rtt = 0;               // last round trip in microseconds
+    uint32_t bestRtt = UINT32_MAX;  // lower envelope of recent round trips
+    uint32_t lastFrameTime = 0;     // VDM micros of the last data frame from this node (sensor time)
+    uint16_t samples = 0;           // accepted round trips
+    uint16_t rejected = 0;          // round trips dropped as congested
+
+    bool measured() const {return samples > 0;}
+    uint32_t latency() const {return measured() ? bestRtt / 2 : 0;}
+};
+
+struct BusLatency {
+    NodeLatency nodes[LATENCY_NODE_COUNT];
+
+    // feed one ping response
+    // @param node node that answered
+    // @param sent_us VDM micros() echoed from the request
+    // @param now_us VDM micros() when the response was read
+    void onPingResponse(LatencyNode node, uint32_t sent_us, uint32_t now_us){
+        if(node >= LATENCY_NODE_COUNT) return;
+        NodeLatency& c = nodes[node];
+        uint32_t rtt = now_us - sent_us;
+        c.rtt = rtt;
+        // round trips that sat in a bus queue overstate the latency, keep to the fast ones
+        c.bestRtt = (c.bestRtt > UINT32_MAX - LATENCY_RTT_DECAY) ? rtt : c.bestRtt + LATENCY_RTT_DECAY;
+        if(rtt < c.bestRtt) c.bestRtt = rtt;
+        if(c.samples && rtt > 2 * c.bestRtt + LATENCY_RTT_SLACK){
+            c.rejected++;
+            return;
+        }
+        if(c.samples < UINT16_MAX) c.samples++;
+    }
+
+    // stamp a data frame from a node in VDM time: arrival minus the estimated one way bus latency
+    // @return sensor time of the frame in VDM micros()
+    uint32_t stampFrame(LatencyNode node, uint32_t arrival_us){
+        NodeLatency& c = nodes[node];
+        c.lastFrameTime = arrival_us - c.latency();
+        return c.lastFrameTime;
+    }
+
+    uint32_t frameTime(LatencyNode node) const {return nodes[node].lastFrameTime;}
+};
+
+#endif
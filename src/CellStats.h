@@ -0,0 +1,151 @@
+
+// GAUCHO RACING VDM CELL STATISTICS
+// Min, max, mean and spread of the 128 raw cell bytes the ACU sends 8 to a Condensed_Cell_* frame,
+// kept up to date one frame at a time so asking for pack state costs nothing. A frame only touches
+// its own group of 8: the group's min, max and sum come from the Cortex-M7 packed byte instructions
+// (USUB8/SEL for per-byte min and max, USAD8 for the sum), then the 16 group minima and maxima are
+// folded the same way for the pack. Other targets (host tools) get the same results from plain C.
+// Groups that have never arrived do not count; until all 16 have, the figures cover the ones seen.
+#ifndef CELL_STATS_H
+#define CELL_STATS_H
+
+#include <stdint.h>
+#include <string.h>
+
+const uint8_t CELL_COUNT = 128;
+const uint8_t CELL_GROUP = 8;                       // cells per Condensed_Cell_* frame
+const uint8_t CELL_GROUPS = CELL_COUNT / CELL_GROUP;
+
+// per byte lane: min(a, b), max(a, b), and the sum of the four bytes
+#if defined(__ARM_FEATURE_SIMD32)
+inline uint32_t cell_min8(uint32_t a, uint32_t b){
+    uint32_t r;
+    // GE[i] = a[i] >= b[i], take b there
+    asm("usub8 %0, %1, %2\n\tsel %0, %2, %1" : "=&r"(r) : "r"(a), "r"(b) : "cc");
+    return r;
+}
+inline uint32_t cell_max8(uint32_t a, uint32_t b){
+    uint32_t r;
+    asm("usub8 %0, %1, %2\n\tsel %0, %1, %2" : "=&r"(r) : "r"(a), "r"(b) : "cc");
+    return r;
+}
+inline uint32_t cell_sum8(uint32_t a){
+    uint32_t r;
+    asm("usad8 %0, %1, %2" : "=r"(r) : "r"(a), "r"(0));
+    return r;
+}
+#else
+inline uint32_t cell_min8(uint32_t a, uint32_t b){
+    uint32_t r = 0;
+    for(int s = 0; s < 32; s += 8){
+        uint32_t x = (a >> s) & 0xFF, y = (b >> s) & 0xFF;
+        r |= (x < y ? x : y) << s;
+    }
+    return r;
+}
+inline uint32_t cell_max8(uint32_t a, uint32_t b){
+    uint32_t r = 0;
+    for(int s = 0; s < 32; s += 8){
+        uint32_t x = (a >> s) & 0xFF, y = (b >> s) & 0xFF;
+        r |= (x > y ? x : y) << s;
+    }
+    return r;
+}
+inline uint32_t cell_sum8(uint32_t a){return (a & 0xFF) + ((a >> 8) & 0xFF) + ((a >> 16) & 0xFF) + (a >> 24);}
+#endif
+
+// fold the four lanes of a word into lane 0
+inline uint8_t cell_fold_min(uint32_t m){
+    m = cell_min8(m, m >> 16);
+    return cell_min8(m, m >> 8) & 0xFF;
+}
+inline uint8_t cell_fold_max(uint32_t m){
+    m = cell_max8(m, m >> 16);
+    return cell_max8(m, m >> 8) & 0xFF;
+}
+
+// lane of the first byte of w equal to v (little endian, the byte at the lowest address), 4 if none
+inline uint8_t cell_find8(uint32_t w, uint8_t v){
+    uint32_t d = w ^ (v * 0x01010101u);
+    uint32_t z = (d - 0x01010101u) & ~d & 0x80808080u;
+    return z ? __builtin_ctz(z) / 8 : 4;
+}
+
+// index of the first of n bytes (a multiple of 4) equal to v
+inline uint8_t cell_find(const uint8_t* p, uint8_t n, uint8_t v){
+    for(uint8_t i = 0; i < n; i += 4){
+        uint32_t w;
+        memcpy(&w, p + i, 4);
+        uint8_t lane = cell_find8(w, v);
+        if(lane < 4) return i + lane;
+    }
+    return 0;
+}
+
+struct CellStats {
+    // pack figures in raw ACU units
+    uint8_t min = 0;
+    uint8_t max = 0;
+    uint8_t minCell = 0;                            // 0..127
+    uint8_t maxCell = 0;
+    uint16_t sum = 0;                               // over the cells of the groups seen
+    uint16_t seen = 0;                              // bit per group that has arrived
+    uint8_t cells = 0;                              // cells covered by sum
+
+    CellStats(){
+        memset(groupMin, 0xFF, sizeof(groupMin));   // never the pack minimum until it arrives
+        memset(groupMax, 0, sizeof(groupMax));
+        memset(groupMinCell, 0, sizeof(groupMinCell));
+        memset(groupMaxCell, 0, sizeof(groupMaxCell));
+        memset(groupSum, 0, sizeof(groupSum));
+    }
+
+    // take the 8 raw cell bytes of one frame
+    // @param group frame index, cells group*8 .. group*8+7
+    void update(uint8_t group, const uint8_t raw[CELL_GROUP]){
+        if(group >= CELL_GROUPS) return;
+        uint32_t lo, hi;
+        memcpy(&lo, raw, 4);
+        memcpy(&hi, raw + 4, 4);
+        uint8_t gmin = cell_fold_min(cell_min8(lo, hi));
+        uint8_t gmax = cell_fold_max(cell_max8(lo, hi));
+        uint16_t gsum = cell_sum8(lo) + cell_sum8(hi);
+
+        if(!(seen & (1u << group))){
+            seen |= 1u << group;
+            cells += CELL_GROUP;
+        }
+        sum += gsum - groupSum[group];
+        groupSum[group] = gsum;
+        groupMin[group] = gmin;
+        groupMax[group] = gmax;
+        groupMinCell[group] = cell_find(raw, CELL_GROUP, gmin);
+        groupMaxCell[group] = cell_find(raw, CELL_GROUP, gmax);
+
+        // pack from the 16 group figures, 4 lanes at a time
+        uint32_t w[4], mn = 0xFFFFFFFF, mx = 0;
+        memcpy(w, groupMin, sizeof(w));
+        for(int i = 0; i < 4; i++) mn = cell_min8(mn, w[i]);
+        memcpy(w, groupMax, sizeof(w));
+        for(int i = 0; i < 4; i++) mx = cell_max8(mx, w[i]);
+        min = cell_fold_min(mn);
+        max = cell_fold_max(mx);
+        uint8_t g = cell_find(groupMin, CELL_GROUPS, min);
+        minCell = g * CELL_GROUP + groupMinCell[g];
+        g = cell_find(groupMax, CELL_GROUPS, max);
+        maxCell = g * CELL_GROUP + groupMaxCell[g];
+    }
+
+    bool complete() const {return seen == 0xFFFF;}
+    float mean() const {return cells ? (float)sum / cells : 0;}
+    uint8_t spread() const {return cells ? max - min : 0;}
+
+    private:
+    alignas(4) uint8_t groupMin[CELL_GROUPS];
+    alignas(4) uint8_t groupMax[CELL_GROUPS];
+    uint8_t groupMinCell[CELL_GROUPS];              // 0..7 within the group
+    uint8_t groupMaxCell[CELL_GROUPS];
+    uint16_t groupSum[CELL_GROUPS];
+};
+
+#endif
@@ -0,0 +1,91 @@
+
+// GAUCHO RACING VDM SERIAL CONSOLE
+// Line oriented command console on the USB serial port. Input is read a few bytes at a time within a
+// fixed microsecond budget and a complete line is split into words and handed to a command handler,
+// at most one line per call. Replies go into a DebugPage that the caller drains without blocking.
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <Arduino.h>
+#include "DebugPage.h"
+
+const uint8_t CONSOLE_LINE_LENGTH = 96;
+const uint8_t CONSOLE_MAX_WORDS = 6;
+const uint32_t CONSOLE_BUDGET = 20;                 // microseconds of input handling per call
+
+// reply text, cold so it lives in OCRAM
+DMAMEM char console_text[DEBUG_PAGE_SIZE];
+
+struct Console {
+    // run one command line
+    // @param argc number of words, at least 1
+    // @param argv the words, valid until the handler returns
+    // @param out reply text
+    // @return true to continue the reply through resume()
+    bool (*handler)(int argc, char** argv, DebugPage& out) = nullptr;
+    // continue a multi line reply started by the handler, return false when it is done
+    bool (*resume)(DebugPage& out) = nullptr;
+
+    DebugPage out{console_text};                    // reply waiting for the port
+    bool resuming = false;
+
+    // statistics
+    uint32_t lines = 0;
+    uint32_t overflows = 0;                         // lines cut at CONSOLE_LINE_LENGTH
+    uint32_t worstTime = 0;                         // microseconds of the slowest call
+
+    // read input within CONSOLE_BUDGET and run at most one complete line, call every loop
+    void service(Stream& port){
+        uint32_t start = micros();
+        if(resuming){
+            // long replies (list) are produced a line at a time, once the last part has been sent
+            if(!out.busy()){
+                out.clear();
+                resuming = resume(out);
+            }
+        }
+        else {
+            bool ready = false;
+            while(!ready && port.available() > 0 && micros() - start < CONSOLE_BUDGET){
+                char c = port.read();
+                if(c == '\r' || c == '\n') ready = length > 0 || overflowed;
+                else if(length < CONSOLE_LINE_LENGTH - 1) line[length++] = c;
+                else overflowed = true;
+            }
+            if(ready) run();
+        }
+        uint32_t elapsed = micros() - start;
+        if(elapsed > worstTime) worstTime = elapsed;
+    }
+
+    private:
+    char line[CONSOLE_LINE_LENGTH];
+    uint8_t length = 0;
+    bool overflowed = false;
+
+    void run(){
+        line[length] = 0;
+        char* argv[CONSOLE_MAX_WORDS];
+        int argc = 0;
+        char* p = line;
+        while(*p && argc < CONSOLE_MAX_WORDS){
+            while(*p == ' ' || *p == '\t') *p++ = 0;
+            if(!*p) break;
+            argv[argc++] = p;
+            while(*p && *p != ' ' && *p != '\t') p++;
+        }
+        if(!out.busy()) out.clear();
+        if(overflowed){
+            overflows++;
+            out.println("ERR line too long");
+        }
+        else if(argc && handler){
+            lines++;
+            resuming = handler(argc, argv, out) && resume;
+        }
+        length = 0;
+        overflowed = false;
+    }
+};
+
+#endif
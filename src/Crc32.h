@@ -0,0 +1,30 @@
+
+// GAUCHO RACING VDM CRC-32
+// Standard reflected CRC-32 (poly 0xEDB88320, same as zlib), nibble table so it stays small in RAM.
+// Shared with the host tools, so no Arduino dependencies here.
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+static const uint32_t crc32_nibble_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+// continue a CRC over more bytes, start with crc = 0
+inline uint32_t crc32_update(uint32_t crc, const void* data, size_t len){
+    const uint8_t* p = (const uint8_t*)data;
+    crc = ~crc;
+    for(size_t i = 0; i < len; i++){
+        crc ^= p[i];
+        crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+        crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+inline uint32_t crc32(const void* data, size_t len){return crc32_update(0, data, len);}
+
+#endif
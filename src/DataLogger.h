@@ -0,0 +1,313 @@
+
+// GAUCHO RACING VDM DATA LOGGER
+// Samples a list of signals at a fixed rate (up to 1 kHz) into two RAM blocks. While one block
+// fills, the other is encoded a column at a time and streamed to a preallocated contiguous file
+// on the builtin SD card a chunk at a time, so the card never holds up the control loop for more
+// than one chunk. Closing the file is stepped the same way. See LogFormat.h for the file layout.
+#ifndef DATA_LOGGER_H
+#define DATA_LOGGER_H
+
+#include <Arduino.h>
+#include "SD.h"
+#include "LogFormat.h"
+
+// RAM blocks live in OCRAM (RAM2) unless the board has the PSRAM chip fitted
+#if defined(VDM_LOG_EXTMEM)
+    #define LOG_BUFFER_MEM EXTMEM
+#else
+    #define LOG_BUFFER_MEM DMAMEM
+#endif
+
+const uint32_t LOG_CHUNK_SIZE = 1024;               // bytes written to the card per service() call, multiple of 512
+const uint64_t LOG_FILE_SIZE = 512ULL << 20;        // preallocated file size
+const uint32_t LOG_MIN_PERIOD = 1000;               // microseconds, 1 kHz max sample rate
+const uint32_t LOG_OUT_SIZE = (sizeof(LogBlockHeader) + LOG_MAX_PAYLOAD + LOG_SECTOR_SIZE - 1) & ~(LOG_SECTOR_SIZE - 1);
+
+// steps of closing a file, one per service() call once the block before it is on the card
+enum LogCloseStep {LOG_OPEN, LOG_CLOSE_FLUSH, LOG_CLOSE_INDEX, LOG_CLOSE_HEADER, LOG_CLOSE_TRIM};
+
+// a logged signal: name, unit and scale for the self describing file header, and a function
+// returning the decoded value. The scale is the resolution kept in the log, normally the LSB of
+// the Nodes.h decode for that signal.
+struct LogSignal {
+    const char* name;
+    const char* unit;
+    float scale;
+    float (*read)();
+};
+
+// raw samples, column major: column 0 is the time, column 1 + i is signal i
+LOG_BUFFER_MEM int32_t log_raw[2][LOG_MAX_SIGNALS + 1][LOG_BLOCK_SAMPLES];
+// encoded block (or the file header at begin() and end()) waiting for the card
+LOG_BUFFER_MEM uint8_t log_out[LOG_OUT_SIZE] __attribute__((aligned(32)));
+LOG_BUFFER_MEM LogIndexBlock log_index;
+
+struct DataLogger {
+    const LogSignal* signals = nullptr;
+    uint8_t signalCount = 0;
+    uint32_t period = LOG_MIN_PERIOD;
+    float invScale[LOG_MAX_SIGNALS];
+    uint16_t lap = 0;                               // lap number tagged on sealed blocks
+
+    FsFile file;
+    bool active = false;
+    uint8_t filling = 0;                            // raw block being filled by sample()
+    uint16_t fill = 0;                              // samples in the filling block
+    bool pending = false;                           // the other raw block is being encoded / written
+    uint8_t encodeColumn = 0;                       // next column of the pending block to encode
+    uint32_t* encodeEnd = nullptr;
+    const uint8_t* writeSource = nullptr;           // region being streamed to the card
+    uint32_t writeLength = 0;
+    uint32_t writePos = 0;
+    bool writingIndex = false;
+    LogCloseStep closeStep = LOG_OPEN;
+    uint32_t blockOffset = 0;                       // file offset of the block being written
+    uint32_t lastIndex = 0;                         // file offset of the newest index block
+    uint32_t session = 0;
+    uint32_t startTime = 0;
+    uint32_t lastSample = 0;
+    uint32_t seq = 0;
+    uint64_t fileBytes = 0;
+
+    // statistics
+    uint32_t samples = 0;
+    uint32_t dropped = 0;
+    uint32_t blocksWritten = 0;
+    uint32_t writeErrors = 0;
+    uint32_t bytesEncoded = 0;
+    uint32_t lastWriteTime = 0;                     // microseconds for the last chunk
+    uint32_t worstWriteTime = 0;                    // microseconds for the slowest chunk
+
+    // open a new log file and start sampling. SD.begin() must already have succeeded.
+    // @param list signals to log, must outlive the logger
+    // @param count number of signals (at most LOG_MAX_SIGNALS)
+    // @param rate sample rate in Hz (at most 1000)
+    bool begin(const LogSignal* list, uint8_t count, uint16_t rate){
+        if(count == 0 || count > LOG_MAX_SIGNALS || rate == 0) return false;
+        signals = list;
+        signalCount = count;
+        period = 1000000UL / rate;
+        if(period < LOG_MIN_PERIOD) period = LOG_MIN_PERIOD;
+        for(int i = 0; i < count; i++) invScale[i] = 1.0 / list[i].scale;
+
+        char name[16];
+        int n = 0;
+        for(; n < 1000; n++){
+            snprintf(name, sizeof(name), "log%03d.bin", n);
+            if(!SD.exists(name)) break;
+        }
+        file = SD.sdfs.open(name, O_RDWR | O_CREAT | O_TRUNC);
+        if(!file) return false;
+        // contiguous clusters: no FAT lookups or allocation while driving
+        if(!file.preAllocate(LOG_FILE_SIZE)){
+            file.close();
+            return false;
+        }
+
+        startTime = micros();
+        session = startTime ^ ((uint32_t)n << 20) ^ 0x5A5A5A5A;
+        // cleared before fillHeader() stamps the index magic and session
+        memset(&log_index, 0, sizeof(log_index));
+        lastIndex = 0;
+        fillHeader();
+        if(file.write(log_out, LOG_HEADER_SIZE) != LOG_HEADER_SIZE){
+            file.close();
+            return false;
+        }
+        fileBytes = LOG_HEADER_SIZE;
+
+        filling = 0;
+        fill = 0;
+        pending = false;
+        closeStep = LOG_OPEN;
+        active = true;
+        return true;
+    }
+
+    // take a sample if the sample period has elapsed, call every loop
+    void sample(uint32_t now){
+        if(!active || closeStep != LOG_OPEN || now - lastSample < period) return;
+        lastSample = now;
+        if(fill == LOG_BLOCK_SAMPLES){
+            // the card is still busy with the other block, drop rather than wait
+            if(pending){
+                dropped++;
+                return;
+            }
+            sealBlock();
+        }
+        log_raw[filling][0][fill] = (int32_t)now;
+        for(int i = 0; i < signalCount; i++){
+            float count = signals[i].read() * invScale[i];
+            if(count > 2.0e9f) count = 2.0e9f;
+            if(count < -2.0e9f) count = -2.0e9f;
+            log_raw[filling][i + 1][fill] = lroundf(count);
+        }
+        fill++;
+        samples++;
+    }
+
+    // do one step of work on the pending block: encode one column or write one chunk (multiple of 512 bytes),
+    // or one step of closing the file. Call every loop.
+    void service(){
+        if(closeStep != LOG_OPEN && !pending){
+            stepClose();
+            return;
+        }
+        if(!active || !pending) return;
+        if(writeSource == nullptr){
+            encodeStep();
+            return;
+        }
+        uint32_t length = writeLength - writePos;
+        if(length > LOG_CHUNK_SIZE) length = LOG_CHUNK_SIZE;
+        uint32_t start = micros();
+        size_t n = file.write(writeSource + writePos, length);
+        lastWriteTime = micros() - start;
+        if(lastWriteTime > worstWriteTime) worstWriteTime = lastWriteTime;
+        if(n != length){
+            writeErrors++;
+            active = false;
+            pending = false;
+            return;
+        }
+        writePos += n;
+        fileBytes += n;
+        if(writePos < writeLength) return;
+
+        writeSource = nullptr;
+        if(writingIndex){
+            lastIndex = blockOffset;
+            log_index.prevIndex = lastIndex;
+            log_index.count = 0;
+            writingIndex = false;
+            pending = false;
+        }
+        else {
+            blocksWritten++;
+            const LogBlockHeader* h = (const LogBlockHeader*)log_out;
+            LogIndexEntry& e = log_index.entries[log_index.count++];
+            e.offset = blockOffset;
+            e.firstTime = h->firstTime;
+            e.lap = h->lap;
+            e.samples = h->samples;
+            e.seq = h->seq;
+            if(log_index.count == LOG_INDEX_ENTRIES) startIndexWrite();
+            else pending = false;
+        }
+        if(!pending && closeStep == LOG_OPEN && fileBytes + LOG_OUT_SIZE + sizeof(LogIndexBlock) > LOG_FILE_SIZE) close();
+    }
+
+    // stop sampling and close the file over the following service() calls
+    void close(){
+        if(file && closeStep == LOG_OPEN) closeStep = LOG_CLOSE_FLUSH;
+    }
+
+    bool closing() const {return closeStep != LOG_OPEN;}
+
+    // flush what is left, close the index and trim the file to the data written (blocking, for shutdown)
+    void end(){
+        close();
+        while(closing()) service();
+    }
+
+    private:
+    // flush the part block, write the last index, rewrite the file header, then trim and close
+    void stepClose(){
+        switch(closeStep){
+            case LOG_CLOSE_FLUSH:
+                closeStep = LOG_CLOSE_INDEX;
+                if(active && fill > 0 && fileBytes + LOG_OUT_SIZE + sizeof(LogIndexBlock) <= LOG_FILE_SIZE) sealBlock();
+                break;
+            case LOG_CLOSE_INDEX:
+                closeStep = LOG_CLOSE_HEADER;
+                if(active && log_index.count > 0){
+                    pending = true;
+                    startIndexWrite();
+                }
+                break;
+            case LOG_CLOSE_HEADER:
+                closeStep = LOG_CLOSE_TRIM;
+                if(active){
+                    fillHeader();
+                    LogFileHeader* h = (LogFileHeader*)log_out;
+                    h->lastIndex = lastIndex;
+                    h->blocks = blocksWritten;
+                    file.seekSet(0);
+                    file.write(log_out, LOG_HEADER_SIZE);
+                }
+                break;
+            default:
+                active = false;
+                file.truncate(fileBytes);
+                file.close();
+                closeStep = LOG_OPEN;
+                break;
+        }
+    }
+
+    void fillHeader(){
+        memset(log_out, 0, LOG_HEADER_SIZE);
+        LogFileHeader* h = (LogFileHeader*)log_out;
+        h->magic = LOG_FILE_MAGIC;
+        h->version = LOG_VERSION;
+        h->signalCount = signalCount;
+        h->period = period;
+        h->blockSamples = LOG_BLOCK_SAMPLES;
+        h->session = session;
+        h->startTime = startTime;
+        for(int i = 0; i < signalCount; i++){
+            strncpy(h->signals[i].name, signals[i].name, LOG_NAME_LENGTH - 1);
+            strncpy(h->signals[i].unit, signals[i].unit, LOG_UNIT_LENGTH - 1);
+            h->signals[i].scale = signals[i].scale;
+        }
+        log_index.magic = LOG_INDEX_MAGIC;
+        log_index.session = session;
+    }
+
+    void sealBlock(){
+        LogBlockHeader* h = (LogBlockHeader*)log_out;
+        h->magic = LOG_BLOCK_MAGIC;
+        h->session = session;
+        h->seq = seq++;
+        h->firstTime = (uint32_t)log_raw[filling][0][0];
+        h->lap = lap;
+        h->samples = fill;
+        h->crc = 0;
+        encodeColumn = 0;
+        encodeEnd = (uint32_t*)(log_out + sizeof(LogBlockHeader));
+        pending = true;
+        filling ^= 1;
+        fill = 0;
+    }
+
+    // encode one column of the pending raw block, then queue the block for writing
+    void encodeStep(){
+        LogBlockHeader* h = (LogBlockHeader*)log_out;
+        const int32_t* column = log_raw[filling ^ 1][encodeColumn];
+        uint32_t* start = encodeEnd;
+        encodeEnd = log_encode_column(column, h->samples, encodeColumn ? LOG_COL_DELTA : LOG_COL_DELTA2, start);
+        h->crc = crc32_update(h->crc, start, (encodeEnd - start) * sizeof(uint32_t));
+        if(++encodeColumn <= signalCount) return;
+
+        h->payload = (uint8_t*)encodeEnd - (log_out + sizeof(LogBlockHeader));
+        h->size = log_round_sector(sizeof(LogBlockHeader) + h->payload);
+        memset((uint8_t*)encodeEnd, 0, h->size - sizeof(LogBlockHeader) - h->payload);
+        bytesEncoded += h->size;
+        blockOffset = fileBytes;
+        writeSource = log_out;
+        writeLength = h->size;
+        writePos = 0;
+    }
+
+    void startIndexWrite(){
+        for(uint32_t i = log_index.count; i < LOG_INDEX_ENTRIES; i++) memset(&log_index.entries[i], 0, sizeof(LogIndexEntry));
+        blockOffset = fileBytes;
+        writeSource = (const uint8_t*)&log_index;
+        writeLength = sizeof(LogIndexBlock);
+        writePos = 0;
+        writingIndex = true;
+    }
+};
+
+#endif
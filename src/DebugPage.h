@@ -0,0 +1,59 @@
+
+// GAUCHO RACING VDM DEBUG PAGE
+// Text page rendered into a fixed static buffer with snprintf style formatting, then drained to a
+// serial port only as fast as its transmit buffer accepts it, so printing never blocks the loop
+// and never touches the heap. The buffer is passed in so it can live in OCRAM (DMAMEM).
+#ifndef DEBUG_PAGE_H
+#define DEBUG_PAGE_H
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+const size_t DEBUG_PAGE_SIZE = 4096;
+
+struct DebugPage {
+    char* const buf;                                // DEBUG_PAGE_SIZE bytes
+    size_t length = 0;                              // bytes rendered
+    size_t sent = 0;                                // bytes handed to the port
+    uint32_t truncated = 0;                         // pages that did not fit in the buffer
+
+    explicit DebugPage(char* storage) : buf(storage) {}
+
+    void clear(){
+        length = 0;
+        sent = 0;
+    }
+
+    // append formatted text, anything past the end of the buffer is cut off
+    void printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))){
+        if(length >= DEBUG_PAGE_SIZE - 1) return;
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(buf + length, DEBUG_PAGE_SIZE - length, fmt, args);
+        va_end(args);
+        if(n < 0) return;
+        if(length + n >= DEBUG_PAGE_SIZE){
+            length = DEBUG_PAGE_SIZE - 1;
+            truncated++;
+        }
+        else length += n;
+    }
+
+    void println(const char* line){printf("%s\n", line);}
+
+    // still draining the last page
+    bool busy() const {return sent < length;}
+
+    // hand the port as much of the page as it can take without blocking
+    void service(Stream& port){
+        if(!busy()) return;
+        int room = port.availableForWrite();
+        if(room <= 0) return;
+        size_t n = length - sent;
+        if(n > (size_t)room) n = room;
+        sent += port.write((const uint8_t*)buf + sent, n);
+    }
+};
+
+#endif
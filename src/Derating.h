@@ -0,0 +1,104 @@
+
+// GAUCHO RACING VDM DERATING
+// Continuous inverter current ceiling. Each input maps onto a factor that is 1 up to its start point
+// and falls linearly to 0 at its end point: motor, inverter and battery temperature between the
+// tune's warn and limit temperatures, and the lowest cell voltage under load between
+// DERATE_CELL_START and DERATE_CELL_END. The lowest factor scales the ceiling from the active power
+// level's current down to the LIMIT level's, which is where the old binary LIMIT switch went in
+// one step. Beyond the limit temperatures the fault checks take over as before.
+// The ceiling drops at once and recovers at DERATE_RECOVER, also after a power level or tune change;
+// only the first update starts it straight at the target. The inverter only hears about it when it
+// has moved DERATE_STEP or settled back on the power level's current.
+#ifndef DERATING_H
+#define DERATING_H
+
+#include <stdint.h>
+
+const uint32_t DERATE_PERIOD = 10000;               // us between updates
+const float DERATE_STEP = 1.0;                      // A the ceiling moves before it is sent again
+const float DERATE_RECOVER = 20.0;                  // A/s the ceiling may rise
+const float DERATE_CELL_START = 3.30;               // V, lowest cell under load where derating starts
+const float DERATE_CELL_END = 3.00;                 // V, down to the LIMIT current here
+
+// what is holding the ceiling down
+enum DerateCause : uint8_t {DERATE_NONE, DERATE_MOTOR, DERATE_INVERTER, DERATE_BATTERY, DERATE_CELL_VOLTAGE};
+const char* const DERATE_CAUSE_NAMES[] = {"none", "motor temp", "inverter temp", "battery temp", "cell voltage"};
+
+struct DerateInputs {
+    float motorTemp;                                // C
+    float inverterTemp;
+    float batteryTemp;                              // hottest cell
+    float minCellVoltage;                           // V
+    bool cellsValid;                                // minCellVoltage covers every cell
+};
+
+// tune temperatures, derating runs from warn to limit
+struct DerateThresholds {
+    float motorWarn, motorLimit;
+    float inverterWarn, inverterLimit;
+    float batteryWarn, batteryLimit;
+};
+
+// 1 at start, 0 at end, linear between; start may be above end (voltages)
+inline float derate_factor(float x, float start, float end){
+    if(start == end) return x < start ? 1 : 0;      // warn == limit in the tune: a plain step
+    float f = 1 - (x - start) / (end - start);
+    return f < 0 ? 0 : f > 1 ? 1 : f;
+}
+
+struct Derating {
+    float ceiling = 0;                              // A, current ceiling
+    float target = 0;                               // A, ceiling before the recovery slew
+    float factor = 1;                               // lowest input factor
+    DerateCause cause = DERATE_NONE;
+    uint32_t sends = 0;
+
+    // update and resend on the next call, after the power level or tune changed
+    void force(){forced = true;}
+
+    // recompute the ceiling every DERATE_PERIOD
+    // @param now micros()
+    // @param base current of the active power level, A
+    // @param floor current of the LIMIT power level, A
+    // @return true when ceiling should be sent to the inverter
+    bool update(uint32_t now, float base, float floor, const DerateInputs& in, const DerateThresholds& th){
+        uint32_t dt = now - last;
+        if(dt < DERATE_PERIOD && !forced) return false;
+        last = now;
+
+        factor = 1;
+        cause = DERATE_NONE;
+        limitBy(derate_factor(in.motorTemp, th.motorWarn, th.motorLimit), DERATE_MOTOR);
+        limitBy(derate_factor(in.inverterTemp, th.inverterWarn, th.inverterLimit), DERATE_INVERTER);
+        limitBy(derate_factor(in.batteryTemp, th.batteryWarn, th.batteryLimit), DERATE_BATTERY);
+        if(in.cellsValid) limitBy(derate_factor(in.minCellVoltage, DERATE_CELL_START, DERATE_CELL_END), DERATE_CELL_VOLTAGE);
+
+        if(floor > base) floor = base;
+        target = floor + (base - floor) * factor;
+        if(target <= ceiling || sent < 0) ceiling = target;
+        else {
+            float rise = DERATE_RECOVER * dt * 1e-6f;
+            ceiling = (target - ceiling > rise) ? ceiling + rise : target;
+        }
+
+        float moved = ceiling - sent;
+        if(!forced && moved < DERATE_STEP && moved > -DERATE_STEP && (ceiling != base || sent == base)) return false;
+        forced = false;
+        sent = ceiling;
+        sends++;
+        return true;
+    }
+
+    private:
+    uint32_t last = 0;
+    float sent = -1;                                // last value sent, -1 before the first
+    bool forced = true;
+
+    void limitBy(float f, DerateCause c){
+        if(f >= factor) return;
+        factor = f;
+        cause = c;
+    }
+};
+
+#endif
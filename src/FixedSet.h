@@ -0,0 +1,49 @@
+
+// GAUCHO RACING VDM FIXED SET
+// Set with its storage inline, for the active fault, limit and warning lists: no heap. Members keep
+// their insertion order, so begin() is the oldest entry.
+#ifndef FIXED_SET_H
+#define FIXED_SET_H
+
+#include <stdint.h>
+
+template <typename T, uint8_t N>
+struct FixedSet {
+    uint32_t overflows = 0;                         // inserts dropped because the set was full
+
+    // @return false if v is not in the set and there is no room for it
+    bool insert(T v){
+        if(find(v) != end()) return true;
+        if(count == N){
+            overflows++;
+            return false;
+        }
+        items[count++] = v;
+        return true;
+    }
+
+    void erase(T v){
+        T* p = find(v);
+        if(p == end()) return;
+        for(; p + 1 < end(); p++) *p = *(p + 1);
+        count--;
+    }
+
+    T* find(T v){
+        for(T* p = begin(); p < end(); p++) if(*p == v) return p;
+        return end();
+    }
+
+    void clear(){count = 0;}
+    uint8_t size() const {return count;}
+    T* begin(){return items;}
+    T* end(){return items + count;}
+    const T* begin() const {return items;}
+    const T* end() const {return items + count;}
+
+    private:
+    T items[N];
+    uint8_t count = 0;
+};
+
+#endif
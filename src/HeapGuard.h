@@ -0,0 +1,45 @@
+
+// GAUCHO RACING VDM HEAP GUARD
+// The firmware keeps all of its memory static: nothing may allocate once boot has finished. A
+// checked build (pio run -e teensy41_checked) links with -Wl,--wrap=malloc and defines HEAP_CHECK, so
+// every malloc (and operator new, which calls it) goes through here; one after HEAP_GUARD.lock()
+// records its caller and traps, and CrashReport names the culprit on the next boot.
+// In the normal build malloc is not wrapped and lock() only sets the flag.
+#ifndef HEAP_GUARD_H
+#define HEAP_GUARD_H
+
+#include <Arduino.h>
+#include <stdlib.h>
+
+struct HeapGuard {
+    volatile bool locked = false;
+    volatile uint32_t allocations = 0;              // mallocs seen before lock(), checked build only
+    void* volatile caller = nullptr;                // return address of the malloc that trapped
+
+    // end of boot (serviceBoot): from here on any allocation is a bug
+    void lock(){
+        // newlib keeps the dtoa buffers of the first float printf on the heap, take them now
+        char warm[16];
+        snprintf(warm, sizeof(warm), "%.2f", 1.5);
+        locked = true;
+    }
+};
+
+HeapGuard HEAP_GUARD;
+
+#ifdef HEAP_CHECK
+extern "C" {
+void* __real_malloc(size_t size);
+
+void* __wrap_malloc(size_t size){
+    if(HEAP_GUARD.locked){
+        HEAP_GUARD.caller = __builtin_return_address(0);
+        __builtin_trap();
+    }
+    HEAP_GUARD.allocations++;
+    return __real_malloc(size);
+}
+}
+#endif
+
+#endif
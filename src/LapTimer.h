@@ -0,0 +1,202 @@
+
+// GAUCHO RACING VDM LAP TIMER
+// Lap and sector times from GPS fixes. Every fix is projected onto a local plane (metres east and
+// north of the start line) and the segment from the previous fix is tested against the start/finish
+// line and the next sector line; a crossing is timed by interpolating between the two fix times, so
+// the result is not tied to the GPS rate. Lines run from the driver's left to right and only count
+// when crossed forwards; placeLine() lays one across the track at the last fix, square to the
+// direction of travel. With S sector lines a lap has S + 1 sectors, the last ending at the start line.
+#ifndef LAP_TIMER_H
+#define LAP_TIMER_H
+
+#include <stdint.h>
+#include <math.h>
+#include "Crc32.h"
+
+const uint8_t LAP_MAX_SECTORS = 8;                  // sector lines, not counting start/finish
+const float LAP_LINE_HALF_WIDTH = 12;               // m either side of the car when placing a line
+const uint32_t LAP_MIN_TIME = 10000000;             // us, start crossings closer than this are ignored
+const uint32_t LAP_FIX_GAP = 1000000;               // us, fixes further apart do not make a segment
+const uint32_t LAP_LINES_MAGIC = 0x4C50524C;        // "LRPL"
+const double LAP_EARTH_RADIUS = 6371000.0;          // m
+
+struct GeoPoint {
+    double lat, lon;                                // degrees
+};
+
+// a timing line, from the driver's left to right
+struct TimingLine {
+    GeoPoint a, b;
+};
+
+// the lines of one track, kept in EEPROM by main.cpp
+struct LapLines {
+    uint32_t magic = LAP_LINES_MAGIC;
+    uint8_t sectors = 0;                            // sector lines in use
+    uint8_t hasStart = 0;
+    uint8_t reserved[2] = {};                       // no padding inside the CRC
+    TimingLine start;
+    TimingLine sector[LAP_MAX_SECTORS];
+    uint32_t crc = 0;                               // crc32 of everything above
+};
+
+inline uint32_t lap_lines_crc(const LapLines& l){return crc32_update(0, &l, offsetof(LapLines, crc));}
+inline bool lap_lines_check(const LapLines& l){return l.magic == LAP_LINES_MAGIC && l.sectors <= LAP_MAX_SECTORS && l.crc == lap_lines_crc(l);}
+
+struct LapTimer {
+    LapLines lines;
+
+    uint16_t lap = 0;                               // laps started, 0 until the first start crossing
+    uint8_t sector = 0;                             // sector being driven, 0..lines.sectors
+    uint32_t lapStart = 0;                          // VDM micros() of the last start crossing
+    uint32_t lastLap = 0;                           // us, 0 until a lap is complete
+    uint32_t bestLap = 0;
+    uint32_t sectorTime[LAP_MAX_SECTORS + 1] = {};  // us, latest time of each sector
+    uint32_t bestSector[LAP_MAX_SECTORS + 1] = {};
+    uint8_t lastSector = 0;                         // sector completed most recently
+    int32_t sectorDelta = 0;                        // us, lastSector against its best before it, 0 without one
+
+    // set by a crossing, cleared by whoever publishes it
+    bool lapEvent = false;
+    bool sectorEvent = false;
+
+    // statistics
+    uint32_t fixes = 0;
+    uint32_t crossings = 0;
+    uint32_t ignored = 0;                           // start crossings under LAP_MIN_TIME
+
+    // use a new set of lines, timing starts over
+    void setLines(const LapLines& l){
+        lines = l;
+        if(lines.hasStart) setOrigin(lines.start.a);
+        else if(fixes) setOrigin(last);
+        else originSet = false;
+        lap = 0;
+        sector = 0;
+        lastLap = bestLap = 0;
+        for(uint8_t i = 0; i <= LAP_MAX_SECTORS; i++) sectorTime[i] = bestSector[i] = 0;
+        havePrev = false;
+    }
+
+    // lay the start line (or the next sector line) across the track at the last fix
+    // @return false without two recent fixes to take the direction from
+    bool placeLine(bool start){
+        if(!havePrev || (!start && lines.sectors == LAP_MAX_SECTORS)) return false;
+        float hx = prevX - beforeX, hy = prevY - beforeY;
+        float n = sqrtf(hx * hx + hy * hy);
+        if(n < 0.5f) return false;
+        // left of the direction of travel is (-hy, hx)
+        float lx = -hy / n * LAP_LINE_HALF_WIDTH, ly = hx / n * LAP_LINE_HALF_WIDTH;
+        TimingLine line = {toGeo(prevX + lx, prevY + ly), toGeo(prevX - lx, prevY - ly)};
+        LapLines l = lines;
+        if(start){
+            l.start = line;
+            l.hasStart = 1;
+        }
+        else l.sector[l.sectors++] = line;
+        l.crc = lap_lines_crc(l);
+        setLines(l);
+        return true;
+    }
+
+    // one GPS fix
+    // @param t VDM micros() of the fix
+    void fix(uint32_t t, double lat, double lon){
+        fixes++;
+        last = {lat, lon};
+        if(!originSet) setOrigin(last);
+        float x, y;
+        toLocal(last, x, y);
+        if(havePrev && t - prevTime < LAP_FIX_GAP){
+            float s;
+            if(lines.hasStart && crosses(lines.start, x, y, s)) startCrossing(prevTime + (uint32_t)(s * (t - prevTime)));
+            else if(lap && sector < lines.sectors && crosses(lines.sector[sector], x, y, s)) sectorCrossing(prevTime + (uint32_t)(s * (t - prevTime)));
+        }
+        beforeX = prevX;
+        beforeY = prevY;
+        prevX = x;
+        prevY = y;
+        prevTime = t;
+        havePrev = true;
+    }
+
+    // us into the current lap
+    uint32_t lapTime(uint32_t now) const {return lap ? now - lapStart : 0;}
+
+    private:
+    GeoPoint origin = {0, 0};
+    GeoPoint last = {0, 0};
+    double cosLat = 1;
+    float prevX = 0, prevY = 0, beforeX = 0, beforeY = 0;
+    uint32_t prevTime = 0;
+    uint32_t sectorStart = 0;
+    bool havePrev = false;
+    bool originSet = false;
+
+    // local plane around p, close enough that floats keep centimetres
+    void setOrigin(const GeoPoint& p){
+        origin = p;
+        cosLat = cos(origin.lat * M_PI / 180);
+        originSet = true;
+    }
+
+    void toLocal(const GeoPoint& p, float& x, float& y) const {
+        x = (p.lon - origin.lon) * (M_PI / 180) * LAP_EARTH_RADIUS * cosLat;
+        y = (p.lat - origin.lat) * (M_PI / 180) * LAP_EARTH_RADIUS;
+    }
+    GeoPoint toGeo(float x, float y) const {
+        return {origin.lat + y / LAP_EARTH_RADIUS * (180 / M_PI), origin.lon + x / (LAP_EARTH_RADIUS * cosLat) * (180 / M_PI)};
+    }
+
+    // does the segment from the previous fix to (x, y) cross the line forwards
+    // @param s fraction of the segment at the crossing
+    bool crosses(const TimingLine& line, float x, float y, float& s) const {
+        float ax, ay, bx, by;
+        toLocal(line.a, ax, ay);
+        toLocal(line.b, bx, by);
+        float dx = x - prevX, dy = y - prevY;
+        float ex = bx - ax, ey = by - ay;
+        float denom = dx * ey - dy * ex;
+        // forwards across a left to right line is a negative cross product
+        if(denom >= 0) return false;
+        float qx = ax - prevX, qy = ay - prevY;
+        s = (qx * ey - qy * ex) / denom;
+        float u = (qx * dy - qy * dx) / denom;
+        return s >= 0 && s < 1 && u >= 0 && u <= 1;
+    }
+
+    void startCrossing(uint32_t tc){
+        if(lap && tc - lapStart < LAP_MIN_TIME){
+            ignored++;
+            return;
+        }
+        crossings++;
+        if(lap){
+            lastLap = tc - lapStart;
+            if(!bestLap || lastLap < bestLap) bestLap = lastLap;
+            // the last sector only counts when every sector line was crossed
+            if(sector == lines.sectors) completeSector(tc);
+        }
+        lap++;
+        lapStart = sectorStart = tc;
+        sector = 0;
+        lapEvent = true;
+    }
+
+    void sectorCrossing(uint32_t tc){
+        crossings++;
+        completeSector(tc);
+        sector++;
+    }
+
+    void completeSector(uint32_t tc){
+        sectorTime[sector] = tc - sectorStart;
+        sectorDelta = bestSector[sector] ? (int32_t)(sectorTime[sector] - bestSector[sector]) : 0;
+        if(!bestSector[sector] || sectorTime[sector] < bestSector[sector]) bestSector[sector] = sectorTime[sector];
+        lastSector = sector;
+        sectorStart = tc;
+        sectorEvent = true;
+    }
+};
+
+#endif
@@ -0,0 +1,189 @@
+
+// GAUCHO RACING VDM LOG FORMAT
+// Binary on-car log written by DataLogger and read by tools/vdm_logdecode.cpp.
+// Shared with the host tools, so no Arduino dependencies here.
+//
+// File layout (all little endian, every region starts on a 512 byte sector):
+//     LogFileHeader           LOG_HEADER_SIZE bytes, self describing signal table (name, unit, scale)
+//     data block              LogBlockHeader + column payload + zero padding
+//     data block ...
+//     index block             LogIndexBlock, every LOG_INDEX_ENTRIES data blocks, chained backwards
+//     ...
+//
+// Each data block holds up to LOG_BLOCK_SAMPLES samples stored column by column. Every signal is
+// quantized to an int32 count of its scale (the LSB of its Nodes.h decode), delta coded, zigzagged
+// and bit packed with the narrowest width that fits the block. The time column is delta-of-delta
+// coded since it normally only jitters around the sample period.
+//
+// A cleanly closed file has LogFileHeader.lastIndex pointing at the newest index block. If power was
+// cut instead, the reader walks the block headers from the start (LogBlockHeader.size) until the
+// session, sequence or CRC stops matching.
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H
+
+#include <stdint.h>
+#include <string.h>
+#include "Crc32.h"
+
+const uint32_t LOG_FILE_MAGIC = 0x464C5247;         // "GRLF"
+const uint32_t LOG_BLOCK_MAGIC = 0x424C5247;        // "GRLB"
+const uint32_t LOG_INDEX_MAGIC = 0x494C5247;        // "GRLI"
+const uint16_t LOG_VERSION = 2;
+const uint32_t LOG_SECTOR_SIZE = 512;
+const uint32_t LOG_HEADER_SIZE = 2048;              // bytes, multiple of 512
+const uint8_t LOG_MAX_SIGNALS = 32;
+const uint8_t LOG_NAME_LENGTH = 16;
+const uint8_t LOG_UNIT_LENGTH = 8;
+const uint16_t LOG_BLOCK_SAMPLES = 256;
+const uint8_t LOG_INDEX_ENTRIES = 63;               // keeps LogIndexBlock at exactly 1024 bytes
+
+// column coding modes
+const uint8_t LOG_COL_DELTA = 1;
+const uint8_t LOG_COL_DELTA2 = 2;
+
+struct LogSignalInfo {
+    char name[LOG_NAME_LENGTH];
+    char unit[LOG_UNIT_LENGTH];
+    float scale;                                    // physical value = count * scale
+    uint32_t reserved;
+};
+
+struct LogFileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t signalCount;
+    uint8_t reserved;
+    uint32_t period;                                // microseconds between samples
+    uint16_t blockSamples;
+    uint16_t reserved2;
+    uint32_t session;                               // random per file, repeated in every block
+    uint32_t startTime;                             // VDM micros when logging started
+    uint32_t lastIndex;                             // byte offset of the newest index block, 0 if never closed
+    uint32_t blocks;                                // data blocks written, 0 if never closed
+    uint32_t reserved3[6];
+    LogSignalInfo signals[LOG_MAX_SIGNALS];
+};
+
+struct LogBlockHeader {
+    uint32_t magic;
+    uint32_t session;
+    uint32_t seq;                                   // data block number in the file
+    uint32_t firstTime;                             // VDM micros of the first sample
+    uint16_t lap;                                   // lap number when the block was sealed
+    uint16_t samples;
+    uint32_t payload;                               // bytes of column data after this header
+    uint32_t size;                                  // bytes of the whole block including padding
+    uint32_t crc;                                   // CRC-32 of the payload
+};
+
+struct LogIndexEntry {
+    uint32_t offset;                                // byte offset of the data block in the file
+    uint32_t firstTime;
+    uint16_t lap;
+    uint16_t samples;
+    uint32_t seq;
+};
+
+struct LogIndexBlock {
+    uint32_t magic;
+    uint32_t session;
+    uint32_t prevIndex;                             // byte offset of the previous index block, 0 if first
+    uint32_t count;
+    LogIndexEntry entries[LOG_INDEX_ENTRIES];
+};
+
+// worst case payload: every column at full width
+const uint32_t LOG_MAX_PAYLOAD = (LOG_MAX_SIGNALS + 1) * (3 + LOG_BLOCK_SAMPLES) * sizeof(uint32_t);
+
+inline uint32_t log_round_sector(uint32_t bytes){return (bytes + LOG_SECTOR_SIZE - 1) & ~(LOG_SECTOR_SIZE - 1);}
+
+inline uint32_t log_zigzag(int32_t v){return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);}
+inline int32_t log_unzigzag(uint32_t z){return (int32_t)(z >> 1) ^ -(int32_t)(z & 1);}
+
+// encode one column of n >= 1 values into 32 bit words
+// layout: first value | mode + width << 8 | (first delta, DELTA2 only) | packed zigzag residuals
+// @return one past the last word written
+inline uint32_t* log_encode_column(const int32_t* v, uint16_t n, uint8_t mode, uint32_t* out){
+    *out++ = (uint32_t)v[0];
+    uint32_t* modeWord = out++;
+    uint32_t prevDelta = 0;
+    uint16_t start = 1;
+    if(mode == LOG_COL_DELTA2 && n > 1){
+        prevDelta = (uint32_t)v[1] - (uint32_t)v[0];
+        *out++ = prevDelta;
+        start = 2;
+    }
+    // pass 1: width of the widest residual (wrapping arithmetic, so any int32 step fits in 32 bits)
+    uint32_t all = 0;
+    uint32_t d = prevDelta;
+    for(uint16_t i = start; i < n; i++){
+        uint32_t delta = (uint32_t)v[i] - (uint32_t)v[i - 1];
+        all |= log_zigzag((int32_t)(mode == LOG_COL_DELTA2 ? delta - d : delta));
+        d = delta;
+    }
+    uint8_t width = 0;
+    while(width < 32 && (all >> width)) width++;
+    *modeWord = mode | ((uint32_t)width << 8);
+    if(width == 0) return out;
+    // pass 2: pack least significant bit first
+    uint64_t acc = 0;
+    uint8_t bits = 0;
+    d = prevDelta;
+    for(uint16_t i = start; i < n; i++){
+        uint32_t delta = (uint32_t)v[i] - (uint32_t)v[i - 1];
+        acc |= (uint64_t)log_zigzag((int32_t)(mode == LOG_COL_DELTA2 ? delta - d : delta)) << bits;
+        d = delta;
+        bits += width;
+        if(bits >= 32){
+            *out++ = (uint32_t)acc;
+            acc >>= 32;
+            bits -= 32;
+        }
+    }
+    if(bits) *out++ = (uint32_t)acc;
+    return out;
+}
+
+// decode one column written by log_encode_column
+// @return one past the last word read, nullptr if the column would run past end
+inline const uint32_t* log_decode_column(const uint32_t* in, const uint32_t* end, uint16_t n, int32_t* v){
+    if(end - in < 2) return nullptr;
+    v[0] = (int32_t)*in++;
+    uint8_t mode = *in & 0xFF;
+    uint8_t width = (*in++ >> 8) & 0xFF;
+    if(width > 32 || (mode != LOG_COL_DELTA && mode != LOG_COL_DELTA2)) return nullptr;
+    uint32_t d = 0;
+    uint16_t start = 1;
+    if(mode == LOG_COL_DELTA2 && n > 1){
+        if(in >= end) return nullptr;
+        d = *in++;
+        v[1] = (int32_t)((uint32_t)v[0] + d);
+        start = 2;
+    }
+    uint32_t words = (width * (uint32_t)(n > start ? n - start : 0) + 31) / 32;
+    if((uint32_t)(end - in) < words) return nullptr;
+    uint64_t mask = (width == 32) ? 0xFFFFFFFFULL : ((1ULL << width) - 1);
+    uint64_t acc = 0;
+    uint8_t bits = 0;
+    for(uint16_t i = start; i < n; i++){
+        uint32_t z = 0;
+        if(width){
+            if(bits < width){
+                acc |= (uint64_t)*in++ << bits;
+                bits += 32;
+            }
+            z = (uint32_t)(acc & mask);
+            acc >>= width;
+            bits -= width;
+        }
+        uint32_t step = (uint32_t)log_unzigzag(z);
+        if(mode == LOG_COL_DELTA2){
+            d += step;
+            step = d;
+        }
+        v[i] = (int32_t)((uint32_t)v[i - 1] + step);
+    }
+    return in;
+}
+
+#endif
@@ -0,0 +1,98 @@
+
+// GAUCHO RACING VDM MEMORY MONITOR
+// Stack and heap high water marks. paint() fills the free stack (DTCM from the end of .bss up to
+// just below the current stack pointer) with a pattern at boot; service() then checks a few words
+// per call from the bottom up, so the first overwritten word gives the deepest the stack has ever
+// been without ever stalling the loop. The heap (OCRAM, locked once boot finishes, see HeapGuard.h) is read
+// from mallinfo() once a second: bytes in use, peak, and the free bytes and chunks left inside the
+// arena as the fragmentation figure.
+#ifndef MEMORY_MONITOR_H
+#define MEMORY_MONITOR_H
+
+#include <Arduino.h>
+#if defined(__IMXRT1062__)
+#include <malloc.h>
+extern unsigned long _ebss;                         // end of the DTCM globals, bottom of the stack
+extern unsigned long _estack;                       // top of the stack
+#endif
+
+const uint32_t STACK_PAINT = 0xA5A5A5A5;
+const uint16_t STACK_SCAN_WORDS = 256;              // words checked per service() call
+const uint32_t STACK_PAINT_MARGIN = 256;            // bytes left alone below the stack pointer of paint()
+const uint32_t HEAP_PERIOD = 1000;                  // ms between mallinfo() reads
+
+struct MemoryMonitor {
+    uint32_t stackSize = 0;                         // bytes between the end of .bss and the top of the stack
+    uint32_t stackPeak = 0;                         // deepest stack use seen, bytes
+    uint32_t passes = 0;                            // complete scans of the painted region
+
+    uint32_t heapInUse = 0;                         // bytes allocated
+    uint32_t heapPeak = 0;
+    uint32_t heapFree = 0;                          // bytes free inside the arena
+    uint32_t heapFreeChunks = 0;
+    uint32_t heapAtLock = 0;                        // bytes in use when boot finished
+
+    // paint the free stack, first thing in setup()
+    void paint(){
+#if defined(__IMXRT1062__)
+        volatile uint32_t here = 0;
+        bottom = (uint32_t*)(((uintptr_t)&_ebss + 3) & ~3);
+        top = (uint32_t*)&_estack;
+        uint32_t* end = (uint32_t*)(((uintptr_t)&here - STACK_PAINT_MARGIN) & ~3);
+        for(uint32_t* p = bottom; p < end; p++) *p = STACK_PAINT;
+        stackSize = (top - bottom) * sizeof(uint32_t);
+        stackPeak = (top - end) * sizeof(uint32_t);
+        scan = bottom;
+#endif
+    }
+
+    // the heap should not grow from here on
+    void lock(){
+        readHeap();
+        heapAtLock = heapInUse;
+        locked = true;
+    }
+
+    // check the next STACK_SCAN_WORDS words, read the heap once per HEAP_PERIOD
+    // @param now millis()
+    void service(uint32_t now){
+        if(now - lastHeap >= HEAP_PERIOD){
+            lastHeap = now;
+            readHeap();
+        }
+        if(!scan) return;
+        for(uint16_t i = 0; i < STACK_SCAN_WORDS; i++, scan++){
+            if(scan < top && *scan == STACK_PAINT) continue;
+            // first used word from the bottom, or nothing used below the top
+            uint32_t used = (top - scan) * sizeof(uint32_t);
+            if(used > stackPeak) stackPeak = used;
+            scan = bottom;
+            passes++;
+            return;
+        }
+    }
+
+    uint8_t stackPercent() const {return stackSize ? (uint64_t)stackPeak * 100 / stackSize : 0;}
+    bool heapGrew() const {return locked && heapPeak > heapAtLock;}
+
+    private:
+    uint32_t* bottom = nullptr;
+    uint32_t* top = nullptr;
+    uint32_t* scan = nullptr;
+    uint32_t lastHeap = 0;
+    bool locked = false;
+
+    void readHeap(){
+#if defined(__IMXRT1062__)
+        struct mallinfo mi = mallinfo();
+        heapInUse = mi.uordblks;
+        heapFree = mi.fordblks;
+        heapFreeChunks = mi.ordblks;
+        if(heapInUse > heapPeak) heapPeak = heapInUse;
+#endif
+    }
+};
+
+MemoryMonitor MEMORY;
+
+#endif
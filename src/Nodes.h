@@ -10,12 +10,12 @@
 #define NODES
 
 #include "config.h"
+#include "CellStats.h"
 #include <Arduino.h>
 #include <FlexCAN_T4.h>
 #include <SPI.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <unordered_map>
 #define USE_CAN_PRIMARY
 // #define USE_CAN_DATA  
 
@@ -64,7 +64,7 @@ struct Inverter {
         can = Can1;
     }
 
-    bool receive(unsigned long id, byte buf[]){
+    FASTRUN bool receive(unsigned long id, byte buf[]){
         if(id >= DTI_Data_1 && id <= DTI_Data_5){
             byte digit2 = (id >> 8) & 0xF; // 0 for 0x2016, 1 for 0x2116, 2 for 0x2216, 3 for 0x2316, 4 for 0x2416
             receiveTime = millis();
@@ -157,7 +157,7 @@ struct VDM{
         can2 = Can2;
     }
 
-    bool receive(unsigned long id, byte buf[]){
+    FASTRUN bool receive(unsigned long id, byte buf[]){
         if(id >= 0xF0 && id <= 0xF5){
             int row = id-0xF0;
             receiveTime = millis();
@@ -201,35 +201,35 @@ struct VDM{
     bool INVERTER_TEMP_Critical() const {return (data[1][2] & 0b00000100);}
     bool TCM_Failure() const {return (data[1][2] & 0b00000010);}    
 
-    String getMotorHealth() const {
+    const char* getMotorHealth() const {
         if(MOTOR_TEMP_Critical()) return "CRITICAL FAULT";
         else if(MOTOR_TEMP_Limit()) return "THERMAL THROTTLING";
         else if(MOTOR_TEMP_Warning()) return "WARNING";
         else return "OK";
     }
 
-    String getBatteryHealth() const {
+    const char* getBatteryHealth() const {
         if(BATTERY_TEMP_Critical()) return "CRITICAL FAULT";
         else if(BATTERY_TEMP_Limit()) return "THERMAL THROTTLING";
         else if(BATTERY_TEMP_Warning()) return "WARNING";
         else return "OK";
     }
 
-    String getCoolantHealth() const {
+    const char* getCoolantHealth() const {
         if(COOLANT_TEMP_Critical()) return "CRITICAL FAULT";
         else if(COOLANT_TEMP_Limit()) return "THERMAL THROTTLING";
         else if(COOLANT_TEMP_Warning()) return "WARNING";
         else return "OK";
     }
 
-    String getInverterHealth() const {
+    const char* getInverterHealth() const {
         if(INVERTER_TEMP_Critical()) return "CRITICAL FAULT";
         else if(INVERTER_TEMP_Limit()) return "THERMAL THROTTLING";
         else if(INVERTER_TEMP_Warning()) return "WARNING";
         else return "OK";
     }
 
-    String getTCMHealth() const {
+    const char* getTCMHealth() const {
         if(TCM_Failure()) return "CLOUD DATA COMM ERROR";
         else return "OK";
     }
@@ -308,7 +308,7 @@ struct Wheel {
     CAN_message_t msg;
     unsigned long receiveTime = 0;
     unsigned long id_range[2];
-    String loc_cstr;
+    const char* loc_cstr = "";
     Wheel(FlexCAN_T4<CAN_DATA_BUS, RX_SIZE_256, TX_SIZE_16> &can, HubSensorArray loc) : location(loc){
         can = Can2; //set reference
         switch(location){
@@ -338,7 +338,7 @@ struct Wheel {
     }
     
 
-    bool receive(unsigned long id, byte buf[]){
+    FASTRUN bool receive(unsigned long id, byte buf[]){
         if(id >= id_range[0] && id <= id_range[1]){
             // extract row dpending on id and wheel location
             byte row = (id - id_range[0]);
@@ -395,8 +395,8 @@ struct Central_IMU {
         can = Can2;
     }
 
-    bool receive(unsigned long id, byte buf[]){
-        if(id >= 0x10F20 && id <= 0x1022){
+    FASTRUN bool receive(unsigned long id, byte buf[]){
+        if(id >= 0x10F20 && id <= 0x10F22){
             byte digit2 = (id - 0x10F20); 
             receiveTime = millis();
             for(int i = 0; i < 8; i++) data[digit2][i] = buf[i];                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                    
@@ -406,15 +406,16 @@ struct Central_IMU {
         }
         return 1;
     }
-    float getAccelX() const {return ((long)data[0][0] << 8) + data[0][1];}
-    float getAccelY() const {return ((long)data[0][2] << 8) + data[0][3];}
-    float getAccelZ() const {return ((long)data[0][4] << 8) + data[0][5];}
-    float getGyroX() const {return ((long)data[1][0] << 8) + data[1][1];}
-    float getGyroY() const {return ((long)data[1][2] << 8) + data[1][3];}
-    float geti() const {return ((long)data[1][4] << 8) + data[1][5];}
-    float getMagX() const {return ((long)data[2][0] << 8) + data[2][1];}  
-    float getMagY() const {return ((long)data[2][2] << 8) + data[2][3];}
-    float getMagZ() const {return ((long)data[2][4] << 8) + data[2][5];}
+    // raw signed 16 bit counts, see the IMU scales in main.cpp
+    float getAccelX() const {return (int16_t)((data[0][0] << 8) | data[0][1]);}
+    float getAccelY() const {return (int16_t)((data[0][2] << 8) | data[0][3]);}
+    float getAccelZ() const {return (int16_t)((data[0][4] << 8) | data[0][5]);}
+    float getGyroX() const {return (int16_t)((data[1][0] << 8) | data[1][1]);}
+    float getGyroY() const {return (int16_t)((data[1][2] << 8) | data[1][3]);}
+    float getGyroZ() const {return (int16_t)((data[1][4] << 8) | data[1][5]);}
+    float getMagX() const {return (int16_t)((data[2][0] << 8) | data[2][1]);}
+    float getMagY() const {return (int16_t)((data[2][2] << 8) | data[2][3]);}
+    float getMagZ() const {return (int16_t)((data[2][4] << 8) | data[2][5]);}
     
     unsigned long getAge() const {return(millis() - receiveTime);} //time since last data packet
 
@@ -431,8 +432,8 @@ struct GPS {
         can = Can2;
     }
 
-    bool receive(unsigned long id, byte buf[]){
-        if(id >= 0x10F23 && id <= 0x10F6){
+    FASTRUN bool receive(unsigned long id, byte buf[]){
+        if(id >= 0x10F23 && id <= 0x10F26){
             byte digit2 = (id - 0x10F23); 
             receiveTime = millis();
             for(int i = 0; i < 8; i++) data[digit2][i] = buf[i];                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                    
@@ -449,8 +450,15 @@ struct GPS {
     float getHighPrecisionLongitude() const {return ((long)data[1][4] << 24) + ((long)data[1][5] << 16) + ((long)data[1][6] << 8) + data[1][7];}
     unsigned long getAge() const {return(millis() - receiveTime);} //time since last data packet
 
+    // degrees, taking the u-blox HPPOSLLH layout: signed 1e-7 deg plus a signed 1e-9 deg high precision part
+    double getLatitudeDeg() const {return word(0, 0) * 1e-7 + word(0, 4) * 1e-9;}
+    double getLongitudeDeg() const {return word(1, 0) * 1e-7 + word(1, 4) * 1e-9;}
+
     //rest of the data is still undecided.
 
+    private:
+    int32_t word(uint8_t row, uint8_t at) const {return (int32_t)(((uint32_t)data[row][at] << 24) | ((uint32_t)data[row][at + 1] << 16) | ((uint32_t)data[row][at + 2] << 8) | data[row][at + 3]);}
+
 };
 
 
@@ -465,7 +473,7 @@ struct Pedals{
         can = Can1; //Is this right? //Fucked?
     }
 
-    bool receive(unsigned long id, byte buf[]){
+    FASTRUN bool receive(unsigned long id, byte buf[]){
         if(id == Pedals_Inputs || id == Pedals_Ping_Response){
             receiveTime = millis();
             for(int i = 0; i < 8; i++) data[id - Pedals_Inputs][i] = buf[i];
@@ -519,16 +527,20 @@ struct ACU {
     CAN_message_t msg;
     uint32_t receiveTime = 0;
     int range_cell_data[2] = {Charging_Cart_Config, Condensed_Cell_Temp_n134};
+    CellStats cellVoltages;                         // updated as each Condensed_Cell_Voltage frame lands
+    CellStats cellTemps;
     
     ACU(FlexCAN_T4<CAN_PRIMARY_BUS, RX_SIZE_256, TX_SIZE_16> &can){
         can = Can1;
     }
 
-    bool receive(unsigned long id, byte buf[]){
+    FASTRUN bool receive(unsigned long id, byte buf[]){
         if(id >= ACU_General && id <= Condensed_Cell_Temp_n134){
             uint32_t row = id - ACU_General;
             receiveTime = millis();
             for(size_t i = 0; i < 8; i++) data[row][i] = buf[i];
+            if(id >= Condensed_Cell_Voltage_n0 && id <= Condensed_Cell_Voltage_n120) cellVoltages.update(id - Condensed_Cell_Voltage_n0, buf);
+            else if(id >= Condensed_Cell_Temp_n0 && id <= Condensed_Cell_Temp_n120) cellTemps.update(id - Condensed_Cell_Temp_n0, buf);
         }
         else if(id == ACU_Ping_Response) {
             receiveTime = millis();
@@ -541,20 +553,32 @@ struct ACU {
         }
         return 1;
     }
-    //voltages and temps for specific cells (range 0 to 127)
+    //voltages and temps for specific cells (range 0 to 127, NAN outside)
     float getCellVoltage_n(size_t cell_n) const {
-        if(cell_n < 0 || cell_n > 127) Serial.println("Battery Cell number out of range [0,127]");
+        if(cell_n >= CELL_COUNT) return NAN;
         size_t col = cell_n % 8;
         size_t row = cell_n / 8 + 11;
         return 2.0 + (0.01 * data[row][col]);
     }
-    float getCellTemp_n(int cell_n) const {
-        if(cell_n < 0 || cell_n > 127) Serial.println("Battery Cell number out of range [0,127]");
+    float getCellTemp_n(size_t cell_n) const {
+        if(cell_n >= CELL_COUNT) return NAN;
         size_t col = cell_n % 8;
         size_t row = cell_n / 8 + 29;
         return (0.25 * data[row][col]) + 10;
     }
 
+    //pack cell statistics, over the condensed frames received so far
+    float getMinCellVoltage() const {return 2.0 + 0.01 * cellVoltages.min;}
+    float getMaxCellVoltage() const {return 2.0 + 0.01 * cellVoltages.max;}
+    float getMeanCellVoltage() const {return 2.0 + 0.01 * cellVoltages.mean();}
+    float getCellVoltageImbalance() const {return 0.01 * cellVoltages.spread();}
+    uint8_t getLowestCell() const {return cellVoltages.minCell;}
+    float getMinCellTemp() const {return 0.25 * cellTemps.min + 10;}
+    float getHottestCellTemp() const {return 0.25 * cellTemps.max + 10;}
+    float getMeanCellTemp() const {return 0.25 * cellTemps.mean() + 10;}
+    float getCellTempImbalance() const {return 0.25 * cellTemps.spread();}
+    uint8_t getHottestCell() const {return cellTemps.maxCell;}
+
     //ACU General
     float getAccumulatorVoltage() const {return 0.01 * (((uint16_t)data[0][0] << 8) + data[0][1]);}
     float getAccumulatorCurrent() const {return 0.01 * (int16_t(uint16_t(data[0][2]) << 8) + data[0][3]);}
@@ -670,7 +694,7 @@ struct TCM {//FIX THIS STUFF (NOT TOO IMPORTANT)
         can = Can2;
     }
 
-    bool receive(unsigned long id, byte buf[]){
+    FASTRUN bool receive(unsigned long id, byte buf[]){
         if(id == 0x12000){
             receiveTime = millis();
             for(int i = 0; i < 8; i++) data[i] = buf[i];
@@ -697,7 +721,7 @@ struct Dash {
         can = Can1;
     }
 
-    bool receive(unsigned long id, byte buf[]){
+    FASTRUN bool receive(unsigned long id, byte buf[]){
         if(id >= Dash_Panel_Ping_Response && id <= Button_Event){
             receiveTime = millis();
             for(int i = 0; i < 8; i++) data[id-Dash_Panel_Ping_Response][i] = buf[i];
@@ -725,20 +749,41 @@ struct Dash {
 
 
 
+// the energy meter sends its words bit reversed, RBIT undoes that in one cycle
+inline uint32_t bit_reverse32(uint32_t x){
+#if defined(__ARM_ARCH_7EM__)
+    uint32_t r;
+    asm("rbit %0, %1" : "=r"(r) : "r"(x));
+    return r;
+#else
+    x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+    x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F) | ((x & 0x0F0F0F0F) << 4);
+    x = ((x >> 8) & 0x00FF00FF) | ((x & 0x00FF00FF) << 8);
+    return (x >> 16) | (x << 16);
+#endif
+}
+
 struct Energy_Meter {
     byte data[2][8];
     FlexCAN_T4<CAN_PRIMARY_BUS, RX_SIZE_256, TX_SIZE_16> Can1;
     CAN_message_t msg;
     unsigned long receiveTime = 0;
+    uint32_t sampleTime = 0;                        // micros() of the last current/voltage frame
+    float current = 0;                              // decoded once per frame
+    float voltage = 0;
 
     Energy_Meter(FlexCAN_T4<CAN_PRIMARY_BUS, RX_SIZE_256, TX_SIZE_16> &can){
         can = Can1;
     }
 
-    bool receive(unsigned long id, byte buf[]){
+    FASTRUN bool receive(unsigned long id, byte buf[]){
         if(id == 0x100){
             receiveTime = millis();
+            sampleTime = micros();
             for(int i = 0; i < 8; i++) data[0][i] = buf[i];
+            current = 0.000015258789063 * LSB_to_MSB(((uint32_t)data[0][0] << 24) | ((uint32_t)data[0][1] << 16) | ((uint32_t)data[0][2] << 8) | data[0][3]);
+            voltage = 0.000015258789063 * LSB_to_MSB(((uint32_t)data[0][4] << 24) | ((uint32_t)data[0][5] << 16) | ((uint32_t)data[0][6] << 8) | data[0][7]);
         }
         else if(id == 0x400){
             receiveTime = millis();
@@ -749,24 +794,15 @@ struct Energy_Meter {
         }
         return 1;
     }
-    long LSB_to_MSB(long LSB) const{
-        long MSB=0;
-        for(int i=0; i<32; i++){
-            MSB |= (((LSB >> i) & 1) << (31-i));
-        }
-        return MSB;
-    }
+    // signed 32 bit value from a bit reversed word
+    int32_t LSB_to_MSB(uint32_t LSB) const {return (int32_t)bit_reverse32(LSB);}
 
-    byte LSB_to_MSB2(byte LSB) const{//This is so fucked up
-        byte MSB=0;
-        for(int i=0; i<4; i++){
-            MSB |= (((LSB >> i) & 1) << (3-i));
-        }
-        return MSB;
-    }
+    // 4 bit gain fields are reversed too
+    byte LSB_to_MSB2(byte LSB) const {return bit_reverse32(LSB) >> 28;}
 
-    float getCurrent() const {return 0.000015258789063 * LSB_to_MSB(((long)data[0][0] << 24) + ((long)data[0][1] << 16) + ((long)data[0][2] << 8) + (long)data[0][3]);}
-    float getVoltage() const {return 0.000015258789063 * LSB_to_MSB(((long)data[0][4] << 24) + ((long)data[0][5] << 16) + ((long)data[0][6] << 8) + (long)data[0][7]);}
+    float getCurrent() const {return current;}
+    float getVoltage() const {return voltage;}
+    uint32_t getSampleTime() const {return sampleTime;}
     byte getVoltageGain() const {return LSB_to_MSB2(data[1][0] & 0b00001111);}//THESE ARE SO FUCKED
     byte getCurrentGain() const {return LSB_to_MSB2(data[1][0] >> 4);}//THESE ARE SO FUCKED
     bool getOverVoltage() const {return data[1][1] & 0b00000001;}
@@ -790,12 +826,12 @@ struct SteeringWheel {
         can = Can1;
     }
 
-    bool receive(unsigned long id, byte buf[]){
+    FASTRUN bool receive(unsigned long id, byte buf[]){
         if(id == Data_to_VDM){
             receiveTime = millis();
             for(int i = 0; i < 8; i++) data[0][i] = buf[i];
         }
-        if(id == Steering_Wheel_Ping_Response){
+        else if(id == Steering_Wheel_Ping_Response){
             receiveTime = millis();
             for(int i = 0; i < 8; i++) data[1][i] = buf[i];
         }
@@ -0,0 +1,100 @@
+
+// GAUCHO RACING VDM POWER CAP
+// Keeps accumulator power under the FSAE 80 kW limit. Every DC voltage/current frame (energy meter,
+// or the ACU while the meter is silent) updates the measured power, its trend and a learnt plant gain
+// (watts per percent of relative current). Before each torque command the next period's power is
+// predicted for the requested command,
+//     P(r) = P + gain * (r - r_last) + max(trend, 0) * period
+// and the command is cut to the r where that prediction meets the cap less POWER_CAP_MARGIN. With no
+// fresh sample the request passes through: the cap cannot act on data it does not have, and stale
+// samples are counted. Violations are samples measured above the cap; latency is the time from the
+// sample to the command it limited.
+#ifndef POWER_CAP_H
+#define POWER_CAP_H
+
+#include <stdint.h>
+
+const float POWER_CAP_W = 80000;                    // FSAE EV accumulator power limit
+const float POWER_CAP_MARGIN = 2000;                // W the controller aims below the cap
+const uint32_t POWER_STALE = 100000;                // us before a power sample is too old to act on
+const float POWER_GAIN_INIT = POWER_CAP_W / 100;    // W per % before the first measurement
+const float POWER_GAIN_MIN_COMMAND = 5;             // % command below which the gain is not learnt
+const float POWER_GAIN_FILTER = 0.2;                // weight of a new gain measurement
+
+struct PowerCap {
+    float power = 0;                                // W, last measured
+    float trend = 0;                                // W/s between the last two samples
+    float gain = POWER_GAIN_INIT;                   // W per % of relative current
+    float predicted = 0;                            // W predicted for the last command
+    float command = 0;                              // % last command after the cap
+    bool limiting = false;                          // the last command was cut
+
+    // statistics
+    float peak = 0;
+    uint32_t samples = 0;
+    uint32_t violations = 0;                        // samples above POWER_CAP_W
+    uint32_t staleCommands = 0;                     // commands passed through for lack of data
+    uint32_t latency = 0;                           // us from the sample to the command it limited
+    uint32_t worstLatency = 0;
+
+    // take one DC bus measurement
+    // @param t micros() at frame arrival
+    void sample(uint32_t t, float voltage, float current){
+        float p = voltage * current;
+        uint32_t dt = t - sampleTime;
+        trend = (samples && dt > 0) ? (p - power) * 1e6f / dt : 0;
+        power = p;
+        sampleTime = t;
+        samples++;
+        fresh = true;
+        if(p > peak) peak = p;
+        if(p > POWER_CAP_W) violations++;
+        // learn only while commands are flowing through apply()
+        bool live = t - lastApply <= 2 * lastPeriod;
+        if(live && command > POWER_GAIN_MIN_COMMAND && p > 0) gain += POWER_GAIN_FILTER * (p / command - gain);
+        if(gain < 1) gain = 1;
+    }
+
+    // cap a relative current request for the next command period
+    // @param now micros()
+    // @param request % of the inverter's max current
+    // @param period us until the next command
+    float apply(uint32_t now, float request, uint32_t period){
+        // out of drive_active for a while, the inverter has been held at zero
+        if(now - lastApply > 2 * period) command = 0;
+        lastApply = now;
+        lastPeriod = period;
+        if(!samples || now - sampleTime > POWER_STALE){
+            staleCommands++;
+            limiting = false;
+            command = request;
+            return request;
+        }
+        float drift = (trend > 0 ? trend : 0) * period * 1e-6f;
+        predicted = power + gain * (request - command) + drift;
+        float target = POWER_CAP_W - POWER_CAP_MARGIN;
+        float out = request;
+        limiting = predicted > target;
+        if(limiting){
+            out = command + (target - power - drift) / gain;
+            if(out < 0) out = 0;
+            if(out > request) out = request;
+            predicted = power + gain * (out - command) + drift;
+        }
+        if(fresh){
+            latency = now - sampleTime;
+            if(latency > worstLatency) worstLatency = latency;
+            fresh = false;
+        }
+        command = out;
+        return out;
+    }
+
+    private:
+    uint32_t sampleTime = 0;
+    uint32_t lastApply = 0;
+    uint32_t lastPeriod = 0;
+    bool fresh = false;                             // a sample arrived since the last command
+};
+
+#endif
@@ -0,0 +1,90 @@
+
+// GAUCHO RACING VDM STATE OF CHARGE
+// VDM side state of charge and energy used. Energy meter current is integrated every SOC_PERIOD
+// with the real microsecond dt between updates; stale meter data (no frame for SOC_STALE) is not
+// integrated. Coulomb counting drifts, so whenever the pack has rested below SOC_REST_CURRENT for
+// SOC_REST_TIME the estimate is pulled toward the SOC the mean cell voltage reads on the OCV table,
+// with time constant SOC_OCV_TAU. The first complete set of cell voltages seeds the estimate.
+// Current is positive out of the pack.
+#ifndef SOC_ESTIMATOR_H
+#define SOC_ESTIMATOR_H
+
+#include <stdint.h>
+
+const uint32_t SOC_PERIOD = 1000;                   // us between integration steps
+const uint32_t SOC_STALE = 100000;                  // us without a meter frame before integration stops
+const float SOC_CAPACITY_AH = 14.0;                 // pack capacity, check against a full charge/discharge
+const float SOC_NOMINAL_VOLTAGE = 128 * 3.6;        // 128s pack, for the remaining Wh figure
+const float SOC_REST_CURRENT = 2.0;                 // A, below this the cells relax toward OCV
+const uint32_t SOC_REST_TIME = 5000000;             // us of rest before the OCV reading is trusted
+const float SOC_OCV_TAU = 30.0;                     // s, time constant of the OCV correction
+
+// open circuit cell voltage at 0, 10, ... 100 % SOC
+const uint8_t SOC_OCV_POINTS = 11;
+const float SOC_OCV_TABLE[SOC_OCV_POINTS] = {3.00, 3.45, 3.55, 3.62, 3.68, 3.74, 3.80, 3.87, 3.95, 4.05, 4.20};
+
+// SOC (0..1) for an open circuit cell voltage
+inline float soc_from_ocv(float v){
+    if(v <= SOC_OCV_TABLE[0]) return 0;
+    for(uint8_t i = 1; i < SOC_OCV_POINTS; i++){
+        if(v < SOC_OCV_TABLE[i]) return (i - 1 + (v - SOC_OCV_TABLE[i - 1]) / (SOC_OCV_TABLE[i] - SOC_OCV_TABLE[i - 1])) / (SOC_OCV_POINTS - 1);
+    }
+    return 1;
+}
+
+struct SocEstimator {
+    float soc = 0;                                  // 0..1
+    float chargeUsed = 0;                           // Ah out of the pack since boot, regen counts back
+    float energyUsed = 0;                           // Wh
+    bool seeded = false;                            // soc has had a first OCV reading
+
+    // statistics
+    uint32_t steps = 0;
+    uint32_t staleSteps = 0;                        // steps skipped for stale meter data
+    uint32_t corrections = 0;                       // steps with the OCV correction applied
+
+    // integrate one step if SOC_PERIOD has elapsed, call every loop
+    // @param now micros()
+    // @param current, voltage latest energy meter reading, A and V
+    // @param sampleTime micros() of that reading
+    // @param cellVoltage mean cell voltage, V
+    // @param cellsValid every cell voltage has arrived at least once
+    void update(uint32_t now, float current, float voltage, uint32_t sampleTime, float cellVoltage, bool cellsValid){
+        uint32_t dt = now - last;
+        if(dt < SOC_PERIOD) return;
+        last = now;
+        if(!seeded){
+            if(!cellsValid) return;
+            soc = soc_from_ocv(cellVoltage);
+            seeded = true;
+            restSince = now;
+            return;
+        }
+        steps++;
+        if(now - sampleTime > SOC_STALE){
+            staleSteps++;
+            return;
+        }
+        float hours = dt * (1.0f / 3600e6f);
+        chargeUsed += current * hours;
+        energyUsed += current * voltage * hours;
+        soc -= current * hours / SOC_CAPACITY_AH;
+
+        bool resting = current < SOC_REST_CURRENT && current > -SOC_REST_CURRENT;
+        if(!resting) restSince = now;
+        else if(cellsValid && now - restSince >= SOC_REST_TIME){
+            soc += (soc_from_ocv(cellVoltage) - soc) * (dt * 1e-6f / SOC_OCV_TAU);
+            corrections++;
+        }
+        if(soc < 0) soc = 0;
+        if(soc > 1) soc = 1;
+    }
+
+    float remainingWh() const {return soc * SOC_CAPACITY_AH * SOC_NOMINAL_VOLTAGE;}
+
+    private:
+    uint32_t last = 0;
+    uint32_t restSince = 0;
+};
+
+#endif
@@ -0,0 +1,125 @@
+
+// GAUCHO RACING VDM TELEMETRY
+// Streams a selection of the logged signals and the vehicle state over the USB serial port at a
+// fixed rate as COBS framed binary packets (see TelemetryFormat.h). Frames are built into a static
+// buffer and drained only as fast as the port accepts them, the same way DebugPage is. Console
+// replies and status notes share the stream as text packets.
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include "DataLogger.h"
+#include "TelemetryFormat.h"
+
+// frame buffers in OCRAM next to the logger blocks, the control loop never reads them
+DMAMEM uint8_t tlm_packet_buf[TLM_MAX_PACKET];
+DMAMEM uint8_t tlm_frame_buf[TLM_MAX_FRAME];
+
+struct TelemetryStream {
+    const LogSignal* signals = nullptr;
+    uint8_t selected[TLM_MAX_SIGNALS];              // indices into signals
+    uint8_t signalCount = 0;
+    uint32_t period = 10000;                        // microseconds between data packets
+    uint16_t descriptorEvery = 100;                 // data packets between descriptors
+
+    size_t length = 0;                              // bytes in frame
+    size_t sent = 0;                                // bytes handed to the port
+    uint32_t lastPacket = 0;
+    uint16_t sinceDescriptor = 0;
+    char text[TLM_MAX_TEXT];                        // console reply waiting for a gap in the stream
+    size_t textLength = 0;
+
+    // statistics
+    uint32_t seq = 0;                               // data packets generated
+    uint32_t packets = 0;                           // data packets sent
+    uint32_t overruns = 0;                          // data packets skipped, port still busy
+
+    // @param list signal table, normally the logger's, must outlive the stream
+    // @param count number of entries in list
+    // @param mask bit i selects list[i]
+    // @param rate data packets per second
+    void begin(const LogSignal* list, uint8_t count, uint32_t mask, uint16_t rate){
+        signals = list;
+        signalCount = 0;
+        for(uint8_t i = 0; i < count && i < 32 && signalCount < TLM_MAX_SIGNALS; i++){
+            if(mask & (1UL << i)) selected[signalCount++] = i;
+        }
+        period = 1000000UL / (rate ? rate : 1);
+        descriptorEvery = rate ? rate : 1;
+        sinceDescriptor = descriptorEvery;          // describe the stream first
+        // lone delimiter ends any boot text already on the port, so the first descriptor decodes
+        tlm_frame_buf[0] = 0;
+        length = 1;
+        sent = 0;
+    }
+
+    bool busy() const {return sent < length;}
+
+    // queue text (console replies, status notes), appended to what is waiting and sent ahead of the
+    // next data packet
+    // @return bytes taken, fewer than len once the text buffer is full
+    size_t sendText(const char* t, size_t len){
+        if(len > TLM_MAX_TEXT - textLength) len = TLM_MAX_TEXT - textLength;
+        memcpy(text + textLength, t, len);
+        textLength += len;
+        return len;
+    }
+
+    // build the next packet when due and push as much as the port takes, call every loop
+    void service(Stream& port, uint32_t now, TelemetryStatus status){
+        if(signals == nullptr) return;
+        if(now - lastPacket >= period){
+            lastPacket = now;
+            if(busy()) {
+                seq++;                              // the host sees the gap
+                overruns++;
+            }
+            else if(sinceDescriptor >= descriptorEvery){
+                buildDescriptor(now);
+                sinceDescriptor = 0;
+            }
+            else {
+                buildData(now, status);
+                sinceDescriptor++;
+            }
+        }
+        if(!busy() && textLength){
+            size_t n = tlm_text_packet(tlm_packet_buf, seq, now, text, textLength);
+            length = tlm_frame(tlm_packet_buf, n, tlm_frame_buf);
+            sent = 0;
+            textLength = 0;
+        }
+        if(!busy()) return;
+        int room = port.availableForWrite();
+        if(room <= 0) return;
+        size_t n = length - sent;
+        if(n > (size_t)room) n = room;
+        sent += port.write(tlm_frame_buf + sent, n);
+    }
+
+    private:
+    void buildData(uint32_t now, TelemetryStatus status){
+        float values[TLM_MAX_SIGNALS];
+        for(uint8_t i = 0; i < signalCount; i++) values[i] = signals[selected[i]].read();
+        size_t n = tlm_data_packet(tlm_packet_buf, seq++, now, status, values, signalCount);
+        length = tlm_frame(tlm_packet_buf, n, tlm_frame_buf);
+        sent = 0;
+        packets++;
+    }
+
+    void buildDescriptor(uint32_t now){
+        const char* names[TLM_MAX_SIGNALS];
+        const char* units[TLM_MAX_SIGNALS];
+        float scales[TLM_MAX_SIGNALS];
+        for(uint8_t i = 0; i < signalCount; i++){
+            names[i] = signals[selected[i]].name;
+            units[i] = signals[selected[i]].unit;
+            scales[i] = signals[selected[i]].scale;
+        }
+        size_t n = tlm_descriptor_packet(tlm_packet_buf, seq, now, names, units, scales, signalCount);
+        length = tlm_frame(tlm_packet_buf, n, tlm_frame_buf);
+        sent = 0;
+    }
+};
+
+#endif
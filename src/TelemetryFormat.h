@@ -0,0 +1,164 @@
+
+// GAUCHO RACING VDM TELEMETRY FORMAT
+// Binary telemetry streamed on the USB serial port and read by tools/vdm_telemetry.cpp.
+// Shared with the host tools, so no Arduino dependencies here.
+//
+// Every packet is COBS encoded and terminated by a 0x00 byte, so a reader can join the stream at
+// any point and resynchronise on the next zero. Decoded packet (little endian):
+//     TelemetryHeader         type, version, signal count, sequence number, VDM micros
+//     payload                 TLM_DATA: TelemetryStatus, then one float per signal
+//                             TLM_DESCRIPTOR: per signal: scale (float), name\0, unit\0
+//                             TLM_TEXT: console reply text, no terminator
+//     CRC-32                  of header + payload
+//
+// The sequence number counts every data packet the VDM generated, including the ones it skipped
+// because the port was still busy, so a gap on the host covers drops on either side. Descriptors
+// repeat about once a second and carry the sequence number of the next data packet.
+#ifndef TELEMETRY_FORMAT_H
+#define TELEMETRY_FORMAT_H
+
+#include <stdint.h>
+#include <string.h>
+#include "Crc32.h"
+
+const uint8_t TLM_DATA = 0x01;
+const uint8_t TLM_DESCRIPTOR = 0x02;
+const uint8_t TLM_TEXT = 0x03;
+const uint8_t TLM_VERSION = 1;
+const uint8_t TLM_MAX_SIGNALS = 32;
+const uint16_t TLM_MAX_PACKET = 1024;                             // decoded bytes including the CRC
+const uint16_t TLM_MAX_TEXT = 512;                                // bytes of text per packet
+const uint16_t TLM_MAX_FRAME = TLM_MAX_PACKET + TLM_MAX_PACKET / 254 + 2;   // COBS overhead + delimiter
+
+// status flags
+const uint8_t TLM_FLAG_FAULT = 0x01;
+const uint8_t TLM_FLAG_LIMIT = 0x02;
+const uint8_t TLM_FLAG_LOGGING = 0x04;
+const uint8_t TLM_FLAG_TRACTION = 0x08;                           // traction control is cutting torque
+
+struct TelemetryHeader {
+    uint8_t type;
+    uint8_t version;
+    uint8_t signalCount;
+    uint8_t reserved;
+    uint32_t seq;
+    uint32_t time;                                                // VDM micros when the packet was built
+};
+
+struct TelemetryStatus {
+    uint8_t state;
+    uint8_t mode;
+    uint8_t powerLevel;
+    uint8_t flags;
+};
+
+// COBS encode len bytes into out (len + len / 254 + 1 bytes), no delimiter
+// @return bytes written
+inline size_t cobs_encode(const uint8_t* in, size_t len, uint8_t* out){
+    size_t codeAt = 0;
+    size_t o = 1;
+    uint8_t code = 1;
+    for(size_t i = 0; i < len; i++){
+        if(in[i] == 0){
+            out[codeAt] = code;
+            codeAt = o++;
+            code = 1;
+            continue;
+        }
+        out[o++] = in[i];
+        if(++code == 0xFF){
+            out[codeAt] = code;
+            codeAt = o++;
+            code = 1;
+        }
+    }
+    out[codeAt] = code;
+    return o;
+}
+
+// decode one COBS frame (without the delimiter) into out (cap bytes)
+// @return decoded length, -1 if the frame is malformed or decodes to more than cap bytes
+inline int cobs_decode(const uint8_t* in, size_t len, uint8_t* out, size_t cap){
+    size_t i = 0;
+    size_t o = 0;
+    while(i < len){
+        uint8_t code = in[i++];
+        if(code == 0 || i + code - 1 > len) return -1;
+        for(uint8_t k = 1; k < code; k++){
+            if(in[i] == 0 || o >= cap) return -1;
+            out[o++] = in[i++];
+        }
+        if(code != 0xFF && i < len){
+            if(o >= cap) return -1;
+            out[o++] = 0;
+        }
+    }
+    return (int)o;
+}
+
+// append the CRC to a packet of len bytes (needs 4 spare bytes), COBS encode it into frame
+// (TLM_MAX_FRAME bytes) and terminate it
+// @return frame length including the delimiter
+inline size_t tlm_frame(uint8_t* packet, size_t len, uint8_t* frame){
+    uint32_t crc = crc32(packet, len);
+    memcpy(packet + len, &crc, sizeof(crc));
+    size_t n = cobs_encode(packet, len + sizeof(crc), frame);
+    frame[n++] = 0;
+    return n;
+}
+
+// decode and check one frame (without the delimiter) into packet (TLM_MAX_PACKET bytes)
+// @return packet length without the CRC, -1 if the frame is malformed or corrupt
+inline int tlm_unframe(const uint8_t* frame, size_t len, uint8_t* packet){
+    if(len == 0 || len > TLM_MAX_FRAME) return -1;
+    int n = cobs_decode(frame, len, packet, TLM_MAX_PACKET);
+    if(n < (int)(sizeof(TelemetryHeader) + sizeof(uint32_t))) return -1;
+    n -= sizeof(uint32_t);
+    uint32_t crc;
+    memcpy(&crc, packet + n, sizeof(crc));
+    if(crc != crc32(packet, n)) return -1;
+    return n;
+}
+
+// build a data packet into packet (TLM_MAX_PACKET bytes)
+// @return packet length without the CRC
+inline size_t tlm_data_packet(uint8_t* packet, uint32_t seq, uint32_t time, TelemetryStatus status, const float* values, uint8_t count){
+    TelemetryHeader h = {TLM_DATA, TLM_VERSION, count, 0, seq, time};
+    memcpy(packet, &h, sizeof(h));
+    memcpy(packet + sizeof(h), &status, sizeof(status));
+    memcpy(packet + sizeof(h) + sizeof(status), values, count * sizeof(float));
+    return sizeof(h) + sizeof(status) + count * sizeof(float);
+}
+
+// build a descriptor packet into packet (TLM_MAX_PACKET bytes), names are cut to 15 and units to 7 characters
+// @return packet length without the CRC
+inline size_t tlm_descriptor_packet(uint8_t* packet, uint32_t seq, uint32_t time, const char* const* names, const char* const* units, const float* scales, uint8_t count){
+    TelemetryHeader h = {TLM_DESCRIPTOR, TLM_VERSION, count, 0, seq, time};
+    memcpy(packet, &h, sizeof(h));
+    size_t n = sizeof(h);
+    for(uint8_t i = 0; i < count; i++){
+        memcpy(packet + n, &scales[i], sizeof(float));
+        n += sizeof(float);
+        size_t l = strnlen(names[i], 15);
+        memcpy(packet + n, names[i], l);
+        packet[n + l] = 0;
+        n += l + 1;
+        l = strnlen(units[i], 7);
+        memcpy(packet + n, units[i], l);
+        packet[n + l] = 0;
+        n += l + 1;
+    }
+    return n;
+}
+
+// build a text packet into packet (TLM_MAX_PACKET bytes), len is cut to TLM_MAX_TEXT
+// @return packet length without the CRC
+inline size_t tlm_text_packet(uint8_t* packet, uint32_t seq, uint32_t time, const char* text, size_t len){
+    if(len > TLM_MAX_TEXT) len = TLM_MAX_TEXT;
+    TelemetryHeader h = {TLM_TEXT, TLM_VERSION, 0, 0, seq, time};
+    memcpy(packet, &h, sizeof(h));
+    memcpy(packet + sizeof(h), text, len);
+    return sizeof(h) + len;
+}
+
+#endif
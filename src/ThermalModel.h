@@ -0,0 +1,88 @@
+
+// GAUCHO RACING VDM THERMAL MODEL
+// One lumped thermal node per component: heat capacity C (J/K) behind a thermal resistance R (K/W)
+// to a coolant temperature,
+//     C dT/dt = P_loss - (T - T_coolant) / R,   P_loss = 3 I^2 R_phase + 3 I V_drop
+// integrated every THERMAL_PERIOD from the AC phase current (taken as RMS). The measured temperature
+// pulls the estimate back (THERMAL_OBSERVER_GAIN) and slowly trims the coolant temperature
+// (THERMAL_COOLANT_GAIN), so model error does not build up. With the current losses held, T heads
+// for T_ss = T_coolant + P_loss R with time constant RC, which gives the temperature a few seconds
+// ahead and the time until a limit is reached. At 10 Hz this costs a few hundred cycles a second.
+// The C and R values are first estimates; fit them from logged drives.
+#ifndef THERMAL_MODEL_H
+#define THERMAL_MODEL_H
+
+#include <stdint.h>
+#include <math.h>
+
+const uint32_t THERMAL_PERIOD = 100000;             // us between steps
+const float THERMAL_OBSERVER_GAIN = 0.5;            // 1/s, pull toward the measured temperature
+const float THERMAL_COOLANT_GAIN = 0.02;            // 1/s, coolant trim from the remaining error
+const float THERMAL_NEVER = 3600;                   // s, time to limit when the limit is out of reach
+const float THERMAL_HORIZON = 5;                    // s ahead the derating looks
+const float THERMAL_WARN_TIME = 30;                 // s to a limit before the dash is told
+
+struct ThermalParams {
+    float capacity;                                 // J/K
+    float resistance;                               // K/W to the coolant
+    float phaseResistance;                          // ohm, copper loss per phase
+    float voltageDrop;                              // V, conduction loss per phase
+};
+
+struct ThermalModel {
+    const ThermalParams params;
+    float temp = 0;                                 // C, estimate
+    float coolant = 0;                              // C, estimate
+    float loss = 0;                                 // W, last step
+    float timeToLimit = THERMAL_NEVER;              // s
+    bool seeded = false;
+
+    explicit ThermalModel(const ThermalParams& p) : params(p) {}
+
+    // one step every THERMAL_PERIOD
+    // @param now micros()
+    // @param current AC phase current, A RMS
+    // @param measured sensor temperature, C
+    // @param limit temperature the time to limit is taken to, C
+    // @return true when a step was taken
+    bool update(uint32_t now, float current, float measured, float limit){
+        uint32_t elapsed = now - last;
+        if(elapsed < THERMAL_PERIOD) return false;
+        last = now;
+        if(!seeded){
+            temp = coolant = measured;
+            seeded = true;
+            return true;
+        }
+        float dt = elapsed * 1e-6f;
+        float i = fabsf(current);
+        loss = 3 * i * (i * params.phaseResistance + params.voltageDrop);
+        temp += (loss - (temp - coolant) / params.resistance) / params.capacity * dt;
+        float err = measured - temp;
+        temp += THERMAL_OBSERVER_GAIN * dt * err;
+        coolant += THERMAL_COOLANT_GAIN * dt * err;
+
+        float ss = steadyState();
+        if(temp >= limit) timeToLimit = 0;
+        else if(ss <= limit) timeToLimit = THERMAL_NEVER;
+        else {
+            timeToLimit = tau() * logf((ss - temp) / (ss - limit));
+            if(timeToLimit > THERMAL_NEVER) timeToLimit = THERMAL_NEVER;
+        }
+        return true;
+    }
+
+    float steadyState() const {return coolant + loss * params.resistance;}
+    float tau() const {return params.resistance * params.capacity;}
+
+    // temperature after horizon seconds at the present losses
+    float predict(float horizon) const {
+        float ss = steadyState();
+        return ss + (temp - ss) * expf(-horizon / tau());
+    }
+
+    private:
+    uint32_t last = 0;
+};
+
+#endif
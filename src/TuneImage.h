@@ -0,0 +1,218 @@
+
+// GAUCHO RACING VDM TUNE IMAGE
+// Binary vehicle tune: everything VehicleTuneController holds, in one fixed layout block with a version
+// and a CRC. Written by tools/vdm_tune.cpp, read from the SD card.
+// Shared with the host tools, so no Arduino dependencies here.
+//
+// TUNE_FIELDS names every value with its unit and valid range, tune_data_consistent() adds the rules
+// between fields. The serial console, the image loader and the host tool all go through them, so a bad
+// value is rejected the same way everywhere.
+#ifndef TUNE_IMAGE_H
+#define TUNE_IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "Crc32.h"
+
+const uint32_t TUNE_MAGIC = 0x4E545247;             // "GRTN"
+const uint16_t TUNE_VERSION = 2;
+const uint8_t TUNE_LEVELS = 4;                      // torque maps, power and regen levels selectable on the steering wheel
+
+struct TuneTorqueProfile {
+    float K;                                        // multiplier 0 to 2 (the race map runs 1.7)
+    float P;                                        // steepness 0 to 5
+    float B;                                        // offset 0 to 1
+};
+
+struct TuneData {
+    TuneTorqueProfile torque[TUNE_LEVELS];
+    float power[TUNE_LEVELS];                       // inverter current limit in Amperes
+    float regen[TUNE_LEVELS];                       // regen power in percent
+    uint32_t maxCANPing;                            // microseconds for CAN timeout
+    uint8_t tempMotor[3];                           // degrees celsius: warn, limit, critical
+    uint8_t tempBattery[3];
+    uint8_t tempCoolant[3];
+    uint8_t tempInverter[3];
+    uint16_t revLimit;                              // RPM cutoff
+    uint16_t appsZero[2];                           // ADC value for APPS 1 and 2 at 0% throttle
+    uint16_t appsFloor[2];                          // ADC value for APPS 1 and 2 at 100% throttle
+    uint16_t reserved;
+    float maxRegenSteeringAngle;                    // radians
+    float regenRMSAmps;
+    float regenDumpAmps;
+    float regenRMSMaxRPM;
+    float regenDumpMinRPM;
+};
+
+struct TuneImage {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;                                  // sizeof(TuneImage)
+    uint32_t generation;                            // bumped on every save, newest wins
+    uint32_t reserved;
+    TuneData data;
+    uint32_t crc;                                   // CRC-32 of everything above
+};
+
+// compiled in race tune, used whenever no valid image is found
+inline TuneData tune_defaults(){
+    TuneData d;
+    memset(&d, 0, sizeof(d));
+    d.torque[1] = {1.7, 1.2, 0.6};                  // TORQUE_MAP_1
+    const float power[TUNE_LEVELS] = {15, 30, 80, 150};
+    const float regen[TUNE_LEVELS] = {0, 0, 0, 100};
+    memcpy(d.power, power, sizeof(power));
+    memcpy(d.regen, regen, sizeof(regen));
+    d.maxCANPing = 100000;
+    const uint8_t temps[3] = {60, 65, 70};
+    memcpy(d.tempMotor, temps, 3);
+    memcpy(d.tempBattery, temps, 3);
+    memcpy(d.tempCoolant, temps, 3);
+    memcpy(d.tempInverter, temps, 3);
+    d.revLimit = 5500;
+    d.appsZero[0] = 13460;
+    d.appsZero[1] = 27250;
+    d.appsFloor[0] = 9302;
+    d.appsFloor[1] = 18950;
+    d.maxRegenSteeringAngle = 0.5;
+    d.regenRMSAmps = 2;
+    d.regenDumpAmps = 5;
+    d.regenRMSMaxRPM = 2000;
+    d.regenDumpMinRPM = 3000;
+    return d;
+}
+
+// FIELD TABLE
+enum TuneFieldType : uint8_t {TUNE_F32, TUNE_U32, TUNE_U16, TUNE_U8};
+
+struct TuneField {
+    const char* name;
+    const char* unit;
+    TuneFieldType type;
+    uint8_t count;                                  // 1 for single values, TUNE_LEVELS for the per level tables
+    uint8_t stride;                                 // bytes between entries
+    bool live;                                      // safe to change while driving
+    float min;
+    float max;
+    uint16_t offset;                                // in TuneData
+};
+
+#define TUNE_FIELD(name, unit, type, count, stride, live, min, max, member) {name, unit, type, count, stride, live, min, max, offsetof(TuneData, member)}
+
+const TuneField TUNE_FIELDS[] = {
+    TUNE_FIELD("can_ping", "us", TUNE_U32, 1, 4, true, 1000, 1000000, maxCANPing),
+    TUNE_FIELD("motor_warn", "C", TUNE_U8, 1, 1, true, 0, 150, tempMotor[0]),
+    TUNE_FIELD("motor_limit", "C", TUNE_U8, 1, 1, true, 0, 150, tempMotor[1]),
+    TUNE_FIELD("motor_critical", "C", TUNE_U8, 1, 1, true, 0, 150, tempMotor[2]),
+    TUNE_FIELD("battery_warn", "C", TUNE_U8, 1, 1, true, 0, 80, tempBattery[0]),
+    TUNE_FIELD("battery_limit", "C", TUNE_U8, 1, 1, true, 0, 80, tempBattery[1]),
+    TUNE_FIELD("battery_critical", "C", TUNE_U8, 1, 1, true, 0, 80, tempBattery[2]),
+    TUNE_FIELD("coolant_warn", "C", TUNE_U8, 1, 1, true, 0, 120, tempCoolant[0]),
+    TUNE_FIELD("coolant_limit", "C", TUNE_U8, 1, 1, true, 0, 120, tempCoolant[1]),
+    TUNE_FIELD("coolant_critical", "C", TUNE_U8, 1, 1, true, 0, 120, tempCoolant[2]),
+    TUNE_FIELD("inverter_warn", "C", TUNE_U8, 1, 1, true, 0, 120, tempInverter[0]),
+    TUNE_FIELD("inverter_limit", "C", TUNE_U8, 1, 1, true, 0, 120, tempInverter[1]),
+    TUNE_FIELD("inverter_critical", "C", TUNE_U8, 1, 1, true, 0, 120, tempInverter[2]),
+    TUNE_FIELD("rev_limit", "rpm", TUNE_U16, 1, 2, false, 1000, 8000, revLimit), // divides the torque map, never 0
+    TUNE_FIELD("apps_zero1", "adc", TUNE_U16, 1, 2, false, 0, 65535, appsZero[0]),
+    TUNE_FIELD("apps_zero2", "adc", TUNE_U16, 1, 2, false, 0, 65535, appsZero[1]),
+    TUNE_FIELD("apps_floor1", "adc", TUNE_U16, 1, 2, false, 0, 65535, appsFloor[0]),
+    TUNE_FIELD("apps_floor2", "adc", TUNE_U16, 1, 2, false, 0, 65535, appsFloor[1]),
+    TUNE_FIELD("regen_angle", "rad", TUNE_F32, 1, 4, false, 0, 1.57, maxRegenSteeringAngle),
+    TUNE_FIELD("regen_rms", "A", TUNE_F32, 1, 4, false, 0, 50, regenRMSAmps),
+    TUNE_FIELD("regen_dump", "A", TUNE_F32, 1, 4, false, 0, 100, regenDumpAmps),
+    TUNE_FIELD("regen_rms_rpm", "rpm", TUNE_F32, 1, 4, false, 0, 8000, regenRMSMaxRPM),
+    TUNE_FIELD("regen_dump_rpm", "rpm", TUNE_F32, 1, 4, false, 0, 8000, regenDumpMinRPM),
+    TUNE_FIELD("power", "A", TUNE_F32, TUNE_LEVELS, 4, false, 0, 250, power[0]),
+    TUNE_FIELD("regen", "%", TUNE_F32, TUNE_LEVELS, 4, false, 0, 100, regen[0]),
+    TUNE_FIELD("torque_k", "", TUNE_F32, TUNE_LEVELS, sizeof(TuneTorqueProfile), false, 0, 2, torque[0].K),
+    TUNE_FIELD("torque_p", "", TUNE_F32, TUNE_LEVELS, sizeof(TuneTorqueProfile), false, 0, 5, torque[0].P),
+    TUNE_FIELD("torque_b", "", TUNE_F32, TUNE_LEVELS, sizeof(TuneTorqueProfile), false, 0, 1, torque[0].B),
+};
+const uint8_t TUNE_FIELD_COUNT = sizeof(TUNE_FIELDS) / sizeof(TuneField);
+
+#undef TUNE_FIELD
+
+inline const TuneField* tune_field_find(const char* name){
+    for(uint8_t i = 0; i < TUNE_FIELD_COUNT; i++) if(strcmp(TUNE_FIELDS[i].name, name) == 0) return &TUNE_FIELDS[i];
+    return nullptr;
+}
+
+inline float tune_field_get(const TuneData& d, const TuneField& f, uint8_t i){
+    const uint8_t* p = (const uint8_t*)&d + f.offset + i * f.stride;
+    switch(f.type){
+        case TUNE_F32: {float v; memcpy(&v, p, 4); return v;}
+        case TUNE_U32: {uint32_t v; memcpy(&v, p, 4); return v;}
+        case TUNE_U16: {uint16_t v; memcpy(&v, p, 2); return v;}
+        default: return *p;
+    }
+}
+
+// store v, which must already be in range (tune_field_check)
+inline void tune_field_set(TuneData& d, const TuneField& f, uint8_t i, float v){
+    uint8_t* p = (uint8_t*)&d + f.offset + i * f.stride;
+    switch(f.type){
+        case TUNE_F32: memcpy(p, &v, 4); break;
+        case TUNE_U32: {uint32_t u = v; memcpy(p, &u, 4); break;}
+        case TUNE_U16: {uint16_t u = v; memcpy(p, &u, 2); break;}
+        default: *p = v;
+    }
+}
+
+inline bool tune_field_integer(const TuneField& f){return f.type != TUNE_F32;}
+
+// value acceptable for the field: in range and whole for integer fields (NaN fails)
+inline bool tune_field_check(const TuneField& f, float v){
+    if(!(v >= f.min && v <= f.max)) return false;
+    return !tune_field_integer(f) || v == (float)(int32_t)v;
+}
+
+// rules between fields: each APPS needs some travel between zero and floor (the pedal map divides by
+// it) and every temperature set has to escalate warn < limit < critical
+// @param bad set to the field that breaks a rule
+inline bool tune_data_consistent(const TuneData& d, const TuneField** bad = nullptr){
+    const char* broken = nullptr;
+    if(d.appsZero[0] == d.appsFloor[0]) broken = "apps_floor1";
+    else if(d.appsZero[1] == d.appsFloor[1]) broken = "apps_floor2";
+    const uint8_t* temps[4] = {d.tempMotor, d.tempBattery, d.tempCoolant, d.tempInverter};
+    const char* limits[4] = {"motor_limit", "battery_limit", "coolant_limit", "inverter_limit"};
+    for(uint8_t i = 0; i < 4 && !broken; i++){
+        if(!(temps[i][0] < temps[i][1] && temps[i][1] < temps[i][2])) broken = limits[i];
+    }
+    if(broken && bad) *bad = tune_field_find(broken);
+    return !broken;
+}
+
+// every field in range and consistent with the others
+// @param bad set to the first field out of range or breaking a rule
+inline bool tune_data_check(const TuneData& d, const TuneField** bad = nullptr){
+    for(uint8_t k = 0; k < TUNE_FIELD_COUNT; k++){
+        for(uint8_t i = 0; i < TUNE_FIELDS[k].count; i++){
+            if(tune_field_check(TUNE_FIELDS[k], tune_field_get(d, TUNE_FIELDS[k], i))) continue;
+            if(bad) *bad = &TUNE_FIELDS[k];
+            return false;
+        }
+    }
+    return tune_data_consistent(d, bad);
+}
+
+// fill in the header and CRC
+inline void tune_image_seal(TuneImage& img, const TuneData& d, uint32_t generation){
+    memset(&img, 0, sizeof(img));
+    img.magic = TUNE_MAGIC;
+    img.version = TUNE_VERSION;
+    img.size = sizeof(TuneImage);
+    img.generation = generation;
+    img.data = d;
+    img.crc = crc32(&img, offsetof(TuneImage, crc));
+}
+
+// header, CRC and every field range
+inline bool tune_image_check(const TuneImage& img){
+    if(img.magic != TUNE_MAGIC || img.version != TUNE_VERSION || img.size != sizeof(TuneImage)) return false;
+    if(img.crc != crc32(&img, offsetof(TuneImage, crc))) return false;
+    return tune_data_check(img.data);
+}
+
+#endif
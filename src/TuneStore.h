@@ -0,0 +1,94 @@
+
+// GAUCHO RACING VDM TUNE STORE
+// Keeps the tune in two TuneImage slots (A/B) in the Teensy's EEPROM emulated flash. Boot loads the
+// valid slot with the newest generation. A save writes the other slot a chunk at a time, CRC last,
+// so the new tune only becomes valid once every byte has landed; until then, or if power is cut
+// halfway, the old slot is still the newest valid one.
+#ifndef TUNE_STORE_H
+#define TUNE_STORE_H
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "TuneImage.h"
+
+const uint16_t TUNE_STORE_BASE = 0;                 // EEPROM address of slot A
+const uint16_t TUNE_SLOT_SIZE = 256;                // bytes reserved per slot
+const uint8_t TUNE_STORE_CHUNK = 8;                 // bytes written per service() call
+
+static_assert(sizeof(TuneImage) <= TUNE_SLOT_SIZE, "tune image does not fit a slot");
+
+struct TuneStore {
+    int8_t active = -1;                             // slot holding the current tune, -1 if neither is valid
+    uint32_t generation = 0;                        // generation of the active slot
+
+    // statistics
+    uint32_t saves = 0;
+    uint32_t failures = 0;                          // saves that did not read back valid
+
+    // load the newest valid slot
+    // @param img destination, only valid when true is returned
+    bool load(TuneImage& img){
+        TuneImage slot[2];
+        bool valid[2];
+        for(int s = 0; s < 2; s++){
+            readSlot(s, slot[s]);
+            valid[s] = tune_image_check(slot[s]);
+        }
+        if(!valid[0] && !valid[1]) return false;
+        // generations wrap, newest is the one ahead of the other
+        int s = (!valid[1] || (valid[0] && (int32_t)(slot[0].generation - slot[1].generation) > 0)) ? 0 : 1;
+        img = slot[s];
+        active = s;
+        generation = img.generation;
+        return true;
+    }
+
+    // start writing d to the inactive slot
+    // @return false while the last save is still being written
+    bool save(const TuneData& d){
+        if(writing) return false;
+        tune_image_seal(pending, d, generation + 1);
+        target = (active == 0) ? 1 : 0;
+        writePos = 0;
+        writing = true;
+        return true;
+    }
+
+    bool busy() const {return writing;}
+
+    // write the next chunk of a save, call every loop outside the drive states (a flash erase can stall)
+    void service(){
+        if(!writing) return;
+        const uint8_t* src = (const uint8_t*)&pending;
+        uint16_t end = writePos + TUNE_STORE_CHUNK;
+        if(end > sizeof(TuneImage)) end = sizeof(TuneImage);
+        for(uint16_t i = writePos; i < end; i++) EEPROM.update(slotAddress(target) + i, src[i]);
+        writePos = end;
+        if(writePos < sizeof(TuneImage)) return;
+
+        writing = false;
+        TuneImage check;
+        readSlot(target, check);
+        if(tune_image_check(check) && check.generation == pending.generation){
+            active = target;
+            generation = pending.generation;
+            saves++;
+        }
+        else failures++;
+    }
+
+    private:
+    TuneImage pending;
+    bool writing = false;
+    int8_t target = 0;
+    uint16_t writePos = 0;
+
+    static uint16_t slotAddress(int s){return TUNE_STORE_BASE + s * TUNE_SLOT_SIZE;}
+
+    static void readSlot(int s, TuneImage& img){
+        uint8_t* dst = (uint8_t*)&img;
+        for(uint16_t i = 0; i < sizeof(TuneImage); i++) dst[i] = EEPROM.read(slotAddress(s) + i);
+    }
+};
+
+#endif
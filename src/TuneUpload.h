@@ -0,0 +1,324 @@
+
+// GAUCHO RACING VDM TUNE UPLOAD
+// Chunked transfer of a TuneImage over CAN, from the dash or a laptop (tools/vdm_tune.cpp) to the VDM.
+// Shared with the host tools, so no Arduino dependencies here: the caller moves the 8 byte frames.
+//
+// Frames (extended ids, 8 bytes, little endian):
+//     Tune_Upload_Control  sender -> VDM   BEGIN: cmd, size (2), window, CRC-32 of the image (4)
+//                                          ABORT: cmd
+//     Tune_Upload_Data     sender -> VDM   chunk number (2), 6 image bytes
+//     Tune_Upload_Ack      VDM -> sender   status, next chunk expected (2), window
+//
+// The sender keeps up to `window` chunks in flight past the last acknowledged one. The VDM acks every
+// `window` chunks, answers a gap with a NACK naming the chunk it expects (go back N) and re-acks
+// duplicates. Once every chunk is in, the whole image must match the BEGIN CRC and pass
+// tune_image_check() before it is STAGED in the shadow copy. The VDM applies it (APPLIED) only
+// once the car is in a safe state.
+#ifndef TUNE_UPLOAD_H
+#define TUNE_UPLOAD_H
+
+#include <stdint.h>
+#include <string.h>
+#include "TuneImage.h"
+
+const uint8_t TUNE_CHUNK_BYTES = 6;
+const uint16_t TUNE_UPLOAD_CHUNKS = (sizeof(TuneImage) + TUNE_CHUNK_BYTES - 1) / TUNE_CHUNK_BYTES;
+const uint8_t TUNE_UPLOAD_WINDOW = 8;               // most chunks in flight the VDM accepts
+const uint32_t TUNE_UPLOAD_TIMEOUT = 1000;          // ms without a frame before the VDM drops a transfer
+const uint32_t TUNE_UPLOAD_RETRY = 100;             // ms without an ack before the sender goes back
+const uint8_t TUNE_UPLOAD_RETRIES = 10;
+const uint32_t TUNE_UPLOAD_APPLY_WAIT = 60000;      // ms the sender waits for a safe state
+
+// control commands
+const uint8_t TUNE_CMD_BEGIN = 1;
+const uint8_t TUNE_CMD_ABORT = 2;
+
+// ack status
+const uint8_t TUNE_ACK = 0x00;
+const uint8_t TUNE_NACK = 0x01;
+const uint8_t TUNE_READY = 0x02;
+const uint8_t TUNE_STAGED = 0x03;
+const uint8_t TUNE_APPLIED = 0x04;
+const uint8_t TUNE_ERR_SIZE = 0x80;
+const uint8_t TUNE_ERR_CRC = 0x81;
+const uint8_t TUNE_ERR_IMAGE = 0x82;                // CRC fine but not a valid tune (version, ranges)
+const uint8_t TUNE_ERR_TIMEOUT = 0x83;
+const uint8_t TUNE_ERR_ABORTED = 0x84;
+
+inline const char* tune_upload_status_name(uint8_t s){
+    switch(s){
+        case TUNE_ACK: return "ACK";
+        case TUNE_NACK: return "NACK";
+        case TUNE_READY: return "READY";
+        case TUNE_STAGED: return "STAGED";
+        case TUNE_APPLIED: return "APPLIED";
+        case TUNE_ERR_SIZE: return "ERR_SIZE";
+        case TUNE_ERR_CRC: return "ERR_CRC";
+        case TUNE_ERR_IMAGE: return "ERR_IMAGE";
+        case TUNE_ERR_TIMEOUT: return "ERR_TIMEOUT";
+        case TUNE_ERR_ABORTED: return "ERR_ABORTED";
+        default: return "?";
+    }
+}
+
+inline uint16_t tune_get16(const uint8_t* p){return p[0] | (p[1] << 8);}
+inline uint32_t tune_get32(const uint8_t* p){return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);}
+inline void tune_put16(uint8_t* p, uint16_t v){p[0] = v; p[1] = v >> 8;}
+inline void tune_put32(uint8_t* p, uint32_t v){p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;}
+
+
+// VDM side: every call that returns true has filled ack with a frame for Tune_Upload_Ack
+struct TuneUploadReceiver {
+    enum Phase {IDLE, RECEIVING, STAGED};
+    Phase phase = IDLE;
+    TuneImage shadow;                               // staged tune, valid in STAGED
+
+    // statistics
+    uint32_t staged = 0;
+    uint32_t failed = 0;
+    uint32_t nacks = 0;
+
+    bool onControl(const uint8_t* buf, uint8_t len, uint32_t now, uint8_t* ack){
+        if(len < 1) return false;
+        if(buf[0] == TUNE_CMD_ABORT){
+            phase = IDLE;
+            return finish(ack, TUNE_ERR_ABORTED);
+        }
+        if(buf[0] != TUNE_CMD_BEGIN || len < 8) return false;
+        // a new BEGIN restarts any transfer and drops an image that was staged but not applied
+        phase = IDLE;
+        result = 0;
+        if(tune_get16(buf + 1) != sizeof(TuneImage)){
+            failed++;
+            return finish(ack, TUNE_ERR_SIZE);
+        }
+        window = buf[3] ? buf[3] : 1;
+        if(window > TUNE_UPLOAD_WINDOW) window = TUNE_UPLOAD_WINDOW;
+        crc = tune_get32(buf + 4);
+        expected = 0;
+        sinceAck = 0;
+        nacked = false;
+        lastFrame = now;
+        phase = RECEIVING;
+        return reply(ack, TUNE_READY);
+    }
+
+    bool onData(const uint8_t* buf, uint8_t len, uint32_t now, uint8_t* ack){
+        if(len < 8) return false;
+        // a chunk after the transfer ended: the sender missed how it ended
+        if(phase != RECEIVING) return result ? reply(ack, result) : false;
+        lastFrame = now;
+        uint16_t seq = tune_get16(buf);
+        if(seq < expected) return reply(ack, TUNE_ACK);          // duplicate, our ack was lost
+        if(seq > expected){
+            if(nacked) return false;                            // one NACK per gap
+            nacked = true;
+            nacks++;
+            sinceAck = 0;
+            return reply(ack, TUNE_NACK);
+        }
+        uint16_t at = seq * TUNE_CHUNK_BYTES;
+        uint16_t n = sizeof(TuneImage) - at;
+        if(n > TUNE_CHUNK_BYTES) n = TUNE_CHUNK_BYTES;
+        memcpy((uint8_t*)&shadow + at, buf + 2, n);
+        expected++;
+        nacked = false;
+        if(expected == TUNE_UPLOAD_CHUNKS){
+            phase = IDLE;
+            if(crc32(&shadow, sizeof(TuneImage)) != crc){
+                failed++;
+                return finish(ack, TUNE_ERR_CRC);
+            }
+            if(!tune_image_check(shadow)){
+                failed++;
+                return finish(ack, TUNE_ERR_IMAGE);
+            }
+            phase = STAGED;
+            staged++;
+            return finish(ack, TUNE_STAGED);
+        }
+        if(++sinceAck < window) return false;
+        sinceAck = 0;
+        return reply(ack, TUNE_ACK);
+    }
+
+    // drop a transfer that went quiet, call every loop
+    bool service(uint32_t now, uint8_t* ack){
+        if(phase != RECEIVING || now - lastFrame < TUNE_UPLOAD_TIMEOUT) return false;
+        phase = IDLE;
+        failed++;
+        return finish(ack, TUNE_ERR_TIMEOUT);
+    }
+
+    // the staged image has been applied
+    bool applied(uint8_t* ack){
+        phase = IDLE;
+        return finish(ack, TUNE_APPLIED);
+    }
+
+    private:
+    uint32_t crc = 0;
+    uint32_t lastFrame = 0;
+    uint16_t expected = 0;
+    uint8_t window = 1;
+    uint8_t sinceAck = 0;
+    bool nacked = false;
+    uint8_t result = 0;                             // how the last transfer ended, repeated to late chunks
+
+    bool finish(uint8_t* ack, uint8_t status){
+        result = status;
+        return reply(ack, status);
+    }
+
+    bool reply(uint8_t* ack, uint8_t status){
+        memset(ack, 0, 8);
+        ack[0] = status;
+        tune_put16(ack + 1, expected);
+        ack[3] = window;
+        return true;
+    }
+};
+
+
+// sender side, used by tools/vdm_tune.cpp: poll() for the next frame to transmit, onAck() for replies
+struct TuneUploadSender {
+    enum Phase {IDLE, BEGIN, SENDING, WAIT_STAGED, WAIT_APPLIED, DONE, FAILED};
+    Phase phase = IDLE;
+    uint8_t error = 0;                              // ack status that failed the transfer, 0 for a timeout
+
+    // statistics
+    uint32_t framesSent = 0;
+    uint32_t resends = 0;                           // chunks sent again after a NACK or a timeout
+
+    // @param img sealed image, must outlive the transfer
+    // @param w chunks in flight, the VDM may lower it
+    void begin(const TuneImage& img, uint8_t w, uint32_t now){
+        image = (const uint8_t*)&img;
+        window = w ? w : 1;
+        base = next = highest = 0;
+        retries = 0;
+        lastProgress = now;
+        beginSent = false;
+        phase = BEGIN;
+    }
+
+    // next frame to put on the bus
+    // @return false if nothing is due now
+    bool poll(uint32_t now, uint32_t& id, uint8_t* buf, uint32_t controlId, uint32_t dataId){
+        if(phase == BEGIN){
+            if(beginSent && !timedOut(now, TUNE_UPLOAD_RETRY)) return false;
+            beginSent = true;
+            id = controlId;
+            memset(buf, 0, 8);
+            buf[0] = TUNE_CMD_BEGIN;
+            tune_put16(buf + 1, sizeof(TuneImage));
+            buf[3] = window;
+            tune_put32(buf + 4, crc32(image, sizeof(TuneImage)));
+            framesSent++;
+            return true;
+        }
+        if(phase == SENDING || phase == WAIT_STAGED){
+            if(next < TUNE_UPLOAD_CHUNKS && next < base + window){
+                chunk(next++, id, buf, dataId);
+                return true;
+            }
+            if(!timedOut(now, TUNE_UPLOAD_RETRY)) return false;
+            // no ack: go back to the last acknowledged chunk, or poke the VDM with the last one
+            next = base < TUNE_UPLOAD_CHUNKS ? base : TUNE_UPLOAD_CHUNKS - 1;
+            chunk(next++, id, buf, dataId);
+            return true;
+        }
+        if(phase == WAIT_APPLIED){
+            if(now - lastProgress > TUNE_UPLOAD_APPLY_WAIT) fail(0);
+            // the APPLIED ack may get lost too, a late chunk makes the VDM repeat it
+            else if(now - lastPoll >= TUNE_UPLOAD_RETRY * 10){
+                lastPoll = now;
+                chunk(TUNE_UPLOAD_CHUNKS - 1, id, buf, dataId);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void onAck(const uint8_t* buf, uint8_t len, uint32_t now){
+        if(len < 4 || phase == IDLE || phase == DONE || phase == FAILED) return;
+        uint8_t status = buf[0];
+        uint16_t n = tune_get16(buf + 1);
+        if(status & 0x80) return fail(status);
+        switch(status){
+            case TUNE_READY:
+                if(phase != BEGIN) return;
+                window = buf[3] ? buf[3] : 1;
+                base = next = 0;
+                phase = SENDING;
+                break;
+            case TUNE_ACK:
+                if(n > base && n <= TUNE_UPLOAD_CHUNKS) base = n;
+                else return;
+                break;
+            case TUNE_NACK:
+                if(n > TUNE_UPLOAD_CHUNKS) return;
+                base = n;
+                next = n;
+                break;
+            case TUNE_STAGED:
+                if(phase == WAIT_APPLIED) return;
+                base = TUNE_UPLOAD_CHUNKS;
+                lastPoll = now;
+                phase = WAIT_APPLIED;
+                break;
+            case TUNE_APPLIED:
+                // implies STAGED, whose ack may have been lost
+                if(phase == BEGIN) return;
+                base = TUNE_UPLOAD_CHUNKS;
+                phase = DONE;
+                break;
+            default:
+                return;
+        }
+        if(phase == SENDING && base >= TUNE_UPLOAD_CHUNKS) phase = WAIT_STAGED;
+        retries = 0;
+        lastProgress = now;
+    }
+
+    bool finished() const {return phase == DONE || phase == FAILED;}
+    uint16_t acked() const {return base;}
+
+    private:
+    const uint8_t* image = nullptr;
+    uint8_t window = 1;
+    uint16_t base = 0;                              // first chunk not acknowledged
+    uint16_t next = 0;                              // next chunk to send
+    uint16_t highest = 0;                           // chunks sent at least once
+    uint8_t retries = 0;
+    uint32_t lastProgress = 0;
+    uint32_t lastPoll = 0;
+    bool beginSent = false;
+
+    bool timedOut(uint32_t now, uint32_t after){
+        if(now - lastProgress < after) return false;
+        lastProgress = now;
+        if(++retries > TUNE_UPLOAD_RETRIES) fail(0);
+        return phase != FAILED;
+    }
+
+    void fail(uint8_t status){
+        error = status;
+        phase = FAILED;
+    }
+
+    void chunk(uint16_t seq, uint32_t& id, uint8_t* buf, uint32_t dataId){
+        id = dataId;
+        memset(buf, 0, 8);
+        tune_put16(buf, seq);
+        uint16_t at = seq * TUNE_CHUNK_BYTES;
+        uint16_t n = sizeof(TuneImage) - at;
+        if(n > TUNE_CHUNK_BYTES) n = TUNE_CHUNK_BYTES;
+        memcpy(buf + 2, image + at, n);
+        if(seq < highest) resends++;
+        else highest = seq + 1;
+        framesSent++;
+    }
+};
+
+#endif
@@ -0,0 +1,160 @@
+
+// GAUCHO RACING VDM WHEEL STORE
+// The last WHEEL_HISTORY samples of every corner, kept as one array per quantity (structure of
+// arrays) and stamped with the VDM micros() at arrival. The four hubs send on their own clocks, so
+// update() picks the newest instant every corner has data for, interpolates each corner to it
+// (and to WHEEL_DERIV_SPAN before it for the derivatives) and derives per-wheel slip against the
+// mean of the undriven front wheels, wheel acceleration and suspension velocity. Traction control,
+// the logger and telemetry all read the one WheelState that comes out.
+#ifndef WHEEL_STORE_H
+#define WHEEL_STORE_H
+
+#include <stdint.h>
+
+enum WheelCorner {CORNER_FL, CORNER_FR, CORNER_RL, CORNER_RR, WHEEL_CORNERS};
+
+const uint8_t WHEEL_HISTORY = 16;                   // samples per corner, power of two
+const uint32_t WHEEL_DERIV_SPAN = 20000;            // us between the two instants of a derivative
+const uint32_t WHEEL_STALE = 100000;                // us a corner may lag the others and still count
+const float WHEEL_MIN_SPEED = 30;                   // rpm reference below which slip is not defined
+
+static_assert((WHEEL_HISTORY & (WHEEL_HISTORY - 1)) == 0, "WHEEL_HISTORY must be a power of two");
+
+// one sample of one corner
+struct WheelSample {
+    float speed;                                    // rpm
+    float travel;                                   // mm
+    float accelX, accelY, accelZ;                   // hub IMU, raw counts
+};
+
+// all four corners at one instant
+struct WheelState {
+    uint32_t time = 0;                              // VDM micros() the corners were aligned to
+    uint32_t skew = 0;                              // us between the newest samples of the first and last corner
+    bool valid = false;                             // every corner has enough fresh history
+    uint32_t updates = 0;
+
+    float speed[WHEEL_CORNERS] = {};                // rpm
+    float travel[WHEEL_CORNERS] = {};               // mm
+    float accelX[WHEEL_CORNERS] = {};
+    float accelY[WHEEL_CORNERS] = {};
+    float accelZ[WHEEL_CORNERS] = {};
+    float wheelAccel[WHEEL_CORNERS] = {};           // rpm/s
+    float suspVelocity[WHEEL_CORNERS] = {};         // mm/s
+    float slip[WHEEL_CORNERS] = {};                 // (speed - reference) / reference
+    float reference = 0;                            // rpm, mean of the front wheels
+
+    float front() const {return (speed[CORNER_FL] + speed[CORNER_FR]) / 2;}
+    float rear() const {return (speed[CORNER_RL] + speed[CORNER_RR]) / 2;}
+};
+
+struct WheelStore {
+    // newest sample of a corner
+    // @param t VDM micros() at arrival
+    void push(uint8_t corner, uint32_t t, const WheelSample& s){
+        uint8_t i = (head[corner] + 1) & (WHEEL_HISTORY - 1);
+        head[corner] = i;
+        if(count[corner] < WHEEL_HISTORY) count[corner]++;
+        time[corner][i] = t;
+        speed[corner][i] = s.speed;
+        travel[corner][i] = s.travel;
+        accelX[corner][i] = s.accelX;
+        accelY[corner][i] = s.accelY;
+        accelZ[corner][i] = s.accelZ;
+        dirty = true;
+    }
+
+    // align the corners and derive the per-wheel figures, staleness is checked on every call but the
+    // figures are only derived after a new sample
+    // @param now micros()
+    // @return true when out was refreshed
+    bool update(uint32_t now, WheelState& out){
+        // newest instant every corner has reached, and how far apart the corners are
+        uint32_t oldestNewest = 0, newestNewest = 0;
+        bool ready = true;
+        for(uint8_t c = 0; c < WHEEL_CORNERS; c++){
+            if(count[c] < 2 || now - time[c][head[c]] > WHEEL_STALE){
+                ready = false;
+                break;
+            }
+            uint32_t age = now - time[c][head[c]];
+            if(c == 0 || age > now - oldestNewest) oldestNewest = time[c][head[c]];
+            if(c == 0 || age < now - newestNewest) newestNewest = time[c][head[c]];
+        }
+        if(!ready){
+            // hubs gone quiet, nothing may keep acting on the last slip
+            bool was = out.valid;
+            out.valid = false;
+            for(uint8_t c = 0; c < WHEEL_CORNERS; c++) out.slip[c] = 0;
+            dirty = false;
+            return was;
+        }
+        if(!dirty && out.valid) return false;
+        dirty = false;
+        out.valid = true;
+        uint32_t t = oldestNewest;
+        out.time = t;
+        out.skew = newestNewest - oldestNewest;
+
+        for(uint8_t c = 0; c < WHEEL_CORNERS; c++){
+            WheelSample now_s, past_s;
+            at(c, t, now_s);
+            at(c, t - WHEEL_DERIV_SPAN, past_s);
+            out.speed[c] = now_s.speed;
+            out.travel[c] = now_s.travel;
+            out.accelX[c] = now_s.accelX;
+            out.accelY[c] = now_s.accelY;
+            out.accelZ[c] = now_s.accelZ;
+            out.wheelAccel[c] = (now_s.speed - past_s.speed) * (1e6f / WHEEL_DERIV_SPAN);
+            out.suspVelocity[c] = (now_s.travel - past_s.travel) * (1e6f / WHEEL_DERIV_SPAN);
+        }
+        out.reference = out.front();
+        for(uint8_t c = 0; c < WHEEL_CORNERS; c++){
+            out.slip[c] = out.reference > WHEEL_MIN_SPEED ? (out.speed[c] - out.reference) / out.reference : 0;
+        }
+        out.updates++;
+        return true;
+    }
+
+    private:
+    uint32_t time[WHEEL_CORNERS][WHEEL_HISTORY] = {};
+    float speed[WHEEL_CORNERS][WHEEL_HISTORY] = {};
+    float travel[WHEEL_CORNERS][WHEEL_HISTORY] = {};
+    float accelX[WHEEL_CORNERS][WHEEL_HISTORY] = {};
+    float accelY[WHEEL_CORNERS][WHEEL_HISTORY] = {};
+    float accelZ[WHEEL_CORNERS][WHEEL_HISTORY] = {};
+    uint8_t head[WHEEL_CORNERS] = {};
+    uint8_t count[WHEEL_CORNERS] = {};
+    bool dirty = false;
+
+    // corner c interpolated to t, held at the ends of the history
+    void at(uint8_t c, uint32_t t, WheelSample& s) const {
+        uint8_t newer = head[c];
+        for(uint8_t n = 1; n < count[c]; n++){
+            uint8_t older = (newer - 1) & (WHEEL_HISTORY - 1);
+            // wrap safe: t at or after the older sample
+            if((int32_t)(t - time[c][older]) >= 0){
+                if((int32_t)(t - time[c][newer]) >= 0){
+                    take(c, newer, newer, 0, s);
+                    return;
+                }
+                uint32_t span = time[c][newer] - time[c][older];
+                float f = span ? (float)(t - time[c][older]) / span : 1;
+                take(c, older, newer, f, s);
+                return;
+            }
+            newer = older;
+        }
+        take(c, newer, newer, 0, s);
+    }
+
+    void take(uint8_t c, uint8_t a, uint8_t b, float f, WheelSample& s) const {
+        s.speed = speed[c][a] + (speed[c][b] - speed[c][a]) * f;
+        s.travel = travel[c][a] + (travel[c][b] - travel[c][a]) * f;
+        s.accelX = accelX[c][a] + (accelX[c][b] - accelX[c][a]) * f;
+        s.accelY = accelY[c][a] + (accelY[c][b] - accelY[c][a]) * f;
+        s.accelZ = accelZ[c][a] + (accelZ[c][b] - accelZ[c][a]) * f;
+    }
+};
+
+#endif
@@ -52,6 +52,11 @@
 #define VDM_Ping_Values 0xF2                    //Index 52
 #define VDM_States_and_Settings 0xF3            //Index 53
 #define Dash_PopUp_Alert 0xF4
+#define Tune_Upload_Control 0xF6                // sender -> VDM, see TuneUpload.h
+#define Tune_Upload_Data 0xF7
+#define Tune_Upload_Ack 0xFB                    // VDM -> sender
+#define Lap_Timing 0xFC                         // VDM -> dash, TCM: lap, last lap ms, best lap ms
+#define Sector_Timing 0xFD                      // VDM -> dash, TCM: lap, sector, sector ms, delta to best ms
 
 #define Energy_Meter_Measurements 0x100         //Index 58
 #define DTI_Control_1 0x116                     //Index 59
@@ -2,14 +2,37 @@
 #include "imxrt.h"
 #include "Arduino.h"
 #include "Nodes.h"
-#include <unordered_set>
+#include "BusLatency.h"
+#include "DataLogger.h"
+#include "DebugPage.h"
+#include "Telemetry.h"
+#include "Console.h"
+#include "TuneImage.h"
+#include "TuneStore.h"
+#include "TuneUpload.h"
+#include "FixedSet.h"
+#include "HeapGuard.h"
+#include "MemoryMonitor.h"
+#include "BootTrace.h"
+#include "SocEstimator.h"
+#include "Derating.h"
+#include "PowerCap.h"
+#include "ThermalModel.h"
+#include "WheelStore.h"
+#include "LapTimer.h"
+#include "Attitude.h"
 #include <cstddef>
+#include <cstdarg>
 #include "SD.h"
-#include <sstream>
-#include <string>
-#include <unordered_map>    
-#include <vector>
-#include "string"
+#include <array>
+#include <atomic>
+
+// MEMORY PLACEMENT (Teensy 4.1)
+// Code runs from ITCM and globals sit in DTCM unless marked otherwise. FASTRUN pins the control path
+// (drive states, traction control, system checks, node receive()) there explicitly. FLASHMEM moves cold
+// code (setup, debug page, console, SD import) to flash so ITCM takes fewer 32 KB FlexRAM banks away
+// from DTCM. DMAMEM puts the logger, telemetry and text buffers in OCRAM. scripts/memory_report.py
+// checks the placement after every link.
 
 
 
@@ -35,13 +58,21 @@ Wheel WFR = Wheel(can_data, WHEEL_FR);
 Wheel WRL = Wheel(can_data, WHEEL_RL);
 Wheel WRR = Wheel(can_data, WHEEL_RR);
 GPS GPS1 = GPS(can_data);
+Central_IMU CIMU = Central_IMU(can_data);
 Pedals PEDALS = Pedals(can_primary);
 ACU ACU1 = ACU(can_primary);
 TCM TCM1 = TCM(can_data);
 Dash DASHBOARD = Dash(can_primary);
 Energy_Meter ENERGY_METER = Energy_Meter(can_primary);
 SteeringWheel STEERING_WHEEL = SteeringWheel(can_primary);
-byte IMU[3][8] = {0x00};
+BusLatency BUS_LATENCY; // per node bus latency, stamps node data frames in VDM micros()
+SocEstimator SOC; // energy meter coulomb counting with OCV correction at rest
+Derating DERATE; // continuous inverter current ceiling from temperatures and cell sag
+PowerCap POWER_CAP; // 80 kW accumulator limit on the torque command
+WheelStore WHEELS; // timestamped history of the four hubs
+WheelState WHEEL; // corners aligned to one instant, read by traction control, logging and telemetry
+LapTimer LAP; // lap and sector times from the GPS, lines kept in EEPROM after the tune slots
+Attitude ATTITUDE; // roll, pitch, yaw and body frame acceleration from the central IMU
 
 
 
@@ -87,9 +118,9 @@ const uint8_t VMODE_ST = 1;
 const uint8_t VMODE_TC = 2;
 
 struct TorqueProfile{
-    float K; // multiplier
-    float P; // steepness
-    float B; // offset
+    float K = 0; // multiplier
+    float P = 0; // steepness
+    float B = 0; // offset
     TorqueProfile(float k, float p, float b): K(k), P(p), B(b){}
     TorqueProfile(){}
 };
@@ -98,279 +129,318 @@ struct TorqueProfile{
 
 
 
+/*
+One complete vehicle tune. A published snapshot is never written again: VehicleTuneController fills the
+spare buffer and swaps the pointer, so a reader holding a snapshot always sees one consistent tune.
+*/
+struct TuneSnapshot {
+    std::array<TorqueProfile, TUNE_LEVELS> TorqueProfilesData; // Actual Torque profiles with Data for Torque Map
+    std::array<float, TUNE_LEVELS> PowerLevelsData; // Actual max current value in Amperes
+    std::array<float, TUNE_LEVELS> RegenLevelsData; // Actual Regen Levels as percentile value 0 to 100
+
+    uint32_t MaxCANPing; // microseconds for CAN timeout
+    uint8_t temp_motor_warn; // degrees celsius for motor warning
+    uint8_t temp_motor_limit; // degrees celsius for motor limit
+    uint8_t temp_motor_critical; // degrees celsius for motor critical
+
+    uint8_t temp_battery_warn; // degrees celsius for battery warning
+    uint8_t temp_battery_limit; // degrees celsius for battery limit
+    uint8_t temp_battery_critical; // degrees celsius for battery critical
+
+    uint8_t temp_coolant_warn; // degrees celsius for coolant warning
+    uint8_t temp_coolant_limit; // degrees celsius for coolant limit
+    uint8_t temp_coolant_critical; // degrees celsius for coolant critical
+
+    uint8_t temp_inverter_warn; // degrees celsius for inverter warning
+    uint8_t temp_inverter_limit; // degrees celsius for inverter limit
+    uint8_t temp_inverter_critical; // degrees celsius for inverter critical
+    uint16_t rev_limit;// RPM cutoff   
+
+    uint16_t apps_zero_1; // ADC value for APPS 1 at 0% throttle
+    uint16_t apps_zero_2; // ADC value for APPS 2 at 0% throttle
+    uint16_t apps_floor_1; // ADC value for APPS 1 at 100% throttle
+    uint16_t apps_floor_2; // ADC value for APPS 2 at 100% throttle
+
+    float max_regen_steering_angle; // radians for max regen steering angle
+    float regen_rms_amps; // Amperes for regen RMS current
+    float regen_dump_amps; // Amperes for regen dump current
+    float regen_rms_max_rpm; // RPM minimum for regen RMS current
+    float regen_dump_min_rpm; // RPM minimum for regen dump current
+};
+
+
 /*
 A class to store the vehicle's performance tune and settings. 
 This includes the power limits, torque mappings, regen settings, error limits, and other vehicle parameters.
 The tune should be initialized via SD card and can be modified in other functions using the set methods. 
+Every write publishes a new TuneSnapshot, readers in the drive states take one snapshot per loop.
 */
 class VehicleTuneController {
     private:
-        std::vector<TorqueProfile> TorqueProfilesData; // Actual Torque profiles with Data for Torque Map
-        std::vector<float> PowerLevelsData; // Actual max current value in Amperes
-        std::vector<float> RegenLevelsData; // Actual Regen Levels as percentile value 0 to 100
-
-        uint32_t MaxCANPing = 100000; // microseconds for CAN timeout
-        uint8_t temp_motor_warn = 60; // degrees celsius for motor warning
-        uint8_t temp_motor_limit = 65; // degrees celsius for motor limit
-        uint8_t temp_motor_critical = 70; // degrees celsius for motor critical
-
-        uint8_t temp_battery_warn = 60; // degrees celsius for battery warning
-        uint8_t temp_battery_limit = 65; // degrees celsius for battery limit
-        uint8_t temp_battery_critical = 70; // degrees celsius for battery critical
-
-        uint8_t temp_coolant_warn = 60; // degrees celsius for coolant warning
-        uint8_t temp_coolant_limit = 65; // degrees celsius for coolant limit
-        uint8_t temp_coolant_critical = 70; // degrees celsius for coolant critical
-
-        uint8_t temp_inverter_warn = 60; // degrees celsius for inverter warning
-        uint8_t temp_inverter_limit = 65; // degrees celsius for inverter limit
-        uint8_t temp_inverter_critical = 70; // degrees celsius for inverter critical
-        uint16_t rev_limit = 5500;// RPM cutoff   
-
-        uint16_t apps_zero_1 = 13460; // ADC value for APPS 1 at 0% throttle
-        uint16_t apps_zero_2 = 27250; // ADC value for APPS 2 at 0% throttle
-        uint16_t apps_floor_1 = 9302; // ADC value for APPS 1 at 100% throttle
-        uint16_t apps_floor_2 = 18950; // ADC value for APPS 2 at 100% throttle
-
-        float max_regen_steering_angle = 0.5; // radians for max regen steering angle
-        float regen_rms_amps = 2; // Amperes for regen RMS current
-        float regen_dump_amps = 5; // Amperes for regen dump current
-        float regen_rms_max_rpm = 2000; // RPM minimum for regen RMS current
-        float regen_dump_min_rpm = 3000; // RPM minimum for regen dump current
+        TuneSnapshot buffers[2];
+        std::atomic<const TuneSnapshot*> active{&buffers[0]};
+
+        // the spare buffer, seeded with the current tune
+        TuneSnapshot& edit(){
+            TuneSnapshot& spare = active.load(std::memory_order_relaxed) == &buffers[0] ? buffers[1] : buffers[0];
+            spare = *snapshot();
+            return spare;
+        }
+        // make the buffer returned by edit() the current tune in one pointer store
+        void publish(){
+            active.store(active.load(std::memory_order_relaxed) == &buffers[0] ? &buffers[1] : &buffers[0], std::memory_order_release);
+        }
 
     public:
+        // compiled in race tune (tune_defaults), overwritten from the SD card or the tune console
         VehicleTuneController(){
-            // init from sd card
-            TorqueProfilesData = std::vector<TorqueProfile>(4);
-            PowerLevelsData = std::vector<float>(4);
-            RegenLevelsData = std::vector<float>(4);
+            importData(tune_defaults());
+        }
+
+        // the current tune, read it once per loop and keep no pointer across loops: the buffer is
+        // reused by the publish after next
+        const TuneSnapshot* snapshot() const { return active.load(std::memory_order_acquire); }
+
+        // copy every value into a tune image block
+        // @param d destination
+        void exportData(TuneData& d) const {
+            const TuneSnapshot& s = *snapshot();
+            for(int i = 0; i < TUNE_LEVELS; i++){
+                d.torque[i] = {s.TorqueProfilesData[i].K, s.TorqueProfilesData[i].P, s.TorqueProfilesData[i].B};
+                d.power[i] = s.PowerLevelsData[i];
+                d.regen[i] = s.RegenLevelsData[i];
+            }
+            d.maxCANPing = s.MaxCANPing;
+            d.tempMotor[0] = s.temp_motor_warn;
+            d.tempMotor[1] = s.temp_motor_limit;
+            d.tempMotor[2] = s.temp_motor_critical;
+            d.tempBattery[0] = s.temp_battery_warn;
+            d.tempBattery[1] = s.temp_battery_limit;
+            d.tempBattery[2] = s.temp_battery_critical;
+            d.tempCoolant[0] = s.temp_coolant_warn;
+            d.tempCoolant[1] = s.temp_coolant_limit;
+            d.tempCoolant[2] = s.temp_coolant_critical;
+            d.tempInverter[0] = s.temp_inverter_warn;
+            d.tempInverter[1] = s.temp_inverter_limit;
+            d.tempInverter[2] = s.temp_inverter_critical;
+            d.revLimit = s.rev_limit;
+            d.appsZero[0] = s.apps_zero_1;
+            d.appsZero[1] = s.apps_zero_2;
+            d.appsFloor[0] = s.apps_floor_1;
+            d.appsFloor[1] = s.apps_floor_2;
+            d.maxRegenSteeringAngle = s.max_regen_steering_angle;
+            d.regenRMSAmps = s.regen_rms_amps;
+            d.regenDumpAmps = s.regen_dump_amps;
+            d.regenRMSMaxRPM = s.regen_rms_max_rpm;
+            d.regenDumpMinRPM = s.regen_dump_min_rpm;
+        }
+
+        // take every value from a tune image block and publish it as one snapshot
+        // @param d source, already range checked
+        void importData(const TuneData& d){
+            TuneSnapshot& s = edit();
+            for(int i = 0; i < TUNE_LEVELS; i++){
+                s.TorqueProfilesData[i] = TorqueProfile(d.torque[i].K, d.torque[i].P, d.torque[i].B);
+                s.PowerLevelsData[i] = d.power[i];
+                s.RegenLevelsData[i] = d.regen[i];
+            }
+            s.MaxCANPing = d.maxCANPing;
+            s.temp_motor_warn = d.tempMotor[0];
+            s.temp_motor_limit = d.tempMotor[1];
+            s.temp_motor_critical = d.tempMotor[2];
+            s.temp_battery_warn = d.tempBattery[0];
+            s.temp_battery_limit = d.tempBattery[1];
+            s.temp_battery_critical = d.tempBattery[2];
+            s.temp_coolant_warn = d.tempCoolant[0];
+            s.temp_coolant_limit = d.tempCoolant[1];
+            s.temp_coolant_critical = d.tempCoolant[2];
+            s.temp_inverter_warn = d.tempInverter[0];
+            s.temp_inverter_limit = d.tempInverter[1];
+            s.temp_inverter_critical = d.tempInverter[2];
+            s.rev_limit = d.revLimit;
+            s.apps_zero_1 = d.appsZero[0];
+            s.apps_zero_2 = d.appsZero[1];
+            s.apps_floor_1 = d.appsFloor[0];
+            s.apps_floor_2 = d.appsFloor[1];
+            s.max_regen_steering_angle = d.maxRegenSteeringAngle;
+            s.regen_rms_amps = d.regenRMSAmps;
+            s.regen_dump_amps = d.regenDumpAmps;
+            s.regen_rms_max_rpm = d.regenRMSMaxRPM;
+            s.regen_dump_min_rpm = d.regenDumpMinRPM;
+            publish();
         }
 
         // REGEN STUFF
 
         // radians for max regen steering angle
-        float getMaxRegenSteeringAngle(){ return max_regen_steering_angle; } 
+        float getMaxRegenSteeringAngle(){ return snapshot()->max_regen_steering_angle; } 
         // Amperes for regen RMS current
-        float getRegenRMSAmps(){ return regen_rms_amps; } 
+        float getRegenRMSAmps(){ return snapshot()->regen_rms_amps; } 
         // Amperes for regen dump current
-        float getRegenDumpAmps(){ return regen_dump_amps; } 
+        float getRegenDumpAmps(){ return snapshot()->regen_dump_amps; } 
         // RPM minimum for regen RMS current
-        float getRegenRMSMaxRPM(){ return regen_rms_max_rpm; }
+        float getRegenRMSMaxRPM(){ return snapshot()->regen_rms_max_rpm; }
          // RPM minimum for regen dump current 
-        float getRegenDumpMinRPM(){ return regen_dump_min_rpm; }
+        float getRegenDumpMinRPM(){ return snapshot()->regen_dump_min_rpm; }
 
         // set the max regen steering angle
         //@param angle in radians
-        void setMaxRegenSteeringAngle(float angle){ max_regen_steering_angle = angle; } 
+        void setMaxRegenSteeringAngle(float angle){ edit().max_regen_steering_angle = angle; publish(); } 
         // Set the Amperes for regen RMS current
         //@param amps Amperes
-        void setRegenRMSAmps(float amps){ regen_rms_amps = amps; }
+        void setRegenRMSAmps(float amps){ edit().regen_rms_amps = amps; publish(); }
         // Amperes for regen dump current
         //@param amps Amperes
-        void setRegenDumpAmps(float amps){ regen_dump_amps = amps; } 
+        void setRegenDumpAmps(float amps){ edit().regen_dump_amps = amps; publish(); } 
         // RPM minimum for regen RMS current
         //@param rpm RPM minimum
-        void setRegenRMSMaxRPM(float rpm){ regen_rms_max_rpm = rpm; } 
+        void setRegenRMSMaxRPM(float rpm){ edit().regen_rms_max_rpm = rpm; publish(); } 
         // RPM minimum for regen dump current
         //@param rpm RPM minimum
-        void setRegenDumpMinRPM(float rpm){ regen_dump_min_rpm = rpm; } 
+        void setRegenDumpMinRPM(float rpm){ edit().regen_dump_min_rpm = rpm; publish(); } 
 
 
         // APPS CALIBRATION
         // get the ADC value for APPS 1 at 0% throttle
-        uint32_t getAPPSZero1(){ return apps_zero_1; } 
+        uint32_t getAPPSZero1(){ return snapshot()->apps_zero_1; } 
         // get the ADC value for APPS 2 at 0% throttle
-        uint32_t getAPPSZero2(){ return apps_zero_2; } 
+        uint32_t getAPPSZero2(){ return snapshot()->apps_zero_2; } 
         // get the ADC value for APPS 1 at 100% throttle
-        uint32_t getAPPSFloor1(){ return apps_floor_1; } 
+        uint32_t getAPPSFloor1(){ return snapshot()->apps_floor_1; } 
         // get the ADC value for APPS 2 at 100% throttle
-        uint32_t getAPPSFloor2(){ return apps_floor_2; }
+        uint32_t getAPPSFloor2(){ return snapshot()->apps_floor_2; }
 
         // set the ADC value for APPS 1 at 0% throttle 
         // @param apps ADC value
-        void setAPPSZero1(uint32_t apps){ apps_zero_1 = apps; }
+        void setAPPSZero1(uint32_t apps){ edit().apps_zero_1 = apps; publish(); }
         // ADC value for APPS 2 at 0% throttle
         // @param apps ADC value
-        void setAPPSZero2(uint32_t apps){ apps_zero_2 = apps; } 
+        void setAPPSZero2(uint32_t apps){ edit().apps_zero_2 = apps; publish(); } 
         // ADC value for APPS 1 at 100% throttle
         // @param apps ADC value
-        void setAPPSFloor1(uint32_t apps){ apps_floor_1 = apps; }
+        void setAPPSFloor1(uint32_t apps){ edit().apps_floor_1 = apps; publish(); }
         // ADC value for APPS 2 at 100% throttle
         // @param apps ADC value
-        void setAPPSFloor2(uint32_t apps){ apps_floor_2 = apps; } 
+        void setAPPSFloor2(uint32_t apps){ edit().apps_floor_2 = apps; publish(); } 
         
         // ERROR THRESHOLDS
         // get the maximum CAN ping time in microseconds
-        uint8_t getMaxCANPing() const { return MaxCANPing; }
+        uint8_t getMaxCANPing() const { return snapshot()->MaxCANPing; }
         // get the motor warning temperature in degrees celsius
-        uint8_t getMotorWarnTemp(){ return temp_motor_warn; }
+        uint8_t getMotorWarnTemp(){ return snapshot()->temp_motor_warn; }
         // get the motor limit temperature in degrees celsius
-        uint8_t getMotorLimitTemp(){ return temp_motor_limit; }
+        uint8_t getMotorLimitTemp(){ return snapshot()->temp_motor_limit; }
         // get the motor critical temperature in degrees celsius
-        uint8_t getMotorCriticalTemp(){ return temp_motor_critical; }
+        uint8_t getMotorCriticalTemp(){ return snapshot()->temp_motor_critical; }
         // get the battery warning temperature in degrees celsius
-        uint8_t getBatteryWarnTemp(){ return temp_battery_warn; }
+        uint8_t getBatteryWarnTemp(){ return snapshot()->temp_battery_warn; }
         // get the battery limit temperature in degrees celsius
-        uint8_t getBatteryLimitTemp(){ return temp_battery_limit; }
+        uint8_t getBatteryLimitTemp(){ return snapshot()->temp_battery_limit; }
         // get the battery critical temperature in degrees celsius
-        uint8_t getBatteryCriticalTemp(){ return temp_battery_critical; }
+        uint8_t getBatteryCriticalTemp(){ return snapshot()->temp_battery_critical; }
         // get the coolant warning temperature in degrees celsius
-        uint8_t getCoolantWarnTemp(){ return temp_coolant_warn; }
+        uint8_t getCoolantWarnTemp(){ return snapshot()->temp_coolant_warn; }
         // get the coolant limit temperature in degrees celsius
-        uint8_t getCoolantLimitTemp(){ return temp_coolant_limit; }
+        uint8_t getCoolantLimitTemp(){ return snapshot()->temp_coolant_limit; }
         // get the coolant critical temperature in degrees celsius
-        uint8_t getCoolantCriticalTemp(){ return temp_coolant_critical; }
+        uint8_t getCoolantCriticalTemp(){ return snapshot()->temp_coolant_critical; }
         // get the inverter warning temperature in degrees celsius
-        uint8_t getInverterWarnTemp(){ return temp_inverter_warn; }
+        uint8_t getInverterWarnTemp(){ return snapshot()->temp_inverter_warn; }
         // get the inverter limit temperature in degrees celsius
-        uint8_t getInverterLimitTemp(){ return temp_inverter_limit; }
+        uint8_t getInverterLimitTemp(){ return snapshot()->temp_inverter_limit; }
         // get the inverter critical temperature in degrees celsius
-        uint8_t getInverterCriticalTemp(){ return temp_inverter_critical; }
+        uint8_t getInverterCriticalTemp(){ return snapshot()->temp_inverter_critical; }
 
 
         // set the maximum CAN ping time in microseconds
         // @param ping round trip delay in microseconds
-        void setMaxCANPing(uint32_t ping){ MaxCANPing = ping; }
+        void setMaxCANPing(uint32_t ping){ edit().MaxCANPing = ping; publish(); }
         // set the motor warning temperature in degrees celsius
         // @param temp degrees celsius
-        void setMotorWarnTemp(uint8_t temp){ temp_motor_warn = temp; }
+        void setMotorWarnTemp(uint8_t temp){ edit().temp_motor_warn = temp; publish(); }
         // set the motor limit temperature in degrees celsius
         // @param temp degrees celsius
-        void setMotorLimitTemp(uint8_t temp){ temp_motor_limit = temp; }
+        void setMotorLimitTemp(uint8_t temp){ edit().temp_motor_limit = temp; publish(); }
         // set the motor critical temperature in degrees celsius
         // @param temp degrees celsius
-        void setMotorCriticalTemp(uint8_t temp){ temp_motor_critical = temp; }
+        void setMotorCriticalTemp(uint8_t temp){ edit().temp_motor_critical = temp; publish(); }
         // set the battery warning temperature in degrees celsius
         // @param temp degrees celsius
-        void setBatteryWarnTemp(uint8_t temp){ temp_battery_warn = temp; }
+        void setBatteryWarnTemp(uint8_t temp){ edit().temp_battery_warn = temp; publish(); }
         // set the battery limit temperature in degrees celsius
         // @param temp degrees celsius
-        void setBatteryLimitTemp(uint8_t temp){ temp_battery_limit = temp; }
+        void setBatteryLimitTemp(uint8_t temp){ edit().temp_battery_limit = temp; publish(); }
         // set the battery critical temperature in degrees celsius
         // @param temp degrees celsius
-        void setBatteryCriticalTemp(uint8_t temp){ temp_battery_critical = temp; }
+        void setBatteryCriticalTemp(uint8_t temp){ edit().temp_battery_critical = temp; publish(); }
         // set the coolant warning temperature in degrees celsius
         // @param temp degrees celsius
-        void setCoolantWarnTemp(uint8_t temp){ temp_coolant_warn = temp; }
+        void setCoolantWarnTemp(uint8_t temp){ edit().temp_coolant_warn = temp; publish(); }
         // set the coolant limit temperature in degrees celsius
         // @param temp degrees celsius
-        void setCoolantLimitTemp(uint8_t temp){ temp_coolant_limit = temp; }
+        void setCoolantLimitTemp(uint8_t temp){ edit().temp_coolant_limit = temp; publish(); }
         // set the coolant critical temperature in degrees celsius
         // @param temp degrees celsius
-        void setCoolantCriticalTemp(uint8_t temp){ temp_coolant_critical = temp; }
+        void setCoolantCriticalTemp(uint8_t temp){ edit().temp_coolant_critical = temp; publish(); }
         // set the inverter warning temperature in degrees celsius
         // @param temp degrees celsius
-        void setInverterWarnTemp(uint8_t temp){ temp_inverter_warn = temp; }
+        void setInverterWarnTemp(uint8_t temp){ edit().temp_inverter_warn = temp; publish(); }
         // set the inverter limit temperature in degrees celsius
         // @param temp degrees celsius
-        void setInverterLimitTemp(uint8_t temp){ temp_inverter_limit = temp; }
+        void setInverterLimitTemp(uint8_t temp){ edit().temp_inverter_limit = temp; publish(); }
         // set the inverter critical temperature in degrees celsius
         // @param temp degrees celsius
-        void setInverterCriticalTemp(uint8_t temp){ temp_inverter_critical = temp; }
+        void setInverterCriticalTemp(uint8_t temp){ edit().temp_inverter_critical = temp; publish(); }
 
         // get the active torque profile for a given position in the vehicles VehicleTuneController (as K, P, B)
         // @param pos position of the torque profile corr. to SW
-        TorqueProfile getActiveTorqueProfile(int8_t pos){ return TorqueProfilesData[pos]; }      
+        TorqueProfile getActiveTorqueProfile(int8_t pos){ return snapshot()->TorqueProfilesData[pos]; }      
         // get the active current limit for a given position in the vehicles VehicleTuneController (in AMPS)
         // @param pos position of the current limit corr. to SW  
-        float getActiveCurrentLimit(int8_t pos){ return PowerLevelsData[pos];} 
+        float getActiveCurrentLimit(int8_t pos){ return snapshot()->PowerLevelsData[pos];} 
         // get the active regen power for a given position in the vehicles VehicleTuneController (in percentile)
         // @param pos position of the regen power corr. to SW
-        float getActiveRegenPower(int8_t pos){ return RegenLevelsData[pos];} 
+        float getActiveRegenPower(int8_t pos){ return snapshot()->RegenLevelsData[pos];} 
         // get rev limiter cuttoff
-        int revLimit(){ return rev_limit; } 
-
-        // get torque profile data
-        std::vector<TorqueProfile> getTorqueProfilesData() const { return TorqueProfilesData; }
-        // get power level data
-        std::vector<float> getPowerLevelsData() const { return PowerLevelsData; }
-        // get regen level data
-        std::vector<float> getRegenLevelsData() const { return RegenLevelsData; }
+        int revLimit(){ return snapshot()->rev_limit; } 
+        // set rev limiter cutoff
+        // @param rpm motor RPM
+        void setRevLimit(uint16_t rpm){ edit().rev_limit = rpm; publish(); }
+
         // set the Torque Profile for a given position in the vehicles VehicleTuneController
         // @param index position of the torque profile corr. to SW
         // @param tp TorqueProfile object
-        void setTorqueProfileData(uint8_t index, TorqueProfile tp){ TorqueProfilesData[index] = tp; }
+        void setTorqueProfileData(uint8_t index, TorqueProfile tp){ edit().TorqueProfilesData[index] = tp; publish(); }
         // set the Power Level for a given position in the vehicles VehicleTuneController
         // @param index position of the current limit corr. to SW
         // @param power float value in Amperes
-        void setPowerLevelData(uint8_t index, float power){ PowerLevelsData[index] = power; }
+        void setPowerLevelData(uint8_t index, float power){ edit().PowerLevelsData[index] = power; publish(); }
         // set the Regen Level for a given position in the vehicles VehicleTuneController
         // @param index position of the regen power corr. to SW
         // @param regen float value in percentile
-        void setRegenLevelData(uint8_t index, float regen){ RegenLevelsData[index] = regen; }
+        void setRegenLevelData(uint8_t index, float regen){ edit().RegenLevelsData[index] = regen; publish(); }
     
 };
 
 
 
-/*
-Reads the SD card in the Microcontroller to initialize the Vehicles Parameters and Performance VehicleTuneController with Race Presets.
+const char* TUNE_FILE = "gr24.bin"; // TuneImage written by tools/vdm_tune
+bool sdReady = false; // SD.begin() succeeded, it is only tried once so boot never waits for the card
+TuneStore TUNE_STORE; // A/B tune slots in EEPROM: the boot path, SD and the console import into it
+TuneUploadReceiver TUNE_UPLOAD; // tune images streamed over CAN, staged until the car is in a safe state
 
-*/
-void readSDCard(VehicleTuneController& t){
-    Serial.println("Initializing SD Card...");
-            while(!SD.begin(BUILTIN_SDCARD)){
-                Serial.println("Waiting for SD Card to initialize...");
-            }
-            
-            Serial.println("SD INITIALIZATION SUCCESSFUL");
-            File ecu_tune;
-            ecu_tune = SD.open("gr24.txt");
-            Serial.print("Reading ECU FLASH....");
-            String tune;
-            while(ecu_tune.available()){
-                Serial.print("..");
-                tune += (char)ecu_tune.read(); 
-            }
-            Serial.println(tune.length());
-            Serial.println(tune);
-            ecu_tune.close();
-            Serial.println("");
 /*
-            std::stringstream iss(tune.c_str());
-            // read in torque profiles, regen profiles, and traction profiles
-            for(int i = 0; i < 4; i++){
-                float k, p, b;
-                iss >> k >> p >> b;
-                t.setTorqueProfileData(i, TorqueProfile(k, p, b));
-            }   
-            Serial.println("TORQUE PROFILES INITIALIZED");
-            for(int i = 0; i < 4; i++){
-                float cmax;
-                iss >> cmax;
-                t.setPowerLevelData(i, cmax);
-            }   
-            Serial.println("CURRENT LIMITS INITIALIZED");
-            for(int i = 0; i < 4; i++){
-                float r;
-                iss >> r;
-                t.setRegenLevelData(i, r);
-            }
-            Serial.println("REGEN LEVELS INITIALIZED");
-            Serial.println("ECU FLASH COMPLETE. GR24 TUNE DOWNLOADED.");
-            Serial.println("STARTING CAR WITH SETTINGS: ");
-            Serial.print("THROTTLE MAP: ");
-            for (int i = 0; i < 4; i++) {
-                Serial.print(t.getTorqueProfilesData()[i].K); 
-                Serial.print(" ");
-                Serial.print(t.getTorqueProfilesData()[i].P );
-                Serial.print(" ");
-                Serial.println(t.getTorqueProfilesData()[i].B);
-            }
-            Serial.print("POWER LEVELS: ");
-            for (int i = 0; i < 4; i++) {
-                Serial.print(t.getRegenLevelsData()[i]); 
-                Serial.print(" ");
-            }
-            Serial.println("");
-            Serial.print("REGEN LEVELS: ");
-            for (int i = 0; i < 4; i++) {
-                Serial.print(t.getRegenLevelsData()[i]); 
-                Serial.print(" ");
-            }
-            Serial.println("");
-            Serial.println("--------------------------");
-            */
+Reads the binary tune image from the SD card in the Microcontroller with a single read and checks its
+version, CRC and ranges. On any error img is not valid and the caller keeps the tune it has.
+The SD card is an import path only: an imported tune is saved to TUNE_STORE and boots from there.
+*/
+FLASHMEM bool readSDCard(TuneImage& img){
+    if(!sdReady) return false;
+    FsFile f = SD.sdfs.open(TUNE_FILE, O_RDONLY); // not SD.open, its File wraps a heap object
+    if(!f) return false;
+    bool ok = f.fileSize() == sizeof(TuneImage) && f.read(&img, sizeof(TuneImage)) == sizeof(TuneImage) && tune_image_check(img);
+    f.close();
+    return ok;
 }
 
 
@@ -403,6 +473,11 @@ const uint8_t AUX_OUT_PIN = 3;
 
 
 // error severity: warning -> limit -> critical
+// stack high water mark that raises the memory warning. The peak is only what the bench and the car
+// have exercised so far, so a quarter is kept back for deeper paths and nested interrupts. It depends
+// on the firmware build rather than the car, so it is a constant and not a tune field.
+const uint8_t MEMORY_WARN_PERCENT = 75;
+typedef FixedSet<bool (*)(VehicleTuneController& t), 16> CheckSet; // active checks as function pointers, one slot per check
 
 // A class to statically check for system faults and warnings and gives dynamic CAN frames using bit masking. 
 class SystemsCheck {
@@ -421,14 +496,14 @@ class SystemsCheck {
             /*
             8 bytes of 8 bits:
             [can warn][can failure][AMS][IMD][BSPD][SDC][][]
-            [warn motor][limit motor][crit motor][warn batt][limit batt][crit batt][rev limit][] temps motor and battery, Revs
+            [warn motor][limit motor][crit motor][warn batt][limit batt][crit batt][rev limit][memory low] temps motor and battery, Revs, stack/heap
             [warn water][limit water][crit water][warn mcu][limit mcu][crit mcu][TCM Status][] // water temp DTI temp, TCM
             [][][][][][][][] 
             [][][][][][][][] 
             */
         }
         
-        void hardware_system_critical(std::unordered_set<bool (*)(VehicleTuneController& t)> &af, VehicleTuneController* t){
+        FASTRUN void hardware_system_critical(CheckSet &af, VehicleTuneController* t){
             if(SDC_opened(*t)) af.insert(SDC_opened);  
             SYS_CHECK_CAN_FRAME[0] = SDC_opened(*t) ? (SYS_CHECK_CAN_FRAME[0] | 0b00000100) : (SYS_CHECK_CAN_FRAME[0] & 0b11111011);
             if(AMS_fault(*t)) af.insert(AMS_fault);
@@ -442,7 +517,7 @@ class SystemsCheck {
         }
 
         // NOTE: OPEN THE SOFTWARE LATCH IF the Inverter is not responding or there are critical system faults. 
-        void system_faults(std::unordered_set<bool (*)(VehicleTuneController& t)> &af, VehicleTuneController* t){
+        FASTRUN void system_faults(CheckSet &af, VehicleTuneController* t){
             if(critical_motor_temp(*t)) af.insert(critical_motor_temp);
             SYS_CHECK_CAN_FRAME[1] = critical_motor_temp(*t) ? (SYS_CHECK_CAN_FRAME[1] | 0b00100000) : (SYS_CHECK_CAN_FRAME[1] & 0b11011111);
             if(critical_battery_temp(*t)) af.insert(critical_battery_temp);
@@ -456,7 +531,7 @@ class SystemsCheck {
             
         }
 
-        void system_limits(std::unordered_set<bool (*)(VehicleTuneController& t)> &al, VehicleTuneController* t){
+        FASTRUN void system_limits(CheckSet &al, VehicleTuneController* t){
             if(limit_motor_temp(*t)) al.insert(limit_motor_temp);
             else if(al.find(limit_motor_temp) != al.end()) al.erase(limit_motor_temp);
             SYS_CHECK_CAN_FRAME[1] = limit_motor_temp(*t) ? (SYS_CHECK_CAN_FRAME[1] | 0b01000000) : (SYS_CHECK_CAN_FRAME[1] & 0b10111111);
@@ -470,7 +545,7 @@ class SystemsCheck {
             SYS_CHECK_CAN_FRAME[2] = limit_mcu_temp(*t) ? (SYS_CHECK_CAN_FRAME[2] | 0b00001000) : (SYS_CHECK_CAN_FRAME[2] & 0b11110111);
         }
 
-        void system_warnings(std::unordered_set<bool (*)(VehicleTuneController& t)> &aw, VehicleTuneController* t){
+        FASTRUN void system_warnings(CheckSet &aw, VehicleTuneController* t){
             if(warn_motor_temp(*t)) aw.insert(warn_motor_temp);
             else if(aw.find(warn_motor_temp) != aw.end()) aw.erase(warn_motor_temp);
             SYS_CHECK_CAN_FRAME[1] = warn_motor_temp(*t) ? (SYS_CHECK_CAN_FRAME[1] | 0b10000000) : (SYS_CHECK_CAN_FRAME[1] & 0b01111111);
@@ -487,6 +562,13 @@ class SystemsCheck {
             SYS_CHECK_CAN_FRAME[1] = rev_limit_exceeded(*t) ? (SYS_CHECK_CAN_FRAME[1] | 0b00000010) : (SYS_CHECK_CAN_FRAME[1] & 0b11111101);
         }
 
+        // stack or heap headroom, runs on the bench too
+        void memory_warnings(CheckSet &aw, VehicleTuneController* t){
+            if(memory_low(*t)) aw.insert(memory_low);
+            else aw.erase(memory_low);
+            SYS_CHECK_CAN_FRAME[1] = memory_low(*t) ? (SYS_CHECK_CAN_FRAME[1] | 0b00000001) : (SYS_CHECK_CAN_FRAME[1] & 0b11111110);
+        }
+
 
 
 
@@ -510,11 +592,11 @@ class SystemsCheck {
         // 2.4v is ok - ADC: 744
         // 1v = 310
         // bits 2, 3, 4, 5, 
-        static bool AMS_fault(VehicleTuneController& t){ return digitalRead(AMS_OK_PIN) != HIGH ;}
-        static bool IMD_fault(VehicleTuneController& t){ return analogRead(IMD_OK_PIN) < 300 ; }
-        static bool BSPD_fault(VehicleTuneController& t){ return digitalRead(BSPD_OK_PIN) != HIGH ;}
+        FASTRUN static bool AMS_fault(VehicleTuneController& t){ return digitalRead(AMS_OK_PIN) != HIGH ;}
+        FASTRUN static bool IMD_fault(VehicleTuneController& t){ return analogRead(IMD_OK_PIN) < 300 ; }
+        FASTRUN static bool BSPD_fault(VehicleTuneController& t){ return digitalRead(BSPD_OK_PIN) != HIGH ;}
         // check voltage < 7V (this one is 16V 8 bit ADC)
-        static bool SDC_opened(VehicleTuneController& t){
+        FASTRUN static bool SDC_opened(VehicleTuneController& t){
             return (analogRead(SDC_IN_PIN) < 50 || analogRead(SDC_OUT_PIN) < 50);
             }
  
@@ -523,16 +605,17 @@ class SystemsCheck {
 
         // BYTE 1 ---------------------------------------------------------------------------
         // bit 0, 1, 2
-        static bool warn_motor_temp(VehicleTuneController& t){return DTI.getMotorTemp() > t.getMotorWarnTemp() && DTI.getMotorTemp() < t.getMotorLimitTemp();}
-        static bool limit_motor_temp(VehicleTuneController& t){return DTI.getMotorTemp() > t.getMotorLimitTemp() && DTI.getMotorTemp() < t.getMotorCriticalTemp();}
-        static bool critical_motor_temp(VehicleTuneController& t){return DTI.getMotorTemp() > t.getMotorCriticalTemp();}
+        FASTRUN static bool warn_motor_temp(VehicleTuneController& t){return DTI.getMotorTemp() > t.getMotorWarnTemp() && DTI.getMotorTemp() < t.getMotorLimitTemp();}
+        FASTRUN static bool limit_motor_temp(VehicleTuneController& t){return DTI.getMotorTemp() > t.getMotorLimitTemp() && DTI.getMotorTemp() < t.getMotorCriticalTemp();}
+        FASTRUN static bool critical_motor_temp(VehicleTuneController& t){return DTI.getMotorTemp() > t.getMotorCriticalTemp();}
         // bit 3, 4, 5
-        static bool warn_battery_temp(VehicleTuneController& t) {return ACU1.getMaxCellTemp() > t.getBatteryWarnTemp() && ACU1.getMaxCellTemp() < t.getBatteryLimitTemp();}
-        static bool limit_battery_temp(VehicleTuneController& t) {return ACU1.getMaxCellTemp() > t.getBatteryLimitTemp() && ACU1.getMaxCellTemp() < t.getBatteryCriticalTemp();}
-        static bool critical_battery_temp(VehicleTuneController& t) {return ACU1.getMaxCellTemp() > t.getBatteryCriticalTemp();}
+        FASTRUN static bool warn_battery_temp(VehicleTuneController& t) {return ACU1.getMaxCellTemp() > t.getBatteryWarnTemp() && ACU1.getMaxCellTemp() < t.getBatteryLimitTemp();}
+        FASTRUN static bool limit_battery_temp(VehicleTuneController& t) {return ACU1.getMaxCellTemp() > t.getBatteryLimitTemp() && ACU1.getMaxCellTemp() < t.getBatteryCriticalTemp();}
+        FASTRUN static bool critical_battery_temp(VehicleTuneController& t) {return ACU1.getMaxCellTemp() > t.getBatteryCriticalTemp();}
         // bit 6
-        static bool rev_limit_exceeded(VehicleTuneController& t) {return DTI.getERPM()/10 > t.revLimit();}
-        // bit 7 
+        FASTRUN static bool rev_limit_exceeded(VehicleTuneController& t) {return DTI.getERPM()/10 > t.revLimit();}
+        // bit 7 (0b00000001, bits count from the MSB as in the frame layout above)
+        static bool memory_low(VehicleTuneController& t) {return MEMORY.stackPercent() >= MEMORY_WARN_PERCENT || MEMORY.heapGrew();}
 
         // BYTE 2 ---------------------------------------------------------------------------
         // bit 0, 1, 2 NOTE: COOLANT TEMP SENSOR NOT FUNCTIONAL
@@ -540,9 +623,9 @@ class SystemsCheck {
         // static bool limit_water_temp(VehicleTuneController& t){return ACU1.getWaterTemp() > t.getCoolantLimitTemp() && ACU1.getWaterTemp() < t.getCoolantCriticalTemp();}
         // static bool critical_water_temp(VehicleTuneController& t){return ACU1.getWaterTemp() > t.getCoolantCriticalTemp();}
         // bit 3, 4, 5
-        static bool warn_mcu_temp(VehicleTuneController& t) {return DTI.getInvTemp() > t.getInverterWarnTemp() && DTI.getInvTemp() < t.getInverterLimitTemp();}
-        static bool limit_mcu_temp(VehicleTuneController& t){return DTI.getInvTemp() > t.getInverterLimitTemp() && DTI.getInvTemp() < t.getInverterCriticalTemp();}
-        static bool critical_mcu_temp(VehicleTuneController& t) {return DTI.getInvTemp() > t.getInverterCriticalTemp();}
+        FASTRUN static bool warn_mcu_temp(VehicleTuneController& t) {return DTI.getInvTemp() > t.getInverterWarnTemp() && DTI.getInvTemp() < t.getInverterLimitTemp();}
+        FASTRUN static bool limit_mcu_temp(VehicleTuneController& t){return DTI.getInvTemp() > t.getInverterLimitTemp() && DTI.getInvTemp() < t.getInverterCriticalTemp();}
+        FASTRUN static bool critical_mcu_temp(VehicleTuneController& t) {return DTI.getInvTemp() > t.getInverterCriticalTemp();}
         // bit 6
         // static bool TCM_fault(VehicleTuneController& t) {return false;} // TODO: do
         // bit 7 empty for now
@@ -572,25 +655,48 @@ struct SWSettings {
 };  
 
 // iCANflex* Car; // Controller Area Network Object for the Vehicles CAN Bus
-SystemsCheck* sysCheck; // Static System Check
-VehicleTuneController* tune; // Global System Tuning Profile
-
-// THIS HASH FUNCTION DOES NOT WORK: DO NOT USE
-// namespace std { 
-//     template <>
-//     struct hash<bool (*)(VehicleTuneController& t)> {
-//         size_t operator()(bool (*f)(VehicleTuneController& t)) const noexcept{
-//             return reinterpret_cast<size_t>(f);
-//         }
-//     };
-// };
-
-std::unordered_set<bool (*)(VehicleTuneController& t)> *active_faults; // hashset of active system faults as function pointers
-std::unordered_set<bool (*)(VehicleTuneController& t)> *active_warnings; // hashset of active system warnings as function pointers
-std::unordered_set<bool (*)(VehicleTuneController& t)> *active_limits; // hashset of active system limits as function pointers
+SystemsCheck SYSTEMS_CHECK;
+VehicleTuneController TUNE;
+SystemsCheck* sysCheck = &SYSTEMS_CHECK; // Static System Check
+VehicleTuneController* tune = &TUNE; // Global System Tuning Profile
+
+CheckSet FAULTS, WARNINGS, LIMITS;
+CheckSet *active_faults = &FAULTS; // active system faults as function pointers
+CheckSet *active_warnings = &WARNINGS; // active system warnings as function pointers
+CheckSet *active_limits = &LIMITS; // active system limits as function pointers
 bool (*errorCheck)(VehicleTuneController&); // global function pointer to error causing the ISR
 
-std::unordered_set<int> timeout_nodes;
+// ping bookkeeping per node // TODO: BCM, TCM
+struct PingNode {
+    unsigned long requestId;
+    unsigned long responseId;
+    uint8_t number; // node number sent in VDM_Ping_Values
+    const char* name;
+    unsigned long ping; // last round trip in microseconds
+    unsigned long lastResponse; // micros() of the last response
+    bool seen; // answered at least once, no ping value is sent before then
+    bool timedOut; // no response for PING_TIMEOUT
+};
+static PingNode PING_NODES[] = {
+    {ACU_Ping_Request, ACU_Ping_Response, 1, "ACU", 0, 0, false, false},
+    {Pedals_Ping_Request, Pedals_Ping_Response, 2, "Pedals", 0, 0, false, false},
+    {Steering_Wheel_Ping_Request, Steering_Wheel_Ping_Response, 3, "Steering", 0, 0, false, false},
+    {Dash_Panel_Ping_Request, Dash_Panel_Ping_Response, 4, "DashPanel", 0, 0, false, false}
+};
+
+// @return the node answering on a ping response id, nullptr for any other id
+PingNode* pingNode(unsigned long responseId){
+    for(PingNode& n : PING_NODES) if(n.responseId == responseId) return &n;
+    return nullptr;
+}
+
+// number of nodes that stopped answering pings
+uint8_t pingTimeouts(){
+    uint8_t count = 0;
+    for(const PingNode& n : PING_NODES) count += n.timedOut;
+    return count;
+}
+
 
 bool BSE_APPS_violation = false;
 State state;
@@ -616,6 +722,13 @@ unsigned long lastPingRequestAttempt = 0; // last request for all Pings in milli
 unsigned long lastInfoSend = 0; // last send of VDM Info in millis
 
 unsigned long prechargeStartTime = 0;
+unsigned long lastActuationTime = 0; // last torque command to the inverter in micros (VDM time base)
+unsigned long pedalToTorqueLatency = 0; // microseconds from the pedal frame to the torque command built from it
+float commandedCurrent = 0; // last relative current sent to the inverter in percent
+// driver inputs sampled once per loop, read by the states, the brake light and the debug page
+uint16_t brakeADC = 0;
+float throttle1 = 0;
+float throttle2 = 0;
 
 enum Color {RED, GREEN, OFF};// green means press, red means dont press
 enum Style {SOLID, PULSE, FLASH};
@@ -666,6 +779,11 @@ const float GEAR_RATIO = 3.55;
 const float MOTOR_POLE_PAIRS = 10.0;
 const float WHEEL_RADIUS_IN = 8; // inches
 
+// lumped thermal models ahead of the temperature sensors (see ThermalModel.h)
+ThermalModel MOTOR_THERMAL({5400, 0.04, R_RESISTANCE, 0}); // ~12 kg of motor, water cooled
+ThermalModel INVERTER_THERMAL({1500, 0.05, 0, 1.5}); // conduction losses only
+unsigned long lastThermalPopup = 0; // millis
+
 
 // System variables
 float tc_multiplier = 1;
@@ -679,7 +797,7 @@ unsigned long lastTractionCompute = 0;
 const float SLIP_THRESHOLD = 0.1;  // Threshold for initiating corrective action
 
 // Function to dynamically adjust PID gains based on driving conditions
-void adjustPIDGains(float slipRatio) {
+FASTRUN void adjustPIDGains(float slipRatio) {
     if (slipRatio > SLIP_THRESHOLD) {
         // Increase gains for high slip scenarios
         Kp = 0.3;
@@ -694,23 +812,24 @@ void adjustPIDGains(float slipRatio) {
 }
 
 // Calculate slip ratio
-float calculateSlipRatio(float referenceSpeed, float actualSpeed) {
+FASTRUN float calculateSlipRatio(float referenceSpeed, float actualSpeed) {
     if (referenceSpeed == 0) return 0;
     return (actualSpeed - referenceSpeed) / referenceSpeed;
 }
 
+// one wheel sample from a hub's latest frames
+FASTRUN void pushWheel(WheelCorner corner, const Wheel& w, uint32_t t){
+    WHEELS.push(corner, t, {w.getWheelSpeed(), w.getSuspensionTravel(), w.getIMUAccelX(), w.getIMUAccelY(), w.getIMUAccelZ()});
+}
+
 // Main traction control function
-void computeTractionControl() {
+FASTRUN void computeTractionControl() {
     if (millis() - lastTractionCompute > 1000 / TRACTION_CONTROL_FREQENCY) {
-        float rearLeftWheelSpeed = WRL.getWheelSpeed();
-        float rearRightWheelSpeed = WRR.getWheelSpeed();
-        float frontLeftWheelSpeed = WFL.getWheelSpeed();
-        float frontRightWheelSpeed = WFR.getWheelSpeed();
+        // front and rear from the same instant (see WheelStore.h)
+        float averageRearWheelSpeed = WHEEL.rear();
+        float averageFrontWheelSpeed = WHEEL.front();
 
-        float averageRearWheelSpeed = (rearLeftWheelSpeed + rearRightWheelSpeed) / 2;
-        float averageFrontWheelSpeed = (frontLeftWheelSpeed + frontRightWheelSpeed) / 2;
-
-        float slipRatio = calculateSlipRatio(averageFrontWheelSpeed, averageRearWheelSpeed);
+        float slipRatio = WHEEL.valid ? calculateSlipRatio(averageFrontWheelSpeed, averageRearWheelSpeed) : 0;
 
         // Adjust PID gains dynamically based on slip ratio
         adjustPIDGains(slipRatio);
@@ -733,7 +852,60 @@ void computeTractionControl() {
     }
 }
 
-float mVehicleSpeedMPH(){return ((DTI.getERPM()/MOTOR_POLE_PAIRS)*2*PI*WHEEL_RADIUS_IN)/(GEAR_RATIO*1056.0);}
+FASTRUN float mVehicleSpeedMPH(){return ((DTI.getERPM()/MOTOR_POLE_PAIRS)*2*PI*WHEEL_RADIUS_IN)/(GEAR_RATIO*1056.0);}
+
+// central IMU scales, x forward, y left, z up (see Attitude.h)
+const float IMU_ACCEL_SCALE = 1 / 8192.0; // g per count, +-4 g range
+const float IMU_GYRO_SCALE = PI / 180 / 65.5; // rad/s per count, +-500 deg/s range
+const unsigned long IMU_STALE = 100; // ms without IMU frames before the attitude holds
+uint32_t attitudeCycles = 0, attitudeWorstCycles = 0; // CPU cycles of the last and the slowest step
+
+// fixed rate attitude step on the latest IMU frames
+FASTRUN void serviceAttitude(){
+    uint32_t now = micros();
+    if(!ATTITUDE.due(now) || CIMU.getAge() > IMU_STALE) return;
+    ImuSample s = {CIMU.getGyroX() * IMU_GYRO_SCALE, CIMU.getGyroY() * IMU_GYRO_SCALE, CIMU.getGyroZ() * IMU_GYRO_SCALE,
+                   CIMU.getAccelX() * IMU_ACCEL_SCALE, CIMU.getAccelY() * IMU_ACCEL_SCALE, CIMU.getAccelZ() * IMU_ACCEL_SCALE,
+                   CIMU.getMagX(), CIMU.getMagY(), CIMU.getMagZ()};
+    uint32_t start = ARM_DWT_CYCCNT;
+    ATTITUDE.update(now, s, mVehicleSpeedMPH() * 0.44704f);
+    attitudeCycles = ARM_DWT_CYCCNT - start;
+    if(attitudeCycles > attitudeWorstCycles) attitudeWorstCycles = attitudeCycles;
+}
+
+
+// the whole tune as one block
+TuneData captureTune(){
+    TuneData d;
+    memset(&d, 0, sizeof(d));
+    tune->exportData(d);
+    return d;
+}
+
+// switch to a range checked tune, the derating engine pushes the new current ceiling to the inverter
+void applyTune(const TuneData& d){
+    tune->importData(d);
+    DERATE.force();
+}
+
+// the hotter of the sensor and where the model says it will be THERMAL_HORIZON from now
+float anticipatedTemp(const ThermalModel& m, float measured){
+    if(!m.seeded) return measured;
+    float ahead = m.predict(THERMAL_HORIZON);
+    return ahead > measured ? ahead : measured;
+}
+
+// scale the active power level's current between it and the LIMIT level's by motor, inverter and battery
+// temperature and cell sag, the inverter only hears about meaningful changes (see Derating.h)
+// motor and inverter go by the thermal models so the ceiling comes down before the sensors cross a limit
+FASTRUN void serviceDerating(VehicleTuneController& t){
+    const TuneSnapshot* s = t.snapshot();
+    DerateThresholds th = {(float)s->temp_motor_warn, (float)s->temp_motor_limit, (float)s->temp_inverter_warn,
+                           (float)s->temp_inverter_limit, (float)s->temp_battery_warn, (float)s->temp_battery_limit};
+    DerateInputs in = {anticipatedTemp(MOTOR_THERMAL, DTI.getMotorTemp()), anticipatedTemp(INVERTER_THERMAL, DTI.getInvTemp()),
+                       ACU1.getMaxCellTemp(), ACU1.getMinCellVoltage(), ACU1.cellVoltages.complete()};
+    if(DERATE.update(micros(), s->PowerLevelsData[settings.power_level], s->PowerLevelsData[LIMIT], in, th)) DTI.setMaxCurrent(DERATE.ceiling);
+}
 
 
 
@@ -746,12 +918,34 @@ float mVehicleSpeedMPH(){return ((DTI.getERPM()/MOTOR_POLE_PAIRS)*2*PI*WHEEL_RAD
                                                                                                     
 */
 
+// the USB serial port carries either the human readable debug page or binary telemetry for tools/vdm_telemetry,
+// debug until the console switches it with "mode telemetry"
+enum SerialMode {SERIAL_DEBUG, SERIAL_TELEMETRY};
+SerialMode serialMode = SERIAL_DEBUG;
+const uint16_t TELEMETRY_RATE = 100; // Hz
+const uint32_t TELEMETRY_SIGNALS = 0x00FFFFFF; // bit i streams log_signals[i]
+TelemetryStream TELEMETRY;
+
+// one line status message, sent as a text packet while telemetry owns the port so the frames stay intact
+void serialNote(const char* format, ...){
+    char line[128];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+    if(n < 0) return;
+    if(n > (int)sizeof(line) - 2) n = sizeof(line) - 2;
+    line[n++] = '\n';
+    if(serialMode == SERIAL_TELEMETRY) TELEMETRY.sendText(line, n);
+    else Serial.write((const uint8_t*)line, n);
+}
+
 #define PRIMARY_CAN_BUS 1 // helper
 #define DATA_CAN_BUS 2 // helper
 /*
 
 */
-void writeMessage(unsigned int id, uint8_t* data, unsigned char len, uint8_t bus){
+FASTRUN void writeMessage(unsigned int id, uint8_t* data, unsigned char len, uint8_t bus){
     CAN_message_t message;
     message.flags.extended = true;
     message.id = id;
@@ -759,7 +953,7 @@ void writeMessage(unsigned int id, uint8_t* data, unsigned char len, uint8_t bus
     memcpy(message.buf, data, len);
     if(bus == PRIMARY_CAN_BUS) can_primary.write(message);
     else if (bus == DATA_CAN_BUS) can_data.write(message);
-    else Serial.println("Invalid CAN Bus");
+    else serialNote("Invalid CAN Bus");
 }
 
 
@@ -775,13 +969,90 @@ void sendDashPopup(int8_t error_code, int8_t secs, uint8_t tq = 0, uint8_t mc =
     byte data_out[8] = {error_code, secs, tq, (uint8_t)(mc), mc, r, 0, 0};
     // Serial.println("Sending Dash Popup ");
     // for(int i = 0; i < 8; i++) Serial.print(data_out[i]);
-    Serial.println("");
     writeMessage(Dash_PopUp_Alert, data_out, 8, PRIMARY_CAN_BUS);
 }
 
+// step the motor and inverter thermal models, tell the dash when a limit is under THERMAL_WARN_TIME away
+FASTRUN void serviceThermal(VehicleTuneController& t){
+    uint32_t now = micros();
+    float current = DTI.getACCurrent();
+    MOTOR_THERMAL.update(now, current, DTI.getMotorTemp(), t.getMotorLimitTemp());
+    INVERTER_THERMAL.update(now, current, DTI.getInvTemp(), t.getInverterLimitTemp());
+    bool soon = MOTOR_THERMAL.timeToLimit < THERMAL_WARN_TIME || INVERTER_THERMAL.timeToLimit < THERMAL_WARN_TIME;
+    if(soon && millis() - lastThermalPopup > 1000){
+        sendDashPopup(0xA, 1);
+        lastThermalPopup = millis();
+    }
+}
+
+// LAP TIMING
+// Lap_Timing:    bytes 0-1 lap, 2-4 last lap ms, 5-7 best lap ms
+// Sector_Timing: bytes 0-1 lap, 2 sector, 3-5 sector ms, 6-7 signed ms against the previous best of that sector
+// both go out on a crossing and once a second after, to the dash on the primary bus and the TCM on the data bus
+const uint16_t LAP_LINES_ADDRESS = TUNE_STORE_BASE + 2 * TUNE_SLOT_SIZE;
+LapLines lapSaveLines; // copy being written by the console's lap save
+uint16_t lapSavePos = sizeof(LapLines); // next byte of lapSaveLines to write, sizeof(LapLines) when idle
+unsigned long lastLapSend = 0; // millis
+
+void put24(byte* p, uint32_t v){
+    p[0] = v >> 16;
+    p[1] = v >> 8;
+    p[2] = v;
+}
+
+void serviceLapTimer(){
+    bool lapEvent = LAP.lapEvent, sectorEvent = LAP.sectorEvent;
+    if(!lapEvent && !sectorEvent && (!LAP.lap || millis() - lastLapSend < 1000)) return;
+    LAP.lapEvent = LAP.sectorEvent = false;
+    lastLapSend = millis();
+
+    byte lapOut[8] = {(uint8_t)(LAP.lap >> 8), (uint8_t)LAP.lap};
+    put24(lapOut + 2, LAP.lastLap / 1000);
+    put24(lapOut + 5, LAP.bestLap / 1000);
+    writeMessage(Lap_Timing, lapOut, 8, PRIMARY_CAN_BUS);
+    writeMessage(Lap_Timing, lapOut, 8, DATA_CAN_BUS);
+
+    uint8_t s = LAP.lastSector;
+    int32_t delta = LAP.sectorDelta / 1000;
+    if(delta > INT16_MAX) delta = INT16_MAX;
+    if(delta < INT16_MIN) delta = INT16_MIN;
+    byte sectorOut[8] = {(uint8_t)(LAP.lap >> 8), (uint8_t)LAP.lap, s};
+    put24(sectorOut + 3, LAP.sectorTime[s] / 1000);
+    sectorOut[6] = (uint16_t)delta >> 8;
+    sectorOut[7] = (uint16_t)delta;
+    writeMessage(Sector_Timing, sectorOut, 8, PRIMARY_CAN_BUS);
+    writeMessage(Sector_Timing, sectorOut, 8, DATA_CAN_BUS);
+}
+
+
+/*
+Receives a tune image streamed over CAN (see TuneUpload.h) into the TUNE_UPLOAD shadow copy.
+Call for every primary bus frame.
+*/
+void handleECUTuning(){
+    uint8_t ack[8];
+    bool reply = false;
+    if(msg.id == Tune_Upload_Control) reply = TUNE_UPLOAD.onControl(msg.buf, msg.len, millis(), ack);
+    else if(msg.id == Tune_Upload_Data) reply = TUNE_UPLOAD.onData(msg.buf, msg.len, millis(), ack);
+    if(reply) writeMessage(Tune_Upload_Ack, ack, 8, PRIMARY_CAN_BUS);
+}
 
-void handleECUTuning(VehicleTuneController& tune){
-    // TODO:
+/*
+Times out a stalled upload and applies a staged one. The swap only happens with the car in GLV_ON or
+DRIVE_STANDBY and the tune store idle, so the new tune is applied and saved in one go; until then the
+old tune stays in charge and the sender waits on the APPLIED ack.
+*/
+void serviceTuneUpload(){
+    uint8_t ack[8];
+    if(TUNE_UPLOAD.service(millis(), ack)) writeMessage(Tune_Upload_Ack, ack, 8, PRIMARY_CAN_BUS);
+    if(TUNE_UPLOAD.phase != TuneUploadReceiver::STAGED) return;
+    if(state != GLV_ON && state != DRIVE_STANDBY) return;
+    if(TUNE_STORE.busy()) return;
+    applyTune(TUNE_UPLOAD.shadow.data);
+    TUNE_STORE.save(TUNE_UPLOAD.shadow.data);
+    TUNE_UPLOAD.applied(ack);
+    writeMessage(Tune_Upload_Ack, ack, 8, PRIMARY_CAN_BUS);
+    serialNote("CAN tune upload applied");
 }
 
 
@@ -790,13 +1061,13 @@ void handleECUTuning(VehicleTuneController& tune){
 function to handle the driver inputs from the steering wheel and update the settings of the vehicle
 @param tune - Instantiated VehicleTuneController object for the vehicle
 */
-void handleDriverInputs(VehicleTuneController& tune){
+FASTRUN void handleDriverInputs(VehicleTuneController& tune){
     if(msg.id == 0x11002){
         settings.power_level = msg.buf[0];
         settings.throttle_map = msg.buf[1];
         settings.regen_level = msg.buf[2];
         sendDashPopup(0x9, 1, settings.throttle_map, tune.getActiveCurrentLimit(settings.power_level), settings.regen_level);
-        DTI.setMaxCurrent(tune.getActiveCurrentLimit(settings.power_level));
+        DERATE.force();
         // ! deprecated standard
         // uint16_t rpm = DTI.getERPM()/10;
         // uint8_t tqMap = settings.throttle_map;
@@ -815,7 +1086,9 @@ void sendVDMInfo(VehicleTuneController& t){
     if(millis() - lastInfoSend >= 1000/VDM_INFO_SEND_FREQENCY){
         byte* sys_check_data = sysCheck->getSysCheckFrame();
         uint8_t v = static_cast<uint8_t>(mVehicleSpeedMPH());
-        byte data_out[8] = {sys_check_data[0], sys_check_data[1], sys_check_data[2],0, 0, v, 0, 0};
+        // bytes 3, 4: stack high water mark in percent of the stack, heap in use in KB
+        uint8_t heapKB = MEMORY.heapInUse / 1024 > 255 ? 255 : MEMORY.heapInUse / 1024;
+        byte data_out[8] = {sys_check_data[0], sys_check_data[1], sys_check_data[2], MEMORY.stackPercent(), heapKB, v, 0, 0};
         writeMessage(VDM_Info_2, data_out, 8, PRIMARY_CAN_BUS); 
 
         uint8_t vstate = VSTATE_N; 
@@ -827,12 +1100,12 @@ void sendVDMInfo(VehicleTuneController& t){
         if(mode == STANDARD) vmode = VMODE_ST;
         else if(mode == DYNAMIC_TC) vmode = VMODE_TC;
         uint8_t tcm_ok = TCM1.getAge() < 1000000 ? 1 : 0;
-        uint8_t can_ok = (timeout_nodes.size() == 0) ? 1 : 0;
+        uint8_t can_ok = (pingTimeouts() == 0) ? 1 : 0;
         uint8_t sys_ok = 1;
         if(active_warnings->size()) sys_ok = 2;
         if(active_limits->size()) sys_ok = 3;
         if(active_faults->size()) sys_ok = 4;
-        uint8_t maxPowerkW = (t.getActiveCurrentLimit(settings.power_level) * 550)/1000;
+        uint8_t maxPowerkW = (DERATE.ceiling * 550)/1000;
         uint8_t raw_state = 1;
         if(state == ECU_FLASH) raw_state = 1;
         else if(state == GLV_ON) raw_state = 2;
@@ -849,7 +1122,7 @@ void sendVDMInfo(VehicleTuneController& t){
         writeMessage(VDM_Info_1, data_out_2, 8, PRIMARY_CAN_BUS);
 
         //F8  state, mode, tcm, can, sys, maxP, vSpeed, Power
-        //F9 Batt, Inv, Motor, TSV, BF, BR, PowerPercent, SOC
+        //F9 Batt, Inv, Motor, TSV, MotorTime, InvTime, PowerPercent, SOC
         //FA RPM (2bytes), TqMap, MaxCurrent, Regen, 0, 0, 0 
         uint8_t power = (DTI.getACCurrent() * DTI.getVoltIn()) /1000;
         byte data_out_dash_1[8] = {vmode, vstate, tcm_ok, can_ok, sys_ok, maxPowerkW, v, power };
@@ -857,12 +1130,15 @@ void sendVDMInfo(VehicleTuneController& t){
         uint8_t inv_temp = (uint8_t)DTI.getInvTemp();
         uint8_t motor_temp = (uint8_t)DTI.getMotorTemp();
         uint8_t tsv = ACU1.getTSVoltage(); 
-        uint8_t powerBar = (power * 100) / maxPowerkW;
+        uint8_t powerBar = maxPowerkW ? (power * 100) / maxPowerkW : 0; // the ceiling can round down to 0 kW
         uint8_t soc = ACU1.getSOC();
-        byte data_out_dash_2[8]= {max_cell, inv_temp, motor_temp, tsv, 0, 0, powerBar, soc};
+        // bytes 4, 5: seconds until the motor and inverter reach their limit temperature, 255 for not soon
+        uint8_t motor_time = MOTOR_THERMAL.timeToLimit > 255 ? 255 : MOTOR_THERMAL.timeToLimit;
+        uint8_t inv_time = INVERTER_THERMAL.timeToLimit > 255 ? 255 : INVERTER_THERMAL.timeToLimit;
+        byte data_out_dash_2[8]= {max_cell, inv_temp, motor_temp, tsv, motor_time, inv_time, powerBar, soc};
         uint16_t rpm = DTI.getERPM()/10;
         uint8_t tqMap = settings.throttle_map;
-        uint8_t maxCurrent = t.getActiveCurrentLimit(settings.power_level);
+        uint8_t maxCurrent = DERATE.ceiling;
         uint8_t regen = settings.regen_level;
         byte data_out_dash_3[8] = {(uint8_t)(rpm >> 8), (uint8_t)(rpm), tqMap, maxCurrent, regen, 0, 0, 0};
         
@@ -901,8 +1177,8 @@ void sendDashLED(uint8_t AMS, uint8_t IMD, Color TSColor, Color RTDColor){
 
 
 
-void handleDashPanelInputs(){
-    float brake = analogRead(BSE_HIGH);
+FASTRUN void handleDashPanelInputs(){
+    float brake = brakeADC;
     if(msg.id == Button_Event){
         if(msg.buf[0]){ // TS_ACTIVE
         // ! NEED BRAKE TO START CAR
@@ -942,36 +1218,11 @@ void handleDashPanelInputs(){
 
 // PING LOGIC
 
-// response times as {id, time} in microseconds
-static std::unordered_map<int, unsigned long> ping_response_times = { // TODO: BCM, TCM
-    {ACU_Ping_Response, 0},
-    {Pedals_Ping_Response, 0},
-    {Steering_Wheel_Ping_Response, 0},
-    {Dash_Panel_Ping_Response, 0}
-};
-// last response time as {id, time} in milliseconds
-static std::unordered_map<int, unsigned long> last_response_times = {
-    {ACU_Ping_Response, 0},
-    {Pedals_Ping_Response, 0},
-    {Steering_Wheel_Ping_Response, 0},
-    {Dash_Panel_Ping_Response, 0}
-};
-// node numbers as {id, number}
-static std::unordered_map<int, int> node_numbers = {
-    {ACU_Ping_Response, 1},
-    {Pedals_Ping_Response, 2},
-    {Steering_Wheel_Ping_Response, 3},
-    {Dash_Panel_Ping_Response, 4}
-}; // TODO: Fix this shit
-
-
-// Will try to send a ping request to the nodes in the list of request IDs
-// @param request_ids: list of request ids to request a ping response from
-// @param Car: iCANflex object defined by GR 24 Nodes API
-void tryPingRequests(std::vector<uint32_t> request_ids){
+// Will try to send a ping request to every node in PING_NODES
+void tryPingRequests(){
     if(millis()-lastPingRequestAttempt >= 1000/PING_REQ_FREQENCY){
         // Serial.println("Sending Ping Requests");
-        for(uint32_t request_id : request_ids){
+        for(const PingNode& n : PING_NODES){
             unsigned long mills=millis();
             unsigned long micro=micros();
             byte data[8] = {0x00};
@@ -979,34 +1230,49 @@ void tryPingRequests(std::vector<uint32_t> request_ids){
                 data[3-i]=(byte)(mills >> (i*8));
                 data[7-i]=(byte)(micro >> (i*8));
             }
-            writeMessage(request_id, data, 8, PRIMARY_CAN_BUS);
+            writeMessage(n.requestId, data, 8, PRIMARY_CAN_BUS);
             // Serial.println("Sent Message");
         }
         lastPingRequestAttempt=millis();
     }   
 }
 
+// latency node for a ping response id, LATENCY_NODE_COUNT for any other id
+LatencyNode latencyNodeFor(unsigned long id){
+    switch(id){
+        case ACU_Ping_Response: return LATENCY_ACU;
+        case Pedals_Ping_Response: return LATENCY_PEDALS;
+        case Steering_Wheel_Ping_Response: return LATENCY_STEERING;
+        case Dash_Panel_Ping_Response: return LATENCY_DASH;
+        default: return LATENCY_NODE_COUNT;
+    }
+}
+
+// round trip from the VDM micros() echoed in bytes 4..7 of the response
 unsigned long calculatePing() {
-    unsigned long newTime = (long)msg.buf[3] + ((long)msg.buf[2] << 8) + ((long)msg.buf[1] << 16) + ((long)msg.buf[0] << 24);
-    unsigned long newTime2 = (long)msg.buf[7] + ((long)msg.buf[6] << 8) + ((long)msg.buf[5] << 16) + ((long)msg.buf[4] << 24);
-    unsigned long roundTripDelay = ((millis() - newTime) * 1000) + ((micros() - newTime2) % 1000);
-    return roundTripDelay;
+    unsigned long sentMicros = (long)msg.buf[7] + ((long)msg.buf[6] << 8) + ((long)msg.buf[5] << 16) + ((long)msg.buf[4] << 24);
+    return micros() - sentMicros;
 }
 
-void handlePingResponse(){
-    if(msg.id == ACU_Ping_Response || msg.id == Pedals_Ping_Response || msg.id == Steering_Wheel_Ping_Response || msg.id == Dash_Panel_Ping_Response){
-        ping_response_times[msg.id] = calculatePing();
-        last_response_times[msg.id] = micros();
+FASTRUN void handlePingResponse(){
+    PingNode* node = pingNode(msg.id);
+    if(node){
+        unsigned long now = micros();
+        node->ping = calculatePing();
+        node->lastResponse = now;
+        node->seen = true;
+        BUS_LATENCY.onPingResponse(latencyNodeFor(msg.id), now - node->ping, now);
     }
 }
 
 void sendPingValues(){
     if(millis()-lastPingSend > 1000/PING_VALUE_SEND_FREQENCY){
-        for(auto e : ping_response_times){
+        for(const PingNode& n : PING_NODES){
+            if(!n.seen) continue;
             CAN_message_t message;
-            message.buf[0] = node_numbers[e.first];
+            message.buf[0] = n.number;
             for(int j=0; j<4; j++){
-                message.buf[4-j]=(byte)(e.second >> (j*8));
+                message.buf[4-j]=(byte)(n.ping >> (j*8));
             }
             message.len = 8;
             message.id = VDM_Ping_Values;
@@ -1018,16 +1284,7 @@ void sendPingValues(){
 }
 
 void checkPingTimeout(){
-    for(auto e : last_response_times){
-        if(micros() - e.second > PING_TIMEOUT){
-            timeout_nodes.insert(e.first);
-        }
-        else{
-            if(timeout_nodes.find(e.first) != timeout_nodes.end()){
-                timeout_nodes.erase(e.first);
-            }
-        }
-    }
+    for(PingNode& n : PING_NODES) n.timedOut = micros() - n.lastResponse > PING_TIMEOUT;
 
 }
 
@@ -1065,12 +1322,18 @@ This will be the first state that the car will enter.
 This is essential for the car to operate as the ECU flash contains the 
 torque profiles, regen profiles, and traction control profiles.
 */
-State ecu_flash(VehicleTuneController* t) {
+FLASHMEM State ecu_flash(VehicleTuneController* t) {
     // DTI.setDriveEnable(0);
     // DTI.setRCurrent(0);
     // flash the ecu
-    readSDCard(*t);
-    Serial.println("ECU Flash Complete");
+    if(!sdReady) sdReady = SD.begin(BUILTIN_SDCARD);
+    TuneImage img;
+    if(readSDCard(img)) {
+        applyTune(img.data);
+        TUNE_STORE.save(img.data);
+        serialNote("ECU Flash Complete");
+    }
+    else serialNote("ECU Flash Failed, tune unchanged");
     return GLV_ON;
 
 }
@@ -1148,21 +1411,28 @@ READY TO DRIVE SUB STATES
 
 
 
-float getThrottle1(uint16_t a1, VehicleTuneController& tune){
+FASTRUN float getThrottle1(uint16_t a1, VehicleTuneController& tune){
     float throttle =  1.0 - ((a1 - tune.getAPPSFloor1()*1.0)/(tune.getAPPSZero1()-tune.getAPPSFloor1()));
     if (throttle > 1.1) return 0;
     throttle = map(throttle, 0.05, 1, 0, 1);
     return constrain(throttle, 0, 1);
 }
 
-float getThrottle2(uint16_t a2,  VehicleTuneController& tune){
+FASTRUN float getThrottle2(uint16_t a2,  VehicleTuneController& tune){
     float throttle =  1.0 - ((a2 - tune.getAPPSFloor2()*1.0)/(tune.getAPPSZero2()-tune.getAPPSFloor2()));
     if (throttle > 1.1) return 0;
     throttle = map(throttle, 0.05, 1, 0, 1);
     return constrain(throttle, 0, 1);
 }
 
-State drive_standby(bool& BSE_APPS_violation, VehicleTuneController& tune) {
+// one ADC conversion and one throttle scaling per loop instead of one per reader
+FASTRUN void sampleDriverInputs(VehicleTuneController& tune){
+    brakeADC = analogRead(BSE_HIGH);
+    throttle1 = getThrottle1(PEDALS.getAPPS1(), tune);
+    throttle2 = getThrottle2(PEDALS.getAPPS2(), tune);
+}
+
+FASTRUN State drive_standby(bool& BSE_APPS_violation, VehicleTuneController& tune) {
     
     if(ACU1.getTSVoltage() < 60) return GLV_ON;
     if(millis() - lastDTIMessage > 1000/DTI_COMM_FREQUENCY){
@@ -1171,9 +1441,9 @@ State drive_standby(bool& BSE_APPS_violation, VehicleTuneController& tune) {
         lastDTIMessage = millis();
     }
 
-    float throttle = getThrottle1(PEDALS.getAPPS1(), tune);
+    float throttle = throttle1;
     // ! CHANGE TO REAL BSE
-    float brake = analogRead(BSE_HIGH);
+    float brake = brakeADC;
     // only if no violation, and throttle is pressed, go to DRIVE
 
     if(!BSE_APPS_violation && throttle > 0.05) return DRIVE_ACTIVE;
@@ -1211,10 +1481,10 @@ THIS IS FOR A GENERALLY SMOOTHER TORQUE PROFILE AND DRIVABILITY.
 THE DRIVE_TORQUE STATE IS ALSO RESPONSIBLE FOR CHECKING THE APPS AND BSE FOR VIOLATIONS AS WELL AS 
 THE GRADIENTS OF THE TWO APPS SIGNALS TO MAKE SURE THAT THEY ARE NOT COMPROMISED. 
 */
-State drive_active(bool& BSE_APPS_violation, VehicleTuneController& tune) {
-    float throttle = getThrottle1(PEDALS.getAPPS1(), tune);
-    float a2 = getThrottle2(PEDALS.getAPPS2(), tune);
-    float brake = analogRead(BSE_HIGH); 
+FASTRUN State drive_active(bool& BSE_APPS_violation, VehicleTuneController& tune) {
+    float throttle = throttle1;
+    float a2 = throttle2;
+    float brake = brakeADC;
     // ! CHANGE TO REAL BSE
     if (throttle < 0.05) return DRIVE_STANDBY;
     // ACCELERATOR GRADIENT PLAUSIBILITY VIOLATION
@@ -1232,30 +1502,35 @@ State drive_active(bool& BSE_APPS_violation, VehicleTuneController& tune) {
         DTI.setDriveEnable(1);
         // TORQUE MAPPING FOR DRIVING AND STABILITY VIA NONLINEAR THROTTLE CONTROL
         // THROTTLE CURVE EQUATION: z = np.clip((x - (1-x)*(x + b)*((y/5500.0)**p)*k )*100, 0, 100) 
-        TorqueProfile tp = tune.getActiveTorqueProfile(settings.throttle_map);
+        const TuneSnapshot* t = tune.snapshot(); // one consistent tune for the whole update
+        const TorqueProfile& tp = t->TorqueProfilesData[settings.throttle_map];
         float k = tp.K;
         float p = tp.P;
         float b = tp.B;
         float rpm = DTI.getERPM()/10.0;
-        float torque_multiplier = (throttle-(1-throttle)*(throttle+b)*pow(rpm/tune.revLimit(), p)*k);
+        float torque_multiplier = (throttle-(1-throttle)*(throttle+b)*pow(rpm/t->rev_limit, p)*k);
         if(torque_multiplier > 1) torque_multiplier = 1; // clipping
         if(torque_multiplier < 0) torque_multiplier = 0;
         float r_current = torque_multiplier*100;
         if(settings.throttle_map == LINEAR_TORQUE) r_current = throttle*100;
         if(mode == DYNAMIC_TC) r_current *= tc_multiplier;
+        r_current = POWER_CAP.apply(micros(), r_current, 1000000/DTI_COMM_FREQUENCY);
         DTI.setRCurrent(r_current);
+        commandedCurrent = r_current;
+        lastActuationTime = micros();
+        pedalToTorqueLatency = lastActuationTime - BUS_LATENCY.frameTime(LATENCY_PEDALS);
         lastDTIMessage = millis();
     }
     return DRIVE_ACTIVE; // stay in the drive state
 }
 
 
-State drive_regen(bool& BSE_APPS_violation, VehicleTuneController& tune){
+FASTRUN State drive_regen(bool& BSE_APPS_violation, VehicleTuneController& tune){
     if(settings.regen_level == REGEN_OFF) return DRIVE_STANDBY;
 
-    float brake = analogRead(BSE_HIGH); 
+    float brake = brakeADC;
     // ! CHANGE TO REAL BSE
-    float throttle = getThrottle1(PEDALS.getAPPS1(), tune);
+    float throttle = throttle1;
     if(throttle > 0.05) return DRIVE_ACTIVE;
     // if(brake < 500) return DRIVE_STANDBY;
 
@@ -1273,28 +1548,29 @@ State drive_regen(bool& BSE_APPS_violation, VehicleTuneController& tune){
     /*
     if(millis() - lastDTIMessage > 1000/DTI_COMM_FREQUENCY){
         DTI.setDriveEnable(1);
+        const TuneSnapshot* t = tune.snapshot();
         // Do this one in AMPS instead of Relative Current
         // 30A Max Regen, 15A Continuous/RMS
         float accumulator_input_amps = 0; 
         float steering_angle = 0; //TODO: in nodes
         // must be > 5 kph
-        bool regen_ok = ACU1.getSOC() < 85 && rpm > 250 && brake > 500 && throttle == 0 && abs(steering_angle) < tune.getMaxRegenSteeringAngle();
-        bool max_regen_ok = regen_ok && rpm > tune.getRegenDumpMinRPM() && brake > 0.75 && !sysCheck->warn_battery_temp(tune) && !sysCheck->limit_battery_temp(tune);
+        bool regen_ok = ACU1.getSOC() < 85 && rpm > 250 && brake > 500 && throttle == 0 && abs(steering_angle) < t->max_regen_steering_angle;
+        bool max_regen_ok = regen_ok && rpm > t->regen_dump_min_rpm && brake > 0.75 && !sysCheck->warn_battery_temp(tune) && !sysCheck->limit_battery_temp(tune);
         if(max_regen_ok) {// make sure revs are high enough for significant backemf
             // only for hard braking requests, dump energy back into accumulator
-            accumulator_input_amps = tune.getRegenDumpAmps();
+            accumulator_input_amps = t->regen_dump_amps;
         } else if(regen_ok){
             // 250 - 2000 RPM interpolate from 0 to 15A based on RPM
             // 2000 - 3000 RPM is 15A 
-            if (rpm < tune.getRegenRMSMaxRPM()) accumulator_input_amps = tune.getRegenRMSAmps()*(rpm-250)/(tune.getRegenRMSMaxRPM()-250);
-            else accumulator_input_amps = tune.getRegenRMSAmps(); // TODO: Put this interpolation diagram in the tuning software
-            Serial.println(accumulator_input_amps);
+            if (rpm < t->regen_rms_max_rpm) accumulator_input_amps = t->regen_rms_amps*(rpm-250)/(t->regen_rms_max_rpm-250);
+            else accumulator_input_amps = t->regen_rms_amps; // TODO: Put this interpolation diagram in the tuning software
+            if(serialMode == SERIAL_DEBUG) Serial.println(accumulator_input_amps);
 
         } else {
             accumulator_input_amps = 0;
         }
 
-        DTI.setBrakeCurrent(-1 * accumulator_input_amps * tune.getActiveRegenPower(settings.regen_level));
+        DTI.setBrakeCurrent(-1 * accumulator_input_amps * t->RegenLevelsData[settings.regen_level]);
         lastDTIMessage = millis();
     }*/
     return DRIVE_REGEN;
@@ -1310,7 +1586,7 @@ DRIVER REQUESTS TO STOP THE VEHICLE.
 THE VEHICLE REMAINS IN THIS STATE UNTIL ALL VIOLATIONS ARE RESOLVED 
 
 */
-State error(VehicleTuneController& t, bool (*errorCheck)(VehicleTuneController& t), std::unordered_set<bool (*)(VehicleTuneController& t)>& active_faults){
+FASTRUN State error(VehicleTuneController& t, bool (*errorCheck)(VehicleTuneController& t), CheckSet& active_faults){
     if(millis() - lastDTIMessage >= 1000/DTI_COMM_FREQUENCY){
         DTI.setRCurrent(0);
         DTI.setDriveEnable(0);
@@ -1353,128 +1629,447 @@ State ts_discharge_off(){
 */
 
 unsigned long lastPrintTime = 0;
-std::unordered_map<State, std::string> state_to_string = {
-                {ECU_FLASH, "ECU_FLASH"},
-                {GLV_ON, "GLV_ON"},
-                {TS_PRECHARGE, "TS_PRECHARGE"},
-                {PRECHARGING, "PRECHARGING"},
-                {PRECHARGE_COMPLETE, "PRECHARGE_COMPLETE"},
-                {DRIVE_STANDBY, "DRIVE_STANDBY"},
-                {DRIVE_ACTIVE, "DRIVE_ACTIVE"},
-                {DRIVE_REGEN, "DRIVE_REGEN"},
-                {ERROR, "ERROR"},
-                {TS_DISCHARGE_OFF, "TS_DISCHARGE_OFF"}
-};
-std::unordered_map<Mode, std::string>mode_to_string = {
-                {STANDARD, "STANDARD"},
-                {DYNAMIC_TC, "DYNAMIC_TC"}
-}; 
-std::unordered_map<int, std::string>node_to_string = {
-    {1, "ACU"},
-    {2, "Pedals"},
-    {3, "Steering Wheel"},
-    {4, "Dash Panel"} //TODO: BCM, TCM
-};
+DMAMEM char debug_page_text[DEBUG_PAGE_SIZE];
+DebugPage DEBUG_PAGE(debug_page_text); // static text buffer for the debug dashboard, in OCRAM
+
+const char* stateName(State s){
+    switch(s){
+        case ECU_FLASH: return "ECU_FLASH";
+        case GLV_ON: return "GLV_ON";
+        case TS_PRECHARGE: return "TS_PRECHARGE";
+        case TS_DISCHARGE_OFF: return "TS_DISCHARGE_OFF";
+        case PRECHARGING: return "PRECHARGING";
+        case PRECHARGE_COMPLETE: return "PRECHARGE_COMPLETE";
+        case DRIVE_STANDBY: return "DRIVE_STANDBY";
+        case DRIVE_ACTIVE: return "DRIVE_ACTIVE";
+        case DRIVE_REGEN: return "DRIVE_REGEN";
+        case ERROR: return "ERROR";
+        default: return "UNKNOWN";
+    }
+}
+
+const char* modeName(Mode m){
+    switch(m){
+        case STANDARD: return "STANDARD";
+        case DYNAMIC_TC: return "DYNAMIC_TC";
+        default: return "UNKNOWN";
+    }
+}
+
+const char* levelName(uint8_t level){
+    switch(level){
+        case 0: return "OFF";
+        case 1: return "LOW";
+        case 2: return "MID";
+        case 3: return "HIGH";
+        default: return "?";
+    }
+}
 
 
-String vehicleStatus(){
-    String output = "|                       STATUS:                          |\n";
-    output += "| CLOCK: " + String(millis()) + " ms ";
-    output += "| STATE: ";
-    State currentState = state;
-    output += state_to_string.find(currentState)->second.c_str();
-    output += " | MODE: ";
-    Mode currentMode = mode;
-    output += mode_to_string.find(currentMode)->second.c_str();
-    output += "     |\n";
-    output += "----------------------------------------------------------";
-    return output;
+FLASHMEM void vehicleStatus(DebugPage& p){
+    p.println("|                       STATUS:                          |");
+    p.printf("| CLOCK: %lu ms | STATE: %s | MODE: %s     |\n", (unsigned long)millis(), stateName(state), modeName(mode));
+    p.println("----------------------------------------------------------");
 }
 
-String vehicleHealth(){
-    String output = "|                      SYSTEM HEALTH:                    |\n";
-    output += "| CRITICAL: " + String(active_faults->size()) + " | LIMIT: " + String(active_limits->size()) + " | WARN: " + String(active_warnings->size()) + "          \n| HARDWARE FAULTS: ";
+FLASHMEM void vehicleHealth(DebugPage& p){
+    p.println("|                      SYSTEM HEALTH:                    |");
+    p.printf("| CRITICAL: %u | LIMIT: %u | WARN: %u          \n| HARDWARE FAULTS: ", (unsigned)active_faults->size(), (unsigned)active_limits->size(), (unsigned)active_warnings->size());
     for(auto e : *active_faults){
-        if(e == SystemsCheck::AMS_fault) output += "AMS | ";
-        if(e == SystemsCheck::IMD_fault) output += "IMD | ";
-        if(e == SystemsCheck::BSPD_fault) output += "BSPD | ";
-        if(e == SystemsCheck::SDC_opened) output += "SDC ";
+        if(e == SystemsCheck::AMS_fault) p.printf("AMS | ");
+        if(e == SystemsCheck::IMD_fault) p.printf("IMD | ");
+        if(e == SystemsCheck::BSPD_fault) p.printf("BSPD | ");
+        if(e == SystemsCheck::SDC_opened) p.printf("SDC ");
     }
-    if(active_faults->size() == 0) output += "NONE";
-    output += "\n";
-    output += "| MOTOR TEMP: " + String(DTI.getMotorTemp()) + " C | INVERTER TEMP: " + String(DTI.getInvTemp()) + " C \n| BATTERY TEMP: " + String(ACU1.getMaxCellTemp()) + " C \n"; 
-    output += " ----------------------------------------------------------";
-    return output;
+    if(active_faults->size() == 0) p.printf("NONE");
+    p.printf("\n| MOTOR TEMP: %.2f C | INVERTER TEMP: %.2f C \n| BATTERY TEMP: %.2f C \n", DTI.getMotorTemp(), DTI.getInvTemp(), ACU1.getMaxCellTemp());
+    p.printf("| MODEL: MOTOR %.1f C (%.0f W, %.0f s to limit) | INVERTER %.1f C (%.0f W, %.0f s to limit)\n", MOTOR_THERMAL.temp, MOTOR_THERMAL.loss, MOTOR_THERMAL.timeToLimit, INVERTER_THERMAL.temp, INVERTER_THERMAL.loss, INVERTER_THERMAL.timeToLimit);
+    p.printf("| CELLS: %.2f-%.2f V (mean %.3f, spread %.2f, low #%u) | %.1f-%.1f C (hot #%u)\n", ACU1.getMinCellVoltage(), ACU1.getMaxCellVoltage(), ACU1.getMeanCellVoltage(), ACU1.getCellVoltageImbalance(), ACU1.getLowestCell(), ACU1.getMinCellTemp(), ACU1.getHottestCellTemp(), ACU1.getHottestCell());
+    p.printf("| STACK: %lu / %lu B (%u%%)%s\n", (unsigned long)MEMORY.stackPeak, (unsigned long)MEMORY.stackSize, MEMORY.stackPercent(), MEMORY.stackPercent() >= MEMORY_WARN_PERCENT ? " LOW" : "");
+    p.printf("| HEAP: %lu B | PEAK %lu B | FREE %lu B IN %lu CHUNKS%s\n", (unsigned long)MEMORY.heapInUse, (unsigned long)MEMORY.heapPeak, (unsigned long)MEMORY.heapFree, (unsigned long)MEMORY.heapFreeChunks, MEMORY.heapGrew() ? " GREW" : "");
+    p.println(" ----------------------------------------------------------");
 }
 
-String vehicleNetwork(){
-    String output = "|          NETWORK SPEED: (microseconds)                 |\n";
-    if(timeout_nodes.find(ACU_Ping_Response) != timeout_nodes.end()) output += "| ACU: COOKED \n";
-    else output += "| ACU: " + String(ping_response_times[ACU_Ping_Response]) + "\n" ;
-    if(timeout_nodes.find(Pedals_Ping_Response) != timeout_nodes.end()) output += "| Pedals: COOKED \n";
-    else output += "| Pedals: " + String(ping_response_times[Pedals_Ping_Response]) + "\n" ;
-    if(timeout_nodes.find(Steering_Wheel_Ping_Response) != timeout_nodes.end()) output += "| Steering: COOKED  \n";
-    else output += "| Steering: " + String(ping_response_times[Steering_Wheel_Ping_Response]) + "\n" ;
-    if(timeout_nodes.find(Dash_Panel_Ping_Response) != timeout_nodes.end()) output += "| DashPanel: COOKED \n";
-    else output += "| DashPanel: " + String(ping_response_times[Dash_Panel_Ping_Response]) + "  \n";
-    output += "----------------------------------------------------------";
-    return output;
+FLASHMEM void vehicleNetwork(DebugPage& p){
+    p.println("|          NETWORK SPEED: (microseconds)                 |");
+    for(const PingNode& n : PING_NODES){
+        if(n.timedOut) p.printf("| %s: COOKED \n", n.name);
+        else p.printf("| %s: %lu \n", n.name, n.ping);
+    }
+    p.printf("| BUS LATENCY (us): ACU %lu | Pedals %lu\n", (unsigned long)BUS_LATENCY.nodes[LATENCY_ACU].latency(), (unsigned long)BUS_LATENCY.nodes[LATENCY_PEDALS].latency());
+    p.printf("| PEDAL TO TORQUE: %lu us \n", pedalToTorqueLatency);
+    p.println("----------------------------------------------------------");
 }
 
-String vehicleSettings(){
-    String output = "|                     VEHICLE SETTINGS:                  |\n";
-    output += "| POWER LEVEL: ";
-    if (settings.power_level == LIMIT) output += "LIMIT     ";
-    else if (settings.power_level == LOW_PWR) output += "LOW       ";
-    else if (settings.power_level == MID_PWR) output += "MID       ";
-    else if (settings.power_level == HIGH_PWR) output += "HIGH      ";
-    output += "\n| THROTTLE MAP: ";
-    if (settings.throttle_map == LINEAR_TORQUE) output += "LINEAR    ";
-    else if (settings.throttle_map == TORQUE_MAP_1) output += "MAP 1     ";
-    else if (settings.throttle_map == TORQUE_MAP_2) output += "MAP 2     ";
-    else if (settings.throttle_map == TORQUE_MAP_3) output += "MAP 3     ";
-    output += "\n| REGEN LEVEL: ";
-    if (settings.regen_level == REGEN_OFF) output += "OFF       \n";
-    else if (settings.regen_level == REGEN_LOW) output += "LOW       \n";
-    else if (settings.regen_level == REGEN_MID) output += "MID       \n";
-    else if (settings.regen_level == REGEN_HIGH) output += "HIGH      \n";
-    output += "----------------------------------------------------------";
-    return output;
+FLASHMEM void vehicleSettings(DebugPage& p){
+    p.println("|                     VEHICLE SETTINGS:                  |");
+    p.printf("| POWER LEVEL: %-10s\n", settings.power_level == LIMIT ? "LIMIT" : levelName(settings.power_level));
+    if(settings.throttle_map == LINEAR_TORQUE) p.printf("| THROTTLE MAP: LINEAR    \n");
+    else p.printf("| THROTTLE MAP: MAP %u     \n", settings.throttle_map);
+    p.printf("| REGEN LEVEL: %-10s\n", levelName(settings.regen_level));
+    if(TUNE_STORE.active < 0) p.printf("| TUNE: DEFAULTS %s\n", TUNE_STORE.busy() ? "(SAVING)" : "");
+    else p.printf("| TUNE: SLOT %c GEN %lu %s\n", 'A' + TUNE_STORE.active, (unsigned long)TUNE_STORE.generation, TUNE_STORE.busy() ? "(SAVING)" : "");
+    p.println("----------------------------------------------------------");
 }
 
-String vehiclePowerData(){
-    String output = "|                     POWER DATA:                        |\n";
-    output += "| BSE: " + String(analogRead(BSE_HIGH)) + "               \n";
-    int raw1 = PEDALS.getAPPS1();
-    output += "| APPS1: RAW: " + String(raw1) + ", SCALED: " + String(getThrottle1(raw1, *tune)) + "               \n";
-    int raw2 = PEDALS.getAPPS2();
-    output += "| APPS2: RAW: " + String(raw2) + ", SCALED: " + String(getThrottle2(raw2, *tune)) + "               \n";
-    output += "| INVERTER CURRENT LIMIT: " + String(tune->getPowerLevelsData()[settings.power_level] )+ " A        \n";
-    output += "| POWER DRAW: " + String(DTI.getACCurrent() * ACU1.getTSVoltage()) + "W        \n";
-    output += "| RPM " + String(DTI.getERPM()/10.0) + "                           \n";
-    output += "| CURRENT: " + String(DTI.getACCurrent()) + " Amps AC | " + String(ACU1.getAccumulatorCurrent()) + " Amps DC" + "             \n";
-    output += "| TS VOLTAGE: " + String(ACU1.getTSVoltage()) + " V                          \n";
-    output += "| SOC: " + String(ACU1.getSOC()) + " %                          \n";
-    output += "| Vehicle Speed: " + String(mVehicleSpeedMPH()) + " MPH                       \n";
-    output += "| SDC Voltage: " + String(ACU1.getSDCVoltage()) + " V                          \n";  
-    output += "----------------------------------------------------------\n";
-    // for (int i = 0; i < 10; i++){
-    //     output += "| " + String(i) + " " + String(ACU1.getCellVoltage_n(i)) + " V                          \n";
-    // }
-    return output;
+FLASHMEM void vehiclePowerData(DebugPage& p){
+    p.println("|                     POWER DATA:                        |");
+    p.printf("| BSE: %u               \n", brakeADC);
+    p.printf("| APPS1: RAW: %d, SCALED: %.2f               \n", (int)PEDALS.getAPPS1(), throttle1);
+    p.printf("| APPS2: RAW: %d, SCALED: %.2f               \n", (int)PEDALS.getAPPS2(), throttle2);
+    p.printf("| INVERTER CURRENT LIMIT: %.2f A        \n", tune->getActiveCurrentLimit(settings.power_level));
+    p.printf("| POWER DRAW: %.2fW DC | PEAK %.0fW | CAP %.0fW%s \n", POWER_CAP.power, POWER_CAP.peak, POWER_CAP_W, POWER_CAP.limiting ? " LIMITING" : "");
+    p.printf("| POWER CAP: predicted %.0fW | %.1f W/%% | %lu over | latency %lu us (worst %lu) \n", POWER_CAP.predicted, POWER_CAP.gain, (unsigned long)POWER_CAP.violations, (unsigned long)POWER_CAP.latency, (unsigned long)POWER_CAP.worstLatency);
+    p.printf("| RPM %.2f                           \n", DTI.getERPM()/10.0);
+    p.printf("| CURRENT: %.2f Amps AC | %.2f Amps DC             \n", DTI.getACCurrent(), ACU1.getAccumulatorCurrent());
+    p.printf("| TS VOLTAGE: %.2f V                          \n", ACU1.getTSVoltage());
+    p.printf("| SOC: %.2f %% | VDM SOC: %.1f %%%s          \n", ACU1.getSOC(), SOC.soc * 100, SOC.seeded ? "" : " (waiting for cells)");
+    p.printf("| CURRENT CEILING: %.1f A (target %.1f A, %s) \n", DERATE.ceiling, DERATE.target, DERATE_CAUSE_NAMES[DERATE.cause]);
+    p.printf("| ENERGY USED: %.1f Wh | LEFT: %.0f Wh | %.2f Ah \n", SOC.energyUsed, SOC.remainingWh(), SOC.chargeUsed);
+    p.printf("| Vehicle Speed: %.2f MPH                       \n", mVehicleSpeedMPH());
+    p.printf("| ROLL %.1f | PITCH %.1f | YAW %.1f deg | LONG %.2f | LAT %.2f m/s^2 \n", ATTITUDE.roll * 180 / PI, ATTITUDE.pitch * 180 / PI,
+             ATTITUDE.yaw * 180 / PI, ATTITUDE.longAccel, ATTITUDE.latAccel);
+    p.printf("| LAP %u: %.1f s | LAST %.3f s | BEST %.3f s | GPS AGE %lu ms \n", LAP.lap, LAP.lapTime(micros()) * 1e-6f, LAP.lastLap * 1e-6f, LAP.bestLap * 1e-6f, GPS1.getAge());
+    p.printf("| SDC Voltage: %.2f V                          \n", ACU1.getSDCVoltage());
+    p.println("----------------------------------------------------------");
+}
+
+// signals recorded by the SD data logger, in file order
+// scales follow the resolution of the Nodes.h decode so the log keeps every bit the bus carried
+const LogSignal log_signals[] = {
+    {"state", "", 1, []() -> float {return state;}},
+    {"apps1", "adc", 1, []() -> float {return PEDALS.getAPPS1();}},
+    {"apps2", "adc", 1, []() -> float {return PEDALS.getAPPS2();}},
+    {"brake_f", "adc", 1, []() -> float {return PEDALS.getBrakePressureF();}},
+    {"brake_r", "adc", 1, []() -> float {return PEDALS.getBrakePressureR();}},
+    {"bse", "adc", 1, []() -> float {return brakeADC;}},
+    {"rpm", "rpm", 0.1, []() -> float {return DTI.getERPM()/10.0;}},
+    {"ac_current", "A", 0.1, []() -> float {return DTI.getACCurrent();}},
+    {"dc_current", "A", 0.1, []() -> float {return DTI.getDCCurrent();}},
+    {"cmd_current", "%", 0.01, []() -> float {return commandedCurrent;}},
+    {"tc_mult", "", 0.001, []() -> float {return tc_multiplier;}},
+    {"motor_temp", "C", 0.1, []() -> float {return DTI.getMotorTemp();}},
+    {"inv_temp", "C", 0.1, []() -> float {return DTI.getInvTemp();}},
+    {"ts_voltage", "V", 0.01, []() -> float {return ACU1.getTSVoltage();}},
+    {"acc_current", "A", 0.01, []() -> float {return ACU1.getAccumulatorCurrent();}},
+    {"max_cell_temp", "C", 0.01, []() -> float {return ACU1.getMaxCellTemp();}},
+    {"em_voltage", "V", 0.001, []() -> float {return ENERGY_METER.getVoltage();}},
+    {"em_current", "A", 0.001, []() -> float {return ENERGY_METER.getCurrent();}},
+    {"wfl_speed", "rpm", 0.1, []() -> float {return WHEEL.speed[CORNER_FL];}},
+    {"wfr_speed", "rpm", 0.1, []() -> float {return WHEEL.speed[CORNER_FR];}},
+    {"wrl_speed", "rpm", 0.1, []() -> float {return WHEEL.speed[CORNER_RL];}},
+    {"wrr_speed", "rpm", 0.1, []() -> float {return WHEEL.speed[CORNER_RR];}},
+    {"wrl_susp", "mm", 0.1, []() -> float {return WHEEL.travel[CORNER_RL];}},
+    {"wrr_susp", "mm", 0.1, []() -> float {return WHEEL.travel[CORNER_RR];}},
+    {"soc", "%", 0.01, []() -> float {return SOC.soc * 100;}},
+    {"energy_used", "Wh", 0.1, []() -> float {return SOC.energyUsed;}},
+    {"current_ceiling", "A", 0.1, []() -> float {return DERATE.ceiling;}},
+    {"dc_power", "W", 1, []() -> float {return POWER_CAP.power;}},
+    {"motor_temp_model", "C", 0.1, []() -> float {return MOTOR_THERMAL.temp;}},
+    {"inv_temp_model", "C", 0.1, []() -> float {return INVERTER_THERMAL.temp;}},
+    {"wrl_slip", "", 0.001, []() -> float {return WHEEL.slip[CORNER_RL];}},
+    {"wrr_slip", "", 0.001, []() -> float {return WHEEL.slip[CORNER_RR];}},
+};
+const uint16_t LOG_RATE = 1000; // Hz
+DataLogger LOGGER;
+
+void sendTelemetry(){
+    TelemetryStatus status;
+    status.state = state;
+    status.mode = mode;
+    status.powerLevel = settings.power_level;
+    status.flags = (active_faults->size() ? TLM_FLAG_FAULT : 0) | (active_limits->size() ? TLM_FLAG_LIMIT : 0)
+                 | (LOGGER.active ? TLM_FLAG_LOGGING : 0) | (tc_multiplier < 1 ? TLM_FLAG_TRACTION : 0);
+    TELEMETRY.service(Serial, micros(), status);
+}
+
+FLASHMEM void loggerStatus(DebugPage& p){
+    p.println("|                     DATA LOGGER:                       |");
+    if(!LOGGER.active) p.printf("| OFF ");
+    p.printf("| SAMPLES: %lu | DROPPED: %lu | BLOCKS: %lu\n", (unsigned long)LOGGER.samples, (unsigned long)LOGGER.dropped, (unsigned long)LOGGER.blocksWritten);
+    p.printf("| WORST WRITE: %lu us | LAST WRITE: %lu us \n", (unsigned long)LOGGER.worstWriteTime, (unsigned long)LOGGER.lastWriteTime);
+    p.println("----------------------------------------------------------");
+}
+
+// renders the debug dashboard into DEBUG_PAGE and drains it to Serial without blocking
+FLASHMEM void printDebug(){
+    DEBUG_PAGE.service(Serial);
+    if(DEBUG_PAGE.busy() || millis() - lastPrintTime <= 1000/DEBUG_PRINT_FREQUENCY) return;
+    DEBUG_PAGE.clear();
+    DEBUG_PAGE.println("----------------------------------------------------------");
+    DEBUG_PAGE.println("|                     GR24 EV VEHICLE DEBUG              |");
+    DEBUG_PAGE.println("----------------------------------------------------------");
+    vehicleStatus(DEBUG_PAGE);
+    vehicleHealth(DEBUG_PAGE);
+    vehicleNetwork(DEBUG_PAGE);
+    vehicleSettings(DEBUG_PAGE);
+    vehiclePowerData(DEBUG_PAGE);
+    loggerStatus(DEBUG_PAGE);
+    lastPrintTime = millis();
 }
 
-void printDebug(){
-    if(millis() - lastPrintTime > 1000/DEBUG_PRINT_FREQUENCY){
-        Serial.println("----------------------------------------------------------");
-        Serial.println("|                     GR24 EV VEHICLE DEBUG              |");
-        Serial.println("----------------------------------------------------------");
-        Serial.println(vehicleStatus());
-        Serial.println(vehicleHealth());
-        Serial.println(vehicleNetwork());
-        Serial.println(vehicleSettings());
-        Serial.println(vehiclePowerData());
-        lastPrintTime = millis();
+
+/*
+  ________  ___   ________   __________  _   _______ ____  __    ______
+ /_  __/ / / / | / / ____/  / ____/ __ \/ | / / ___// __ \/ /   / ____/
+  / / / / / /  |/ / __/    / /   / / / /  |/ /\__ \/ / / / /   / __/   
+ / / / /_/ / /|  / /___   / /___/ /_/ / /|  /___/ / /_/ / /___/ /___   
+/_/  \____/_/ |_/_____/   \____/\____/_/ |_//____/\____/_____/_____/   
+*/
+Console CONSOLE;
+uint8_t consoleListNext = 0; // next field printed by the list command
+bool consoleImport = false; // import queued for serviceConsoleJobs()
+
+FLASHMEM void printField(DebugPage& out, const TuneData& d, const TuneField& f, uint8_t i){
+    float v = tune_field_get(d, f, i);
+    if(f.count > 1) out.printf("%s %u = ", f.name, i);
+    else out.printf("%s = ", f.name);
+    if(tune_field_integer(f)) out.printf("%ld %s\n", lroundf(v), f.unit);
+    else out.printf("%g %s\n", v, f.unit);
+}
+
+bool parseNumber(const char* s, float& v){
+    char* end;
+    v = strtof(s, &end);
+    return end != s && *end == 0;
+}
+
+// list one parameter per call so a long listing never holds up the loop
+FLASHMEM bool consoleList(DebugPage& out){
+    const TuneField& f = TUNE_FIELDS[consoleListNext];
+    TuneData d = captureTune();
+    out.printf("%-18s", f.name);
+    for(uint8_t i = 0; i < f.count; i++){
+        if(tune_field_integer(f)) out.printf(" %ld", lroundf(tune_field_get(d, f, i)));
+        else out.printf(" %g", tune_field_get(d, f, i));
+    }
+    out.printf(" %s [%g, %g]%s\n", f.unit, f.min, f.max, f.live ? "" : " not while driving");
+    return ++consoleListNext < TUNE_FIELD_COUNT;
+}
+
+// lap [start|sector|clear|save]: lines are laid at the car's position and only kept across power cycles by save
+FLASHMEM void lapCommand(int argc, char** argv, DebugPage& out){
+    if(argc == 1){
+        out.printf("lap %u | sector %u of %u | start line %s | %lu fixes, %lu crossings, %lu ignored\n", LAP.lap, LAP.sector, LAP.lines.sectors + 1,
+                   LAP.lines.hasStart ? "set" : "not set", (unsigned long)LAP.fixes, (unsigned long)LAP.crossings, (unsigned long)LAP.ignored);
+        out.printf("last %.3f s | best %.3f s\n", LAP.lastLap * 1e-6f, LAP.bestLap * 1e-6f);
+        for(uint8_t i = 0; i <= LAP.lines.sectors; i++) out.printf("sector %u %.3f s | best %.3f s\n", i, LAP.sectorTime[i] * 1e-6f, LAP.bestSector[i] * 1e-6f);
+        return;
+    }
+    if(strcmp(argv[1], "start") == 0 || strcmp(argv[1], "sector") == 0){
+        if(LAP.placeLine(argv[1][1] == 't')) out.printf("OK %s line at the car, timing restarted\n", argv[1]);
+        else out.println("ERR needs the car moving with a GPS fix, at most 8 sector lines");
+    }
+    else if(strcmp(argv[1], "clear") == 0){
+        LAP.setLines(LapLines());
+        out.println("OK lines cleared");
+    }
+    // written a chunk per loop by serviceConsoleJobs(), an EEPROM flash erase can stall for milliseconds
+    else if(strcmp(argv[1], "save") == 0){
+        if(state == DRIVE_ACTIVE || state == DRIVE_REGEN) out.println("ERR not while driving");
+        else if(lapSavePos < sizeof(LapLines)) out.println("ERR save in progress");
+        else {
+            lapSaveLines = LAP.lines;
+            lapSavePos = 0;
+            out.println("OK saving lines");
+        }
+    }
+    else out.println("ERR lap [start|sector|clear|save]");
+}
+
+// help | list | get NAME [INDEX] | set NAME [INDEX] VALUE | save | import | mode debug|telemetry | stats | boot | lap
+FLASHMEM bool consoleCommand(int argc, char** argv, DebugPage& out){
+    if(strcmp(argv[0], "help") == 0){
+        out.println("help | list | get NAME [INDEX] | set NAME [INDEX] VALUE | save | import | mode debug|telemetry | stats | boot | lap [start|sector|clear|save]");
+        return false;
+    }
+    if(strcmp(argv[0], "lap") == 0){
+        lapCommand(argc, argv, out);
+        return false;
+    }
+    // set only changes the running tune, save makes it the boot tune
+    if(strcmp(argv[0], "save") == 0){
+        if(TUNE_STORE.save(captureTune())) out.printf("OK saving generation %lu to slot %c\n", (unsigned long)TUNE_STORE.generation + 1, TUNE_STORE.active == 0 ? 'B' : 'A');
+        else out.println("ERR save in progress");
+        return false;
+    }
+    // the SD read runs in serviceConsoleJobs()
+    if(strcmp(argv[0], "import") == 0){
+        if(state == DRIVE_ACTIVE || state == DRIVE_REGEN) out.println("ERR not while driving");
+        else {
+            consoleImport = true;
+            out.printf("OK importing %s\n", TUNE_FILE);
+        }
+        return false;
+    }
+    if(strcmp(argv[0], "list") == 0){
+        consoleListNext = 0;
+        return true;
+    }
+    if(strcmp(argv[0], "mode") == 0 && argc == 2){
+        if(strcmp(argv[1], "debug") == 0) serialMode = SERIAL_DEBUG;
+        else if(strcmp(argv[1], "telemetry") == 0){
+            serialMode = SERIAL_TELEMETRY;
+            TELEMETRY.begin(log_signals, sizeof(log_signals) / sizeof(LogSignal), TELEMETRY_SIGNALS, TELEMETRY_RATE);
+        }
+        else {
+            out.println("ERR mode debug|telemetry");
+            return false;
+        }
+        out.printf("OK mode %s\n", argv[1]);
+        return false;
+    }
+    if(strcmp(argv[0], "stats") == 0){
+        out.printf("console worst %lu us | lines %lu | overflows %lu\n", (unsigned long)CONSOLE.worstTime, (unsigned long)CONSOLE.lines, (unsigned long)CONSOLE.overflows);
+        out.printf("telemetry packets %lu | overruns %lu\n", (unsigned long)TELEMETRY.packets, (unsigned long)TELEMETRY.overruns);
+        out.printf("logger samples %lu | dropped %lu | worst write %lu us\n", (unsigned long)LOGGER.samples, (unsigned long)LOGGER.dropped, (unsigned long)LOGGER.worstWriteTime);
+        out.printf("tune slot %d | generation %lu | saves %lu | failures %lu\n", TUNE_STORE.active, (unsigned long)TUNE_STORE.generation, (unsigned long)TUNE_STORE.saves, (unsigned long)TUNE_STORE.failures);
+        out.printf("attitude steps %lu | gated %lu | %lu cycles, worst %lu of %lu\n", (unsigned long)ATTITUDE.steps, (unsigned long)ATTITUDE.rejected, (unsigned long)attitudeCycles, (unsigned long)attitudeWorstCycles, (unsigned long)ATTITUDE_CYCLE_BUDGET);
+        out.printf("stack peak %lu of %lu B | heap %lu B peak %lu B | stack scans %lu\n", (unsigned long)MEMORY.stackPeak, (unsigned long)MEMORY.stackSize, (unsigned long)MEMORY.heapInUse, (unsigned long)MEMORY.heapPeak, (unsigned long)MEMORY.passes);
+        return false;
+    }
+    if(strcmp(argv[0], "boot") == 0){
+        for(uint8_t i = 0; i < BOOT.count; i++) out.printf("%-8s %8lu us  at %8lu us\n", BOOT.stages[i].name, (unsigned long)BOOT.stages[i].time, (unsigned long)BOOT.stages[i].end);
+        out.printf("ready %lu us (budget %lu us) | ", (unsigned long)BOOT.ready, (unsigned long)BOOT_READY_BUDGET);
+        if(BOOT.done) out.printf("done %lu us\n", (unsigned long)BOOT.done);
+        else out.println("background steps running");
+        return false;
+    }
+    bool set = strcmp(argv[0], "set") == 0;
+    if(!set && strcmp(argv[0], "get") != 0){
+        out.printf("ERR unknown command %s\n", argv[0]);
+        return false;
+    }
+    const TuneField* f = argc >= 2 ? tune_field_find(argv[1]) : nullptr;
+    if(f == nullptr){
+        out.println("ERR unknown parameter, try list");
+        return false;
+    }
+    // words after the name: [INDEX] for get, [INDEX] VALUE for set
+    int indexed = f->count > 1 ? 1 : 0;
+    if(argc != 2 + indexed + (set ? 1 : 0)){
+        out.printf(set ? "ERR set %s%s VALUE\n" : "ERR get %s%s\n", f->name, indexed ? " INDEX" : "");
+        return false;
+    }
+    float index = 0;
+    if(indexed && (!parseNumber(argv[2], index) || index < 0 || index >= f->count || index != (int)index)){
+        out.printf("ERR index 0..%u\n", f->count - 1);
+        return false;
+    }
+    TuneData d = captureTune();
+    if(set){
+        float v;
+        if(!parseNumber(argv[argc - 1], v)){
+            out.println("ERR not a number");
+            return false;
+        }
+        if(!tune_field_check(*f, v)){
+            out.printf(tune_field_integer(*f) ? "ERR integer %g..%g\n" : "ERR range %g..%g\n", f->min, f->max);
+            return false;
+        }
+        if(!f->live && (state == DRIVE_ACTIVE || state == DRIVE_REGEN)){
+            out.println("ERR not while driving");
+            return false;
+        }
+        tune_field_set(d, *f, index, v);
+        const TuneField* bad = nullptr;
+        if(!tune_data_consistent(d, &bad)){
+            out.printf("ERR %s breaks apps zero != floor or warn < limit < critical\n", bad ? bad->name : f->name);
+            return false;
+        }
+        applyTune(d);
+        out.printf("OK ");
+    }
+    printField(out, d, *f, index);
+    return false;
+}
+
+// the serial port is shared by the console replies and either the debug page or the telemetry stream
+void serviceSerial(){
+    CONSOLE.service(Serial);
+    DebugPage& reply = CONSOLE.out;
+    if(serialMode == SERIAL_TELEMETRY){
+        if(reply.busy()) reply.sent += TELEMETRY.sendText(reply.buf + reply.sent, reply.length - reply.sent);
+        sendTelemetry();
+    }
+    // never split a debug page with a reply
+    else if(DEBUG_PAGE.busy() || !reply.busy()) printDebug();
+    else reply.service(Serial);
+}
+
+// CONSOLE JOBS
+// console commands that touch the SD card or EEPROM only queue their work, it runs here outside the
+// console budget with the car at rest, one step per loop pass
+FLASHMEM void serviceConsoleJobs(){
+    if(state == DRIVE_ACTIVE || state == DRIVE_REGEN) return;
+    if(lapSavePos < sizeof(LapLines)){
+        const uint8_t* src = (const uint8_t*)&lapSaveLines;
+        uint16_t end = lapSavePos + TUNE_STORE_CHUNK;
+        if(end > sizeof(LapLines)) end = sizeof(LapLines);
+        for(uint16_t i = lapSavePos; i < end; i++) EEPROM.update(LAP_LINES_ADDRESS + i, src[i]);
+        lapSavePos = end;
+        if(lapSavePos == sizeof(LapLines)) serialNote("OK lines saved");
+        return;
+    }
+    // same rule as a CAN upload, the tune only changes with the car at rest
+    if(consoleImport && (state == GLV_ON || state == DRIVE_STANDBY) && !TUNE_STORE.busy()){
+        consoleImport = false;
+        TuneImage img;
+        if(!readSDCard(img)) serialNote("ERR no valid %s on the SD card", TUNE_FILE);
+        else {
+            applyTune(img.data);
+            TUNE_STORE.save(img.data);
+            serialNote("OK imported %s", TUNE_FILE);
+        }
+    }
+}
+
+// BOOT
+// setup() leaves the SD card, the data logger and an SD tune import to these steps, one per loop
+// pass so the checks and CAN keep running in between. SD.begin() itself still blocks while the card
+// initialises, so it only runs with the car sitting in GLV_ON.
+enum BootStep {BOOT_SD, BOOT_LOGGER, BOOT_IMPORT, BOOT_DONE};
+BootStep bootStep = BOOT_SD;
+bool bootImport = false; // no valid tune in EEPROM, seed the store from the SD card
+
+FLASHMEM void serviceBoot(){
+    switch(bootStep){
+        case BOOT_SD:
+            if(state != GLV_ON) return;
+            sdReady = SD.begin(BUILTIN_SDCARD);
+            BOOT.mark("sd");
+            bootStep = BOOT_LOGGER;
+            return;
+        case BOOT_LOGGER:
+            // on-car logging is best effort: no card, no log
+            if(!sdReady || !LOGGER.begin(log_signals, sizeof(log_signals) / sizeof(LogSignal), LOG_RATE)){
+                serialNote("DATA LOGGER DISABLED");
+            }
+            BOOT.mark("logger");
+            bootStep = BOOT_IMPORT;
+            return;
+        case BOOT_IMPORT:
+            if(bootImport){
+                // same rule as a CAN upload, the tune only changes with the car at rest
+                if((state != GLV_ON && state != DRIVE_STANDBY) || TUNE_STORE.busy()) return;
+                TuneImage img;
+                if(readSDCard(img)){
+                    applyTune(img.data);
+                    TUNE_STORE.save(img.data);
+                }
+                else serialNote("NO STORED TUNE, USING DEFAULTS");
+                BOOT.mark("import");
+            }
+            bootStep = BOOT_DONE;
+            BOOT.done = micros();
+            serialNote("BOOT ready %lu us%s | done %lu us", (unsigned long)BOOT.ready, BOOT.overBudget() ? " OVER BUDGET" : "", (unsigned long)BOOT.done);
+            // everything is static from here on, the checked build traps any malloc (see HeapGuard.h)
+            HEAP_GUARD.lock();
+            MEMORY.lock();
+            return;
+        case BOOT_DONE:
+            return;
     }
 }
 
@@ -1495,17 +2090,23 @@ void printDebug(){
 
 
 //GLV STARTUP
-void setup() {
+FLASHMEM void setup() {
+    BOOT.mark("core");
+    MEMORY.paint();
+    BOOT.mark("paint");
     // Car = new iCANflex();
     // begin();
     
-    sysCheck = new SystemsCheck();  
-    tune = new VehicleTuneController();
     can_primary.begin();
     can_primary.setBaudRate(1000000);
     msg.flags.extended = 1;
     can_data.begin();
     can_data.setBaudRate(1000000);
+    // inverter disabled before anything else can go wrong
+    DTI.setRCurrent(0);
+    DTI.setDriveEnable(0);
+    lastDTIMessage = millis();
+    BOOT.mark("can");
 
     Serial.begin(115200);
 
@@ -1519,12 +2120,9 @@ void setup() {
     pinMode(SDC_IN_PIN, INPUT);
     pinMode(SDC_OUT_PIN, INPUT);
     pinMode(AUX_OUT_PIN, OUTPUT);
+    BOOT.mark("pins");
 
 
-    active_faults = new std::unordered_set<bool (*)(VehicleTuneController&)>(); 
-    active_warnings = new std::unordered_set<bool (*)(VehicleTuneController&)>();
-    active_limits = new std::unordered_set<bool (*)(VehicleTuneController&)>();
-
     active_faults->clear();
     active_warnings->clear();
     active_limits->clear();
@@ -1538,28 +2136,34 @@ void setup() {
 
     // ! FOR MOTOR TEST BENCH ONLY
     // ! UNCOMMENT FOR NOMINAL VEHICLE OPERATION
-    tune->setPowerLevelData(LIMIT, 15);
-    tune->setPowerLevelData(LOW_PWR,30);
-    tune->setPowerLevelData(MID_PWR, 80);
-    tune->setPowerLevelData(HIGH_PWR, 150);
-    tune->setRegenLevelData(REGEN_HIGH, 100);
     settings.regen_level = REGEN_OFF;
     settings.power_level = HIGH_PWR;
     settings.throttle_map = TORQUE_MAP_1;
-    TorqueProfile tp(1.7, 1.2, 0.6);
-    
-    tune->setTorqueProfileData(TORQUE_MAP_1, tp);
-    DTI.setMaxCurrent(tune->getActiveCurrentLimit(settings.power_level));
-    
+
+    // tune from the newest valid EEPROM slot, the SD card only seeds an empty store (serviceBoot)
+    TuneImage img;
+    if(TUNE_STORE.load(img)) applyTune(img.data);
+    else bootImport = true;
+    LapLines lines;
+    EEPROM.get(LAP_LINES_ADDRESS, lines);
+    if(lap_lines_check(lines)) LAP.setLines(lines);
+    BOOT.mark("tune");
+
+    TELEMETRY.begin(log_signals, sizeof(log_signals) / sizeof(LogSignal), TELEMETRY_SIGNALS, TELEMETRY_RATE);
+    CONSOLE.handler = consoleCommand;
+    CONSOLE.resume = consoleList;
+    BOOT.mark("ready");
+    BOOT.ready = micros();
+    // SD card, logger and tune import continue in serviceBoot()
 }
 
 
 
 // MAIN LOOP
-void loop(){
+FASTRUN void loop(){
     // ! DISABLE REGEN
     settings.regen_level = REGEN_OFF; 
-    // printDebug();
+    serviceSerial();
     // System Checks
     // Serial.println(analogRead(IMD_OK_PIN));
     // ! SYSTEM CHECKS ARE SUPRESSED FOR MOTOR TEST BENCH
@@ -1568,10 +2172,13 @@ void loop(){
     // sysCheck->system_faults(*active_faults, tune);
     // sysCheck->system_limits(*active_limits, tune);
     // sysCheck->system_warnings(*active_warnings, tune); //TODO: implement exit conditions for warnings
+    sysCheck->memory_warnings(*active_warnings, tune);
     
     state = active_faults->size() ?  sendToError(*active_faults->begin()) : state;
     digitalWrite(SOFTWARE_OK_CONTROL_PIN, HIGH);
-    settings.power_level = active_limits->size() ? LIMIT : settings.power_level; // limit power in overheat conditions
+    serviceThermal(*tune);
+    serviceAttitude();
+    serviceDerating(*tune); // graded current ceiling in overheat and sag conditions
 
     if(state == GLV_ON) digitalWrite(AUX_OUT_PIN, LOW);
     // if(settings.power_level == LIMIT) sendDashPopup(0xA, 5);
@@ -1593,41 +2200,63 @@ void loop(){
 
 
     // send outgoing CAN Messages
-    tryPingRequests({Pedals_Ping_Request, Steering_Wheel_Ping_Request, Dash_Panel_Ping_Request, ACU_Ping_Request} );
+    tryPingRequests();
     checkPingTimeout();
     sendPingValues(); 
     sendVDMInfo(*tune); 
     
 
+    sampleDriverInputs(*tune);
     if(can_primary.read(msg)){
+        unsigned long rxTime = micros(); // arrival in the VDM time base
+        // only data frames carry sensor time, ping responses are timed in handlePingResponse()
+        bool data = pingNode(msg.id) == nullptr;
         DTI.receive(msg.id, msg.buf);
         ECU.receive(msg.id, msg.buf);
-        PEDALS.receive(msg.id, msg.buf);
-        ACU1.receive(msg.id, msg.buf);
+        if(PEDALS.receive(msg.id, msg.buf) && data) BUS_LATENCY.stampFrame(LATENCY_PEDALS, rxTime);
+        if(ACU1.receive(msg.id, msg.buf) && data) BUS_LATENCY.stampFrame(LATENCY_ACU, rxTime);
         TCM1.receive(msg.id, msg.buf);
-        DASHBOARD.receive(msg.id, msg.buf);
-        ENERGY_METER.receive(msg.id, msg.buf);
-        STEERING_WHEEL.receive(msg.id, msg.buf);
+        if(DASHBOARD.receive(msg.id, msg.buf) && data) BUS_LATENCY.stampFrame(LATENCY_DASH, rxTime);
+        // DC bus power for the power cap at the frame rate, the ACU stands in while the meter is silent
+        if(ENERGY_METER.receive(msg.id, msg.buf) && msg.id == Energy_Meter_Measurements) POWER_CAP.sample(rxTime, ENERGY_METER.getVoltage(), ENERGY_METER.getCurrent());
+        else if(msg.id == ACU_General && rxTime - ENERGY_METER.getSampleTime() > POWER_STALE) POWER_CAP.sample(rxTime, ACU1.getTSVoltage(), ACU1.getAccumulatorCurrent());
+        if(STEERING_WHEEL.receive(msg.id, msg.buf) && data) BUS_LATENCY.stampFrame(LATENCY_STEERING, rxTime);
         // process incoming CAN Messages    
         handleDashPanelInputs();   
         handleDriverInputs(*tune);
         handlePingResponse();
-        handleECUTuning(*tune);
+        handleECUTuning();
     }
     if(can_data.read(msg2)){
-        WFL.receive(msg.id, msg.buf);
-        WFR.receive(msg.id, msg.buf);
-        WRL.receive(msg.id, msg.buf);
-        WRR.receive(msg.id, msg.buf);
-        GPS1.receive(msg.id, msg.buf);
+        unsigned long rxTime = micros();
+        // the speed/travel frame (first id of each hub) makes a new wheel sample
+        if(WFL.receive(msg2.id, msg2.buf) && msg2.id == WFL.id_range[0]) pushWheel(CORNER_FL, WFL, rxTime);
+        if(WFR.receive(msg2.id, msg2.buf) && msg2.id == WFR.id_range[0]) pushWheel(CORNER_FR, WFR, rxTime);
+        if(WRL.receive(msg2.id, msg2.buf) && msg2.id == WRL.id_range[0]) pushWheel(CORNER_RL, WRL, rxTime);
+        if(WRR.receive(msg2.id, msg2.buf) && msg2.id == WRR.id_range[0]) pushWheel(CORNER_RR, WRR, rxTime);
+        // latitude comes first, the longitude frame completes a fix
+        CIMU.receive(msg2.id, msg2.buf);
+        if(GPS1.receive(msg2.id, msg2.buf) && msg2.id == 0x10F24 && GPS1.getLatitude() != 0) LAP.fix(rxTime, GPS1.getLatitudeDeg(), GPS1.getLongitudeDeg());
     }
+    WHEELS.update(micros(), WHEEL);
+    serviceLapTimer();
+    SOC.update(micros(), ENERGY_METER.getCurrent(), ENERGY_METER.getVoltage(), ENERGY_METER.getSampleTime(), ACU1.getMeanCellVoltage(), ACU1.cellVoltages.complete());
+
+    // data logging, sealed blocks carry the lap they were recorded in
+    LOGGER.lap = LAP.lap;
+    LOGGER.sample(micros());
+    LOGGER.service();
+    serviceTuneUpload();
+    // tune saves, never while driving since an EEPROM flash erase can stall for milliseconds
+    if(state != DRIVE_ACTIVE && state != DRIVE_REGEN) TUNE_STORE.service();
+    serviceConsoleJobs();
 
     // traction control
     if(mode == DYNAMIC_TC) computeTractionControl();
     if(tc_multiplier < 1) sendDashPopup(0x07, 1);
 
     // brake light
-    if(analogRead(BSE_HIGH) > 500) digitalWrite(BRAKE_LIGHT_PIN, HIGH);
+    if(brakeADC > 500) digitalWrite(BRAKE_LIGHT_PIN, HIGH);
     else digitalWrite(BRAKE_LIGHT_PIN, LOW);
 
     // state machine operation
@@ -1649,9 +2278,10 @@ void loop(){
         case TS_PRECHARGE:
             state = ts_precharge();
             break;
-        // case PRECHARGING:
-        //     state = precharging();
-        //     break;
+        // stage 2 is folded into ts_precharge(), which waits on the ACU AIR state itself
+        case PRECHARGING:
+            state = ts_precharge();
+            break;
         case PRECHARGE_COMPLETE:
             state = precharge_complete();
             break;
@@ -1671,6 +2301,10 @@ void loop(){
             state = ts_discharge_off();
     }
 
+    // stack and heap high water marks, a few hundred words per pass
+    MEMORY.service(millis());
+    serviceBoot();
+
 
 
 
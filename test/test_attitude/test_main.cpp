@@ -0,0 +1,107 @@
+// GAUCHO RACING VDM ATTITUDE TESTS
+// src/Attitude.h on a parked car and its cost per step. The host cannot count Teensy cycles, so the
+// step is held to a tenth of ATTITUDE_CYCLE_BUDGET at 600 MHz as tools/vdm_attitude.cpp does; the car
+// reports the real figure with the cycle counter ("stats" on the console).
+//     pio test -e native -f test_attitude
+#include <unity.h>
+#include <chrono>
+#include "Attitude.h"
+
+void setUp(void){}
+void tearDown(void){}
+
+const float DEG = 3.14159265f / 180;
+
+// parked with the given roll and pitch, gyro reading only its bias
+static ImuSample parked(float roll, float pitch, float bias){
+    ImuSample s = {};
+    s.gx = bias;
+    s.gy = -bias;
+    s.gz = bias;
+    s.ax = -sinf(pitch);
+    s.ay = sinf(roll) * cosf(pitch);
+    s.az = cosf(roll) * cosf(pitch);
+    return s;
+}
+
+void test_steps_at_the_period(void){
+    Attitude att;
+    ImuSample s = parked(0, 0, 0);
+    TEST_ASSERT_TRUE(att.update(1000, s, 0));      // the first call seeds
+    TEST_ASSERT_FALSE(att.update(1000 + ATTITUDE_PERIOD - 1, s, 0));
+    TEST_ASSERT_TRUE(att.update(1000 + ATTITUDE_PERIOD, s, 0));
+    TEST_ASSERT_EQUAL_UINT32(1, att.steps);
+}
+
+// the seed levels on the accelerometer, the PI loop then holds the tilt against the gyro bias
+void test_parked_tilt_and_bias(void){
+    Attitude att;
+    ImuSample s = parked(2 * DEG, -3 * DEG, 0.01f);
+    uint32_t now = 0;
+    att.update(now, s, 0);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f * DEG, 2 * DEG, att.roll);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f * DEG, -3 * DEG, att.pitch);
+    for(int i = 0; i < 120 * 200; i++) att.update(now += ATTITUDE_PERIOD, s, 0);
+    TEST_ASSERT_FLOAT_WITHIN(0.2f * DEG, 2 * DEG, att.roll);
+    TEST_ASSERT_FLOAT_WITHIN(0.2f * DEG, -3 * DEG, att.pitch);
+    TEST_ASSERT_FLOAT_WITHIN(0.002f, 0.01f, att.biasX);
+    TEST_ASSERT_FLOAT_WITHIN(0.002f, -0.01f, att.biasY);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 0, att.longAccel);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 0, att.latAccel);
+    TEST_ASSERT_EQUAL_UINT32(0, att.rejected);
+}
+
+// a kerb strike is left to the gyro
+void test_gate_rejects_bumps(void){
+    Attitude att;
+    ImuSample s = parked(0, 0, 0);
+    uint32_t now = 0;
+    att.update(now, s, 0);
+    s.az = 1 + 2 * ATTITUDE_ACCEL_GATE;
+    att.update(now += ATTITUDE_PERIOD, s, 0);
+    TEST_ASSERT_EQUAL_UINT32(1, att.rejected);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0, att.roll);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0, att.pitch);
+}
+
+// every step takes the accelerometer and magnetometer paths, the dearest case
+void test_cycle_budget(void){
+    const int count = 2000;
+    static ImuSample samples[count];
+    static float speeds[count];
+    for(int i = 0; i < count; i++){
+        float t = i * (ATTITUDE_PERIOD * 1e-6f);
+        samples[i] = parked(0.03f * sinf(1.2f * t), -0.05f, 0.01f);
+        samples[i].gz += 0.6f * sinf(1.2f * t);
+        samples[i].mx = 0.45f;
+        samples[i].my = 0.05f;
+        samples[i].mz = -0.35f;
+        speeds[i] = 15 + 5 * sinf(0.2f * t);
+    }
+    // best of a few runs, the host may be busy with something else
+    double best = 1e9;
+    for(int run = 0; run < 5; run++){
+        Attitude att;
+        auto t0 = std::chrono::steady_clock::now();
+        for(int r = 0; r < 10; r++){
+            for(int i = 0; i < count; i++) att.update((uint32_t)((r * count + i) * ATTITUDE_PERIOD), samples[i], speeds[i]);
+        }
+        double ns = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() * 1e9 / (10 * count);
+        if(ns < best) best = ns;
+        TEST_ASSERT_EQUAL_UINT32(10 * count - 1, att.steps);
+    }
+    double allowance = ATTITUDE_CYCLE_BUDGET / 600e6 * 1e9 / 10;
+    char msg[96];
+    snprintf(msg, sizeof(msg), "step %.1f ns on host, allowance %.0f ns", best, allowance);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE_MESSAGE(best <= allowance, msg);
+}
+
+int main(int argc, char** argv){
+    UNITY_BEGIN();
+    RUN_TEST(test_steps_at_the_period);
+    RUN_TEST(test_parked_tilt_and_bias);
+    RUN_TEST(test_gate_rejects_bumps);
+    RUN_TEST(test_cycle_budget);
+    return UNITY_END();
+}
@@ -0,0 +1,138 @@
+// GAUCHO RACING VDM TELEMETRY FORMAT TESTS
+// COBS framing, the decode bound and the CRC check of src/TelemetryFormat.h.
+//     pio test -e native -f test_telemetry_format
+#include <unity.h>
+#include <stdlib.h>
+#include "TelemetryFormat.h"
+
+static uint8_t packet[TLM_MAX_PACKET + 16];
+static uint8_t frame[TLM_MAX_FRAME + 16];
+static uint8_t decoded[TLM_MAX_PACKET + 16];
+
+void setUp(void){}
+void tearDown(void){}
+
+// encode len bytes, decode them again and compare
+static void roundTrip(const uint8_t* in, size_t len){
+    size_t n = cobs_encode(in, len, frame);
+    TEST_ASSERT_LESS_OR_EQUAL(len + len / 254 + 1, n);
+    for(size_t i = 0; i < n; i++) TEST_ASSERT_TRUE(frame[i] != 0);
+    TEST_ASSERT_EQUAL_INT((int)len, cobs_decode(frame, n, decoded, sizeof(decoded)));
+    if(len) TEST_ASSERT_EQUAL_MEMORY(in, decoded, len);
+}
+
+void test_crc32_check_value(void){
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926, crc32("123456789", 9));
+    TEST_ASSERT_EQUAL_HEX32(crc32("123456789", 9), crc32_update(crc32("1234", 4), "56789", 5));
+}
+
+void test_cobs_round_trip(void){
+    srand(1);
+    uint8_t in[TLM_MAX_PACKET];
+    for(size_t len = 0; len <= 600; len++){
+        for(size_t i = 0; i < len; i++) in[i] = (rand() % 4 == 0) ? 0 : rand();
+        roundTrip(in, len);
+    }
+}
+
+// a block of 254 non-zero bytes takes a 0xFF code with no implied zero after it
+void test_cobs_long_runs(void){
+    uint8_t in[TLM_MAX_PACKET];
+    const size_t lengths[] = {253, 254, 255, 508, 509, TLM_MAX_PACKET};
+    for(size_t len : lengths){
+        for(size_t i = 0; i < len; i++) in[i] = 1 + i % 255;
+        roundTrip(in, len);
+        memset(in, 0, len);
+        roundTrip(in, len);
+    }
+}
+
+void test_cobs_rejects_malformed(void){
+    const uint8_t zero[] = {0x02, 0x00};            // zero inside the frame
+    const uint8_t shortRun[] = {0x05, 0x01, 0x02};  // code runs past the end
+    const uint8_t zeroCode[] = {0x00};
+    TEST_ASSERT_EQUAL_INT(-1, cobs_decode(zero, sizeof(zero), decoded, sizeof(decoded)));
+    TEST_ASSERT_EQUAL_INT(-1, cobs_decode(shortRun, sizeof(shortRun), decoded, sizeof(decoded)));
+    TEST_ASSERT_EQUAL_INT(-1, cobs_decode(zeroCode, sizeof(zeroCode), decoded, sizeof(decoded)));
+}
+
+// the output never goes past cap, whether the last byte written is data or an implied zero
+void test_cobs_decode_capacity(void){
+    uint8_t in[64];
+    for(size_t i = 0; i < sizeof(in); i++) in[i] = (i % 7 == 3) ? 0 : 0x55;
+    size_t n = cobs_encode(in, sizeof(in), frame);
+    for(size_t cap = 0; cap < sizeof(in); cap++){
+        memset(decoded, 0xEE, sizeof(decoded));
+        TEST_ASSERT_EQUAL_INT(-1, cobs_decode(frame, n, decoded, cap));
+        TEST_ASSERT_EQUAL_HEX8(0xEE, decoded[cap]);
+    }
+    TEST_ASSERT_EQUAL_INT((int)sizeof(in), cobs_decode(frame, n, decoded, sizeof(in)));
+}
+
+// a frame of TLM_MAX_FRAME bytes is accepted by length but decodes to more than a packet
+void test_unframe_oversized(void){
+    memset(frame, 0x01, TLM_MAX_FRAME);             // every byte a code 1: one zero each
+    memset(packet, 0xEE, sizeof(packet));
+    TEST_ASSERT_EQUAL_INT(-1, tlm_unframe(frame, TLM_MAX_FRAME, packet));
+    for(size_t i = TLM_MAX_PACKET; i < sizeof(packet); i++) TEST_ASSERT_EQUAL_HEX8(0xEE, packet[i]);
+    TEST_ASSERT_EQUAL_INT(-1, tlm_unframe(frame, TLM_MAX_FRAME + 1, packet));
+    TEST_ASSERT_EQUAL_INT(-1, tlm_unframe(frame, 0, packet));
+}
+
+void test_data_packet_round_trip(void){
+    const float values[4] = {0, -1.5f, 1e6f, 3.25f};
+    TelemetryStatus status = {7, 1, 3, TLM_FLAG_LIMIT | TLM_FLAG_LOGGING};
+    size_t n = tlm_data_packet(packet, 42, 123456, status, values, 4);
+    size_t f = tlm_frame(packet, n, frame);
+    TEST_ASSERT_EQUAL_HEX8(0, frame[f - 1]);
+    TEST_ASSERT_EQUAL_INT((int)n, tlm_unframe(frame, f - 1, decoded));
+    TelemetryHeader h;
+    memcpy(&h, decoded, sizeof(h));
+    TEST_ASSERT_EQUAL_UINT8(TLM_DATA, h.type);
+    TEST_ASSERT_EQUAL_UINT8(TLM_VERSION, h.version);
+    TEST_ASSERT_EQUAL_UINT8(4, h.signalCount);
+    TEST_ASSERT_EQUAL_UINT32(42, h.seq);
+    TEST_ASSERT_EQUAL_UINT32(123456, h.time);
+    TEST_ASSERT_EQUAL_MEMORY(&status, decoded + sizeof(h), sizeof(status));
+    TEST_ASSERT_EQUAL_MEMORY(values, decoded + sizeof(h) + sizeof(status), sizeof(values));
+}
+
+// any single bit flip is caught by COBS or the CRC
+void test_corruption_detected(void){
+    const float values[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    TelemetryStatus status = {1, 2, 3, 0};
+    size_t n = tlm_data_packet(packet, 1, 2, status, values, 8);
+    size_t f = tlm_frame(packet, n, frame) - 1;
+    for(size_t i = 0; i < f; i++){
+        for(uint8_t bit = 0; bit < 8; bit++){
+            frame[i] ^= 1 << bit;
+            TEST_ASSERT_EQUAL_INT(-1, tlm_unframe(frame, f, decoded));
+            frame[i] ^= 1 << bit;
+        }
+    }
+    TEST_ASSERT_EQUAL_INT((int)n, tlm_unframe(frame, f, decoded));
+}
+
+void test_text_packet_cut(void){
+    char text[TLM_MAX_TEXT + 100];
+    memset(text, 'x', sizeof(text));
+    size_t n = tlm_text_packet(packet, 0, 0, text, sizeof(text));
+    TEST_ASSERT_EQUAL_UINT(sizeof(TelemetryHeader) + TLM_MAX_TEXT, n);
+    size_t f = tlm_frame(packet, n, frame);
+    TEST_ASSERT_LESS_OR_EQUAL(TLM_MAX_FRAME, f);
+    TEST_ASSERT_EQUAL_INT((int)n, tlm_unframe(frame, f - 1, decoded));
+}
+
+int main(int argc, char** argv){
+    UNITY_BEGIN();
+    RUN_TEST(test_crc32_check_value);
+    RUN_TEST(test_cobs_round_trip);
+    RUN_TEST(test_cobs_long_runs);
+    RUN_TEST(test_cobs_rejects_malformed);
+    RUN_TEST(test_cobs_decode_capacity);
+    RUN_TEST(test_unframe_oversized);
+    RUN_TEST(test_data_packet_round_trip);
+    RUN_TEST(test_corruption_detected);
+    RUN_TEST(test_text_packet_cut);
+    return UNITY_END();
+}
@@ -0,0 +1,185 @@
+// GAUCHO RACING VDM TUNE UPLOAD TESTS
+// src/TuneUpload.h sender against the VDM receiver in process, over a link that drops, duplicates and
+// reorders frames, plus the images the receiver has to refuse.
+//     pio test -e native -f test_tune_upload
+#include <unity.h>
+#include <deque>
+#include <random>
+#include "TuneUpload.h"
+#include "config.h"
+
+void setUp(void){}
+void tearDown(void){}
+
+// one direction of the bus, frames arrive a millisecond after they are sent
+struct LossyLink {
+    struct Frame {
+        uint32_t id;
+        uint8_t buf[8];
+        uint32_t at;
+    };
+    std::deque<Frame> q;
+    std::mt19937 rng;
+    double loss;
+
+    LossyLink(uint32_t seed, double l) : rng(seed), loss(l) {}
+
+    bool chance(double p){return std::uniform_real_distribution<double>(0, 1)(rng) < p;}
+
+    void push(uint32_t id, const uint8_t* buf, uint32_t now){
+        if(chance(loss)) return;
+        Frame f = {id, {}, now + 1};
+        memcpy(f.buf, buf, 8);
+        if(!q.empty() && chance(loss / 2)) q.insert(q.end() - 1, f);       // overtakes the previous frame
+        else q.push_back(f);
+        if(chance(loss / 4)) q.push_back(f);
+    }
+
+    bool pop(uint32_t now, Frame& f){
+        if(q.empty() || q.front().at > now) return false;
+        f = q.front();
+        q.pop_front();
+        return true;
+    }
+};
+
+struct Transfer {
+    TuneUploadReceiver rx;
+    TuneUploadSender tx;
+    uint8_t lastStatus = 0;                         // last status the sender heard
+    bool applied = false;
+};
+
+// run one upload a millisecond at a time until the sender finishes
+// @param safeAt ms from which the car is in a safe state and the staged image is applied
+// @param stopAt ms after which the sender goes quiet
+static void run(Transfer& t, const TuneImage& img, uint32_t seed, double loss, uint8_t window, uint32_t safeAt = 0, uint32_t stopAt = UINT32_MAX){
+    LossyLink up(seed, loss), down(seed + 1, loss);
+    t.tx.begin(img, window, 0);
+    for(uint32_t now = 0; now < 120000 && !t.tx.finished(); now++){
+        uint32_t id;
+        uint8_t buf[8];
+        // a CAN bus at 1 Mbit fits about 8 frames per ms
+        for(int n = 0; n < 8 && now < stopAt && t.tx.poll(now, id, buf, Tune_Upload_Control, Tune_Upload_Data); n++) up.push(id, buf, now);
+        LossyLink::Frame f;
+        uint8_t ack[8];
+        while(up.pop(now, f)){
+            bool reply = f.id == Tune_Upload_Control ? t.rx.onControl(f.buf, 8, now, ack) : t.rx.onData(f.buf, 8, now, ack);
+            if(reply) down.push(Tune_Upload_Ack, ack, now);
+        }
+        if(t.rx.service(now, ack)) down.push(Tune_Upload_Ack, ack, now);
+        if(t.rx.phase == TuneUploadReceiver::STAGED && now >= safeAt && t.rx.applied(ack)){
+            t.applied = true;
+            down.push(Tune_Upload_Ack, ack, now);
+        }
+        while(down.pop(now, f)){
+            t.lastStatus = f.buf[0];
+            t.tx.onAck(f.buf, 8, now);
+        }
+        if(now >= stopAt && t.rx.phase == TuneUploadReceiver::IDLE && t.lastStatus == TUNE_ERR_TIMEOUT) break;
+    }
+}
+
+static TuneImage image(){
+    TuneData d = tune_defaults();
+    d.power[3] = 140;
+    d.revLimit = 5000;
+    TuneImage img;
+    tune_image_seal(img, d, 7);
+    return img;
+}
+
+void test_clean_link(void){
+    TuneImage img = image();
+    const uint8_t windows[] = {1, 4, 8, 32};
+    for(uint8_t w : windows){
+        Transfer t;
+        run(t, img, 1, 0, w);
+        TEST_ASSERT_EQUAL_INT(TuneUploadSender::DONE, t.tx.phase);
+        TEST_ASSERT_TRUE(t.applied);
+        TEST_ASSERT_EQUAL_MEMORY(&img, &t.rx.shadow, sizeof(TuneImage));
+        TEST_ASSERT_EQUAL_UINT32(0, t.tx.resends);
+    }
+}
+
+void test_lossy_link(void){
+    TuneImage img = image();
+    const double losses[] = {0.01, 0.05, 0.2};
+    for(double loss : losses){
+        for(uint32_t seed = 1; seed <= 20; seed++){
+            Transfer t;
+            run(t, img, seed, loss, TUNE_UPLOAD_WINDOW);
+            TEST_ASSERT_EQUAL_INT(TuneUploadSender::DONE, t.tx.phase);
+            TEST_ASSERT_EQUAL_MEMORY(&img, &t.rx.shadow, sizeof(TuneImage));
+        }
+    }
+}
+
+// staged until the car is safe, the sender keeps waiting for APPLIED
+void test_waits_for_safe_state(void){
+    TuneImage img = image();
+    Transfer t;
+    run(t, img, 3, 0.05, TUNE_UPLOAD_WINDOW, 20000);
+    TEST_ASSERT_EQUAL_INT(TuneUploadSender::DONE, t.tx.phase);
+    TEST_ASSERT_TRUE(t.applied);
+}
+
+// the CRC matches but the image is not a tune the VDM may run
+void test_rejects_bad_images(void){
+    TuneImage bad = image();
+    bad.data.revLimit = 60000;                      // out of range
+    bad.crc = crc32(&bad, offsetof(TuneImage, crc));
+    Transfer t;
+    run(t, bad, 1, 0, 8);
+    TEST_ASSERT_EQUAL_INT(TuneUploadSender::FAILED, t.tx.phase);
+    TEST_ASSERT_EQUAL_HEX8(TUNE_ERR_IMAGE, t.tx.error);
+    TEST_ASSERT_EQUAL_UINT32(0, t.rx.staged);
+
+    bad = image();
+    bad.data.revLimit = 0;                          // divides the torque map
+    bad.crc = crc32(&bad, offsetof(TuneImage, crc));
+    Transfer z;
+    run(z, bad, 1, 0, 8);
+    TEST_ASSERT_EQUAL_HEX8(TUNE_ERR_IMAGE, z.tx.error);
+    TEST_ASSERT_EQUAL_UINT32(0, z.rx.staged);
+
+    bad = image();
+    bad.data.tempBattery[0] = bad.data.tempBattery[1]; // warn not below limit
+    bad.crc = crc32(&bad, offsetof(TuneImage, crc));
+    Transfer u;
+    run(u, bad, 1, 0, 8);
+    TEST_ASSERT_EQUAL_HEX8(TUNE_ERR_IMAGE, u.tx.error);
+    TEST_ASSERT_EQUAL_UINT32(0, u.rx.staged);
+}
+
+// the sender vanishes halfway through, the VDM drops the transfer
+void test_stalled_sender_times_out(void){
+    TuneImage img = image();
+    Transfer t;
+    run(t, img, 1, 0, 8, 0, 10);
+    TEST_ASSERT_EQUAL_INT(TuneUploadReceiver::IDLE, t.rx.phase);
+    TEST_ASSERT_EQUAL_HEX8(TUNE_ERR_TIMEOUT, t.lastStatus);
+    TEST_ASSERT_EQUAL_UINT32(0, t.rx.staged);
+}
+
+void test_rejects_wrong_size(void){
+    TuneUploadReceiver rx;
+    uint8_t begin[8] = {TUNE_CMD_BEGIN};
+    tune_put16(begin + 1, sizeof(TuneImage) - 1);
+    begin[3] = 8;
+    uint8_t ack[8];
+    TEST_ASSERT_TRUE(rx.onControl(begin, 8, 0, ack));
+    TEST_ASSERT_EQUAL_HEX8(TUNE_ERR_SIZE, ack[0]);
+    TEST_ASSERT_EQUAL_INT(TuneUploadReceiver::IDLE, rx.phase);
+}
+
+int main(int argc, char** argv){
+    UNITY_BEGIN();
+    RUN_TEST(test_clean_link);
+    RUN_TEST(test_lossy_link);
+    RUN_TEST(test_waits_for_safe_state);
+    RUN_TEST(test_rejects_bad_images);
+    RUN_TEST(test_stalled_sender_times_out);
+    RUN_TEST(test_rejects_wrong_size);
+    return UNITY_END();
+}
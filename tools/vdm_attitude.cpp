@@ -0,0 +1,137 @@
+
+// GAUCHO RACING VDM ATTITUDE BENCH
+// Runs the VDM attitude filter (see src/Attitude.h) against a simulated slalom with body roll, speed changes,
+// gyro bias and sensor noise, and reports its error and its cost per step.
+//
+// Build (Linux):
+//     g++ -O2 -std=c++17 -I src tools/vdm_attitude.cpp -o vdm_attitude
+//
+// Usage:
+//     vdm_attitude [SECONDS]          simulate (120 s default), print the errors and the step time
+//
+// The step time is host time. The Teensy's Cortex-M7 at 600 MHz runs single precision float code several
+// times slower per cycle than a desktop core, so the host figure is held to a tenth of the cycle budget;
+// the VDM measures the real figure with the cycle counter ("stats" on the console).
+#include "Attitude.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// earth vector into body axes for ZYX Euler angles
+static void toBody(double roll, double pitch, double yaw, const double e[3], double b[3]){
+    double cr = cos(roll), sr = sin(roll), cp = cos(pitch), sp = sin(pitch), cy = cos(yaw), sy = sin(yaw);
+    // rows of the earth to body rotation
+    b[0] = cp * cy * e[0] + cp * sy * e[1] - sp * e[2];
+    b[1] = (sr * sp * cy - cr * sy) * e[0] + (sr * sp * sy + cr * cy) * e[1] + sr * cp * e[2];
+    b[2] = (cr * sp * cy + sr * sy) * e[0] + (cr * sp * sy - sr * cy) * e[1] + cr * cp * e[2];
+}
+
+static double wrap(double a){
+    while(a > M_PI) a -= 2 * M_PI;
+    while(a < -M_PI) a += 2 * M_PI;
+    return a;
+}
+
+struct Truth {
+    double t, roll, pitch, yaw, longAccel, latAccel;
+};
+
+int main(int argc, char** argv){
+    double seconds = argc > 1 ? atof(argv[1]) : 120;
+    if(seconds <= 0){
+        fprintf(stderr, "usage: vdm_attitude [SECONDS]\n");
+        return 2;
+    }
+    const double magField[3] = {0.45, 0.05, -0.35}; // earth axes, arbitrary units
+    const double bias[3] = {0.012, -0.008, 0.015};  // rad/s
+
+    std::mt19937 rng(1);
+    std::normal_distribution<double> gyroNoise(0, 0.004), accelNoise(0, 0.02), magNoise(0, 0.01);
+
+    std::vector<ImuSample> samples;
+    std::vector<float> speeds;
+    std::vector<Truth> truth;
+    for(long k = 0; k * (ATTITUDE_PERIOD * 1e-6) < seconds; k++){
+        double t = k * (ATTITUDE_PERIOD * 1e-6);
+        // parked 3 degrees nose down on a 2 degree camber for 5 s, then a slalom with body roll and speed changes
+        bool moving = t > 5;
+        double m = moving ? t - 5 : 0;
+        double speed = moving ? 15 + 5 * sin(0.2 * m) : 0;
+        double accel = moving ? 0.2 * 5 * cos(0.2 * m) : 0;
+        double yaw = 0.5 * (1 - cos(1.2 * m)), yawRate = 0.6 * sin(1.2 * m);
+        double roll = 2 * M_PI / 180 - 0.04 * sin(1.2 * m), rollRate = -0.048 * cos(1.2 * m);
+        double pitch = -3 * M_PI / 180 - 0.01 * accel, pitchRate = moving ? 0.01 * 0.2 * 0.2 * 5 * sin(0.2 * m) : 0;
+        // body rates from the Euler rates
+        double w[3] = {rollRate - yawRate * sin(pitch),
+                       pitchRate * cos(roll) + yawRate * cos(pitch) * sin(roll),
+                       -pitchRate * sin(roll) + yawRate * cos(pitch) * cos(roll)};
+        // specific force: gravity plus the car's own acceleration, both in g
+        double f[3] = {(accel * cos(yaw) - speed * yawRate * sin(yaw)) / STANDARD_GRAVITY,
+                       (accel * sin(yaw) + speed * yawRate * cos(yaw)) / STANDARD_GRAVITY, 1};
+        double fb[3], mb[3], ab[3];
+        toBody(roll, pitch, yaw, f, fb);
+        toBody(roll, pitch, yaw, magField, mb);
+        f[2] = 0;
+        toBody(roll, pitch, yaw, f, ab);
+        ImuSample s;
+        s.gx = w[0] + bias[0] + gyroNoise(rng);
+        s.gy = w[1] + bias[1] + gyroNoise(rng);
+        s.gz = w[2] + bias[2] + gyroNoise(rng);
+        s.ax = fb[0] + accelNoise(rng);
+        s.ay = fb[1] + accelNoise(rng);
+        s.az = fb[2] + accelNoise(rng);
+        s.mx = mb[0] + magNoise(rng);
+        s.my = mb[1] + magNoise(rng);
+        s.mz = mb[2] + magNoise(rng);
+        samples.push_back(s);
+        speeds.push_back(speed);
+        truth.push_back({t, roll, pitch, yaw, ab[0] * STANDARD_GRAVITY, ab[1] * STANDARD_GRAVITY});
+    }
+
+    // yaw is taken against the horizontal field, not the simulation's x axis
+    double yawOffset = -atan2(magField[1], magField[0]);
+    Attitude att;
+    double rollSq = 0, pitchSq = 0, yawSq = 0, longSq = 0, latSq = 0, worstTilt = 0;
+    long n = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < samples.size(); i++){
+        att.update((uint32_t)(i * ATTITUDE_PERIOD), samples[i], speeds[i]);
+        if(truth[i].t < 10) continue;               // settling
+        double er = (att.roll - truth[i].roll) * 180 / M_PI;
+        double ep = (att.pitch - truth[i].pitch) * 180 / M_PI;
+        double ey = wrap(att.yaw - yawOffset - truth[i].yaw) * 180 / M_PI;
+        rollSq += er * er;
+        pitchSq += ep * ep;
+        yawSq += ey * ey;
+        double ex = att.longAccel - truth[i].longAccel, el = att.latAccel - truth[i].latAccel;
+        longSq += ex * ex;
+        latSq += el * el;
+        worstTilt = std::max(worstTilt, std::max(fabs(er), fabs(ep)));
+        n++;
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    // cost alone, the error bookkeeping above is not part of the step
+    Attitude timed;
+    const int reps = 20;
+    t0 = std::chrono::steady_clock::now();
+    for(int r = 0; r < reps; r++){
+        for(size_t i = 0; i < samples.size(); i++) timed.update((uint32_t)(i * ATTITUDE_PERIOD), samples[i], speeds[i]);
+    }
+    double stepNs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() * 1e9 / (reps * samples.size());
+    double budgetNs = ATTITUDE_CYCLE_BUDGET / 600e6 * 1e9;
+
+    printf("%.0f s at %u Hz: %zu steps, %u left to the gyro by the acceleration gate (%.0f ms total)\n",
+        seconds, (unsigned)(1000000 / ATTITUDE_PERIOD), samples.size(), att.rejected, elapsed * 1e3);
+    printf("rms error: roll %.2f deg | pitch %.2f deg | heading %.2f deg | worst tilt %.2f deg\n",
+        sqrt(rollSq / n), sqrt(pitchSq / n), sqrt(yawSq / n), worstTilt);
+    printf("rms error: longitudinal %.3f m/s^2 | lateral %.3f m/s^2\n", sqrt(longSq / n), sqrt(latSq / n));
+    printf("gyro bias: %.4f %.4f %.4f rad/s (true %.4f %.4f %.4f)\n", att.biasX, att.biasY, att.biasZ, bias[0], bias[1], bias[2]);
+    printf("step %.1f ns on host | budget %u cycles = %.0f ns at 600 MHz, host allowance %.0f ns: %s\n",
+        stepNs, (unsigned)ATTITUDE_CYCLE_BUDGET, budgetNs, budgetNs / 10, stepNs <= budgetNs / 10 ? "PASS" : "FAIL");
+    return stepNs <= budgetNs / 10 ? 0 : 1;
+}
@@ -0,0 +1,499 @@
+
+// GAUCHO RACING VDM LOG DECODER
+// Decodes the on-car binary logs written by DataLogger (see src/LogFormat.h) on all cores.
+//
+// Build (Linux):
+//     g++ -O2 -std=c++17 -pthread -I src tools/vdm_logdecode.cpp -o vdm_logdecode
+//
+// Usage:
+//     vdm_logdecode LOG.BIN --info                      print the header and the block index
+//     vdm_logdecode LOG.BIN --csv out.csv [--lap N]     one row per sample, time in seconds
+//     vdm_logdecode LOG.BIN --columns DIR [--lap N]     DIR/time.f64 and DIR/<signal>.f32, raw little endian
+//     vdm_logdecode --bench [MINUTES]                   synthetic log (30 min default), encode + decode throughput
+//     option --threads N limits the worker threads (default: all cores)
+#include "LogFormat.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Block {
+    uint32_t offset;
+    uint32_t seq;
+    uint16_t lap;
+    uint16_t samples;
+    uint64_t firstTime;     // unwrapped micros since the start of the log
+    uint64_t row;           // first output row
+};
+
+struct LogFile {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    const LogFileHeader* header = nullptr;
+    std::vector<Block> blocks;
+    bool fromIndex = false;
+    uint32_t badBlocks = 0;
+};
+
+static bool openLog(const char* path, LogFile& log){
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){ perror(path); return false; }
+    struct stat st;
+    fstat(fd, &st);
+    log.size = st.st_size;
+    if(log.size < LOG_HEADER_SIZE){ fprintf(stderr, "%s: too short for a log\n", path); close(fd); return false; }
+    void* m = mmap(nullptr, log.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(m == MAP_FAILED){ perror("mmap"); return false; }
+    madvise(m, log.size, MADV_SEQUENTIAL);
+    log.data = (const uint8_t*)m;
+    log.header = (const LogFileHeader*)log.data;
+    if(log.header->magic != LOG_FILE_MAGIC || log.header->version != LOG_VERSION || log.header->signalCount > LOG_MAX_SIGNALS){
+        fprintf(stderr, "%s: not a v%d VDM log\n", path, LOG_VERSION);
+        return false;
+    }
+    return true;
+}
+
+static const LogBlockHeader* blockAt(const LogFile& log, uint64_t offset){
+    if(offset + sizeof(LogBlockHeader) > log.size) return nullptr;
+    const LogBlockHeader* h = (const LogBlockHeader*)(log.data + offset);
+    if(h->magic != LOG_BLOCK_MAGIC || h->session != log.header->session) return nullptr;
+    if(h->samples == 0 || h->samples > LOG_BLOCK_SAMPLES || h->size < sizeof(LogBlockHeader) + h->payload) return nullptr;
+    if(offset + h->size > log.size) return nullptr;
+    return h;
+}
+
+// block list from the index chain of a cleanly closed log, or by walking the block headers
+static void buildIndex(LogFile& log){
+    const LogFileHeader* fh = log.header;
+    if(fh->lastIndex){
+        uint64_t at = fh->lastIndex;
+        while(at && at + sizeof(LogIndexBlock) <= log.size){
+            const LogIndexBlock* ib = (const LogIndexBlock*)(log.data + at);
+            if(ib->magic != LOG_INDEX_MAGIC || ib->session != fh->session || ib->count > LOG_INDEX_ENTRIES) break;
+            for(uint32_t i = 0; i < ib->count; i++){
+                const LogIndexEntry& e = ib->entries[i];
+                log.blocks.push_back({e.offset, e.seq, e.lap, e.samples, e.firstTime, 0});
+            }
+            at = ib->prevIndex;
+        }
+        std::sort(log.blocks.begin(), log.blocks.end(), [](const Block& a, const Block& b){return a.seq < b.seq;});
+        log.fromIndex = !log.blocks.empty();
+    }
+    if(!log.fromIndex){
+        uint64_t at = LOG_HEADER_SIZE;
+        uint32_t seq = 0;
+        while(at + LOG_SECTOR_SIZE <= log.size){
+            uint32_t magic = *(const uint32_t*)(log.data + at);
+            if(magic == LOG_INDEX_MAGIC && ((const LogIndexBlock*)(log.data + at))->session == fh->session){
+                at += log_round_sector(sizeof(LogIndexBlock));
+                continue;
+            }
+            const LogBlockHeader* h = blockAt(log, at);
+            if(!h || h->seq != seq) break;
+            log.blocks.push_back({(uint32_t)at, h->seq, h->lap, h->samples, h->firstTime, 0});
+            at += h->size;
+            seq++;
+        }
+    }
+    // unwrap the 32 bit micros and lay out the output rows
+    uint64_t row = 0;
+    uint64_t wraps = 0;
+    uint32_t prev = fh->startTime;
+    for(Block& b : log.blocks){
+        uint32_t t = (uint32_t)b.firstTime;
+        if(t < prev) wraps += 1ULL << 32;
+        prev = t;
+        b.firstTime = wraps + t - fh->startTime;
+        b.row = row;
+        row += b.samples;
+    }
+}
+
+// decode one block into int32 columns (time first), false on a CRC or framing error
+static bool decodeBlock(const LogFile& log, const Block& b, std::vector<int32_t>& cols){
+    const LogBlockHeader* h = blockAt(log, b.offset);
+    if(!h) return false;
+    const uint32_t* p = (const uint32_t*)((const uint8_t*)h + sizeof(LogBlockHeader));
+    const uint32_t* end = p + h->payload / 4;
+    if(crc32(p, h->payload) != h->crc) return false;
+    int columns = log.header->signalCount + 1;
+    cols.resize((size_t)columns * h->samples);
+    for(int c = 0; c < columns; c++){
+        p = log_decode_column(p, end, h->samples, &cols[(size_t)c * h->samples]);
+        if(!p) return false;
+    }
+    return true;
+}
+
+// fixed point printing for decimal scales, which is every signal the VDM logs today
+struct ColumnFormat {
+    int decimals = -1;      // -1: use %g
+    int64_t divisor = 1;
+    int64_t multiplier = 1;
+};
+
+static ColumnFormat formatFor(float scale){
+    ColumnFormat f;
+    for(int d = 0; d <= 6; d++){
+        double steps = scale * std::pow(10.0, d);
+        if(std::fabs(steps - std::round(steps)) < 1e-6 * steps && std::round(steps) >= 1){
+            f.decimals = d;
+            f.multiplier = (int64_t)std::round(steps);
+            f.divisor = (int64_t)std::round(std::pow(10.0, d));
+            return f;
+        }
+    }
+    return f;
+}
+
+static char* writeFixed(char* out, int64_t v, const ColumnFormat& f, float scale){
+    if(f.decimals < 0) return out + sprintf(out, "%g", v * (double)scale);
+    v *= f.multiplier;
+    if(v < 0){ *out++ = '-'; v = -v; }
+    int64_t whole = v / f.divisor;
+    int64_t frac = v % f.divisor;
+    char tmp[24];
+    int n = 0;
+    do { tmp[n++] = '0' + whole % 10; whole /= 10; } while(whole);
+    while(n) *out++ = tmp[--n];
+    if(f.decimals){
+        *out++ = '.';
+        for(int d = f.decimals - 1; d >= 0; d--){ out[d] = '0' + frac % 10; frac /= 10; }
+        out += f.decimals;
+    }
+    return out;
+}
+
+// run work(i) for i in [0, n) on up to threads workers
+template<typename F>
+static void parallelFor(size_t n, unsigned threads, F work){
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> pool;
+    for(unsigned t = 0; t < threads; t++){
+        pool.emplace_back([&](){
+            for(size_t i = next++; i < n; i = next++) work(i);
+        });
+    }
+    for(std::thread& t : pool) t.join();
+}
+
+static std::vector<Block> selectLap(const LogFile& log, int lap){
+    std::vector<Block> out;
+    uint64_t row = 0;
+    for(Block b : log.blocks){
+        if(lap >= 0 && b.lap != lap) continue;
+        b.row = row;
+        row += b.samples;
+        out.push_back(b);
+    }
+    return out;
+}
+
+static uint64_t totalRows(const std::vector<Block>& blocks){
+    return blocks.empty() ? 0 : blocks.back().row + blocks.back().samples;
+}
+
+static bool exportCSV(const LogFile& log, const std::vector<Block>& blocks, FILE* out, unsigned threads, std::atomic<uint32_t>& bad){
+    const LogFileHeader* fh = log.header;
+    int n = fh->signalCount;
+    std::vector<ColumnFormat> formats(n);
+    for(int i = 0; i < n; i++) formats[i] = formatFor(fh->signals[i].scale);
+    fprintf(out, "time_s,lap");
+    for(int i = 0; i < n; i++){
+        if(fh->signals[i].unit[0]) fprintf(out, ",%.16s_%.8s", fh->signals[i].name, fh->signals[i].unit);
+        else fprintf(out, ",%.16s", fh->signals[i].name);
+    }
+    fputc('\n', out);
+
+    // decode and format batches of blocks in parallel, write each batch in order
+    const size_t batch = std::max<size_t>(threads * 4, 16);
+    std::vector<std::string> text(batch);
+    for(size_t first = 0; first < blocks.size(); first += batch){
+        size_t count = std::min(batch, blocks.size() - first);
+        parallelFor(count, threads, [&](size_t k){
+            const Block& b = blocks[first + k];
+            std::vector<int32_t> cols;
+            std::string& s = text[k];
+            s.clear();
+            if(!decodeBlock(log, b, cols)){ bad++; return; }
+            s.resize((size_t)b.samples * (n + 2) * 24);
+            char* p = &s[0];
+            uint32_t t0 = (uint32_t)cols[0];
+            for(uint16_t r = 0; r < b.samples; r++){
+                uint64_t us = b.firstTime + (uint32_t)((uint32_t)cols[r] - t0);
+                p += sprintf(p, "%llu.%06llu,%u", (unsigned long long)(us / 1000000), (unsigned long long)(us % 1000000), b.lap);
+                for(int c = 0; c < n; c++){
+                    *p++ = ',';
+                    p = writeFixed(p, cols[(size_t)(c + 1) * b.samples + r], formats[c], fh->signals[c].scale);
+                }
+                *p++ = '\n';
+            }
+            s.resize(p - &s[0]);
+        });
+        for(size_t k = 0; k < count; k++) fwrite(text[k].data(), 1, text[k].size(), out);
+    }
+    return true;
+}
+
+static bool exportColumns(const LogFile& log, const std::vector<Block>& blocks, const std::string& dir, unsigned threads, std::atomic<uint32_t>& bad){
+    const LogFileHeader* fh = log.header;
+    int n = fh->signalCount;
+    uint64_t rows = totalRows(blocks);
+    std::vector<double> time(rows);
+    std::vector<std::vector<float>> values(n, std::vector<float>(rows));
+    // every block owns a fixed row range, so workers write straight into the columns
+    parallelFor(blocks.size(), threads, [&](size_t k){
+        const Block& b = blocks[k];
+        std::vector<int32_t> cols;
+        if(!decodeBlock(log, b, cols)){
+            bad++;
+            for(uint16_t r = 0; r < b.samples; r++) time[b.row + r] = NAN;
+            return;
+        }
+        uint32_t t0 = (uint32_t)cols[0];
+        for(uint16_t r = 0; r < b.samples; r++) time[b.row + r] = (b.firstTime + (uint32_t)((uint32_t)cols[r] - t0)) * 1e-6;
+        for(int c = 0; c < n; c++){
+            float scale = fh->signals[c].scale;
+            const int32_t* src = &cols[(size_t)(c + 1) * b.samples];
+            float* dst = &values[c][b.row];
+            for(uint16_t r = 0; r < b.samples; r++) dst[r] = src[r] * scale;
+        }
+    });
+    mkdir(dir.c_str(), 0755);
+    auto dump = [&](const std::string& name, const void* p, size_t bytes){
+        FILE* f = fopen((dir + "/" + name).c_str(), "wb");
+        if(!f){ perror(name.c_str()); return false; }
+        fwrite(p, 1, bytes, f);
+        fclose(f);
+        return true;
+    };
+    if(!dump("time.f64", time.data(), time.size() * sizeof(double))) return false;
+    for(int c = 0; c < n; c++){
+        std::string name(fh->signals[c].name, strnlen(fh->signals[c].name, LOG_NAME_LENGTH));
+        if(!dump(name + ".f32", values[c].data(), values[c].size() * sizeof(float))) return false;
+    }
+    return true;
+}
+
+static void printInfo(const LogFile& log){
+    const LogFileHeader* fh = log.header;
+    printf("VDM log v%u, session %08x, %u signals @ %u us, %u samples per block\n", fh->version, fh->session, fh->signalCount, fh->period, fh->blockSamples);
+    printf("%s: %zu blocks, %llu samples\n", log.fromIndex ? "closed cleanly, index used" : "not closed, headers walked", log.blocks.size(), (unsigned long long)totalRows(log.blocks));
+    for(int i = 0; i < fh->signalCount; i++) printf("  %2d %-16.16s %-8.8s x %g\n", i, fh->signals[i].name, fh->signals[i].unit, fh->signals[i].scale);
+    int lap = -1;
+    for(const Block& b : log.blocks){
+        if(b.lap != lap){
+            printf("  lap %u starts at block %u, t = %.3f s\n", b.lap, b.seq, b.firstTime * 1e-6);
+            lap = b.lap;
+        }
+    }
+}
+
+/*
+BENCHMARK
+Writes a synthetic endurance log through the same column coder the VDM uses, then decodes it.
+*/
+struct SyntheticWriter {
+    FILE* f;
+    LogFileHeader header;
+    LogIndexBlock index;
+    uint32_t seq = 0;
+    uint64_t offset = 0;
+    uint32_t lastIndex = 0;
+    std::vector<uint32_t> out;
+    std::vector<uint8_t> zero;
+
+    SyntheticWriter(FILE* file, int signals, uint32_t period) : f(file), out(LOG_MAX_PAYLOAD / 4 + 16), zero(LOG_SECTOR_SIZE){
+        memset(&header, 0, sizeof(header));
+        header.magic = LOG_FILE_MAGIC;
+        header.version = LOG_VERSION;
+        header.signalCount = signals;
+        header.period = period;
+        header.blockSamples = LOG_BLOCK_SAMPLES;
+        header.session = 0x1234ABCD;
+        header.startTime = 4000000000u;     // wraps during the run on purpose
+        for(int i = 0; i < signals; i++){
+            snprintf(header.signals[i].name, LOG_NAME_LENGTH, "sig%02d", i);
+            strcpy(header.signals[i].unit, "u");
+            header.signals[i].scale = (i % 3 == 0) ? 0.1f : (i % 3 == 1) ? 0.01f : 1.0f;
+        }
+        memset(&index, 0, sizeof(index));
+        index.magic = LOG_INDEX_MAGIC;
+        index.session = header.session;
+        std::vector<uint8_t> h(LOG_HEADER_SIZE);
+        memcpy(h.data(), &header, sizeof(header));
+        fwrite(h.data(), 1, h.size(), f);
+        offset = LOG_HEADER_SIZE;
+    }
+
+    void block(const std::vector<int32_t>& cols, uint16_t samples, uint16_t lap){
+        LogBlockHeader h;
+        h.magic = LOG_BLOCK_MAGIC;
+        h.session = header.session;
+        h.seq = seq++;
+        h.firstTime = (uint32_t)cols[0];
+        h.lap = lap;
+        h.samples = samples;
+        uint32_t* p = out.data();
+        for(int c = 0; c <= header.signalCount; c++) p = log_encode_column(&cols[(size_t)c * samples], samples, c ? LOG_COL_DELTA : LOG_COL_DELTA2, p);
+        h.payload = (p - out.data()) * 4;
+        h.size = log_round_sector(sizeof(h) + h.payload);
+        h.crc = crc32(out.data(), h.payload);
+        fwrite(&h, 1, sizeof(h), f);
+        fwrite(out.data(), 1, h.payload, f);
+        fwrite(zero.data(), 1, h.size - sizeof(h) - h.payload, f);
+        index.entries[index.count++] = {(uint32_t)offset, h.firstTime, lap, samples, h.seq};
+        offset += h.size;
+        if(index.count == LOG_INDEX_ENTRIES) flushIndex();
+    }
+
+    void flushIndex(){
+        fwrite(&index, 1, sizeof(index), f);
+        lastIndex = offset;
+        offset += sizeof(index);
+        index.prevIndex = lastIndex;
+        index.count = 0;
+        memset(index.entries, 0, sizeof(index.entries));
+    }
+
+    void close(){
+        if(index.count) flushIndex();
+        header.lastIndex = lastIndex;
+        header.blocks = seq;
+        fseek(f, 0, SEEK_SET);
+        fwrite(&header, 1, sizeof(header), f);
+        fclose(f);
+    }
+};
+
+static int bench(double minutes, unsigned threads){
+    const int signals = 24;
+    const uint32_t period = 1000;
+    std::string path = "/tmp/vdm_bench_log.bin";
+    FILE* f = fopen(path.c_str(), "wb");
+    if(!f){ perror(path.c_str()); return 1; }
+    SyntheticWriter w(f, signals, period);
+    uint64_t total = (uint64_t)(minutes * 60e6 / period);
+    std::vector<int32_t> cols((size_t)(signals + 1) * LOG_BLOCK_SAMPLES);
+    uint32_t t = w.header.startTime;
+    uint32_t rng = 1;
+    auto t0 = std::chrono::steady_clock::now();
+    for(uint64_t s = 0; s < total; s += LOG_BLOCK_SAMPLES){
+        uint16_t n = (uint16_t)std::min<uint64_t>(LOG_BLOCK_SAMPLES, total - s);
+        for(uint16_t r = 0; r < n; r++){
+            rng = rng * 1664525 + 1013904223;
+            t += period + (rng >> 29);      // a few us of loop jitter
+            cols[r] = (int32_t)t;
+            double sec = (s + r) * period * 1e-6;
+            for(int c = 0; c < signals; c++){
+                rng = rng * 1664525 + 1013904223;
+                double v = 1000 * std::sin(sec * (0.05 + 0.07 * c)) + ((rng >> 24) & 7);
+                cols[(size_t)(c + 1) * n + r] = (int32_t)v;
+            }
+        }
+        w.block(cols, n, (uint16_t)(s * period / 90000000));   // 90 s laps
+    }
+    w.close();
+    double encodeS = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    LogFile log;
+    if(!openLog(path.c_str(), log)) return 1;
+    buildIndex(log);
+    double rawBytes = (double)total * (signals + 1) * 4;
+    printf("synthetic log: %.1f min, %llu samples x %d signals, %.1f MB on disk (%.2fx smaller than raw), encode %.0f Msamples/s single core\n",
+        minutes, (unsigned long long)total, signals, log.size / 1e6, rawBytes / log.size, total / encodeS / 1e6);
+
+    std::vector<unsigned> counts = {1};
+    if(threads > 1) counts.push_back(threads);
+    for(unsigned n : counts){
+        std::atomic<uint32_t> bad(0);
+        auto a = std::chrono::steady_clock::now();
+        parallelFor(log.blocks.size(), n, [&](size_t k){
+            std::vector<int32_t> c;
+            if(!decodeBlock(log, log.blocks[k], c)) bad++;
+        });
+        double dec = std::chrono::duration<double>(std::chrono::steady_clock::now() - a).count();
+        a = std::chrono::steady_clock::now();
+        FILE* null = fopen("/dev/null", "w");
+        exportCSV(log, log.blocks, null, n, bad);
+        fclose(null);
+        double csv = std::chrono::duration<double>(std::chrono::steady_clock::now() - a).count();
+        a = std::chrono::steady_clock::now();
+        exportColumns(log, log.blocks, "/tmp/vdm_bench_columns", n, bad);
+        double colS = std::chrono::duration<double>(std::chrono::steady_clock::now() - a).count();
+        printf("%2u thread%s: decode %7.0f MB/s (%6.1f Msamples/s) | csv %6.2f s | columns %6.2f s%s\n",
+            n, n == 1 ? " " : "s", log.size / dec / 1e6, total / dec / 1e6, csv, colS, bad ? " | BLOCK ERRORS" : "");
+        if(bad) return 1;
+    }
+    return 0;
+}
+
+static void usage(){
+    fprintf(stderr, "usage: vdm_logdecode LOG.BIN (--info | --csv OUT.csv | --columns DIR) [--lap N] [--threads N]\n"
+                    "       vdm_logdecode --bench [MINUTES] [--threads N]\n");
+}
+
+int main(int argc, char** argv){
+    const char* path = nullptr;
+    const char* csv = nullptr;
+    const char* columns = nullptr;
+    bool info = false;
+    bool benchmark = false;
+    double minutes = 30;
+    int lap = -1;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    for(int i = 1; i < argc; i++){
+        std::string a = argv[i];
+        if(a == "--csv" && i + 1 < argc) csv = argv[++i];
+        else if(a == "--columns" && i + 1 < argc) columns = argv[++i];
+        else if(a == "--lap" && i + 1 < argc) lap = atoi(argv[++i]);
+        else if(a == "--threads" && i + 1 < argc) threads = std::max(1, atoi(argv[++i]));
+        else if(a == "--info") info = true;
+        else if(a == "--bench"){
+            benchmark = true;
+            if(i + 1 < argc && argv[i + 1][0] != '-') minutes = atof(argv[++i]);
+        }
+        else if(a[0] != '-' && !path) path = argv[i];
+        else { usage(); return 2; }
+    }
+    if(benchmark) return bench(minutes, threads);
+    if(!path || (!info && !csv && !columns)){ usage(); return 2; }
+
+    LogFile log;
+    if(!openLog(path, log)) return 1;
+    buildIndex(log);
+    if(info){
+        printInfo(log);
+        return 0;
+    }
+    std::vector<Block> blocks = selectLap(log, lap);
+    if(blocks.empty()){
+        fprintf(stderr, "no blocks%s\n", lap >= 0 ? " for that lap" : "");
+        return 1;
+    }
+    std::atomic<uint32_t> bad(0);
+    bool ok = true;
+    if(csv){
+        FILE* out = fopen(csv, "w");
+        if(!out){ perror(csv); return 1; }
+        ok = exportCSV(log, blocks, out, threads, bad);
+        fclose(out);
+    }
+    if(columns && ok) ok = exportColumns(log, blocks, columns, threads, bad);
+    if(bad) fprintf(stderr, "%u blocks failed CRC or framing and were skipped\n", (unsigned)bad);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,653 @@
+
+// GAUCHO RACING VDM PLANT SIMULATOR
+// Closes the loop around the VDM firmware on Linux: setup() and loop() from src/main.cpp run on the
+// simulated hardware (native/Hal.h) against a model of the car that answers on the virtual buses.
+//     motor      DC equivalent of the motor model in main.cpp (L_INDUCTANCE, R_RESISTANCE, KB_BACK_EMF,
+//                KM_TORQUE_CONSTANT, J_INERTIA, B_DAMPING, FC), current loop voltage limited by the TS
+//     inverter   follows the DTI control frames: drive enable, relative current of the max current,
+//                brake current; sends DTI_Data_1..5
+//     drivetrain rear axle on GEAR_RATIO, one tire force from slip (simplified Pacejka) on the rear load
+//                with load transfer, free rolling fronts, drag, rolling resistance, mechanical brakes
+//     battery    128 cells with OCV over state of charge, internal resistance and heating; the ACU answers
+//                ACU_Control with a precharge, sends ACU_General, ACU_General2 and the condensed cell frames
+//     sensors    energy meter, pedal box (APPS from the tune's calibration), wheel hubs, central IMU,
+//                brake pedal on BSE_HIGH, and a driver who presses TS ACTIVE and READY TO DRIVE on the dash
+// The firmware file is included here rather than linked, so the scenario can watch the state machine
+// and select DYNAMIC_TC, which nothing on the car sets yet. loop() holds regen_level at REGEN_OFF, so
+// DRIVE_REGEN is counted but not reached until that bench override goes. --tc runs the traction control
+// as it is on the car: computeTractionControl() integrates slip without a bound, so on a low grip launch
+// (--scenario accel --mu 0.5 --tc) the multiplier winds down to 0 and the run fails short of the line.
+//
+// Build (Linux):
+//     g++ -O2 -std=gnu++17 -Wno-narrowing -I native -I src tools/vdm_plant.cpp native/Hal.cpp -o vdm_plant
+//
+// Usage:
+//     vdm_plant [--scenario accel|lap] [--seconds S] [--mu MU] [--tc] [--step US] [--csv FILE] [--serial FILE]
+//     vdm_plant --bench                       25 minutes of laps (an endurance) at 1 ms passes, timed
+//         --scenario   accel: full throttle over 75 m then brake to a stop (default)
+//                      lap: a repeating lap of straights, corners and braking zones for --seconds (60 default)
+//         --mu         tire friction coefficient (1.5 default, 0.6 for a wet track)
+//         --tc         drive in DYNAMIC_TC mode (traction control)
+//         --step       simulated us per loop pass (100 default)
+//         --csv        100 Hz trace of the run
+//         --serial     USB serial output (dropped by default)
+#include "main.cpp"
+#include "Hal.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+const uint8_t PLANT_PRIMARY = CAN_PRIMARY_BUS;
+const uint8_t PLANT_DATA = CAN_DATA_BUS;
+const uint32_t PLANT_SUBSTEP = 20;                  // us, physics step near standstill where tire slip is stiff
+const uint32_t PLANT_SUBSTEP_FAST = 100;            // us, physics step above PLANT_FAST_SPEED
+const float PLANT_FAST_SPEED = 5;                   // m/s
+
+// VEHICLE, beyond the constants in main.cpp
+const float CG_HEIGHT = 0.28;                       // m
+const float WHEELBASE = 1.53;                       // m
+const float DRAG_AREA = 1.2;                        // m^2, Cd * A
+const float AIR_DENSITY = 1.2;                      // kg/m^3
+const float ROLLING_RESISTANCE = 0.015;
+const float REAR_WHEEL_INERTIA = 0.5;               // kg m^2, both rear wheels and the axle
+const float BRAKE_MAX_DECEL = 1.3;                  // g at full mechanical brake
+const float TIRE_B = 10;                            // Pacejka stiffness, peak force near 11% slip
+const float TIRE_C = 1.9;                           // Pacejka shape
+const float SLIP_MIN_SPEED = 0.5;                   // m/s, slip reference floor
+
+// INVERTER
+const float INVERTER_LOOP_TAU = 0.001;              // s, current loop response
+const float INVERTER_DROP = 1.5;                    // V, conduction loss per amp
+const float INVERTER_MIN_VOLTAGE = 60;              // V, below this the bridge stays off
+const uint32_t INVERTER_TIMEOUT = 250000;           // us without control frames before the drive drops
+const float INVERTER_MAX_CURRENT = 150;             // A, until the VDM sets one
+
+// ACCUMULATOR
+const float CELL_CAPACITY = 14;                     // Ah
+const float CELL_RESISTANCE = 0.0025;               // ohm
+const float CELL_OCV_EMPTY = 3.35;                  // V at 0% SOC
+const float CELL_OCV_SPAN = 0.85;                   // V from 0 to 100% SOC
+const float PACK_HEAT_CAPACITY = 9000;              // J/K
+const float PACK_COOLING = 0.5;                     // W/K
+const float PRECHARGE_TAU = 0.3;                    // s
+const float DISCHARGE_TAU = 0.5;                    // s
+
+// THERMAL
+const float COOLANT_TEMP = 40;                      // C
+const float AMBIENT_TEMP = 25;                      // C
+const float MOTOR_HEAT_CAPACITY = 5400;             // J/K
+const float MOTOR_COOLING = 25;                     // W/K
+const float INVERTER_HEAT_CAPACITY = 1500;          // J/K
+const float INVERTER_COOLING = 20;                  // W/K
+
+// ACU_General2 state bits
+const uint8_t ACU_AIR_POS = 0x80;
+const uint8_t ACU_AIR_NEG = 0x40;
+const uint8_t ACU_PRECHARGING = 0x20;
+const uint8_t ACU_PRECHARGE_DONE = 0x10;
+
+// BSE_HIGH readings, BSE_ACTIVATION_ADC lies between
+const uint16_t BRAKE_ADC_OFF = 100;
+const uint16_t BRAKE_ADC_FULL = 1000;
+
+// a periodic frame, offset so the nodes do not all send at once
+struct Every {
+    uint32_t period;
+    uint64_t next;
+    bool due(uint64_t now){
+        if(now < next) return false;
+        next += period;
+        if(next <= now) next = now + period;
+        return true;
+    }
+};
+
+static void put16(uint8_t* p, int32_t v){
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void put32(uint8_t* p, int32_t v){
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static int32_t clamp16(float v){return (int32_t)constrain(v, -32768.0f, 32767.0f);}
+
+struct Plant {
+    // state
+    float current = 0;                              // A, motor
+    float voltage = 0;                              // V, applied by the inverter
+    float motorSpeed = 0;                           // rad/s
+    float speed = 0;                                // m/s, vehicle
+    double distance = 0;                            // m
+    float accel = 0;                                // m/s^2, last step
+    float slip = 0;                                 // rear
+    float tireForce = 0;                            // N, rear
+    double soc = 0.9;
+    float tsVoltage = 0;                            // V, after the AIRs
+    float dcCurrent = 0;                            // A, out of the pack
+    double packTemp = AMBIENT_TEMP;
+    double motorTemp = COOLANT_TEMP;
+    double inverterTemp = COOLANT_TEMP;
+    double energy = 0;                              // Wh out of the pack
+    float mu = 1.5;
+    float brake = 0;                                // 0..1 mechanical brake
+
+    // inverter commands
+    bool enabled = false;
+    bool braking = false;                           // last command was a brake current
+    float relative = 0;                             // % of maxCurrent
+    float brakeCurrent = 0;                         // A
+    float maxCurrent = INVERTER_MAX_CURRENT;
+    uint64_t lastCommand = 0;
+    uint32_t commands = 0;
+
+    // ACU
+    bool airsClosed = false;
+    uint8_t acuStates = 0;
+
+    // peaks
+    float peakSlip = 0;
+    float peakPower = 0;
+    float peakCurrent = 0;
+    float topSpeed = 0;
+
+    Every dti = {10000, 0};
+    Every acu = {10000, 3000};
+    Every cells = {6250, 1000};                     // 16 voltage and 16 temperature frames, each at 10 Hz
+    Every meter = {10000, 5000};
+    Every pedals = {5000, 500};
+    Every hubs = {5000, 1500};
+    Every imu = {5000, 2500};
+    uint8_t cellFrame = 0;
+    uint32_t sent = 0;
+    uint32_t dropped = 0;
+
+    float ocv() const {return CELL_OCV_EMPTY + CELL_OCV_SPAN * std::max(soc, 0.0);}
+    float packResistance() const {return CELL_COUNT * CELL_RESISTANCE;}
+    float cellVoltage(uint8_t cell) const {
+        // a few mV of spread so the cell statistics have something to show
+        return ocv() - dcCurrent * CELL_RESISTANCE + 0.002f * (int)((cell * 7) % 11 - 5);
+    }
+    float cellTemp(uint8_t cell) const {return packTemp + 0.25f * ((cell * 5) % 9);}
+
+    float targetCurrent(uint64_t now) const {
+        if(!enabled || !airsClosed || tsVoltage < INVERTER_MIN_VOLTAGE || now - lastCommand > INVERTER_TIMEOUT) return 0;
+        // brake current opposes rotation and fades out at standstill
+        if(braking) return motorSpeed > 1 ? -brakeCurrent : 0;
+        return constrain(relative, -100.0f, 100.0f) / 100 * maxCurrent;
+    }
+
+    // integrate over dt seconds at time now
+    void step(uint64_t now, float dt){
+        // inverter: voltage for the commanded current, limited by the TS voltage
+        float target = targetCurrent(now);
+        if(target == 0 && (!enabled || !airsClosed)){
+            current = 0;
+            voltage = 0;
+        }
+        else {
+            float v = R_RESISTANCE * target + KB_BACK_EMF * motorSpeed + L_INDUCTANCE * (target - current) / INVERTER_LOOP_TAU;
+            voltage = constrain(v, -tsVoltage, tsVoltage);
+            current += (voltage - R_RESISTANCE * current - KB_BACK_EMF * motorSpeed) / L_INDUCTANCE * dt;
+        }
+
+        // rear tire force on the rear load with load transfer
+        float wheelSpeed = motorSpeed / GEAR_RATIO * WHEEL_RADIUS;
+        float reference = std::max(std::max(fabsf(speed), fabsf(wheelSpeed)), SLIP_MIN_SPEED);
+        slip = (wheelSpeed - speed) / reference;
+        float rearLoad = constrain(VEHICLE_MASS * (G * Q_W_BALANCE_FACTOR + accel * CG_HEIGHT / WHEELBASE), 0.0f, VEHICLE_MASS * G);
+        tireForce = mu * rearLoad * sinf(TIRE_C * atanf(TIRE_B * slip));
+
+        // motor and rear axle
+        float inertia = J_INERTIA + REAR_WHEEL_INERTIA / (GEAR_RATIO * GEAR_RATIO);
+        float friction = motorSpeed > 0 ? FC : motorSpeed < 0 ? -FC : 0;
+        float torque = KM_TORQUE_CONSTANT * current - B_DAMPING * motorSpeed - friction - tireForce * WHEEL_RADIUS / GEAR_RATIO;
+        motorSpeed += torque / inertia * dt;
+
+        // vehicle, the mechanical brakes stop it but never push it back
+        float drag = 0.5f * AIR_DENSITY * DRAG_AREA * speed * speed + (speed > 0 ? ROLLING_RESISTANCE * VEHICLE_MASS * G : 0);
+        float brakeForce = brake * BRAKE_MAX_DECEL * VEHICLE_MASS * G;
+        float force = tireForce - drag;
+        accel = force / VEHICLE_MASS;
+        speed += accel * dt;
+        if(speed > 0) speed = std::max(0.0f, speed - brakeForce / VEHICLE_MASS * dt);
+        if(speed < 0) speed = 0;
+        // the brakes hold the wheels too
+        if(brake > 0 && speed == 0 && motorSpeed > 0 && current <= 0) motorSpeed = 0;
+        if(brake > 0 && speed > 0) accel -= brakeForce / VEHICLE_MASS;
+        distance += speed * dt;
+
+        // accumulator: DC power is the motor terminals plus the bridge losses
+        float power = voltage * current + INVERTER_DROP * fabsf(current);
+        float pack = ocv() * CELL_COUNT;
+        if(airsClosed){
+            tsVoltage = pack - dcCurrent * packResistance();
+            dcCurrent = tsVoltage > INVERTER_MIN_VOLTAGE ? power / tsVoltage : 0;
+        }
+        else if(acuStates & ACU_PRECHARGING){
+            // TS follows the pack through the precharge resistor, AIR+ closes near the end
+            dcCurrent = 0;
+            tsVoltage += (pack - tsVoltage) * dt / PRECHARGE_TAU;
+            if(tsVoltage > 0.95f * pack){
+                airsClosed = true;
+                acuStates = (acuStates & ~ACU_PRECHARGING) | ACU_AIR_POS | ACU_PRECHARGE_DONE;
+            }
+        }
+        else {
+            dcCurrent = 0;
+            tsVoltage *= 1 - dt / DISCHARGE_TAU;
+        }
+        soc -= dcCurrent * dt / (CELL_CAPACITY * 3600);
+        energy += tsVoltage * dcCurrent * dt / 3600;
+        packTemp += (dcCurrent * dcCurrent * packResistance() - PACK_COOLING * (packTemp - AMBIENT_TEMP)) * dt / PACK_HEAT_CAPACITY;
+        motorTemp += (R_RESISTANCE * current * current - MOTOR_COOLING * (motorTemp - COOLANT_TEMP)) * dt / MOTOR_HEAT_CAPACITY;
+        inverterTemp += (INVERTER_DROP * fabsf(current) - INVERTER_COOLING * (inverterTemp - COOLANT_TEMP)) * dt / INVERTER_HEAT_CAPACITY;
+
+        if(speed > 2) peakSlip = std::max(peakSlip, slip);
+        peakPower = std::max(peakPower, tsVoltage * dcCurrent);
+        peakCurrent = std::max(peakCurrent, fabsf(current));
+        topSpeed = std::max(topSpeed, speed);
+    }
+
+    // a frame the VDM sent
+    void command(uint8_t bus, const CAN_message_t& m){
+        if(bus != PLANT_PRIMARY) return;
+        int16_t value = (int16_t)((m.buf[0] << 8) | m.buf[1]);
+        uint64_t now = hal::now();
+        switch(m.id){
+            case 0x516:                             // setRCurrent, % x 10
+                relative = value / 10.0f;
+                braking = false;
+                lastCommand = now;
+                commands++;
+                break;
+            case 0x216:                             // setBrakeCurrent, A x 10
+                brakeCurrent = fabsf(value / 10.0f);
+                braking = true;
+                lastCommand = now;
+                commands++;
+                break;
+            case 0x816:                             // setMaxCurrent, A x 10
+                maxCurrent = value / 10.0f;
+                break;
+            case 0xC16:                             // setDriveEnable
+                enabled = m.buf[0] == 1;
+                lastCommand = now;
+                break;
+            case ACU_Control:
+                if(m.buf[0]){
+                    if(!airsClosed) acuStates = ACU_AIR_NEG | ACU_PRECHARGING;
+                }
+                else {
+                    airsClosed = false;
+                    acuStates = 0;
+                }
+                break;
+            case ACU_Ping_Request:
+                send(PLANT_PRIMARY, ACU_Ping_Response, m.buf);
+                break;
+            case Pedals_Ping_Request:
+                send(PLANT_PRIMARY, Pedals_Ping_Response, m.buf);
+                break;
+        }
+    }
+
+    void send(uint8_t bus, uint32_t id, const uint8_t* data){
+        CAN_message_t m;
+        m.id = id;
+        m.flags.extended = id > 0x7FF;
+        m.len = 8;
+        memcpy(m.buf, data, 8);
+        if(hal::canInject(bus, m)) sent++;
+        else dropped++;
+    }
+
+    // the frames due at now
+    void publish(uint64_t now, float throttle, float brakePressure){
+        uint8_t d[8];
+        float rpm = motorSpeed * 60 / TWO_PI;
+        if(dti.due(now)){
+            memset(d, 0, 8);
+            put32(d, (int32_t)(rpm * MOTOR_POLE_PAIRS));
+            put16(d + 4, tsVoltage > 1 ? (int32_t)(fabsf(voltage) / tsVoltage * 1000) : 0);
+            put16(d + 6, (int32_t)tsVoltage);
+            send(PLANT_PRIMARY, DTI_Data_1, d);
+            memset(d, 0, 8);
+            put16(d, clamp16(current * 10));
+            put16(d + 2, clamp16(dcCurrent * 10));
+            send(PLANT_PRIMARY, DTI_Data_2, d);
+            memset(d, 0, 8);
+            put16(d, clamp16(inverterTemp * 10));
+            put16(d + 2, clamp16(motorTemp * 10));
+            send(PLANT_PRIMARY, DTI_Data_3, d);
+            memset(d, 0, 8);
+            put32(d + 4, (int32_t)(current * 100));
+            send(PLANT_PRIMARY, DTI_Data_4, d);
+            memset(d, 0, 8);
+            d[3] = enabled;
+            send(PLANT_PRIMARY, DTI_Data_5, d);
+        }
+        if(acu.due(now)){
+            float maxTemp = 0;
+            for(uint8_t c = 0; c < CELL_COUNT; c++) maxTemp = std::max(maxTemp, cellTemp(c));
+            memset(d, 0, 8);
+            put16(d, (int32_t)(ocv() * CELL_COUNT * 100));
+            put16(d + 2, clamp16(dcCurrent * 100));
+            put16(d + 4, clamp16(maxTemp * 100));
+            send(PLANT_PRIMARY, ACU_General, d);
+            memset(d, 0, 8);
+            put16(d, (int32_t)(std::max(tsVoltage, 0.0f) * 100));
+            d[2] = acuStates;
+            put16(d + 3, (int32_t)((packTemp + 327.68f) * 100));
+            d[5] = 12 / 0.0625;
+            d[6] = 12 / 0.0625;
+            d[7] = (uint8_t)constrain(soc * 255, 0.0f, 255.0f);
+            send(PLANT_PRIMARY, ACU_General2, d);
+        }
+        if(cells.due(now)){
+            bool temps = cellFrame >= CELL_GROUPS;
+            uint8_t group = cellFrame % CELL_GROUPS;
+            for(uint8_t i = 0; i < CELL_GROUP; i++){
+                uint8_t c = group * CELL_GROUP + i;
+                float raw = temps ? (cellTemp(c) - 10) / 0.25f : (cellVoltage(c) - 2) / 0.01f;
+                d[i] = (uint8_t)constrain(raw + 0.5f, 0.0f, 255.0f);
+            }
+            send(PLANT_PRIMARY, (temps ? Condensed_Cell_Temp_n0 : Condensed_Cell_Voltage_n0) + group, d);
+            cellFrame = (cellFrame + 1) % (2 * CELL_GROUPS);
+        }
+        if(meter.due(now)){
+            put32(d, (int32_t)bit_reverse32((uint32_t)(int32_t)(dcCurrent * 65536)));
+            put32(d + 4, (int32_t)bit_reverse32((uint32_t)(int32_t)(tsVoltage * 65536)));
+            send(PLANT_PRIMARY, Energy_Meter_Measurements, d);
+        }
+        if(pedals.due(now)){
+            // APPS counts fall from zero to floor over the pedal travel, the first 5% is dead band
+            float x = throttle > 0 ? 0.05f + 0.95f * throttle : 0;
+            memset(d, 0, 8);
+            put16(d, (int32_t)(TUNE.getAPPSZero1() - x * (TUNE.getAPPSZero1() - TUNE.getAPPSFloor1())));
+            put16(d + 2, (int32_t)(TUNE.getAPPSZero2() - x * (TUNE.getAPPSZero2() - TUNE.getAPPSFloor2())));
+            put16(d + 4, (int32_t)brakePressure);
+            put16(d + 6, (int32_t)brakePressure);
+            send(PLANT_PRIMARY, Pedals_Inputs, d);
+        }
+        if(hubs.due(now)){
+            float front = speed / WHEEL_RADIUS * 60 / TWO_PI;
+            float rear = rpm / GEAR_RATIO;
+            const uint32_t ids[4] = {0x10F00, 0x10F08, 0x10F10, 0x10F18}; // FR, FL, RR, RL
+            for(uint8_t w = 0; w < 4; w++){
+                memset(d, 0, 8);
+                d[0] = 25;                          // mm travel
+                put16(d + 1, (int32_t)constrain(w < 2 ? front : rear, 0.0f, 65535.0f));
+                d[3] = 12;                          // psi
+                send(PLANT_DATA, ids[w], d);
+            }
+        }
+        if(imu.due(now)){
+            memset(d, 0, 8);
+            put16(d, clamp16(accel / G * 8192));
+            put16(d + 4, 8192);
+            send(PLANT_DATA, 0x10F20, d);
+            memset(d, 0, 8);
+            send(PLANT_DATA, 0x10F21, d);
+        }
+    }
+};
+
+// DRIVER
+enum Phase {PHASE_BOOT, PHASE_PRECHARGE, PHASE_READY, PHASE_RUN, PHASE_DONE, PHASE_FAILED};
+
+struct Segment {
+    float seconds;
+    float throttle;
+    float brake;
+};
+
+// a stylised autocross lap: straights, braking zones and part throttle through the corners
+const Segment LAP_SEGMENTS[] = {
+    {3.0, 1.0, 0}, {0.2, 0, 0}, {1.0, 0, 0.7}, {2.5, 0.35, 0}, {2.0, 0.8, 0}, {0.2, 0, 0}, {0.8, 0, 0.5},
+    {3.0, 0.5, 0}, {1.5, 0, 0}, {2.0, 1.0, 0}, {0.2, 0, 0}, {1.2, 0, 0.9}, {2.0, 0.4, 0},
+};
+const float ACCEL_DISTANCE = 75;                    // m, FSAE acceleration event
+
+struct Options {
+    bool lap = false;
+    double seconds = 60;
+    float mu = 1.5;
+    bool tc = false;
+    uint32_t step = 100;
+    const char* csv = nullptr;
+    const char* serial = nullptr;
+};
+
+struct Run {
+    Phase phase = PHASE_BOOT;
+    uint64_t phaseStart = 0;
+    uint64_t runStart = 0;
+    float throttle = 0;
+    float brake = 1;                                // held from power on for TS ACTIVE and READY TO DRIVE
+    uint64_t lastThrottle = 0;
+    float accelTime = 0;
+    float accelSpeed = 0;
+    State lastState = ECU_FLASH;
+    uint64_t regenUs = 0;
+    uint64_t limitedUs = 0;                         // tc_multiplier below 1
+    float minTc = 1;
+    float lowestCeiling = INVERTER_MAX_CURRENT;     // A, max current the VDM set (derating)
+};
+
+static void button(Plant& plant, uint8_t index){
+    uint8_t d[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    d[index] = 1;
+    plant.send(PLANT_PRIMARY, Button_Event, d);
+}
+
+static void setPhase(Run& r, Phase p, uint64_t now){
+    r.phase = p;
+    r.phaseStart = now;
+}
+
+// the driver's inputs for the pass at now
+static void drive(Run& r, Plant& plant, const Options& o, uint64_t now){
+    float inPhase = (now - r.phaseStart) * 1e-6f;
+    switch(r.phase){
+        case PHASE_BOOT:
+            if(state == GLV_ON && inPhase > 0.5f){
+                button(plant, 0);                   // TS ACTIVE
+                setPhase(r, PHASE_PRECHARGE, now);
+            }
+            break;
+        case PHASE_PRECHARGE:
+            if(state == PRECHARGE_COMPLETE){
+                button(plant, 2);                   // READY TO DRIVE
+                setPhase(r, PHASE_READY, now);
+            }
+            else if(inPhase > 5) setPhase(r, PHASE_FAILED, now);
+            break;
+        case PHASE_READY:
+            if(state == DRIVE_STANDBY){
+                r.brake = 0;
+                if(inPhase > 0.5f){
+                    r.runStart = now;
+                    setPhase(r, PHASE_RUN, now);
+                }
+            }
+            else if(inPhase > 2) setPhase(r, PHASE_FAILED, now);
+            break;
+        case PHASE_RUN: {
+            float t = (now - r.runStart) * 1e-6f;
+            if(!o.lap){
+                if(r.accelTime == 0 && plant.distance >= ACCEL_DISTANCE){
+                    r.accelTime = t;
+                    r.accelSpeed = plant.speed;
+                }
+                r.throttle = r.accelTime == 0 ? 1 : 0;
+                r.brake = r.accelTime == 0 ? 0 : 1;
+                if(r.accelTime != 0 && plant.speed == 0) setPhase(r, PHASE_DONE, now);
+                if(t > 30) setPhase(r, PHASE_FAILED, now);
+            }
+            else {
+                float lap = 0;
+                for(const Segment& s : LAP_SEGMENTS) lap += s.seconds;
+                float at = fmodf(t, lap);
+                for(const Segment& s : LAP_SEGMENTS){
+                    if(at < s.seconds){
+                        r.throttle = s.throttle;
+                        r.brake = s.brake;
+                        break;
+                    }
+                    at -= s.seconds;
+                }
+                if(t >= o.seconds) setPhase(r, PHASE_DONE, now);
+            }
+            break;
+        }
+        default:
+            r.throttle = 0;
+            r.brake = 0;
+    }
+    // the foot moves from one pedal to the other, never both at once
+    if(r.throttle > 0) r.lastThrottle = now;
+    float brake = now - r.lastThrottle < 100000 ? 0 : r.brake;
+    plant.brake = brake;
+    hal::setAnalog(BSE_HIGH, brake > 0 ? BRAKE_ADC_OFF + brake * (BRAKE_ADC_FULL - BRAKE_ADC_OFF) : BRAKE_ADC_OFF);
+}
+
+static void usage(){
+    fprintf(stderr, "usage: vdm_plant [--scenario accel|lap] [--seconds S] [--mu MU] [--tc] [--step US] [--csv FILE] [--serial FILE]\n"
+                    "       vdm_plant --bench\n");
+}
+
+int main(int argc, char** argv){
+    Options o;
+    bool bench = false;
+    for(int i = 1; i < argc; i++){
+        const char* a = argv[i];
+        bool more = i + 1 < argc;
+        if(!strcmp(a, "--scenario") && more){
+            const char* s = argv[++i];
+            if(!strcmp(s, "lap")) o.lap = true;
+            else if(strcmp(s, "accel")){
+                usage();
+                return 2;
+            }
+        }
+        else if(!strcmp(a, "--seconds") && more) o.seconds = atof(argv[++i]);
+        else if(!strcmp(a, "--mu") && more) o.mu = atof(argv[++i]);
+        else if(!strcmp(a, "--tc")) o.tc = true;
+        else if(!strcmp(a, "--step") && more) o.step = std::max(PLANT_SUBSTEP, (uint32_t)atoi(argv[++i]));
+        else if(!strcmp(a, "--csv") && more) o.csv = argv[++i];
+        else if(!strcmp(a, "--serial") && more) o.serial = argv[++i];
+        else if(!strcmp(a, "--bench")){
+            bench = true;
+            o.lap = true;
+            o.seconds = 1500;
+            o.step = 1000;
+        }
+        else {
+            usage();
+            return 2;
+        }
+    }
+
+    hal::serialOutput(-1);
+    if(o.serial){
+        int fd = open(o.serial, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0){
+            perror(o.serial);
+            return 1;
+        }
+        hal::serialOutput(fd);
+    }
+    FILE* csv = nullptr;
+    if(o.csv){
+        csv = fopen(o.csv, "w");
+        if(!csv){
+            perror(o.csv);
+            return 1;
+        }
+        fprintf(csv, "t,state,throttle,brake,speed,distance,motor_rpm,relative,current,slip,tc_multiplier,ts_voltage,dc_current,soc,motor_temp\n");
+    }
+
+    // the car on the grid: shutdown circuit closed, no faults, brake pedal pressed
+    hal::setDigital(BSPD_OK_PIN, true);
+    hal::setAnalog(IMD_OK_PIN, 1000);
+    hal::setDigital(AMS_OK_PIN, true);
+    hal::setAnalog(SDC_IN_PIN, 1000);
+    hal::setAnalog(SDC_OUT_PIN, 1000);
+    hal::setAnalog(BSE_HIGH, BRAKE_ADC_FULL);
+
+    Plant plant;
+    plant.mu = o.mu;
+    Run r;
+    hal::onCanWrite = [&plant](uint8_t bus, const CAN_message_t& m){plant.command(bus, m);};
+
+    auto start = std::chrono::steady_clock::now();
+    setup();
+    if(o.tc) mode = DYNAMIC_TC;
+    double loopNs = 0, worstNs = 0;
+    uint64_t passes = 0, csvNext = 0;
+    auto pass = [&](){
+        auto a = std::chrono::steady_clock::now();
+        loop();
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - a).count();
+        loopNs += ns;
+        worstNs = std::max(worstNs, ns);
+        passes++;
+    };
+    while(r.phase != PHASE_DONE && r.phase != PHASE_FAILED){
+        uint64_t now = hal::now();
+        for(uint32_t t = 0; t < o.step;){
+            uint32_t h = std::min(plant.speed > PLANT_FAST_SPEED ? PLANT_SUBSTEP_FAST : PLANT_SUBSTEP, o.step - t);
+            plant.step(now + t, h * 1e-6f);
+            t += h;
+        }
+        hal::advance(o.step);
+        now = hal::now();
+        drive(r, plant, o, now);
+        plant.publish(now, r.throttle, r.brake * 1000);
+        pass();
+        while(hal::canPending(PLANT_PRIMARY) || hal::canPending(PLANT_DATA)) pass();
+
+        if(state != r.lastState){
+            printf("%9.3f s  %s\n", now * 1e-6, stateName(state));
+            r.lastState = state;
+        }
+        if(state == DRIVE_REGEN) r.regenUs += o.step;
+        if(tc_multiplier < 1) r.limitedUs += o.step;
+        r.minTc = std::min(r.minTc, tc_multiplier);
+        r.lowestCeiling = std::min(r.lowestCeiling, plant.maxCurrent);
+        if(csv && now >= csvNext){
+            fprintf(csv, "%.3f,%s,%.2f,%.2f,%.2f,%.1f,%.0f,%.1f,%.1f,%.3f,%.3f,%.1f,%.1f,%.4f,%.1f\n", now * 1e-6, stateName(state),
+                r.throttle, plant.brake, plant.speed, plant.distance, plant.motorSpeed * 60 / TWO_PI, commandedCurrent, plant.current,
+                plant.slip, tc_multiplier, plant.tsVoltage, plant.dcCurrent, plant.soc, plant.motorTemp);
+            csvNext = now + 10000;
+        }
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if(csv) fclose(csv);
+
+    double simS = hal::now() * 1e-6;
+    printf("\n%s, mu %.2f, %s\n", o.lap ? "lap" : "accel", o.mu, o.tc ? "traction control" : "standard mode");
+    if(r.phase == PHASE_FAILED) printf("FAILED in %s at %.3f s\n", stateName(state), simS);
+    if(!o.lap && r.accelTime > 0) printf("75 m in %.3f s, %.1f km/h at the line\n", r.accelTime, r.accelSpeed * 3.6);
+    printf("distance %.0f m | top speed %.1f km/h | peak rear slip %.3f | peak motor current %.0f A | peak DC power %.1f kW\n",
+        plant.distance, plant.topSpeed * 3.6, plant.peakSlip, plant.peakCurrent, plant.peakPower / 1000);
+    printf("energy %.1f Wh | SOC %.1f %% | pack %.1f C | motor %.1f C | inverter %.1f C\n",
+        plant.energy, plant.soc * 100, plant.packTemp, plant.motorTemp, plant.inverterTemp);
+    printf("traction control cut %.2f s, lowest multiplier %.2f | lowest current ceiling %.0f A | DRIVE_REGEN %.2f s | %u inverter commands\n",
+        r.limitedUs * 1e-6, r.minTc, r.lowestCeiling, r.regenUs * 1e-6, plant.commands);
+    printf("%.1f s simulated in %.3f s, %.0fx real time | %llu loop passes, mean %.2f us, worst %.1f us | %u frames in, %u dropped\n",
+        simS, wall, wall > 0 ? simS / wall : 0, (unsigned long long)passes, passes ? loopNs / passes / 1e3 : 0, worstNs / 1e3,
+        plant.sent, plant.dropped);
+    if(bench) printf("%s\n", r.phase == PHASE_DONE ? "PASS" : "FAIL");
+    return r.phase == PHASE_DONE ? 0 : 1;
+}
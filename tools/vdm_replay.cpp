@@ -0,0 +1,376 @@
+
+// GAUCHO RACING VDM CAN REPLAY
+// Feeds a candump capture from the car through the VDM firmware (setup() and loop() from src/main.cpp on
+// the simulated hardware in native/, see native/Hal.h) as fast as the host allows. The simulated clock
+// jumps from frame to frame, with a loop pass at least every --step us in between so the periodic work
+// runs as on the car; each frame is injected at its capture time and the loop runs until every bus is
+// drained. Every frame the VDM sends is written out in candump log format on the capture's time base,
+// so two firmware versions can be compared with diff.
+//
+// Build (Linux):
+//     g++ -O2 -std=gnu++17 -Wno-narrowing -I native -I src tools/vdm_replay.cpp src/main.cpp native/Hal.cpp -o vdm_replay
+//
+// Usage:
+//     vdm_replay TRACE.log [options]          replay a capture
+//     vdm_replay --bench [SECONDS]            synthetic capture of the car's traffic (90 s lap default), replay and time it
+//         --tx FILE             transmit log (vdm_tx.log default, - for stdout)
+//         --primary IFACE       interface of the primary bus in the capture (can0 default)
+//         --data IFACE          interface of the data bus (can1 default)
+//         --step US             longest simulated gap between loop passes (100 default)
+//         --pin PIN=VALUE       hold an input: analogRead() gives VALUE, digitalRead() HIGH for any VALUE but 0
+//         --sd DIR              directory standing in for the SD card (no card by default)
+//         --serial FILE         USB serial output (dropped by default)
+//
+// Captures: candump -l log lines "(1697040000.123456) can0 0C8#0011223344556677", or candump -ta screen
+// lines "(1697040000.123456)  can0  0C8   [8]  00 11 22 ...". Eight digit ids are extended. CAN FD and
+// remote frames are skipped.
+#include "Hal.h"
+#include "Arduino.h"
+#include "FlexCAN_T4.h"
+#include "config.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+void setup();
+void loop();
+
+// the controllers main.cpp puts the buses on
+const uint8_t PRIMARY_BUS = CAN3;
+const uint8_t DATA_BUS = CAN1;
+const size_t RX_QUEUE = 256;                        // RX_SIZE_256
+
+struct Frame {
+    uint64_t time;                                  // us since the epoch of the capture
+    uint8_t bus;
+    CAN_message_t msg;
+};
+
+struct Trace {
+    std::vector<Frame> frames;
+    uint32_t lines = 0;
+    uint32_t skipped = 0;                           // other interfaces, CAN FD, remote frames
+    uint32_t bad = 0;
+};
+
+static int hexValue(char c){
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// "(sec.usec)" at p, fixed point so the output times are exact
+static bool parseTime(const char*& p, uint64_t& t){
+    while(*p == ' ') p++;
+    if(*p != '(') return false;
+    char* end;
+    uint64_t sec = strtoull(p + 1, &end, 10);
+    if(*end != '.') return false;
+    uint64_t usec = 0;
+    int digits = 0;
+    for(p = end + 1; *p >= '0' && *p <= '9'; p++, digits++) if(digits < 6) usec = usec * 10 + (*p - '0');
+    if(*p != ')' || digits == 0) return false;
+    for(; digits < 6; digits++) usec *= 10;
+    p++;
+    t = sec * 1000000 + usec;
+    return true;
+}
+
+static bool parseId(const char*& p, CAN_message_t& m){
+    const char* start = p;
+    uint32_t id = 0;
+    for(; hexValue(*p) >= 0; p++) id = id << 4 | hexValue(*p);
+    size_t n = p - start;
+    if(n == 0 || n > 8) return false;
+    m.id = id;
+    m.flags.extended = n == 8;
+    return true;
+}
+
+enum LineResult {LINE_FRAME, LINE_SKIP, LINE_BAD};
+
+static LineResult parseLine(const char* line, const std::string& primary, const std::string& data, Frame& f){
+    const char* p = line;
+    while(*p == ' ' || *p == '\t') p++;
+    if(!*p || *p == '\n' || *p == '#') return LINE_SKIP;
+    if(!parseTime(p, f.time)) return LINE_BAD;
+    while(*p == ' ' || *p == '\t') p++;
+    const char* iface = p;
+    while(*p && *p != ' ' && *p != '\t') p++;
+    std::string name(iface, p - iface);
+    if(name == primary) f.bus = PRIMARY_BUS;
+    else if(name == data) f.bus = DATA_BUS;
+    else return LINE_SKIP;
+    while(*p == ' ' || *p == '\t') p++;
+    f.msg = CAN_message_t();
+    if(!parseId(p, f.msg)) return LINE_BAD;
+    uint8_t len = 0;
+    if(*p == '#'){
+        // log format: ID#DATA, ID##FLAGS for CAN FD, ID#R for remote
+        p++;
+        if(*p == '#' || *p == 'R') return LINE_SKIP;
+        while(hexValue(p[0]) >= 0 && hexValue(p[1]) >= 0){
+            if(len == 8) return LINE_SKIP;
+            f.msg.buf[len++] = hexValue(p[0]) << 4 | hexValue(p[1]);
+            p += 2;
+        }
+    }
+    else {
+        // screen format: ID [LEN] BYTES
+        while(*p == ' ') p++;
+        if(*p != '[') return LINE_BAD;
+        int n = atoi(p + 1);
+        if(n > 8) return LINE_SKIP;
+        p = strchr(p, ']');
+        if(!p) return LINE_BAD;
+        p++;
+        for(; len < n; len++){
+            while(*p == ' ') p++;
+            if(hexValue(p[0]) < 0 || hexValue(p[1]) < 0) return strstr(p, "remote") ? LINE_SKIP : LINE_BAD;
+            f.msg.buf[len] = hexValue(p[0]) << 4 | hexValue(p[1]);
+            p += 2;
+        }
+    }
+    f.msg.len = len;
+    return LINE_FRAME;
+}
+
+static bool readTrace(const char* path, const std::string& primary, const std::string& data, Trace& trace){
+    FILE* in = fopen(path, "r");
+    if(!in){
+        perror(path);
+        return false;
+    }
+    char line[512];
+    Frame f;
+    while(fgets(line, sizeof(line), in)){
+        trace.lines++;
+        LineResult r = parseLine(line, primary, data, f);
+        if(r == LINE_FRAME) trace.frames.push_back(f);
+        else if(r == LINE_SKIP) trace.skipped++;
+        else if(trace.bad++ < 5) fprintf(stderr, "%s:%u: not a candump line\n", path, trace.lines);
+    }
+    fclose(in);
+    // captures from several interfaces are merged by time, keep the capture order for equal times
+    std::stable_sort(trace.frames.begin(), trace.frames.end(), [](const Frame& a, const Frame& b){return a.time < b.time;});
+    return true;
+}
+
+struct Result {
+    uint64_t frames = 0;
+    uint64_t sent = 0;
+    uint64_t passes = 0;
+    uint64_t busyPasses = 0;                        // passes that read a frame
+    double busyNs = 0;
+    double idleNs = 0;
+    double worstNs = 0;
+    double wallS = 0;
+    uint64_t simUs = 0;
+};
+
+static size_t pendingFrames(){return hal::canPending(PRIMARY_BUS) + hal::canPending(DATA_BUS);}
+
+static void timedLoop(Result& r){
+    size_t before = pendingFrames();
+    auto a = std::chrono::steady_clock::now();
+    loop();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - a).count();
+    r.passes++;
+    if(pendingFrames() < before){
+        r.busyPasses++;
+        r.busyNs += ns;
+    }
+    else r.idleNs += ns;
+    r.worstNs = std::max(r.worstNs, ns);
+}
+
+static Result replay(const Trace& trace, uint32_t step, FILE* tx, const std::string& primary, const std::string& data){
+    Result r;
+    uint64_t base = trace.frames.empty() ? 0 : trace.frames.front().time;
+    hal::onCanWrite = [&](uint8_t bus, const CAN_message_t& m){
+        r.sent++;
+        if(!tx) return;
+        uint64_t t = base + hal::now();
+        fprintf(tx, "(%llu.%06llu) %s %0*X#", (unsigned long long)(t / 1000000), (unsigned long long)(t % 1000000),
+            bus == PRIMARY_BUS ? primary.c_str() : bus == DATA_BUS ? data.c_str() : "vdm", m.flags.extended ? 8 : 3, (unsigned)m.id);
+        for(uint8_t i = 0; i < m.len && i < 8; i++) fprintf(tx, "%02X", m.buf[i]);
+        fputc('\n', tx);
+    };
+
+    // the car boots with the capture's first frame
+    auto start = std::chrono::steady_clock::now();
+    setup();
+    uint64_t lastPass = 0;
+    size_t next = 0;
+    while(next < trace.frames.size()){
+        uint64_t due = trace.frames[next].time - base;
+        uint64_t t = std::min(due, lastPass + step);
+        if(t > hal::now()) hal::advance(t - hal::now());
+        while(next < trace.frames.size() && trace.frames[next].time - base <= hal::now()){
+            const Frame& f = trace.frames[next++];
+            hal::canInject(f.bus, f.msg);
+            r.frames++;
+            // a burst larger than the RX queue arrives as fast as the loop can take it
+            if(hal::canPending(f.bus) >= RX_QUEUE) timedLoop(r);
+        }
+        timedLoop(r);
+        while(pendingFrames()) timedLoop(r);
+        lastPass = hal::now();
+    }
+    r.wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    r.simUs = hal::now();
+    hal::onCanWrite = nullptr;
+    return r;
+}
+
+static void report(const Trace& trace, const Result& r){
+    uint32_t overruns = hal::canStats(PRIMARY_BUS).overruns + hal::canStats(DATA_BUS).overruns;
+    fprintf(stderr, "%zu frames (%u lines, %u skipped, %u bad) over %.1f s of capture replayed in %.3f s, %.0fx real time\n",
+        trace.frames.size(), trace.lines, trace.skipped, trace.bad, r.simUs * 1e-6, r.wallS, r.wallS > 0 ? r.simUs * 1e-6 / r.wallS : 0);
+    fprintf(stderr, "throughput %.0f frames/s in, %llu frames sent by the VDM, %u RX overruns\n",
+        r.wallS > 0 ? r.frames / r.wallS : 0, (unsigned long long)r.sent, overruns);
+    fprintf(stderr, "per frame %.0f ns (receive and control pass) | idle pass %.0f ns | worst pass %.1f us | %llu passes\n",
+        r.busyPasses ? r.busyNs / r.busyPasses : 0, r.passes > r.busyPasses ? r.idleNs / (r.passes - r.busyPasses) : 0,
+        r.worstNs / 1e3, (unsigned long long)r.passes);
+}
+
+// a capture shaped like the car's traffic: node, id, rate
+struct Source {
+    uint8_t bus;
+    uint32_t id;
+    uint32_t rate;                                  // Hz
+};
+
+static bool writeBench(const char* path, double seconds){
+    std::vector<Source> sources = {
+        {PRIMARY_BUS, Pedals_Inputs, 1000}, {PRIMARY_BUS, ACU_General, 100}, {PRIMARY_BUS, ACU_General2, 100},
+        {PRIMARY_BUS, DTI_Data_1, 100}, {PRIMARY_BUS, DTI_Data_2, 100}, {PRIMARY_BUS, DTI_Data_3, 100},
+        {PRIMARY_BUS, DTI_Data_4, 100}, {PRIMARY_BUS, DTI_Data_5, 100}, {PRIMARY_BUS, Energy_Meter_Measurements, 100},
+        {PRIMARY_BUS, TCM_Status, 10},
+    };
+    for(uint32_t id = Condensed_Cell_Voltage_n0; id <= Condensed_Cell_Temp_n128; id++) sources.push_back({PRIMARY_BUS, id, 10});
+    for(uint32_t hub = 0x10F00; hub <= 0x10F18; hub += 8){
+        for(uint32_t id = hub; id < hub + 3; id++) sources.push_back({DATA_BUS, id, 200});
+    }
+    for(uint32_t id = 0x10F20; id <= 0x10F22; id++) sources.push_back({DATA_BUS, id, 200});
+    for(uint32_t id = 0x10F23; id <= 0x10F26; id++) sources.push_back({DATA_BUS, id, 10});
+
+    FILE* out = fopen(path, "w");
+    if(!out){
+        perror(path);
+        return false;
+    }
+    std::mt19937 rng(7);
+    struct Line {
+        uint64_t t;
+        const Source* s;
+    };
+    std::vector<Line> lines;
+    uint64_t end = (uint64_t)(seconds * 1e6);
+    for(const Source& s : sources){
+        uint64_t period = 1000000 / s.rate, phase = rng() % period;
+        // a little jitter, as node clocks run on their own
+        for(uint64_t t = phase; t < end; t += period) lines.push_back({t + rng() % 50, &s});
+    }
+    std::sort(lines.begin(), lines.end(), [](const Line& a, const Line& b){return a.t < b.t;});
+    const uint64_t epoch = 1700000000ULL * 1000000;
+    for(const Line& l : lines){
+        uint64_t t = epoch + l.t;
+        fprintf(out, "(%llu.%06llu) %s %0*X#", (unsigned long long)(t / 1000000), (unsigned long long)(t % 1000000),
+            l.s->bus == PRIMARY_BUS ? "can0" : "can1", l.s->id > 0x7FF ? 8 : 3, (unsigned)l.s->id);
+        for(int i = 0; i < 8; i++) fprintf(out, "%02X", (unsigned)(rng() & 0xFF));
+        fputc('\n', out);
+    }
+    return fclose(out) == 0;
+}
+
+static void usage(){
+    fprintf(stderr, "usage: vdm_replay TRACE.log [--tx FILE] [--primary IFACE] [--data IFACE] [--step US] [--pin PIN=VALUE]... [--sd DIR] [--serial FILE]\n"
+                    "       vdm_replay --bench [SECONDS]\n");
+}
+
+int main(int argc, char** argv){
+    const char* path = nullptr;
+    const char* txPath = "vdm_tx.log";
+    const char* serial = nullptr;
+    std::string primary = "can0", data = "can1";
+    uint32_t step = 100;
+    bool bench = false;
+    double benchSeconds = 90;
+    for(int i = 1; i < argc; i++){
+        const char* a = argv[i];
+        bool more = i + 1 < argc;
+        if(!strcmp(a, "--tx") && more) txPath = argv[++i];
+        else if(!strcmp(a, "--primary") && more) primary = argv[++i];
+        else if(!strcmp(a, "--data") && more) data = argv[++i];
+        else if(!strcmp(a, "--step") && more) step = std::max(1, atoi(argv[++i]));
+        else if(!strcmp(a, "--sd") && more) hal::sdRoot(argv[++i]);
+        else if(!strcmp(a, "--serial") && more) serial = argv[++i];
+        else if(!strcmp(a, "--pin") && more && strchr(argv[i + 1], '=')){
+            const char* p = argv[++i];
+            int pin = atoi(p), value = atoi(strchr(p, '=') + 1);
+            hal::setAnalog(pin, value);
+            hal::setDigital(pin, value != 0);
+        }
+        else if(!strcmp(a, "--bench")){
+            bench = true;
+            if(more && argv[i + 1][0] != '-') benchSeconds = atof(argv[++i]);
+        }
+        else if(a[0] != '-' && !path) path = a;
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if(bench){
+        path = "/tmp/vdm_bench_trace.log";
+        txPath = "/tmp/vdm_bench_tx.log";
+        primary = "can0";
+        data = "can1";
+        if(!writeBench(path, benchSeconds)) return 1;
+        fprintf(stderr, "synthetic capture %s, transmit log %s\n", path, txPath);
+    }
+    if(!path){
+        usage();
+        return 2;
+    }
+
+    hal::serialOutput(-1);
+    if(serial){
+        int fd = open(serial, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0){
+            perror(serial);
+            return 1;
+        }
+        hal::serialOutput(fd);
+    }
+    Trace trace;
+    if(!readTrace(path, primary, data, trace)) return 1;
+    if(trace.frames.empty()){
+        fprintf(stderr, "%s: no frames on %s or %s\n", path, primary.c_str(), data.c_str());
+        return 1;
+    }
+    FILE* tx = strcmp(txPath, "-") ? fopen(txPath, "w") : stdout;
+    if(!tx){
+        perror(txPath);
+        return 1;
+    }
+    // a large buffer keeps the transmit log from dominating the timing
+    static char txBuffer[1 << 20];
+    setvbuf(tx, txBuffer, _IOFBF, sizeof(txBuffer));
+    Result r = replay(trace, step, tx, primary, data);
+    if(tx != stdout && fclose(tx) != 0) perror(txPath);
+    else if(tx == stdout) fflush(stdout);
+    report(trace, r);
+    return trace.bad ? 1 : 0;
+}
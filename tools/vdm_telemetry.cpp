@@ -0,0 +1,453 @@
+
+// GAUCHO RACING VDM TELEMETRY VIEWER
+// Decodes the binary telemetry stream (see src/TelemetryFormat.h) from the VDM's USB serial port,
+// counts dropped and corrupt packets and shows the live values. Lines typed on stdin go to the VDM
+// serial console (help, list, get, set, mode, stats) and its replies are shown under the table.
+//
+// Build (Linux):
+//     g++ -O2 -std=c++17 -I src tools/vdm_telemetry.cpp -o vdm_telemetry
+//
+// Usage:
+//     vdm_telemetry /dev/ttyACM0                      live table of every signal with a min / max bar
+//     vdm_telemetry /dev/ttyACM0 --csv                one CSV row per data packet on stdout
+//     vdm_telemetry /dev/ttyACM0 --record FILE        also save the raw byte stream to FILE
+//     vdm_telemetry --replay FILE [--csv]             decode a recorded byte stream
+//     vdm_telemetry --loopback                        record a synthetic stream with drops and corruption,
+//                                                     replay it and check the decoder, no hardware needed
+#include "TelemetryFormat.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+// must match State and Mode in main.cpp
+static const char* STATE_NAMES[] = {"ECU_FLASH", "GLV_ON", "TS_PRECHARGE", "TS_DISCHARGE_OFF", "PRECHARGING",
+                                    "PRECHARGE_COMPLETE", "DRIVE_STANDBY", "DRIVE_ACTIVE", "DRIVE_REGEN", "ERROR"};
+static const char* MODE_NAMES[] = {"STANDARD", "DYNAMIC_TC"};
+
+static const char* stateName(uint8_t s){return s < sizeof(STATE_NAMES) / sizeof(*STATE_NAMES) ? STATE_NAMES[s] : "?";}
+static const char* modeName(uint8_t m){return m < sizeof(MODE_NAMES) / sizeof(*MODE_NAMES) ? MODE_NAMES[m] : "?";}
+
+struct Decoder {
+    std::vector<std::string> names;
+    std::vector<std::string> units;
+    std::vector<float> scales;
+
+    // statistics
+    uint64_t bytes = 0;
+    uint64_t packets = 0;               // good data packets
+    uint64_t descriptors = 0;
+    uint64_t texts = 0;
+    uint64_t drops = 0;                 // missing sequence numbers
+    uint64_t corrupt = 0;               // frames failing COBS, CRC or length checks
+    uint64_t restarts = 0;              // sequence went backwards, the VDM rebooted
+
+    std::function<void(const TelemetryHeader&, const TelemetryStatus&, const float*)> onData;
+    std::function<void()> onDescriptor;
+    std::function<void(const std::string&)> onText;
+
+    void feed(const uint8_t* p, size_t n){
+        bytes += n;
+        for(size_t i = 0; i < n; i++){
+            uint8_t b = p[i];
+            if(b == 0){
+                if(overflow) bad();
+                else if(fill) handle();
+                fill = 0;
+                overflow = false;
+            }
+            else if(fill < sizeof(frame)) frame[fill++] = b;
+            else overflow = true;
+        }
+    }
+
+    private:
+    uint8_t frame[TLM_MAX_FRAME];
+    uint8_t packet[TLM_MAX_PACKET];
+    size_t fill = 0;
+    bool overflow = false;
+    bool synced = false;                // seen one good frame, anything before it is boot text or a partial frame
+    bool haveSeq = false;
+    uint32_t nextSeq = 0;
+
+    void bad(){if(synced) corrupt++;}
+
+    void handle(){
+        int n = tlm_unframe(frame, fill, packet);
+        if(n < 0) return bad();
+        TelemetryHeader h;
+        memcpy(&h, packet, sizeof(h));
+        if(h.version != TLM_VERSION || h.signalCount > TLM_MAX_SIGNALS) return bad();
+        if(h.type == TLM_DATA){
+            if((size_t)n != sizeof(h) + sizeof(TelemetryStatus) + h.signalCount * sizeof(float)) return bad();
+            synced = true;
+            if(haveSeq && h.seq != nextSeq){
+                if((int32_t)(h.seq - nextSeq) > 0) drops += h.seq - nextSeq;
+                else restarts++;
+            }
+            nextSeq = h.seq + 1;
+            haveSeq = true;
+            packets++;
+            TelemetryStatus status;
+            float values[TLM_MAX_SIGNALS];
+            memcpy(&status, packet + sizeof(h), sizeof(status));
+            memcpy(values, packet + sizeof(h) + sizeof(status), h.signalCount * sizeof(float));
+            if(names.size() != h.signalCount) describeUnknown(h.signalCount);
+            if(onData) onData(h, status, values);
+        }
+        else if(h.type == TLM_DESCRIPTOR){
+            std::vector<std::string> n2, u2;
+            std::vector<float> s2;
+            size_t at = sizeof(h);
+            for(int i = 0; i < h.signalCount; i++){
+                float scale;
+                if(at + sizeof(float) > (size_t)n) return bad();
+                memcpy(&scale, packet + at, sizeof(float));
+                at += sizeof(float);
+                const char* name = (const char*)packet + at;
+                size_t l = strnlen(name, n - at);
+                if(at + l >= (size_t)n) return bad();
+                at += l + 1;
+                const char* unit = (const char*)packet + at;
+                size_t lu = strnlen(unit, n - at);
+                if(at + lu >= (size_t)n) return bad();
+                at += lu + 1;
+                n2.emplace_back(name, l);
+                u2.emplace_back(unit, lu);
+                s2.push_back(scale);
+            }
+            synced = true;
+            descriptors++;
+            bool changed = n2 != names || u2 != units;
+            names.swap(n2);
+            units.swap(u2);
+            scales.swap(s2);
+            if(changed && onDescriptor) onDescriptor();
+        }
+        else if(h.type == TLM_TEXT){
+            synced = true;
+            texts++;
+            if(onText) onText(std::string((const char*)packet + sizeof(h), n - sizeof(h)));
+        }
+        else bad();
+    }
+
+    // data arrived before its descriptor, show generic names until one comes
+    void describeUnknown(uint8_t count){
+        names.clear();
+        units.assign(count, "");
+        scales.assign(count, 0);
+        for(int i = 0; i < count; i++) names.push_back("sig" + std::to_string(i));
+    }
+};
+
+// ------------------------------------------------------------------------------------------------
+// live view
+
+struct LiveView {
+    std::vector<float> value, lo, hi;
+    std::vector<std::string> console;       // last console reply lines
+    TelemetryHeader last = {};
+    TelemetryStatus status = {};
+    std::chrono::steady_clock::time_point lastDraw, rateStart;
+    uint64_t rateCount = 0;
+    double rate = 0;
+
+    void update(const TelemetryHeader& h, const TelemetryStatus& s, const float* v){
+        if(value.size() != h.signalCount){
+            value.assign(h.signalCount, 0);
+            lo.assign(h.signalCount, INFINITY);
+            hi.assign(h.signalCount, -INFINITY);
+        }
+        for(int i = 0; i < h.signalCount; i++){
+            value[i] = v[i];
+            if(v[i] < lo[i]) lo[i] = v[i];
+            if(v[i] > hi[i]) hi[i] = v[i];
+        }
+        last = h;
+        status = s;
+        rateCount++;
+    }
+
+    void text(const std::string& t){
+        size_t start = 0;
+        while(start < t.size()){
+            size_t end = t.find('\n', start);
+            if(end == std::string::npos) end = t.size();
+            console.push_back(t.substr(start, end - start));
+            start = end + 1;
+        }
+        while(console.size() > 12) console.erase(console.begin());
+    }
+
+    void draw(const Decoder& d, bool force = false){
+        auto now = std::chrono::steady_clock::now();
+        if(!force && now - lastDraw < std::chrono::milliseconds(100)) return;
+        double window = std::chrono::duration<double>(now - rateStart).count();
+        if(window >= 1.0){
+            rate = rateCount / window;
+            rateCount = 0;
+            rateStart = now;
+        }
+        lastDraw = now;
+        printf("\033[H\033[J");
+        printf("VDM %.3f s | %s | %s | power %u | flags%s%s%s%s\n", last.time * 1e-6, stateName(status.state), modeName(status.mode),
+               status.powerLevel, status.flags & TLM_FLAG_FAULT ? " FAULT" : "", status.flags & TLM_FLAG_LIMIT ? " LIMIT" : "",
+               status.flags & TLM_FLAG_LOGGING ? " LOG" : "", status.flags & TLM_FLAG_TRACTION ? " TC" : "");
+        printf("seq %u | %.1f pkt/s | packets %llu | dropped %llu | corrupt %llu | restarts %llu\n\n", last.seq, rate,
+               (unsigned long long)d.packets, (unsigned long long)d.drops, (unsigned long long)d.corrupt, (unsigned long long)d.restarts);
+        for(size_t i = 0; i < value.size() && i < d.names.size(); i++){
+            const int W = 30;
+            int bar = (hi[i] > lo[i]) ? (int)lround((value[i] - lo[i]) / (hi[i] - lo[i]) * W) : 0;
+            char line[W + 1];
+            for(int k = 0; k < W; k++) line[k] = k < bar ? '#' : '.';
+            line[W] = 0;
+            printf("%-16s %12.3f %-4s [%s] %10.3f .. %-10.3f\n", d.names[i].c_str(), value[i], d.units[i].c_str(), line, lo[i], hi[i]);
+        }
+        printf("\n");
+        for(auto& l : console) printf("> %s\n", l.c_str());
+        fflush(stdout);
+    }
+};
+
+// ------------------------------------------------------------------------------------------------
+// input
+
+static int openSerial(const char* path){
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if(fd < 0) return -1;
+    termios t;
+    if(tcgetattr(fd, &t) == 0){
+        cfmakeraw(&t);
+        cfsetispeed(&t, B115200);   // USB serial ignores the baud rate
+        t.c_cc[VMIN] = 1;
+        t.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &t);
+    }
+    // the VDM boots with the debug page on the port, switch it to the binary stream
+    const char mode[] = "mode telemetry\n";
+    if(write(fd, mode, sizeof(mode) - 1) < 0) perror(path);
+    return fd;
+}
+
+// read fd to the end through the decoder, in random chunk sizes when rng is given. With a
+// console, lines typed on stdin are written to fd.
+static void pump(int fd, Decoder& d, FILE* record, LiveView* view, std::mt19937* rng = nullptr, bool console = false){
+    std::vector<uint8_t> buf(4096);
+    std::string typed;
+    for(;;){
+        if(console){
+            pollfd fds[2] = {{fd, POLLIN, 0}, {STDIN_FILENO, POLLIN, 0}};
+            if(poll(fds, 2, -1) < 0) break;
+            if(fds[1].revents & POLLIN){
+                char c[256];
+                ssize_t n = read(STDIN_FILENO, c, sizeof(c));
+                if(n > 0) typed.append(c, n);
+                size_t nl;
+                while((nl = typed.find('\n')) != std::string::npos){
+                    std::string line = typed.substr(0, nl + 1);
+                    if(write(fd, line.data(), line.size()) < 0) perror("console");
+                    typed.erase(0, nl + 1);
+                }
+            }
+            if(!(fds[0].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+        }
+        size_t want = rng ? 1 + (*rng)() % buf.size() : buf.size();
+        ssize_t n = read(fd, buf.data(), want);
+        if(n <= 0) break;
+        if(record) fwrite(buf.data(), 1, n, record);
+        d.feed(buf.data(), n);
+        if(view) view->draw(d);
+    }
+}
+
+static void printSummary(const Decoder& d){
+    fprintf(stderr, "%llu bytes | %llu data packets | %llu descriptors | %llu text | %llu dropped | %llu corrupt | %llu restarts\n",
+            (unsigned long long)d.bytes, (unsigned long long)d.packets, (unsigned long long)d.descriptors, (unsigned long long)d.texts,
+            (unsigned long long)d.drops, (unsigned long long)d.corrupt, (unsigned long long)d.restarts);
+}
+
+static void attachCsv(Decoder& d){
+    d.onText = [](const std::string& t){fprintf(stderr, "%s", t.c_str());};
+    d.onDescriptor = [&d](){
+        printf("seq,time,state,mode,power,flags");
+        for(auto& n : d.names) printf(",%s", n.c_str());
+        printf("\n");
+    };
+    d.onData = [&d](const TelemetryHeader& h, const TelemetryStatus& s, const float* v){
+        if(d.descriptors == 0) return;      // no header row yet
+        printf("%u,%.6f,%u,%u,%u,%u", h.seq, h.time * 1e-6, s.state, s.mode, s.powerLevel, s.flags);
+        for(int i = 0; i < h.signalCount; i++) printf(",%.6g", v[i]);
+        printf("\n");
+    };
+}
+
+// ------------------------------------------------------------------------------------------------
+// loopback: build a recording with the same packet code the VDM uses, damage it, replay it from a
+// file in random chunk sizes and check every count and value
+
+static float synthValue(uint32_t seq, int i){
+    return (float)(i == 0 ? seq % 10 : 100.0 * i * sin(seq * 0.01 * (i + 1)));
+}
+
+static int loopback(){
+    const int SIGNALS = 8;
+    const uint32_t PACKETS = 20000;
+    const uint32_t RATE = 100;
+    const char* names[SIGNALS] = {"state", "apps1", "rpm", "ac_current", "motor_temp", "ts_voltage", "wfl_speed", "a_very_long_signal_name"};
+    const char* units[SIGNALS] = {"", "adc", "rpm", "A", "C", "V", "rpm", "units_too_long"};
+    const float scales[SIGNALS] = {1, 1, 0.1, 0.1, 0.1, 0.01, 1, 0.001};
+
+    std::vector<uint8_t> stream;
+    const char* boot = "Initializing SD Card...\r\nDATA LOGGER DISABLED\r\n";
+    stream.insert(stream.end(), boot, boot + strlen(boot));
+    stream.push_back(0);                // TelemetryStream::begin()
+    uint8_t packet[TLM_MAX_PACKET];
+    uint8_t frame[TLM_MAX_FRAME];
+    uint64_t dropped = 0, corrupted = 0, sent = 0;
+    for(uint32_t seq = 0; seq < PACKETS; seq++){
+        if(seq % RATE == 0){
+            size_t n = tlm_descriptor_packet(packet, seq, seq * 10000, names, units, scales, SIGNALS);
+            size_t f = tlm_frame(packet, n, frame);
+            stream.insert(stream.end(), frame, frame + f);
+        }
+        float values[SIGNALS];
+        for(int i = 0; i < SIGNALS; i++) values[i] = synthValue(seq, i);
+        TelemetryStatus status = {(uint8_t)(seq / 1000 % 10), 0, 3, (uint8_t)(seq & 0x0F)};
+        size_t n = tlm_data_packet(packet, seq, seq * 10000, status, values, SIGNALS);
+        size_t f = tlm_frame(packet, n, frame);
+        if(seq % 5000 == 1234){         // console reply between two data packets
+            const char* reply = "OK rev_limit = 5500 rpm\n";
+            size_t t = tlm_text_packet(packet, seq, seq * 10000, reply, strlen(reply));
+            size_t tf = tlm_frame(packet, t, frame);
+            stream.insert(stream.end(), frame, frame + tf);
+            size_t dn = tlm_data_packet(packet, seq, seq * 10000, status, values, SIGNALS);
+            f = tlm_frame(packet, dn, frame);
+        }
+        if(seq % 997 == 500){           // lost on the wire or skipped on the VDM
+            dropped++;
+            continue;
+        }
+        if(seq % 1499 == 700){          // one flipped byte, never turned into a delimiter
+            uint8_t& b = frame[f / 2];
+            b ^= (b ^ 0x55) ? 0x55 : 0xAA;
+            corrupted++;
+        }
+        else sent++;
+        stream.insert(stream.end(), frame, frame + f);
+    }
+    // the capture stops in the middle of a frame
+    stream.insert(stream.end(), frame, frame + 5);
+
+    char path[] = "/tmp/vdm_telemetry_XXXXXX";
+    int fd = mkstemp(path);
+    if(fd < 0 || write(fd, stream.data(), stream.size()) != (ssize_t)stream.size()){
+        fprintf(stderr, "cannot write %s\n", path);
+        return 1;
+    }
+    lseek(fd, 0, SEEK_SET);
+
+    Decoder d;
+    uint64_t mismatches = 0;
+    uint64_t replies = 0;
+    d.onText = [&](const std::string& t){if(t == "OK rev_limit = 5500 rpm\n") replies++;};
+    d.onData = [&](const TelemetryHeader& h, const TelemetryStatus& s, const float* v){
+        if(h.signalCount != SIGNALS || h.time != h.seq * 10000 || s.flags != (h.seq & 0x0F)) mismatches++;
+        for(int i = 0; i < h.signalCount && i < SIGNALS; i++) if(v[i] != synthValue(h.seq, i)) mismatches++;
+    };
+    std::mt19937 rng(42);
+    auto start = std::chrono::steady_clock::now();
+    pump(fd, d, nullptr, nullptr, &rng);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    close(fd);
+    unlink(path);
+
+    printSummary(d);
+    fprintf(stderr, "decoded %.1f MB/s\n", d.bytes / seconds / 1e6);
+    bool ok = true;
+    auto check = [&](const char* what, uint64_t got, uint64_t want){
+        if(got == want) return;
+        fprintf(stderr, "FAIL %s: got %llu, expected %llu\n", what, (unsigned long long)got, (unsigned long long)want);
+        ok = false;
+    };
+    check("data packets", d.packets, sent);
+    check("dropped", d.drops, dropped + corrupted);
+    check("corrupt", d.corrupt, corrupted);
+    check("descriptors", d.descriptors, (PACKETS + RATE - 1) / RATE);
+    check("restarts", d.restarts, 0);
+    check("console replies", replies, PACKETS / 5000);
+    check("value mismatches", mismatches, 0);
+    if(d.names.size() != SIGNALS || d.names[7] != "a_very_long_sig" || d.units[7] != "units_t" || d.scales[2] != 0.1f){
+        fprintf(stderr, "FAIL descriptor contents\n");
+        ok = false;
+    }
+    fprintf(stderr, ok ? "LOOPBACK PASS\n" : "LOOPBACK FAIL\n");
+    return ok ? 0 : 1;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+static void usage(){
+    fprintf(stderr, "usage: vdm_telemetry PORT [--csv] [--record FILE]\n"
+                    "       vdm_telemetry --replay FILE [--csv]\n"
+                    "       vdm_telemetry --loopback\n");
+}
+
+int main(int argc, char** argv){
+    const char* port = nullptr;
+    const char* replay = nullptr;
+    const char* recordPath = nullptr;
+    bool csv = false;
+    for(int i = 1; i < argc; i++){
+        std::string a = argv[i];
+        if(a == "--loopback") return loopback();
+        else if(a == "--csv") csv = true;
+        else if(a == "--replay" && i + 1 < argc) replay = argv[++i];
+        else if(a == "--record" && i + 1 < argc) recordPath = argv[++i];
+        else if(a[0] != '-' && !port) port = argv[i];
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if(!port == !replay){
+        usage();
+        return 1;
+    }
+
+    int fd = replay ? open(replay, O_RDONLY) : openSerial(port);
+    if(fd < 0){
+        perror(replay ? replay : port);
+        return 1;
+    }
+    FILE* record = nullptr;
+    if(recordPath && !(record = fopen(recordPath, "wb"))){
+        perror(recordPath);
+        return 1;
+    }
+
+    Decoder d;
+    LiveView view;
+    if(csv) attachCsv(d);
+    else {
+        d.onData = [&view](const TelemetryHeader& h, const TelemetryStatus& s, const float* v){view.update(h, s, v);};
+        d.onText = [&view](const std::string& t){view.text(t);};
+    }
+    pump(fd, d, record, csv ? nullptr : &view, nullptr, !replay && !csv);
+    if(!csv) view.draw(d, true);
+    if(record) fclose(record);
+    close(fd);
+    printSummary(d);
+    return 0;
+}
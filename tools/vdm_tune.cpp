@@ -0,0 +1,352 @@
+
+// GAUCHO RACING VDM TUNE TOOL
+// Converts between the readable tune text and the binary tune image the VDM loads (see src/TuneImage.h),
+// and streams an image to the VDM over CAN (see src/TuneUpload.h).
+//
+// Build (Linux):
+//     g++ -O2 -std=c++17 -I src tools/vdm_tune.cpp -o vdm_tune
+//
+// Usage:
+//     vdm_tune defaults                               print the compiled in tune as text
+//     vdm_tune build TUNE.txt gr24.bin [GENERATION]   check the text against the field ranges and write the image
+//     vdm_tune dump gr24.bin                          check an image and print it as text
+//     vdm_tune send gr24.bin [can0] [WINDOW]          upload an image over SocketCAN, wait until the VDM applies it
+//     vdm_tune --loopback                             run the upload protocol against the VDM receiver over a lossy link
+//
+// Tune text: one value per line, the same words as the console set command without "set":
+//     power 3 150                  # NAME [INDEX] VALUE, '#' starts a comment
+// Values not listed keep the compiled in default.
+#include "TuneImage.h"
+#include "TuneUpload.h"
+#include "config.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <string>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static void printTune(const TuneData& d, FILE* out){
+    for(uint8_t k = 0; k < TUNE_FIELD_COUNT; k++){
+        const TuneField& f = TUNE_FIELDS[k];
+        for(uint8_t i = 0; i < f.count; i++){
+            float v = tune_field_get(d, f, i);
+            std::string name = f.name;
+            if(f.count > 1) name += " " + std::to_string(i);
+            if(tune_field_integer(f)) fprintf(out, "%-20s %ld", name.c_str(), lroundf(v));
+            else fprintf(out, "%-20s %g", name.c_str(), v);
+            fprintf(out, "%*s# %s [%g, %g]%s\n", 4, "", f.unit, f.min, f.max, f.live ? "" : " not while driving");
+        }
+    }
+}
+
+static bool parseNumber(const char* s, float& v){
+    char* end;
+    v = strtof(s, &end);
+    return end != s && *end == 0;
+}
+
+// apply a tune text on top of d, report every bad line
+static bool parseTune(FILE* in, const char* path, TuneData& d){
+    char line[256];
+    int lineNo = 0;
+    bool ok = true;
+    while(fgets(line, sizeof(line), in)){
+        lineNo++;
+        char* hash = strchr(line, '#');
+        if(hash) *hash = 0;
+        char* words[4];
+        int n = 0;
+        for(char* w = strtok(line, " \t\r\n"); w && n < 4; w = strtok(nullptr, " \t\r\n")) words[n++] = w;
+        if(n == 0) continue;
+        const TuneField* f = tune_field_find(words[0]);
+        int want = f && f->count > 1 ? 3 : 2;
+        float index = 0, v;
+        const char* err = nullptr;
+        if(!f) err = "unknown parameter";
+        else if(n != want) err = f->count > 1 ? "expected NAME INDEX VALUE" : "expected NAME VALUE";
+        else if(want == 3 && (!parseNumber(words[1], index) || index < 0 || index >= f->count || index != (int)index)) err = "bad index";
+        else if(!parseNumber(words[want - 1], v)) err = "not a number";
+        else if(!tune_field_check(*f, v)) err = tune_field_integer(*f) ? "not an integer in range" : "out of range";
+        if(err){
+            fprintf(stderr, "%s:%d: %s\n", path, lineNo, err);
+            ok = false;
+            continue;
+        }
+        tune_field_set(d, *f, index, v);
+    }
+    const TuneField* bad = nullptr;
+    if(ok && !tune_data_consistent(d, &bad)){
+        fprintf(stderr, "%s: %s breaks apps zero != floor or warn < limit < critical\n", path, bad ? bad->name : "tune");
+        ok = false;
+    }
+    return ok;
+}
+
+static bool readImage(const char* path, TuneImage& img){
+    FILE* in = fopen(path, "rb");
+    bool ok = in && fread(&img, 1, sizeof(img), in) == sizeof(img) && fgetc(in) == EOF;
+    if(in) fclose(in);
+    if(!ok) fprintf(stderr, "%s: not a %zu byte tune image\n", path, sizeof(img));
+    return ok;
+}
+
+static uint32_t nowMs(){
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static int openCan(const char* iface){
+    int s = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if(s < 0){
+        perror("socket");
+        return -1;
+    }
+    ifreq ifr = {};
+    strncpy(ifr.ifr_name, iface, IFNAMSIZ - 1);
+    if(ioctl(s, SIOCGIFINDEX, &ifr) < 0){
+        perror(iface);
+        close(s);
+        return -1;
+    }
+    can_filter filter = {Tune_Upload_Ack | CAN_EFF_FLAG, CAN_EFF_MASK | CAN_EFF_FLAG};
+    setsockopt(s, SOL_CAN_RAW, CAN_RAW_FILTER, &filter, sizeof(filter));
+    sockaddr_can addr = {};
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if(bind(s, (sockaddr*)&addr, sizeof(addr)) < 0){
+        perror("bind");
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+static void printProgress(const TuneUploadSender& tx, TuneUploadSender::Phase& shown){
+    if(tx.phase == shown) return;
+    shown = tx.phase;
+    if(tx.phase == TuneUploadSender::WAIT_APPLIED) fprintf(stderr, "staged, waiting for the car to reach GLV_ON or DRIVE_STANDBY\n");
+    if(tx.phase == TuneUploadSender::DONE) fprintf(stderr, "applied\n");
+}
+
+static int sendImage(const TuneImage& img, const char* iface, uint8_t window){
+    int s = openCan(iface);
+    if(s < 0) return 1;
+    TuneUploadSender tx;
+    TuneUploadSender::Phase shown = TuneUploadSender::IDLE;
+    tx.begin(img, window, nowMs());
+    while(!tx.finished()){
+        can_frame f = {};
+        uint32_t id;
+        // send everything that is due, then wait a little for acks
+        while(tx.poll(nowMs(), id, f.data, Tune_Upload_Control, Tune_Upload_Data)){
+            f.can_id = id | CAN_EFF_FLAG;
+            f.can_dlc = 8;
+            if(write(s, &f, sizeof(f)) != sizeof(f)){
+                // tx queue full, back off and let the retry timer resend
+                usleep(1000);
+                break;
+            }
+        }
+        pollfd p = {s, POLLIN, 0};
+        while(poll(&p, 1, 5) > 0 && read(s, &f, sizeof(f)) == sizeof(f)){
+            if((f.can_id & CAN_EFF_MASK) == Tune_Upload_Ack) tx.onAck(f.data, f.can_dlc, nowMs());
+        }
+        printProgress(tx, shown);
+    }
+    close(s);
+    fprintf(stderr, "%u frames, %u chunks resent\n", tx.framesSent, tx.resends);
+    if(tx.phase == TuneUploadSender::DONE) return 0;
+    fprintf(stderr, "upload failed: %s\n", tx.error ? tune_upload_status_name(tx.error) : "no answer from the VDM");
+    return 1;
+}
+
+/*
+Runs the sender against the VDM receiver in process, over a link that drops, duplicates and
+reorders frames in both directions, with a simulated clock. The car only reaches a safe state
+after a while, so the staged image must wait before it is applied.
+*/
+struct LossyLink {
+    struct Frame {
+        uint32_t id;
+        uint8_t buf[8];
+        uint32_t at;
+    };
+    std::deque<Frame> q;
+    std::mt19937 rng;
+    double loss;
+
+    LossyLink(uint32_t seed, double l) : rng(seed), loss(l) {}
+
+    bool chance(double p){return std::uniform_real_distribution<double>(0, 1)(rng) < p;}
+
+    void push(uint32_t id, const uint8_t* buf, uint32_t now){
+        if(chance(loss)) return;
+        Frame f = {id, {}, now + 1};
+        memcpy(f.buf, buf, 8);
+        if(!q.empty() && chance(loss / 2)) q.insert(q.end() - 1, f);       // overtakes the previous frame
+        else q.push_back(f);
+        if(chance(loss / 4)) q.push_back(f);
+    }
+
+    bool pop(uint32_t now, Frame& f){
+        if(q.empty() || q.front().at > now) return false;
+        f = q.front();
+        q.pop_front();
+        return true;
+    }
+};
+
+// @return final sender phase
+static TuneUploadSender::Phase loopbackRun(const TuneImage& img, uint32_t seed, double loss, uint8_t window, uint32_t safeAt, uint32_t stopAt, TuneUploadReceiver& rx, TuneUploadSender& tx, uint8_t& lastStatus){
+    LossyLink up(seed, loss), down(seed + 1, loss);
+    rx = TuneUploadReceiver();
+    tx = TuneUploadSender();
+    lastStatus = 0;
+    tx.begin(img, window, 0);
+    for(uint32_t now = 0; now < 120000 && !tx.finished(); now++){
+        uint32_t id;
+        uint8_t buf[8];
+        // a CAN bus at 1 Mbit fits about 8 frames per ms
+        for(int n = 0; n < 8 && now < stopAt && tx.poll(now, id, buf, Tune_Upload_Control, Tune_Upload_Data); n++) up.push(id, buf, now);
+        LossyLink::Frame f;
+        uint8_t ack[8];
+        while(up.pop(now, f)){
+            bool reply = false;
+            if(f.id == Tune_Upload_Control) reply = rx.onControl(f.buf, 8, now, ack);
+            else reply = rx.onData(f.buf, 8, now, ack);
+            if(reply) down.push(Tune_Upload_Ack, ack, now);
+        }
+        if(rx.service(now, ack)){
+            lastStatus = ack[0];
+            down.push(Tune_Upload_Ack, ack, now);
+        }
+        if(rx.phase == TuneUploadReceiver::STAGED && now >= safeAt && rx.applied(ack)) down.push(Tune_Upload_Ack, ack, now);
+        while(down.pop(now, f)){
+            lastStatus = f.buf[0];
+            tx.onAck(f.buf, 8, now);
+        }
+        if(now >= stopAt && rx.phase == TuneUploadReceiver::IDLE && lastStatus == TUNE_ERR_TIMEOUT) break;
+    }
+    return tx.phase;
+}
+
+static int loopback(){
+    TuneData d = tune_defaults();
+    d.power[3] = 150;
+    d.revLimit = 5500;
+    TuneImage img;
+    tune_image_seal(img, d, 7);
+    TuneUploadReceiver rx;
+    TuneUploadSender tx;
+    uint8_t status;
+    int failures = 0;
+
+    const double losses[] = {0, 0.01, 0.05, 0.2};
+    const uint8_t windows[] = {1, 4, 8, 32};
+    for(double loss : losses){
+        for(uint8_t w : windows){
+            for(uint32_t seed = 1; seed <= 20; seed++){
+                TuneUploadSender::Phase p = loopbackRun(img, seed, loss, w, 2000, UINT32_MAX, rx, tx, status);
+                bool ok = p == TuneUploadSender::DONE && rx.staged == 1 && memcmp(&rx.shadow, &img, sizeof(img)) == 0;
+                if(!ok){
+                    fprintf(stderr, "loss %.2f window %u seed %u: phase %d error %s\n", loss, w, seed, p, tune_upload_status_name(tx.error));
+                    failures++;
+                }
+            }
+            printf("loss %4.0f%% window %2u: %u frames for %u chunks, %u resent, %u nacks\n", loss * 100, w, tx.framesSent, TUNE_UPLOAD_CHUNKS, tx.resends, rx.nacks);
+        }
+    }
+
+    // a valid CRC over an image that is not a valid tune
+    TuneImage bad = img;
+    bad.data.revLimit = 60000;
+    bad.crc = crc32(&bad, offsetof(TuneImage, crc));
+    if(loopbackRun(bad, 1, 0, 8, 0, UINT32_MAX, rx, tx, status) != TuneUploadSender::FAILED || tx.error != TUNE_ERR_IMAGE || rx.staged){
+        fprintf(stderr, "out of range image not rejected\n");
+        failures++;
+    }
+    // every field in range, but the motor limit sits above critical
+    bad = img;
+    bad.data.tempMotor[1] = bad.data.tempMotor[2] + 1;
+    bad.crc = crc32(&bad, offsetof(TuneImage, crc));
+    if(loopbackRun(bad, 1, 0, 8, 0, UINT32_MAX, rx, tx, status) != TuneUploadSender::FAILED || tx.error != TUNE_ERR_IMAGE || rx.staged){
+        fprintf(stderr, "inconsistent image not rejected\n");
+        failures++;
+    }
+    // the sender vanishes halfway through
+    loopbackRun(img, 1, 0, 8, 0, 10, rx, tx, status);
+    if(status != TUNE_ERR_TIMEOUT || rx.phase != TuneUploadReceiver::IDLE){
+        fprintf(stderr, "stalled upload not timed out\n");
+        failures++;
+    }
+
+    printf("LOOPBACK %s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char** argv){
+    std::string cmd = argc > 1 ? argv[1] : "";
+    if(cmd == "defaults" && argc == 2){
+        printTune(tune_defaults(), stdout);
+        return 0;
+    }
+    if(cmd == "build" && (argc == 4 || argc == 5)){
+        FILE* in = fopen(argv[2], "r");
+        if(!in){
+            perror(argv[2]);
+            return 1;
+        }
+        TuneData d = tune_defaults();
+        bool ok = parseTune(in, argv[2], d);
+        fclose(in);
+        if(!ok) return 1;
+        TuneImage img;
+        tune_image_seal(img, d, argc == 5 ? strtoul(argv[4], nullptr, 0) : 1);
+        FILE* out = fopen(argv[3], "wb");
+        if(!out || fwrite(&img, sizeof(img), 1, out) != 1){
+            perror(argv[3]);
+            return 1;
+        }
+        fclose(out);
+        fprintf(stderr, "%s: %zu bytes, generation %u, crc %08X\n", argv[3], sizeof(img), img.generation, img.crc);
+        return 0;
+    }
+    if(cmd == "dump" && argc == 3){
+        TuneImage img;
+        if(!readImage(argv[2], img)) return 1;
+        if(!tune_image_check(img)){
+            const TuneField* bad = nullptr;
+            fprintf(stderr, "%s: invalid image", argv[2]);
+            if(img.magic == TUNE_MAGIC && img.version == TUNE_VERSION && !tune_data_check(img.data, &bad) && bad) fprintf(stderr, " (%s out of range or inconsistent)", bad->name);
+            fprintf(stderr, "\n");
+            return 1;
+        }
+        printf("# generation %u, crc %08X\n", img.generation, img.crc);
+        printTune(img.data, stdout);
+        return 0;
+    }
+    if(cmd == "send" && argc >= 3 && argc <= 5){
+        TuneImage img;
+        if(!readImage(argv[2], img)) return 1;
+        if(!tune_image_check(img)){
+            fprintf(stderr, "%s: invalid image\n", argv[2]);
+            return 1;
+        }
+        return sendImage(img, argc >= 4 ? argv[3] : "can0", argc == 5 ? atoi(argv[4]) : TUNE_UPLOAD_WINDOW);
+    }
+    if(cmd == "--loopback" && argc == 2) return loopback();
+    fprintf(stderr, "usage: vdm_tune defaults | build TUNE.txt OUT.bin [GENERATION] | dump IMAGE.bin | send IMAGE.bin [IFACE] [WINDOW] | --loopback\n");
+    return 1;
+}